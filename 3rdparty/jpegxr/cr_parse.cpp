@@ -49,7 +49,6 @@
 # include "jxr_priv.h"
 # include <string.h>
 # include <stdlib.h>
-# include <assert.h>
 
 static int read_ifd(jxr_container_t container
 #ifdef JPEGXR_ADOBE_EXT
@@ -84,11 +83,13 @@ void jxr_destroy_container(jxr_container_t container)
 	container->table_cnt = 0;
 	jpegxr_free(container->table);
 	container->table = 0;
+	// allocated with jpegxr_calloc, so the output buffer is not released by a destructor
+	container->wb.~wbitstream();
 #endif //#ifdef JPEGXR_ADOBE_EXT
     jpegxr_free(container);
 }
 
-int jxr_read_image_container(jxr_container_t container
+static int read_image_container(jxr_container_t container
 #ifdef JPEGXR_ADOBE_EXT
 	, const uint8_t *data, int32_t len
 #else //#ifdef JPEGXR_ADOBE_EXT
@@ -162,6 +163,41 @@ int jxr_read_image_container(jxr_container_t container
     return 0;
 }
 
+int jxr_read_image_container(jxr_container_t container
+#ifdef JPEGXR_ADOBE_EXT
+	, const uint8_t *data, int32_t len
+#else //#ifdef JPEGXR_ADOBE_EXT
+	, FILE*fd
+#endif //#ifdef JPEGXR_ADOBE_EXT
+)
+{
+#ifdef JPEGXR_ADOBE_EXT
+    try {
+        int rc = read_image_container(container, data, len);
+        if (rc != 0)
+            return rc;
+        /* The accessors check the tags of the first image on every call, so
+           a container missing one of them is rejected here instead. */
+        if (container->image_count < 1)
+            return JXR_EC_BADFORMAT;
+        jxrc_image_pixelformat(container, 0);
+        jxrc_image_width(container, 0);
+        jxrc_image_height(container, 0);
+        jxrc_image_offset(container, 0);
+        jxrc_image_bytecount(container, 0);
+        jxrc_alpha_offset(container, 0);
+        jxrc_alpha_bytecount(container, 0);
+        jxrc_image_band_presence(container, 0);
+        jxrc_alpha_band_presence(container, 0);
+        return 0;
+    } catch (const jxr_error &) {
+        return JXR_EC_BADFORMAT;
+    }
+#else //#ifdef JPEGXR_ADOBE_EXT
+    return read_image_container(container, fd);
+#endif //#ifdef JPEGXR_ADOBE_EXT
+}
+
 int jxrc_image_count(jxr_container_t container)
 {
     return container->image_count;
@@ -656,6 +692,9 @@ jxrc_t_pixelFormat jxrc_image_pixelformat(jxr_container_t container, int imagenu
     assert(idx < ifd_cnt);
     assert(ifd[idx].tag == 0xbc01);
     assert(ifd[idx].cnt == 16);
+#ifdef JPEGXR_ADOBE_EXT
+    assert(ifd[idx].type == 1);
+#endif //#ifdef JPEGXR_ADOBE_EXT
     memcpy(guid, ifd[idx].value_.p_byte, 16);
     for(i=0; i< NUM_GUIDS; i++)
     {
@@ -1210,6 +1249,10 @@ static int read_ifd(jxr_container_t container
         if (ifd_type == 7)
             assert (ifd_tag == 0x8773 || ifd_tag == 0xea1c);
         uint32_t ifd_cnt = (buf[7]<<24) + (buf[6]<<16) + (buf[5]<<8) + buf[4];
+#ifdef JPEGXR_ADOBE_EXT
+        /* every value takes at least a byte of the container */
+        assert(ifd_cnt <= uint32_t(rb.len()));
+#endif //#ifdef JPEGXR_ADOBE_EXT
 
         assert(ifd_tag > ifd_tag_prev);
         ifd_tag_prev = ifd_tag;
@@ -48,7 +48,6 @@
 # include  "jxr_priv.h"
 # include  <stdlib.h>
 # include  <string.h>
-# include  <assert.h>
 
 int jxrc_start_file(jxr_container_t cp
 #ifndef JPEGXR_ADOBE_EXT
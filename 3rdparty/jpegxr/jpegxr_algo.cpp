@@ -59,7 +59,6 @@
 # include <stdio.h>
 # include <stdlib.h>
 # include <limits.h>
-# include <assert.h>
 
 static void InitVLCTable2(jxr_image_t image, int vlc_select);
 
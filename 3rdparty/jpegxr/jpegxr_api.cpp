@@ -46,9 +46,16 @@
 #endif
 
 # include "jxr_priv.h"
-# include <assert.h>
 # include <stdlib.h>
 
+#ifdef JPEGXR_ADOBE_EXT
+void _jxr_error(const char *expr, const char *file, int line)
+{
+    jxr_error error = { expr, file, line };
+    throw error;
+}
+#endif //#ifdef JPEGXR_ADOBE_EXT
+
 void _jxr_send_mb_to_output(jxr_image_t image, int mx, int my, int*data)
 {
     if (image->out_fun)
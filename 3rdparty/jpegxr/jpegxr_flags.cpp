@@ -46,7 +46,6 @@
 #endif
 
 # include "jxr_priv.h"
-# include <assert.h>
 
 unsigned jxr_get_IMAGE_WIDTH(jxr_image_t image)
 {
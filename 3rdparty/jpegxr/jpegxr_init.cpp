@@ -48,7 +48,6 @@
 
 # include "jxr_priv.h"
 # include <stdlib.h>
-# include <assert.h>
 
 const int _jxr_abslevel_index_delta[7] = { 1, 0, -1, -1, -1, -1, -1 };
 
@@ -358,6 +357,11 @@ void jxr_destroy(jxr_image_t image)
     
     for (; plane_idx > 0; plane_idx --) {
         jxr_image_t plane = (plane_idx == 1 ? image : image->alpha);
+#ifdef JPEGXR_ADOBE_EXT
+        /* a corrupt header can set the alpha flag before the plane exists */
+        if (plane == NULL)
+            continue;
+#endif //#ifdef JPEGXR_ADOBE_EXT
 
         for (idx = 0 ; idx < plane->num_channels ; idx += 1) {
             if (plane->strip[idx].up4) {
@@ -47,7 +47,6 @@
 #endif
 
 # include "jxr_priv.h"
-# include <assert.h>
 
 void _jxr_rbitstream_initialize(struct rbitstream*str
 #ifndef JPEGXR_ADOBE_EXT
@@ -113,6 +112,9 @@ static int get_byte(struct rbitstream*str)
     int tmp;
     assert(str->bits_avail == 0);
 #ifdef JPEGXR_ADOBE_EXT
+    /* the memory stream reads zeros past its end, a stream that runs
+       out before the image is complete is truncated */
+    assert(str->tell() < str->len());
     tmp = str->getc();
 #else //#ifdef JPEGXR_ADOBE_EXT
     tmp = fgetc(str->fd);
@@ -68,6 +68,27 @@ minimal typedefs that we need. */
 #include <memory.h>
 #include <stdlib.h>
 
+#include "../../atfmem.h"
+
+#include <assert.h>
+
+#ifdef JPEGXR_ADOBE_EXT
+/* Checks on the bitstream are asserts in the reference code, which abort the
+   process on corrupt input. Failed checks throw jxr_error instead, the reader
+   entry points catch it and return JXR_EC_BADFORMAT. The sources get assert
+   from here, so no file includes <assert.h> after this. */
+struct jxr_error {
+	const char *expr;
+	const char *file;
+	int line;
+};
+
+extern void _jxr_error(const char *expr, const char *file, int line);
+
+#undef assert
+#define assert(e) ((e) ? (void)0 : _jxr_error(#e, __FILE__, __LINE__))
+#endif //#ifdef JPEGXR_ADOBE_EXT
+
 #if 0 // def JPEGXR_ADOBE_EXT
 #include "../../core/mmfx-external.h"
 #endif //#ifdef JPEGXR_ADOBE_EXT
@@ -85,14 +106,15 @@ minimal typedefs that we need. */
 	
 #else //#ifdef JPEGXR_ADOBE_EXT
 
+// allocations are accounted as ATF_MEM_JXR, see atfmem.h
 #define jpegxr_calloc(count, size) \
-	((void*)calloc((count),(size)))
+	((void*)atf_mem_calloc(ATF_MEM_JXR,(count),(size)))
 
 #define jpegxr_malloc(size) \
-	((void*)malloc((size)))
+	((void*)atf_mem_alloc(ATF_MEM_JXR,(size)))
 
 #define jpegxr_free(ptr) \
-	free((uint8_t*)ptr)
+	atf_mem_free((void*)ptr)
 
 #endif //#ifdef JPEGXR_ADOBE_EXT
 
@@ -141,7 +163,9 @@ public:
 		
 		if ( m_pos >= m_len ) {
 			if ( m_dptr ) {
+				int32_t oldLen = m_len;
 				resize(m_len = (m_pos+1));
+				memset(m_dptr+oldLen,0,m_len-oldLen);
 			} else {
 				m_pos = (m_len-1);
 			}
@@ -214,10 +238,14 @@ private:
 
 	void resize(int32_t newSize) {
 		if ( newSize >= m_size ) {
-			uint8_t *nptr = (uint8_t *)jpegxr_malloc(m_size*2);
+			int32_t nsize = m_size*2;
+			while ( newSize >= nsize ) {
+				nsize *= 2;
+			}
+			uint8_t *nptr = (uint8_t *)jpegxr_malloc(nsize);
 			memcpy(nptr,m_dptr,m_size);
 			jpegxr_free(m_dptr);
-			m_size *= 2;
+			m_size = nsize;
 			m_dptr = nptr;
 		}
 	}
@@ -418,7 +446,14 @@ struct jxr_image{
 
     /* Per-tile quantization data (used during encode) */
     struct jxr_tile_qp*tile_quant;
+#ifdef JPEGXR_ADOBE_EXT
+    /* One entry per tile in raster order, like the reader indexes tile_quant
+       (r_parse.cpp, r_strip.cpp) and jxr_set_QP_DISTRIBUTED documents it.
+       The original row stride of tile_rows+1 read past the array. */
+# define GET_TILE_QUANT(image,tx,ty) ((image)->tile_quant + (ty)*((image)->tile_columns) + (tx))
+#else //#ifdef JPEGXR_ADOBE_EXT
 # define GET_TILE_QUANT(image,tx,ty) ((image)->tile_quant + (ty)*((image)->tile_rows+1) + (tx))
+#endif //#ifdef JPEGXR_ADOBE_EXT
 
     struct model_s model_dc, model_lp, model_hp;
 
@@ -48,7 +48,6 @@
 # include "jxr_priv.h"
 # include <stdlib.h>
 # include <memory.h>
-# include <assert.h>
 
 static int r_image_header(jxr_image_t image, struct rbitstream*str);
 static int r_image_plane_header(jxr_image_t image, struct rbitstream*str, int alpha);
@@ -94,7 +93,7 @@ static int get_num_ch_blk(struct rbitstream*str);
 
 
 
-int jxr_read_image_bitstream(jxr_image_t image
+static int read_image_bitstream(jxr_image_t image
 #ifdef JPEGXR_ADOBE_EXT
 	, const unsigned char *data, int len
 #else //#ifdef JPEGXR_ADOBE_EXT
@@ -117,6 +116,12 @@ int jxr_read_image_bitstream(jxr_image_t image
     /* Image header for the image overall */
     rc = r_image_header(image, &bits);
     if (rc < 0) return rc;
+#ifdef JPEGXR_ADOBE_EXT
+    /* the buffers are sized from the bitstream, it has to agree with the container */
+    if (image->container_width && image->container_height &&
+        (image->width1 + 1 != image->container_width || image->height1 + 1 != image->container_height))
+        return JXR_EC_BADFORMAT;
+#endif //#ifdef JPEGXR_ADOBE_EXT
 
     /* Image plane. */
     rc = r_image_plane_header(image, &bits, 0);
@@ -132,6 +137,16 @@ int jxr_read_image_bitstream(jxr_image_t image
 
         image->alpha = jxr_create_input();
         *image->alpha = *image;
+#ifdef JPEGXR_ADOBE_EXT
+        /* The copy shares the buffers of the image until _jxr_make_mbstore
+           allocates its own, jxr_destroy would free them twice if the alpha
+           plane header is bad. */
+        memset(image->alpha->strip, 0, sizeof(image->alpha->strip));
+        memset(image->alpha->mb_row_buffer, 0, sizeof(image->alpha->mb_row_buffer));
+        memset(image->alpha->mb_row_context, 0, sizeof(image->alpha->mb_row_context));
+        image->alpha->model_hp_buffer = 0;
+        image->alpha->hp_cbp_model_buffer = 0;
+#endif //#ifdef JPEGXR_ADOBE_EXT
 
         rc = r_image_plane_header(image->alpha, &bits, 1);
         if (rc < 0) return rc;
@@ -144,6 +159,9 @@ int jxr_read_image_bitstream(jxr_image_t image
     }
 
     rc = r_INDEX_TABLE(image, &bits);
+#ifdef JPEGXR_ADOBE_EXT
+    if (rc < 0) return rc;
+#endif //#ifdef JPEGXR_ADOBE_EXT
 
 #ifndef JPEGXR_ADOBE_EXT
     /* Store command line input values for later comparison */
@@ -196,6 +214,32 @@ int jxr_read_image_bitstream(jxr_image_t image
     return rc;
 }
 
+int jxr_read_image_bitstream(jxr_image_t image
+#ifdef JPEGXR_ADOBE_EXT
+	, const unsigned char *data, int len
+#else //#ifdef JPEGXR_ADOBE_EXT
+	, FILE*fd
+#endif //#ifdef JPEGXR_ADOBE_EXT
+)
+{
+#ifdef JPEGXR_ADOBE_EXT
+    try {
+        return read_image_bitstream(image, data, len);
+    } catch (const jxr_error &) {
+        /* r_TILE only releases the per tile quantizers when it returns */
+        jpegxr_free(image->tile_quant);
+        image->tile_quant = 0;
+        if (image->alpha) {
+            jpegxr_free(image->alpha->tile_quant);
+            image->alpha->tile_quant = 0;
+        }
+        return JXR_EC_BADFORMAT;
+    }
+#else //#ifdef JPEGXR_ADOBE_EXT
+    return read_image_bitstream(image, fd);
+#endif //#ifdef JPEGXR_ADOBE_EXT
+}
+
 int jxr_test_LONG_WORD_FLAG(jxr_image_t image, int flag)
 {
 #ifdef VERIFY_16BIT
@@ -375,6 +419,13 @@ static int r_image_header(jxr_image_t image, struct rbitstream*str)
 
     image->lwf_test = 0;
 
+#ifdef JPEGXR_ADOBE_EXT
+    /* no more tiles than macroblocks, the last column and row get what is left */
+    assert(image->tile_columns <= (image->extended_width >> 4));
+    assert(image->tile_rows <= (image->extended_height >> 4));
+    assert(wid_sum < (image->extended_width >> 4));
+    assert(hei_sum < (image->extended_height >> 4));
+#endif //#ifdef JPEGXR_ADOBE_EXT
     image->tile_column_width[image->tile_columns-1] = (image->extended_width >> 4)-wid_sum;
     image->tile_column_position[image->tile_columns-1] = wid_sum;
 
@@ -725,6 +776,9 @@ static int r_INDEX_TABLE(jxr_image_t image, struct rbitstream*str)
             num_index_table_entries = image->tile_rows * image->tile_columns;
 
         } else {
+#ifdef JPEGXR_ADOBE_EXT
+            assert(image->bands_present <= 4);
+#endif //#ifdef JPEGXR_ADOBE_EXT
             num_index_table_entries = image->tile_rows * image->tile_columns;
             switch (image->bands_present) {
                 case 4: /* ISOLATED */
@@ -777,6 +831,12 @@ static int r_TILE(jxr_image_t image, struct rbitstream*str)
 int rc = 0;
     image->tile_quant = (struct jxr_tile_qp *) jpegxr_calloc(image->tile_columns*image->tile_rows, sizeof(*(image->tile_quant)));
     assert(image->tile_quant);
+    /* The alpha plane is a copy of the image made before the tiles were
+    known, it needs its own per tile quantizers. */
+    if (ALPHACHANNEL_FLAG(image)) {
+        image->alpha->tile_quant = (struct jxr_tile_qp *) jpegxr_calloc(image->tile_columns*image->tile_rows, sizeof(*(image->tile_quant)));
+        assert(image->alpha->tile_quant);
+    }
 
     if (FREQUENCY_MODE_CODESTREAM_FLAG(image) == 0 /* SPATIALMODE */) {
 
@@ -794,6 +854,10 @@ int rc = 0;
         }
     } else { /* FREQUENCYMODE */
 
+#ifdef JPEGXR_ADOBE_EXT
+        /* the bands of the tiles are found through the index table */
+        assert(image->tile_index_table != 0);
+#endif //#ifdef JPEGXR_ADOBE_EXT
         int num_bands = 0;
         switch (image->bands_present) {
             case 0: /* ALL */
@@ -865,6 +929,11 @@ int rc = 0;
 
 RET:
     jpegxr_free(image->tile_quant);
+    if (ALPHACHANNEL_FLAG(image)) {
+        jpegxr_free(image->alpha->tile_quant);
+        image->alpha->tile_quant = 0;
+    }
+    image->tile_quant = 0;
     return rc;
 }
 
@@ -47,7 +47,6 @@
 
 # include "jxr_priv.h"
 # include <limits.h>
-# include <assert.h>
 # include <math.h>
 # include <memory.h>
 
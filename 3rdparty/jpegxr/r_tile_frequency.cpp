@@ -45,7 +45,6 @@
 #endif
 
 # include "jxr_priv.h"
-# include <assert.h>
 
 static void backup_dc_strip(jxr_image_t image, int tx, int ty, int my);
 static void backup_dclp_strip(jxr_image_t image, int tx, int ty, int my);
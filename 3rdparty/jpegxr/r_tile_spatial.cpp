@@ -46,7 +46,6 @@
 #endif
 
 # include "jxr_priv.h"
-# include <assert.h>
 
 
 
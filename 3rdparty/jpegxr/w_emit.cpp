@@ -47,7 +47,6 @@
 
 # include "jxr_priv.h"
 # include <stdlib.h>
-# include <assert.h>
 
 void initialize_index_table(jxr_image_t image);
 
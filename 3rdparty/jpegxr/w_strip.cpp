@@ -48,7 +48,6 @@
 # include "jxr_priv.h"
 # include <stdlib.h>
 # include <limits.h>
-# include <assert.h>
 
 # define FILTERED_YUV_SAMPLE 1
 
@@ -72,6 +71,20 @@ static void wflush_collect_mb_strip_data(jxr_image_t image, int my);
 static void _jxr_w_store_hpcbp_state(jxr_image_t image, int tx);
 static void _jxr_w_load_hpcbp_state(jxr_image_t image, int tx);
 
+#ifdef JPEGXR_ADOBE_EXT
+/* The PCT stages walk the whole strip with tx = 0, so the per tile
+   quantizers are looked up with the tile column of the macroblock and the
+   macroblock position within that tile. */
+static void w_tile_column(jxr_image_t image, int mx, unsigned*qx, unsigned*qmx)
+{
+    unsigned tx = 0;
+    while (tx+1 < image->tile_columns && (unsigned) mx >= image->tile_column_position[tx+1])
+        tx += 1;
+    *qx = tx;
+    *qmx = mx - image->tile_column_position[tx];
+}
+#endif //#ifdef JPEGXR_ADOBE_EXT
+
 static unsigned char w_guess_dc_quant(jxr_image_t image, int ch,
                                       unsigned tx, unsigned ty)
 {
@@ -1926,7 +1939,15 @@ static void PCT_stage2_up1(jxr_image_t image, int ch, int ty)
         }
 
         /* Quantize */
+#ifdef JPEGXR_ADOBE_EXT
+        unsigned qx, qmx;
+        w_tile_column(image, mx, &qx, &qmx);
+        dc_quant = _jxr_quant_map(image, w_guess_dc_quant(image, ch, qx, ty), ch==0? 1 : 0/* iShift for YONLY */);
+        assert(dc_quant > 0);
+        int lp_quant = w_guess_lp_quant(image, ch, qx, ty, qmx, use_my);
+#else //#ifdef JPEGXR_ADOBE_EXT
         int lp_quant = w_guess_lp_quant(image, ch, tx, ty, mx, use_my);
+#endif //#ifdef JPEGXR_ADOBE_EXT
         MACROBLK_UP1_LP_QUANT(image,ch,tx,mx) = lp_quant;
         lp_quant = _jxr_quant_map(image, lp_quant, ch==0? 1 : 0/* iShift for YONLY */);
         assert(lp_quant > 0);
@@ -2562,7 +2583,13 @@ static void PCT_stage1_up2(jxr_image_t image, int ch, int ty)
 
         dclphp_unshuffle(image->strip[ch].up2[mx].data, dclp_count);
 
+#ifdef JPEGXR_ADOBE_EXT
+        unsigned qx, qmx;
+        w_tile_column(image, mx, &qx, &qmx);
+        int hp_quant_raw = w_guess_hp_quant(image, ch, qx, ty, qmx, use_my);
+#else //#ifdef JPEGXR_ADOBE_EXT
         int hp_quant_raw = w_guess_hp_quant(image, ch, tx, ty, mx, use_my);
+#endif //#ifdef JPEGXR_ADOBE_EXT
         int hp_quant = _jxr_quant_map(image, hp_quant_raw, 1);
         assert(hp_quant > 0);
 
@@ -45,7 +45,6 @@
 #endif
 
 # include "jxr_priv.h"
-# include <assert.h>
 
 void _jxr_w_TILE_DC(jxr_image_t image, struct wbitstream*str,
                           unsigned tx, unsigned ty)
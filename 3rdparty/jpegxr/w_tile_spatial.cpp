@@ -47,7 +47,6 @@
 
 # include "jxr_priv.h"
 # include <stdlib.h>
-# include <assert.h>
 
 
 void _jxr_w_TILE_SPATIAL(jxr_image_t image, struct wbitstream*str,
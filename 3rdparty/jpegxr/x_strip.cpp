@@ -46,7 +46,6 @@
 #endif
 
 # include "jxr_priv.h"
-# include <assert.h>
 
 void _jxr_clear_strip_cur(jxr_image_t image)
 {
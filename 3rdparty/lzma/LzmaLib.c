@@ -7,9 +7,11 @@ Public domain */
 #include "LzmaDec.h"
 #include "Alloc.h"
 #include "LzmaLib.h"
+#include "../../atfmem.h"
 
-static void *SzAlloc(void *p, size_t size) { p = p; return MyAlloc(size); }
-static void SzFree(void *p, void *address) { p = p; MyFree(address); }
+/* allocations are accounted as ATF_MEM_LZMA, see atfmem.h */
+static void *SzAlloc(void *p, size_t size) { p = p; return size ? atf_mem_alloc(ATF_MEM_LZMA, size) : 0; }
+static void SzFree(void *p, void *address) { p = p; atf_mem_free(address); }
 static ISzAlloc g_Alloc = { SzAlloc, SzFree };
 
 MY_STDAPI LzmaCompress(unsigned char *dest, size_t  *destLen, const unsigned char *src, size_t  srcLen,
@@ -0,0 +1,213 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif //#ifdef _MSC_VER
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif //#ifndef _MSC_VER
+
+#include "atfgen.h"
+#include "atfthread.h"
+#include "libatf.h"
+
+using namespace std;
+
+void print_usage()
+{
+	cout << "\natfbench V0.4 Copyright 2010-2012 Adobe Systems Inc. All rights reserved.\n\n";
+	cout << "\nUsage: atfbench [-s <size>] [-c <size>] [-a] [-f <filter>] [-t <seconds>] [-q <0-100>] [-o <dir>]\n\n";
+	cout << "Converts a generated set of DDS textures in memory and reports MB/s (of DDS input) and textures/s per texture and per format. The textures are the same on every run and platform.\n\n";
+	cout << "   -s  Largest texture size, 2048 by default.\n";
+	cout << "   -c  Largest cube map size, 256 by default.\n";
+	cout << "   -a  All power of 2 sizes instead of every other one.\n";
+	cout << "   -f  Only textures whose name contains filter, e.g. -f bgra8_1024 or -f _cube_.\n";
+	cout << "   -t  Minimum time spent per texture, a texture is converted repeatedly until it is reached. 0.05 by default.\n";
+	cout << "   -q  JPEG-XR quantization, the dds2atf default if not given.\n";
+	cout << "   -o  Write the textures as <name>.dds files into dir instead of converting them.\n\n";
+}
+
+struct BenchTotal {
+	double			seconds;
+	double			bytes;
+	double			textures;
+	int32_t			failed;
+};
+
+static void print_rate(const BenchTotal &total)
+{
+	double seconds = max(total.seconds,1e-9);
+	cout << fixed << setprecision(2) << setw(10) << total.bytes / (1024.0 * 1024.0) / seconds << " MB/s";
+	cout << setw(12) << total.textures / seconds << " textures/s";
+	cout.unsetf(ios::floatfield);
+}
+
+int main(int argc, char *argv[]) {
+
+	int32_t maxSize = 2048;
+	int32_t maxCubeSize = 256;
+	int32_t step = 2;
+	double minSeconds = 0.05;
+	const char *filter = 0;
+	const char *outdir = 0;
+
+	atf_options options;
+	atf_options_init(&options);
+
+	for (int32_t c = 1; c < argc; c++) {
+		if (argv[c][0] != '-') {
+			continue;
+		}
+		if (argv[c][1] == 's' && c+1 < argc) {
+			std::istringstream s(argv[c+1]);
+			s >> maxSize;
+		} else if (argv[c][1] == 'c' && c+1 < argc) {
+			std::istringstream s(argv[c+1]);
+			s >> maxCubeSize;
+		} else if (argv[c][1] == 'a') {
+			step = 1;
+		} else if (argv[c][1] == 'f' && c+1 < argc) {
+			filter = argv[c+1];
+		} else if (argv[c][1] == 't' && c+1 < argc) {
+			std::istringstream s(argv[c+1]);
+			s >> minSeconds;
+		} else if (argv[c][1] == 'q' && c+1 < argc) {
+			std::istringstream s(argv[c+1]);
+			s >> options.quality;
+		} else if (argv[c][1] == 'o' && c+1 < argc) {
+			outdir = argv[c+1];
+		} else {
+			print_usage();
+			return -1;
+		}
+	}
+
+	if ( maxSize < 1 || maxSize > 2048 || ( maxSize & (maxSize - 1) ) ) {
+		cerr << "Texture size needs to be a power of 2 up to 2048.\n";
+		return -1;
+	}
+
+	vector<ATFGenSpec> specs;
+	atf_gen_corpus(maxSize,maxCubeSize,step,specs);
+
+	BenchTotal totals[ATF_GEN_FORMAT_COUNT] = { { 0 } };
+	BenchTotal total = { 0 };
+	int32_t count = 0;
+
+	for ( size_t c=0; c<specs.size(); c++) {
+		string name = atf_gen_name(specs[c]);
+		if ( filter && name.find(filter) == string::npos ) {
+			continue;
+		}
+		count++;
+
+		vector<uint8_t> dds;
+		atf_gen_dds(specs[c],dds);
+
+		if ( outdir ) {
+			string filename = string(outdir) + "/" + name + ".dds";
+			ofstream ofile(filename.c_str(),ios::out|ios::binary|ios::trunc);
+			if ( !ofile.is_open() || !ofile.write((const char *)&dds[0],dds.size()) ) {
+				cerr << "Could not write output file. '" << filename << "'\n\n";
+				return -1;
+			}
+			continue;
+		}
+
+		// converted until minSeconds have passed, at least once
+		atf_buffer atf = { 0, 0 };
+		int32_t runs = 0;
+		int result = ATF_OK;
+		double start = atf_wall_time();
+		double seconds = 0;
+		do {
+			atf_buffer_free(&atf);
+			result = atf_convert_dds(&dds[0],dds.size(),&options,&atf);
+			runs++;
+			seconds = atf_wall_time() - start;
+		} while ( result == ATF_OK && seconds < minSeconds );
+
+		BenchTotal &format = totals[specs[c].format];
+		cout << left << setw(32) << name << right;
+		if ( result != ATF_OK ) {
+			cout << " FAILED: " << atf_error_string(result) << "\n";
+			format.failed++;
+			total.failed++;
+			continue;
+		}
+
+		BenchTotal run = { seconds, double(dds.size()) * runs, double(runs), 0 };
+		cout << setw(10) << dds.size() << " -> " << setw(9) << atf.size << " bytes";
+		cout << fixed << setprecision(3) << setw(10) << seconds * 1000.0 / runs << " ms";
+		cout.unsetf(ios::floatfield);
+		print_rate(run);
+		cout << "\n";
+		cout.flush();
+		atf_buffer_free(&atf);
+
+		format.seconds += run.seconds / runs;
+		format.bytes += double(dds.size());
+		format.textures += 1;
+		total.seconds += run.seconds / runs;
+		total.bytes += double(dds.size());
+		total.textures += 1;
+	}
+
+	if ( count == 0 ) {
+		cerr << "No texture matches the filter.\n";
+		return -1;
+	}
+	if ( outdir ) {
+		cout << count << " textures written to '" << outdir << "'.\n";
+		return 0;
+	}
+
+	// every texture counts once, however often it was converted
+	static const char *names[ATF_GEN_FORMAT_COUNT] = { "DXT1", "DXT5", "BGRA8", "BGRX8", "BGR8", "L8" };
+	cout << "\n";
+	for ( int32_t f=0; f<ATF_GEN_FORMAT_COUNT; f++) {
+		if ( totals[f].textures == 0 && totals[f].failed == 0 ) {
+			continue;
+		}
+		cout << left << setw(8) << names[f] << right << setw(6) << int32_t(totals[f].textures) << " textures";
+		print_rate(totals[f]);
+		if ( totals[f].failed ) {
+			cout << ", " << totals[f].failed << " failed";
+		}
+		cout << "\n";
+	}
+	cout << left << setw(8) << "Total" << right << setw(6) << int32_t(total.textures) << " textures";
+	print_rate(total);
+	if ( total.failed ) {
+		cout << ", " << total.failed << " failed";
+	}
+	cout << "\n";
+	return total.failed ? -1 : 0;
+}
@@ -0,0 +1,349 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#endif //#ifdef _MSC_VER
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif //#ifndef _MSC_VER
+
+#include "atfcache.h"
+#include "atfthread.h"
+
+using namespace std;
+
+static string cacheDir;
+static ATFCacheStats cacheStats = { 0, 0, 0, 0 };
+static uint32_t cacheTempCount = 0;
+static atf_mutex cacheMutex;
+
+//
+// MurmurHash3 x64 128 (public domain, Austin Appleby), seeded with the
+// previous hash so several buffers can be chained into one key.
+//
+
+static inline uint64_t rotl64(uint64_t x, int8_t r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k) {
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+static inline uint64_t get_uint64_little(const uint8_t *p) {
+	return (uint64_t(p[0])    )|(uint64_t(p[1])<< 8)|(uint64_t(p[2])<<16)|(uint64_t(p[3])<<24)|
+		   (uint64_t(p[4])<<32)|(uint64_t(p[5])<<40)|(uint64_t(p[6])<<48)|(uint64_t(p[7])<<56);
+}
+
+static void murmur3_128(const uint8_t *data, size_t len, uint64_t hash[2])
+{
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+	uint64_t h1 = hash[0];
+	uint64_t h2 = hash[1];
+
+	size_t nblocks = len / 16;
+	for ( size_t i=0; i<nblocks; i++) {
+		uint64_t k1 = get_uint64_little(data + i*16 + 0);
+		uint64_t k2 = get_uint64_little(data + i*16 + 8);
+
+		k1 *= c1; k1 = rotl64(k1,31); k1 *= c2; h1 ^= k1;
+		h1 = rotl64(h1,27); h1 += h2; h1 = h1*5+0x52dce729;
+		k2 *= c2; k2 = rotl64(k2,33); k2 *= c1; h2 ^= k2;
+		h2 = rotl64(h2,31); h2 += h1; h2 = h2*5+0x38495ab5;
+	}
+
+	const uint8_t *tail = data + nblocks*16;
+	uint64_t k1 = 0;
+	uint64_t k2 = 0;
+	switch ( len & 15 ) {
+		case 15: k2 ^= uint64_t(tail[14]) << 48;
+		case 14: k2 ^= uint64_t(tail[13]) << 40;
+		case 13: k2 ^= uint64_t(tail[12]) << 32;
+		case 12: k2 ^= uint64_t(tail[11]) << 24;
+		case 11: k2 ^= uint64_t(tail[10]) << 16;
+		case 10: k2 ^= uint64_t(tail[ 9]) << 8;
+		case  9: k2 ^= uint64_t(tail[ 8]);
+				 k2 *= c2; k2 = rotl64(k2,33); k2 *= c1; h2 ^= k2;
+		case  8: k1 ^= uint64_t(tail[ 7]) << 56;
+		case  7: k1 ^= uint64_t(tail[ 6]) << 48;
+		case  6: k1 ^= uint64_t(tail[ 5]) << 40;
+		case  5: k1 ^= uint64_t(tail[ 4]) << 32;
+		case  4: k1 ^= uint64_t(tail[ 3]) << 24;
+		case  3: k1 ^= uint64_t(tail[ 2]) << 16;
+		case  2: k1 ^= uint64_t(tail[ 1]) << 8;
+		case  1: k1 ^= uint64_t(tail[ 0]);
+				 k1 *= c1; k1 = rotl64(k1,31); k1 *= c2; h1 ^= k1;
+	}
+
+	h1 ^= uint64_t(len);
+	h2 ^= uint64_t(len);
+	h1 += h2;
+	h2 += h1;
+	h1 = fmix64(h1);
+	h2 = fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+
+	hash[0] = h1;
+	hash[1] = h2;
+}
+
+static void put_uint32(uint32_t v, uint8_t *p) {
+	p[0] = uint8_t((v>>24)&0xFF);
+	p[1] = uint8_t((v>>16)&0xFF);
+	p[2] = uint8_t((v>> 8)&0xFF);
+	p[3] = uint8_t((v>> 0)&0xFF);
+}
+
+static void put_uint64(uint64_t v, uint8_t *p) {
+	put_uint32(uint32_t(v>>32),p);
+	put_uint32(uint32_t(v&0xFFFFFFFF),p+4);
+}
+
+static uint32_t get_uint32(const uint8_t *p) {
+	return (uint32_t(p[0])<<24)|
+		   (uint32_t(p[1])<<16)|
+		   (uint32_t(p[2])<< 8)|
+		   (uint32_t(p[3])<< 0);
+}
+
+enum {
+	ATF_CACHE_HEADER_SIZE = 4 + 1 + 1 + 1 + 5*4 + 16 + 4
+};
+
+static void write_entry_header(const ATFCacheKey &key, uint32_t len, uint8_t *header)
+{
+	header[0] = 'A';
+	header[1] = 'T';
+	header[2] = 'F';
+	header[3] = 'C';
+	header[4] = 1;
+	header[5] = key.kind;
+	header[6] = key.flags;
+	put_uint32(uint32_t(key.width),header+7);
+	put_uint32(uint32_t(key.height),header+11);
+	put_uint32(uint32_t(key.quality),header+15);
+	put_uint32(uint32_t(key.trimFlexBits),header+19);
+	put_uint32(uint32_t(key.jxrFormat),header+23);
+	put_uint64(key.hash[0],header+27);
+	put_uint64(key.hash[1],header+35);
+	put_uint32(len,header+43);
+}
+
+static string hex_name(const ATFCacheKey &key)
+{
+	static const char hex[] = "0123456789abcdef";
+	string name;
+	for ( int32_t c=0; c<2; c++) {
+		for ( int32_t s=60; s>=0; s-=4) {
+			name += hex[(key.hash[c]>>s)&0xF];
+		}
+	}
+	return name;
+}
+
+static bool make_dir(const string &dir)
+{
+#ifdef _MSC_VER
+	return _mkdir(dir.c_str()) == 0 || errno == EEXIST;
+#else
+	return mkdir(dir.c_str(),0777) == 0 || errno == EEXIST;
+#endif //#ifdef _MSC_VER
+}
+
+static string entry_dir(const ATFCacheKey &key)
+{
+	return cacheDir + "/" + hex_name(key).substr(0,2);
+}
+
+bool atf_cache_open(const char *dir)
+{
+	cacheDir = dir;
+	while ( cacheDir.size() > 1 && ( cacheDir[cacheDir.size()-1] == '/' || cacheDir[cacheDir.size()-1] == '\\' ) ) {
+		cacheDir.erase(cacheDir.size()-1);
+	}
+	if ( cacheDir.empty() || !make_dir(cacheDir) ) {
+		cerr << "Could not create cache directory. '" << dir << "'\n\n";
+		cacheDir.clear();
+		return false;
+	}
+	return true;
+}
+
+bool atf_cache_enabled()
+{
+	return !cacheDir.empty();
+}
+
+void atf_cache_key(ATFCacheKey &key, int32_t kind, int32_t w, int32_t h, bool flipped, bool alpha, int32_t quality, int32_t trimFlexBits, int32_t jxrFormat)
+{
+	key.kind = uint8_t(kind);
+	key.flags = ( flipped ? 1 : 0 ) | ( alpha ? 2 : 0 );
+	key.width = w;
+	key.height = h;
+	key.quality = quality;
+	key.trimFlexBits = trimFlexBits;
+	key.jxrFormat = jxrFormat;
+	key.hash[0] = 0;
+	key.hash[1] = 0;
+
+	uint8_t header[ATF_CACHE_HEADER_SIZE];
+	write_entry_header(key,0,header);
+	murmur3_128(header,ATF_CACHE_HEADER_SIZE,key.hash);
+}
+
+void atf_cache_hash(ATFCacheKey &key, const void *data, size_t len)
+{
+	murmur3_128((const uint8_t *)data,len,key.hash);
+}
+
+bool atf_cache_lookup(const ATFCacheKey &key, vector<uint8_t> &entry)
+{
+	if ( !atf_cache_enabled() ) {
+		return false;
+	}
+
+	string name = entry_dir(key) + "/" + hex_name(key) + ".atfc";
+	ifstream ifile(name.c_str(),ios::in|ios::binary);
+
+	uint8_t expected[ATF_CACHE_HEADER_SIZE];
+	uint8_t header[ATF_CACHE_HEADER_SIZE];
+	bool hit = false;
+	if ( ifile.is_open() && ifile.read((char *)header,ATF_CACHE_HEADER_SIZE) ) {
+		uint32_t len = get_uint32(header+43);
+		write_entry_header(key,len,expected);
+		if ( memcmp(header,expected,ATF_CACHE_HEADER_SIZE) == 0 ) {
+			entry.resize(len);
+			hit = len == 0 || ifile.read((char *)&entry[0],len);
+			// a complete entry ends exactly here
+			hit = hit && ifile.peek() == EOF;
+		}
+	}
+
+	cacheMutex.lock();
+	if ( hit ) {
+		cacheStats.hits++;
+		cacheStats.hitBytes += entry.size();
+	} else {
+		cacheStats.misses++;
+	}
+	cacheMutex.unlock();
+
+	if ( !hit ) {
+		entry.clear();
+	}
+	return hit;
+}
+
+void atf_cache_append(vector<uint8_t> &entry, const uint8_t *data, size_t len)
+{
+	if ( !atf_cache_enabled() ) {
+		return;
+	}
+	entry.push_back(uint8_t((len>>16)&0xFF));
+	entry.push_back(uint8_t((len>> 8)&0xFF));
+	entry.push_back(uint8_t((len>> 0)&0xFF));
+	entry.insert(entry.end(),data,data+len);
+}
+
+void atf_cache_store(const ATFCacheKey &key, const vector<uint8_t> &entry)
+{
+	if ( !atf_cache_enabled() ) {
+		return;
+	}
+
+	string dir = entry_dir(key);
+	if ( !make_dir(dir) ) {
+		return;
+	}
+
+	cacheMutex.lock();
+	uint32_t count = cacheTempCount++;
+	cacheMutex.unlock();
+
+#ifdef _MSC_VER
+	int32_t pid = _getpid();
+#else
+	int32_t pid = getpid();
+#endif //#ifdef _MSC_VER
+
+	string name = dir + "/" + hex_name(key) + ".atfc";
+	std::ostringstream tmpname;
+	tmpname << name << "." << pid << "." << count << ".tmp";
+
+	uint8_t header[ATF_CACHE_HEADER_SIZE];
+	write_entry_header(key,uint32_t(entry.size()),header);
+
+	ofstream ofile(tmpname.str().c_str(),ios::out|ios::binary);
+	if ( !ofile.is_open() ) {
+		return;
+	}
+	ofile.write((const char *)header,ATF_CACHE_HEADER_SIZE);
+	if ( entry.size() ) {
+		ofile.write((const char *)&entry[0],entry.size());
+	}
+	ofile.close();
+
+	// Publish atomically. If another process got there first its entry is
+	// identical, so losing the race is fine.
+	if ( ofile.fail() || rename(tmpname.str().c_str(),name.c_str()) != 0 ) {
+		remove(tmpname.str().c_str());
+		return;
+	}
+
+	cacheMutex.lock();
+	cacheStats.stores++;
+	cacheMutex.unlock();
+}
+
+void atf_cache_get_stats(ATFCacheStats &stats)
+{
+	cacheMutex.lock();
+	stats = cacheStats;
+	cacheMutex.unlock();
+}
+
+void atf_hash(const void *data, size_t len, uint64_t hash[2])
+{
+	murmur3_128((const uint8_t *)data,len,hash);
+}
@@ -0,0 +1,94 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _ATFCACHE_H_
+#define _ATFCACHE_H_
+
+#include <vector>
+
+//
+// Content addressed cache for encoded texture levels. An entry is keyed by a
+// hash of the level's input data plus every setting which changes the encoded
+// bytes, and holds the level's sub-streams exactly as written to the ATF file
+// (U24 len + data each). The cache lives in a directory which can be shared by
+// concurrent processes: entries are written to a temporary file and renamed
+// into place, so readers only ever see complete entries.
+//
+// Entry file (<dir>/<hash[0..1]>/<hash>.atfc):
+//
+// U8[4]   -  signature  - 'ATFC'
+// U8      -  version    - 1
+// U8      -  kind       - ATF_CACHE_*
+// U8      -  flags      - bit 0 = flipped, bit 1 = alpha
+// U32     -  width
+// U32     -  height
+// U32     -  quality    - effective JXR quality
+// U32     -  trim       - effective JXR trim flex bits
+// U32     -  jxrformat  - JXR internal color format
+// U8[16]  -  hash       - hash of settings and input data
+// U32     -  len        - length in bytes of the entry data
+// U8[len] -  data       - sub-streams of the level
+//
+
+enum {
+	ATF_CACHE_RAW_888,
+	ATF_CACHE_RAW_8888,
+	ATF_CACHE_DXT1,
+	ATF_CACHE_ETC1
+};
+
+struct ATFCacheKey {
+	uint8_t		kind;
+	uint8_t		flags;
+	int32_t		width;
+	int32_t		height;
+	int32_t		quality;
+	int32_t		trimFlexBits;
+	int32_t		jxrFormat;
+	uint64_t	hash[2];
+};
+
+struct ATFCacheStats {
+	size_t		hits;
+	size_t		misses;
+	size_t		stores;
+	size_t		hitBytes;		// encoded bytes served from the cache
+};
+
+// Enables the cache for the whole process, the directory is created if needed.
+bool atf_cache_open(const char *dir);
+bool atf_cache_enabled();
+
+// Build a key: start with the settings, then feed all input data of the level.
+// Keys are also computed with the cache disabled, -r matches levels by them.
+void atf_cache_key(ATFCacheKey &key, int32_t kind, int32_t w, int32_t h, bool flipped, bool alpha, int32_t quality, int32_t trimFlexBits, int32_t jxrFormat);
+void atf_cache_hash(ATFCacheKey &key, const void *data, size_t len);
+
+bool atf_cache_lookup(const ATFCacheKey &key, std::vector<uint8_t> &entry);
+void atf_cache_append(std::vector<uint8_t> &entry, const uint8_t *data, size_t len);
+void atf_cache_store(const ATFCacheKey &key, const std::vector<uint8_t> &entry);
+
+void atf_cache_get_stats(ATFCacheStats &stats);
+
+// Hashes arbitrary data with the cache's hash function, chained from hash.
+void atf_hash(const void *data, size_t len, uint64_t hash[2]);
+
+#endif //#ifndef _ATFCACHE_H_
@@ -0,0 +1,243 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif //#ifndef _MSC_VER
+
+using namespace std;
+
+//
+// Client for the dds2atf daemon (dds2atf -u <socket>). Sends one job, all jobs
+// of a manifest or a STATS request and prints one answer line per request.
+// Paths are made absolute here since the daemon runs in its own directory.
+//
+
+void print_usage()
+{
+	cout << "\natfclient V0.4 Copyright 2010-2012 Adobe Systems Inc. All rights reserved.\n\n";
+	cout << "\nUsage: atfclient -u <socket> [-s] [-t] [-b manifest.txt] [input.dds output.atf [options]]\n\n";
+	cout << "   -u  UNIX domain socket of a running 'dds2atf -u <socket>' daemon.\n";
+	cout << "   -b  Send all jobs of a manifest file, see dds2atf -b.\n";
+	cout << "   -t  Ask the daemon for its statistics.\n";
+	cout << "   -s  Only print failed jobs.\n\n";
+	cout << "A single job is given as input.dds output.atf followed by the per job dds2atf options -n, -q, -f, -r, -4, -2 and -0.\n\n";
+}
+
+#ifndef _MSC_VER
+
+static string absolute_path(const string &path)
+{
+	if ( path.empty() || path[0] == '/' ) {
+		return path;
+	}
+	char cwd[4096];
+	if ( !getcwd(cwd,sizeof(cwd)) ) {
+		return path;
+	}
+	return string(cwd) + "/" + path;
+}
+
+// Turns a manifest style job into a request line with absolute paths.
+static bool job_request(const vector<string> &tokens, string &request)
+{
+	if ( tokens.size() < 2 ) {
+		return false;
+	}
+	request.clear();
+	for ( size_t c=0; c<tokens.size(); c++) {
+		bool path = c < 2 || ( c > 0 && tokens[c-1] == "-r" );
+		request += ( c ? " " : "" ) + ( path ? absolute_path(tokens[c]) : tokens[c] );
+	}
+	request += "\n";
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+
+	const char *socketPath = 0;
+	const char *manifest = 0;
+	bool stats = false;
+	bool silent = false;
+	vector<string> job;
+
+	int32_t c = 1;
+	for ( ; c < argc && argv[c][0] == '-'; c++) {
+		if (argv[c][1] == 'u' && c+1 < argc) {
+			socketPath = argv[++c];
+		} else if (argv[c][1] == 'b' && c+1 < argc) {
+			manifest = argv[++c];
+		} else if (argv[c][1] == 't') {
+			stats = true;
+		} else if (argv[c][1] == 's') {
+			silent = true;
+		} else {
+			goto printusage;
+		}
+	}
+	for ( ; c < argc; c++) {
+		job.push_back(argv[c]);
+	}
+
+	{
+		if ( !socketPath ) {
+			cerr << "No socket provided.\n";
+			goto printusage;
+		}
+
+		string requests;
+		if ( job.size() ) {
+			string request;
+			if ( !job_request(job,request) ) {
+				cerr << "Expected 'input.dds output.atf [options]'.\n";
+				goto printusage;
+			}
+			requests += request;
+		}
+
+		if ( manifest ) {
+			ifstream mfile(manifest,ios::in);
+			if ( !mfile.is_open() ) {
+				cerr << "Could not open manifest file. '";
+				cerr << manifest;
+				cerr << "'\n\n";
+				return -1;
+			}
+			string line;
+			for ( int32_t n=1; getline(mfile,line); n++) {
+				vector<string> tokens;
+				std::istringstream s(line);
+				string token;
+				while ( s >> token && token[0] != '#' ) {
+					tokens.push_back(token);
+				}
+				if ( tokens.size() == 0 ) {
+					continue;
+				}
+				string request;
+				if ( !job_request(tokens,request) ) {
+					cerr << manifest << ":" << n << ": Expected '<input.dds> <output.atf> [options]'.\n";
+					return -1;
+				}
+				requests += request;
+			}
+		}
+
+		if ( stats ) {
+			requests += "STATS\n";
+		}
+
+		if ( requests.empty() ) {
+			cerr << "Nothing to do.\n";
+			goto printusage;
+		}
+
+		struct sockaddr_un addr;
+		memset(&addr,0,sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if ( strlen(socketPath) >= sizeof(addr.sun_path) ) {
+			cerr << "Socket path too long. '" << socketPath << "'\n\n";
+			return -1;
+		}
+		strcpy(addr.sun_path,socketPath);
+
+		int fd = socket(AF_UNIX,SOCK_STREAM,0);
+		if ( fd < 0 || connect(fd,(struct sockaddr *)&addr,sizeof(addr)) != 0 ) {
+			cerr << "Could not connect to daemon. '" << socketPath << "'\n\n";
+			return -1;
+		}
+
+		for ( size_t pos=0; pos<requests.size(); ) {
+			ssize_t len = write(fd,requests.data()+pos,requests.size()-pos);
+			if ( len < 0 && errno == EINTR ) {
+				continue;
+			}
+			if ( len <= 0 ) {
+				cerr << "Could not send request to daemon.\n\n";
+				close(fd);
+				return -1;
+			}
+			pos += len;
+		}
+		shutdown(fd,SHUT_WR);
+
+		string responses;
+		char buffer[4096];
+		for (;;) {
+			ssize_t len = read(fd,buffer,sizeof(buffer));
+			if ( len < 0 && errno == EINTR ) {
+				continue;
+			}
+			if ( len <= 0 ) {
+				break;
+			}
+			responses.append(buffer,len);
+		}
+		close(fd);
+
+		bool ok = true;
+		size_t answers = 0;
+		std::istringstream lines(responses);
+		string line;
+		while ( getline(lines,line) ) {
+			answers++;
+			if ( line.compare(0,3,"OK ") == 0 || line.compare(0,6,"STATS ") == 0 ) {
+				if ( !silent || line.compare(0,6,"STATS ") == 0 ) {
+					cout << line << "\n";
+				}
+			} else {
+				cerr << line << "\n";
+				ok = false;
+			}
+		}
+
+		size_t expected = std::count(requests.begin(),requests.end(),'\n');
+		if ( answers != expected ) {
+			cerr << "Daemon answered " << answers << " of " << expected << " requests.\n";
+			ok = false;
+		}
+		return ok ? 0 : -1;
+	}
+printusage:
+	print_usage();
+	return -1;
+}
+
+#else
+
+int main(int argc, char *argv[]) {
+	cerr << "atfclient is not supported on this platform.\n";
+	return -1;
+}
+
+#endif //#ifndef _MSC_VER
@@ -0,0 +1,274 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif //#ifdef _MSC_VER
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif //#ifndef _MSC_VER
+
+#include "3rdparty/jpegxr/jpegxr.h"
+#include "atf.h"
+#include "atfdds.h"
+#include "atfmips.h"
+
+using namespace std;
+
+static bool set_dxt1_header(uint8_t *dst, int width, int height, int count, bool cubemap, size_t textureLen)
+{
+	PVR_HEADER *header = (PVR_HEADER *)dst;
+	
+	header->dwHeaderSize = sizeof(PVR_HEADER);
+	header->dwWidth      = width;
+	header->dwHeight     = height;
+	header->dwMipMapCount= count;
+	header->dwTextureDataSize = textureLen;
+	header->dwpfFlags	 = header->dwMipMapCount ? PVRTEX_MIPMAP : 0;
+	header->dwPVR[0]	 = 'P';
+	header->dwPVR[1]	 = 'V';
+	header->dwPVR[2]	 = 'R';
+	header->dwPVR[3]	 = '!';
+	header->dwNumSurfs	 = 1;
+	
+	header->dwRBitMask = 0xFFFFFFFF;
+	header->dwGBitMask = 0xFFFFFFFF;
+	header->dwBBitMask = 0xFFFFFFFF;
+	header->dwpfFlags |= PVR_D3D_DXT1;
+	if ( cubemap ) {
+		header->dwpfFlags |= PVRTEX_CUBEMAP | PVRTEX_DDSCUBEMAPORDER;
+	}
+	return true;
+}
+
+static bool set_dxt5_header(uint8_t *dst, int width, int height, int count, bool cubemap, size_t textureLen)
+{
+	PVR_HEADER *header = (PVR_HEADER *)dst;
+	
+	header->dwHeaderSize = sizeof(PVR_HEADER);
+	header->dwWidth      = width;
+	header->dwHeight     = height;
+	header->dwMipMapCount= count;
+	header->dwTextureDataSize = textureLen;
+	header->dwpfFlags	 = header->dwMipMapCount ? PVRTEX_MIPMAP : 0;
+	header->dwPVR[0]	 = 'P';
+	header->dwPVR[1]	 = 'V';
+	header->dwPVR[2]	 = 'R';
+	header->dwPVR[3]	 = '!';
+	header->dwNumSurfs	 = 1;
+	
+	header->dwRBitMask = 0xFFFFFFFF;
+	header->dwGBitMask = 0xFFFFFFFF;
+	header->dwBBitMask = 0xFFFFFFFF;
+	header->dwpfFlags |= PVR_D3D_DXT5;
+	if ( cubemap ) {
+		header->dwpfFlags |= PVRTEX_CUBEMAP | PVRTEX_DDSCUBEMAPORDER;
+	}
+	return true;
+}
+
+static bool set_bgr_header(uint8_t *dst, int width, int height, int count, bool cubemap, size_t textureLen)
+{
+	PVR_HEADER *header = (PVR_HEADER *)dst;
+	
+	header->dwHeaderSize = sizeof(PVR_HEADER);
+	header->dwWidth      = width;
+	header->dwHeight     = height;
+	header->dwMipMapCount= count;
+	header->dwTextureDataSize = textureLen;
+	header->dwpfFlags	 = header->dwMipMapCount ? PVRTEX_MIPMAP : 0;
+	header->dwPVR[0]	 = 'P';
+	header->dwPVR[1]	 = 'V';
+	header->dwPVR[2]	 = 'R';
+	header->dwPVR[3]	 = '!';
+	header->dwNumSurfs	 = 1;
+	
+    header->dwRBitMask = 0xFF;
+    header->dwGBitMask = 0xFF;
+    header->dwBBitMask = 0xFF;
+    header->dwBitCount = 24;
+    header->dwpfFlags |= PVR_OGL_RGB_888;
+	if ( cubemap ) {
+		header->dwpfFlags |= PVRTEX_CUBEMAP | PVRTEX_DDSCUBEMAPORDER;
+	}
+	return true;
+}
+
+static bool set_bgra_header(uint8_t *dst, int width, int height, int count, bool cubemap, size_t textureLen)
+{
+	PVR_HEADER *header = (PVR_HEADER *)dst;
+	
+	header->dwHeaderSize = sizeof(PVR_HEADER);
+	header->dwWidth      = width;
+	header->dwHeight     = height;
+	header->dwMipMapCount= count;
+	header->dwTextureDataSize = textureLen;
+	header->dwpfFlags	 = header->dwMipMapCount ? PVRTEX_MIPMAP : 0;
+	header->dwPVR[0]	 = 'P';
+	header->dwPVR[1]	 = 'V';
+	header->dwPVR[2]	 = 'R';
+	header->dwPVR[3]	 = '!';
+	header->dwNumSurfs	 = 1;
+	
+	header->dwRBitMask = 0xFF;
+	header->dwGBitMask = 0xFF;
+	header->dwBBitMask = 0xFF;
+	header->dwAlphaBitMask = 0xFF;
+	header->dwBitCount = 32;
+	header->dwpfFlags |= PVR_OGL_RGBA_8888;
+	if ( cubemap ) {
+		header->dwpfFlags |= PVRTEX_CUBEMAP | PVRTEX_DDSCUBEMAPORDER;
+	}
+	return true;
+}
+
+// Chain format of the DDS input data, -1 if it is not supported.
+static int32_t dds_mip_format(const DDS_header *dds)
+{
+	if ( PF_IS_DXT1((*dds)) ) {
+		return ATF_MIP_DXT1;
+	} else if ( PF_IS_DXT5((*dds)) ) {
+		return ATF_MIP_DXT5;
+	} else if ( PF_IS_BGRA8((*dds)) || PF_IS_BGRX8((*dds)) ) {
+		return ATF_MIP_RGBA8;
+	} else if ( PF_IS_BGR8((*dds)) ) {
+		return ATF_MIP_RGB8;
+	} else if ( PF_IS_SINGLECHANNEL((*dds)) ) {
+		return ATF_MIP_L8;
+	}
+	return -1;
+}
+
+bool atf_dds_to_pvr(const uint8_t *src, size_t len, ostream &tfile, bool &dxt5, bool &uncompressed)
+{
+	if ( len < sizeof(DDS_header) ) {
+		cerr << "Input file not a DDS file.\n";
+		return false;
+	}
+
+	const DDS_header *dds = (const DDS_header *)src;
+	if ( dds->dwMagic != DDS_MAGIC ) {
+		cerr << "Input file not a DDS file.\n";
+		return false;
+	}
+
+	// Levels past the end of the file are dropped, same as levels past 1x1.
+	int32_t format = dds_mip_format(dds);
+	ATFMipChain chain;
+	atf_mip_chain(format,dds->dwWidth,dds->dwHeight,dds->dwMipMapCount+1,(dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?6:1,chain);
+	if ( format >= 0 && !atf_mip_truncate(chain,len-sizeof(DDS_header)) ) {
+		cerr << "DDS file is short!\n";
+		return false;
+	}
+	// BGRX and single channel input is written as RGB, the face stride of the
+	// PVR data is the one of the RGB chain.
+	ATFMipChain output;
+	atf_mip_chain(( format == ATF_MIP_L8 || PF_IS_BGRX8((*dds)) ) ? ATF_MIP_RGB8 : format,dds->dwWidth,dds->dwHeight,chain.count,chain.faces,output);
+	int32_t actualMipLevels = chain.count-1;
+	int32_t actualTextureSize = output.faceLength;
+	int32_t actualFileSize = chain.length();
+	int32_t strayBytes = (len-sizeof(DDS_header)) - actualFileSize;
+
+	PVR_HEADER pvr;
+	if ( PF_IS_DXT1((*dds)) ) {
+		set_dxt1_header((uint8_t*)&pvr,dds->dwWidth,dds->dwHeight,actualMipLevels,(dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?true:false,actualTextureSize);
+		uncompressed = false;
+	} else if ( PF_IS_DXT5((*dds)) ) {
+		set_dxt5_header((uint8_t*)&pvr,dds->dwWidth,dds->dwHeight,actualMipLevels,(dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?true:false,actualTextureSize);
+		uncompressed = false;
+	} else if ( PF_IS_BGRA8((*dds)) ) {
+		set_bgra_header((uint8_t*)&pvr,dds->dwWidth,dds->dwHeight,actualMipLevels,(dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?true:false,actualTextureSize);
+		uncompressed = true;
+	} else if ( PF_IS_BGR8((*dds)) || PF_IS_SINGLECHANNEL((*dds)) || PF_IS_BGRX8((*dds))) {
+		set_bgr_header((uint8_t*)&pvr,dds->dwWidth,dds->dwHeight,actualMipLevels,(dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?true:false,actualTextureSize);
+		uncompressed = true;
+	} else {
+		if ( PF_IS_ATI1((*dds)) || PF_IS_BC4U((*dds)) || PF_IS_BC4S((*dds)) ) {
+			cerr << "Unsupported DDS file format: Detected ATI1/BC4 encoded data. (Has to be of type DXT1/BC1, DXT5/BC3, BGRA8 or BGR8).\n";
+		} else if ( PF_IS_ATI2((*dds)) || PF_IS_BC5U((*dds)) || PF_IS_BC5S((*dds)) ) {
+			cerr << "Unsupported DDS file format: Detected ATI2/BC5 encoded data. (Has to be of type DXT1/BC1, DXT5/BC3, BGRA8 or BGR8).\n";
+		} else {
+			cerr << "Unsupported DDS file format. (Has to be of type DXT1/BC1, DXT5/BC3, BGRA8 or BGR8).\n";
+		}
+		return false;
+	}
+
+	if ( strayBytes > 0 ) {
+		cerr << "Warning: Stray data in input file.\n";
+	}
+
+	tfile.write((char *)&pvr,sizeof(PVR_HEADER));
+
+	if ( PF_IS_BGRA8((*dds)) ) {
+		const uint8_t *s = (src+sizeof(DDS_header));
+		for (int32_t c=0; c<actualFileSize; c+=4 ) {
+			tfile.put((char)s[c+2]);
+			tfile.put((char)s[c+1]);
+			tfile.put((char)s[c+0]);
+			tfile.put((char)s[c+3]);
+		}
+	} else if ( PF_IS_BGRX8((*dds)) ) {
+		const uint8_t *s = (src+sizeof(DDS_header));
+		for (int32_t c=0; c<actualFileSize; c+=4 ) {
+			tfile.put((char)s[c+2]);
+			tfile.put((char)s[c+1]);
+			tfile.put((char)s[c+0]);
+		}
+	} else if ( PF_IS_BGR8((*dds)) ) {
+		const uint8_t *s = (src+sizeof(DDS_header));
+		for (int32_t c=0; c<actualFileSize; c+=3 ) {
+			tfile.put((char)s[c+2]);
+			tfile.put((char)s[c+1]);
+			tfile.put((char)s[c+0]);
+		}
+	} else if ( PF_IS_SINGLECHANNEL((*dds)) ) {
+		const uint8_t *s = (src+sizeof(DDS_header));
+		for (int32_t c=0; c<actualFileSize; c++) {
+			tfile.put((char)s[c+0]);
+			tfile.put((char)s[c+0]);
+			tfile.put((char)s[c+0]);
+		}
+	} else {
+		tfile.write((char *)(src+sizeof(DDS_header)),actualFileSize);
+	}
+
+	dxt5 = PF_IS_DXT5((*dds));
+	return !tfile.bad();
+}
+
+bool atf_dds_mip_chain(const uint8_t *src, size_t len, ATFMipChain &chain)
+{
+	if ( len < sizeof(DDS_header) ) {
+		return false;
+	}
+	const DDS_header *dds = (const DDS_header *)src;
+	int32_t format = dds_mip_format(dds);
+	if ( dds->dwMagic != DDS_MAGIC || format < 0 ) {
+		return false;
+	}
+	atf_mip_chain(format,dds->dwWidth,dds->dwHeight,dds->dwMipMapCount+1,(dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?6:1,chain);
+	return atf_mip_truncate(chain,len-sizeof(DDS_header));
+}
@@ -0,0 +1,225 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef _ATFDDS_H_
+#define _ATFDDS_H_
+
+#include <iostream>
+
+/* DDS loader written by Jon Watte 2002 */
+/* Permission granted to use freely, as long as Jon Watte */
+/* is held harmless for all possible damages resulting from */
+/* your use or failure to use this code. */
+/* No warranty is expressed or implied. Use at your own risk, */
+/* or not at all. */
+
+//  little-endian, of course
+#define DDS_MAGIC 0x20534444
+
+//  DDS_header.dwFlags
+#define DDSD_CAPS                   0x00000001 
+#define DDSD_HEIGHT                 0x00000002 
+#define DDSD_WIDTH                  0x00000004 
+#define DDSD_PITCH                  0x00000008 
+#define DDSD_PIXELFORMAT            0x00001000 
+#define DDSD_MIPMAPCOUNT            0x00020000 
+#define DDSD_LINEARSIZE             0x00080000 
+#define DDSD_DEPTH                  0x00800000 
+
+//  DDS_header.sPixelFormat.dwFlags
+#define DDPF_ALPHAPIXELS            0x00000001 
+#define DDPF_FOURCC                 0x00000004 
+#define DDPF_INDEXED                0x00000020 
+#define DDPF_RGB                    0x00000040 
+
+//  DDS_header.sCaps.dwCaps1
+#define DDSCAPS_COMPLEX             0x00000008 
+#define DDSCAPS_TEXTURE             0x00001000 
+#define DDSCAPS_MIPMAP              0x00400000 
+
+//  DDS_header.sCaps.dwCaps2
+#define DDSCAPS2_CUBEMAP            0x00000200 
+#define DDSCAPS2_CUBEMAP_POSITIVEX  0x00000400 
+#define DDSCAPS2_CUBEMAP_NEGATIVEX  0x00000800 
+#define DDSCAPS2_CUBEMAP_POSITIVEY  0x00001000 
+#define DDSCAPS2_CUBEMAP_NEGATIVEY  0x00002000 
+#define DDSCAPS2_CUBEMAP_POSITIVEZ  0x00004000 
+#define DDSCAPS2_CUBEMAP_NEGATIVEZ  0x00008000 
+#define DDSCAPS2_VOLUME             0x00200000 
+
+// the character order of multi-character constants is up to the compiler
+#ifndef MAKEFOURCC
+#define MAKEFOURCC(c0,c1,c2,c3) ((uint32_t)(uint8_t)(c0) | ((uint32_t)(uint8_t)(c1) << 8) | ((uint32_t)(uint8_t)(c2) << 16) | ((uint32_t)(uint8_t)(c3) << 24))
+#endif //#ifndef MAKEFOURCC
+
+#define D3DFMT_DXT1     MAKEFOURCC('D','X','T','1') //  DXT1 compression texture format 
+#define D3DFMT_DXT2     MAKEFOURCC('D','X','T','2') //  DXT2 compression texture format 
+#define D3DFMT_DXT3     MAKEFOURCC('D','X','T','3') //  DXT3 compression texture format 
+#define D3DFMT_DXT4     MAKEFOURCC('D','X','T','4') //  DXT4 compression texture format 
+#define D3DFMT_DXT5     MAKEFOURCC('D','X','T','5') //  DXT5 compression texture format 
+#define D3DFMT_ATI2     MAKEFOURCC('A','T','I','2') //  ATI2 compression texture format 
+#define D3DFMT_ATI1     MAKEFOURCC('A','T','I','1') //  ATI1 compression texture format 
+#define D3DFMT_BC4U     MAKEFOURCC('B','C','4','U') //  BC4U compression texture format 
+#define D3DFMT_BC4S     MAKEFOURCC('B','C','4','S') //  BC4S compression texture format 
+#define D3DFMT_BC5U     MAKEFOURCC('B','C','5','U') //  BC4U compression texture format 
+#define D3DFMT_BC5S     MAKEFOURCC('B','C','5','S') //  BC4S compression texture format 
+
+#define PF_IS_BC5S(pf) \
+  ((pf.sPixelFormat.dwFlags & DDPF_FOURCC) && \
+   (pf.sPixelFormat.dwFourCC == D3DFMT_BC5S))
+
+#define PF_IS_BC5U(pf) \
+  ((pf.sPixelFormat.dwFlags & DDPF_FOURCC) && \
+   (pf.sPixelFormat.dwFourCC == D3DFMT_BC5U))
+
+#define PF_IS_BC4S(pf) \
+  ((pf.sPixelFormat.dwFlags & DDPF_FOURCC) && \
+   (pf.sPixelFormat.dwFourCC == D3DFMT_BC4S))
+
+#define PF_IS_BC4U(pf) \
+  ((pf.sPixelFormat.dwFlags & DDPF_FOURCC) && \
+   (pf.sPixelFormat.dwFourCC == D3DFMT_BC4U))
+
+#define PF_IS_ATI1(pf) \
+  ((pf.sPixelFormat.dwFlags & DDPF_FOURCC) && \
+   (pf.sPixelFormat.dwFourCC == D3DFMT_ATI1))
+
+#define PF_IS_ATI2(pf) \
+  ((pf.sPixelFormat.dwFlags & DDPF_FOURCC) && \
+   (pf.sPixelFormat.dwFourCC == D3DFMT_ATI2))
+
+#define PF_IS_DXT1(pf) \
+  ((pf.sPixelFormat.dwFlags & DDPF_FOURCC) && \
+   (pf.sPixelFormat.dwFourCC == D3DFMT_DXT1))
+
+#define PF_IS_DXT3(pf) \
+  ((pf.sPixelFormat.dwFlags & DDPF_FOURCC) && \
+   (pf.sPixelFormat.dwFourCC == D3DFMT_DXT3))
+
+#define PF_IS_DXT5(pf) \
+  ((pf.sPixelFormat.dwFlags & DDPF_FOURCC) && \
+   (pf.sPixelFormat.dwFourCC == D3DFMT_DXT5))
+
+#define PF_IS_BGRA8(pf) \
+  ((pf.sPixelFormat.dwFlags & DDPF_RGB) && \
+   (pf.sPixelFormat.dwFlags & DDPF_ALPHAPIXELS) && \
+   (pf.sPixelFormat.dwRGBBitCount == 32) && \
+   (pf.sPixelFormat.dwRBitMask == 0xff0000) && \
+   (pf.sPixelFormat.dwGBitMask == 0xff00) && \
+   (pf.sPixelFormat.dwBBitMask == 0xff) && \
+   (pf.sPixelFormat.dwAlphaBitMask == 0xff000000U))
+
+#define PF_IS_BGR8(pf) \
+  ((pf.sPixelFormat.dwFlags & DDPF_RGB) && \
+  !(pf.sPixelFormat.dwFlags & DDPF_ALPHAPIXELS) && \
+   (pf.sPixelFormat.dwRGBBitCount == 24) && \
+   (pf.sPixelFormat.dwRBitMask == 0xff0000) && \
+   (pf.sPixelFormat.dwGBitMask == 0xff00) && \
+   (pf.sPixelFormat.dwBBitMask == 0xff))
+
+#define PF_IS_BGRX8(pf) \
+  ((pf.sPixelFormat.dwFlags & DDPF_RGB) && \
+  !(pf.sPixelFormat.dwFlags & DDPF_ALPHAPIXELS) && \
+   (pf.sPixelFormat.dwRGBBitCount == 32) && \
+   (pf.sPixelFormat.dwRBitMask == 0xff0000) && \
+   (pf.sPixelFormat.dwGBitMask == 0xff00) && \
+   (pf.sPixelFormat.dwBBitMask == 0xff))
+
+#define PF_IS_BGR5A1(pf) \
+  ((pf.sPixelFormat.dwFlags & DDPF_RGB) && \
+   (pf.sPixelFormat.dwFlags & DDPF_ALPHAPIXELS) && \
+   (pf.sPixelFormat.dwRGBBitCount == 16) && \
+   (pf.sPixelFormat.dwRBitMask == 0x00007c00) && \
+   (pf.sPixelFormat.dwGBitMask == 0x000003e0) && \
+   (pf.sPixelFormat.dwBBitMask == 0x0000001f) && \
+   (pf.sPixelFormat.dwAlphaBitMask == 0x00008000))
+
+#define PF_IS_BGR565(pf) \
+  ((pf.sPixelFormat.dwFlags & DDPF_RGB) && \
+  !(pf.sPixelFormat.dwFlags & DDPF_ALPHAPIXELS) && \
+   (pf.sPixelFormat.dwRGBBitCount == 16) && \
+   (pf.sPixelFormat.dwRBitMask == 0x0000f800) && \
+   (pf.sPixelFormat.dwGBitMask == 0x000007e0) && \
+   (pf.sPixelFormat.dwBBitMask == 0x0000001f))
+
+#define PF_IS_INDEX8(pf) \
+  ((pf.sPixelFormat.dwFlags & DDPF_INDEXED) && \
+   (pf.sPixelFormat.dwRGBBitCount == 8))
+
+#define PF_IS_SINGLECHANNEL(pf) \
+  (!(pf.sPixelFormat.dwFlags & DDPF_INDEXED) && \
+   (pf.sPixelFormat.dwRGBBitCount == 8) && \
+   ((pf.sPixelFormat.dwRBitMask == 0x000000FF) || \
+   (pf.sPixelFormat.dwGBitMask == 0x0000FF00) || \
+   (pf.sPixelFormat.dwBBitMask == 0x00FF0000) || \
+   (pf.sPixelFormat.dwAlphaBitMask == 0xFF000000)))
+
+
+union DDS_header {
+  struct {
+    unsigned int    dwMagic;
+    unsigned int    dwSize;
+    unsigned int    dwFlags;
+    unsigned int    dwHeight;
+    unsigned int    dwWidth;
+    unsigned int    dwPitchOrLinearSize;
+    unsigned int    dwDepth;
+    unsigned int    dwMipMapCount;
+    unsigned int    dwReserved1[ 11 ];
+
+    //  DDPIXELFORMAT
+    struct {
+      unsigned int    dwSize;
+      unsigned int    dwFlags;
+      unsigned int    dwFourCC;
+      unsigned int    dwRGBBitCount;
+      unsigned int    dwRBitMask;
+      unsigned int    dwGBitMask;
+      unsigned int    dwBBitMask;
+      unsigned int    dwAlphaBitMask;
+    }               sPixelFormat;
+
+    //  DDCAPS2
+    struct {
+      unsigned int    dwCaps1;
+      unsigned int    dwCaps2;
+      unsigned int    dwDDSX;
+      unsigned int    dwReserved;
+    }               sCaps;
+    unsigned int    dwReserved2;
+  };
+  char data[ 128 ];
+};
+
+struct ATFMipChain;
+
+// Turns a DDS file in memory into the PVR stream pvr2atfcore encodes from:
+// a PVR_HEADER followed by the level data of all faces, swizzled to RGB(A).
+// dxt5 is set for DXT5 input, uncompressed for BGRA8/BGRX8/BGR8/L8 input.
+bool atf_dds_to_pvr(const uint8_t *src, size_t len, std::ostream &tfile, bool &dxt5, bool &uncompressed);
+
+// Mip chain of a DDS file of len bytes from its header alone, src needs to
+// hold sizeof(DDS_header) bytes. Fails quietly for anything atf_dds_to_pvr
+// would reject because of the header or the length.
+bool atf_dds_mip_chain(const uint8_t *src, size_t len, ATFMipChain &chain);
+
+#endif //#ifndef _ATFDDS_H_
@@ -0,0 +1,459 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif //#ifdef _MSC_VER
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif //#ifndef _MSC_VER
+
+#include "atfdds.h"
+#include "atfgen.h"
+#include "atfmips.h"
+
+using namespace std;
+
+static const char *format_names[ATF_GEN_FORMAT_COUNT] = { "dxt1", "dxt5", "bgra8", "bgrx8", "bgr8", "l8" };
+static const char *content_names[ATF_GEN_CONTENT_COUNT] = { "gradient", "noise", "photo" };
+
+struct Pixel {
+	uint8_t			r, g, b, a;
+};
+
+static uint32_t hash32(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352dU;
+	x ^= x >> 15;
+	x *= 0x846ca68bU;
+	x ^= x >> 16;
+	return x;
+}
+
+static uint32_t lattice(uint32_t seed, int32_t x, int32_t y)
+{
+	return hash32(seed ^ hash32(uint32_t(x) * 0x9e3779b1U ^ hash32(uint32_t(y) + 0x632be5abU)));
+}
+
+// Bilinear value noise with a cell size of 1<<shift texels, 0..65535.
+static uint32_t value_noise(uint32_t seed, int32_t x, int32_t y, int32_t shift)
+{
+	int32_t cx = x >> shift;
+	int32_t cy = y >> shift;
+	uint32_t fx = uint32_t(( x & ((1<<shift)-1) ) << (16 - shift));
+	uint32_t fy = uint32_t(( y & ((1<<shift)-1) ) << (16 - shift));
+	uint32_t v00 = lattice(seed,cx,cy) & 0xFFFF;
+	uint32_t v10 = lattice(seed,cx+1,cy) & 0xFFFF;
+	uint32_t v01 = lattice(seed,cx,cy+1) & 0xFFFF;
+	uint32_t v11 = lattice(seed,cx+1,cy+1) & 0xFFFF;
+	uint32_t top = ( v00 * (65536 - fx) + v10 * fx ) >> 16;
+	uint32_t bottom = ( v01 * (65536 - fx) + v11 * fx ) >> 16;
+	return ( top * (65536 - fy) + bottom * fy ) >> 16;
+}
+
+static uint8_t photo_channel(uint32_t seed, int32_t x, int32_t y, int32_t size)
+{
+	// octaves from a quarter of the texture down to 2 texels, halving in weight
+	uint32_t sum = 0;
+	uint32_t weight = 0;
+	uint32_t w = 256;
+	int32_t shift = 0;
+	while ( (1 << (shift + 1)) <= max(2,size / 4) ) {
+		shift++;
+	}
+	for ( ; shift >= 1 && w >= 8; shift--, w /= 2 ) {
+		sum += value_noise(seed + uint32_t(shift),x,y,shift) * w;
+		weight += w;
+	}
+	int32_t v = weight ? int32_t(sum / weight) >> 8 : 128;
+	v += int32_t(lattice(seed ^ 0x51ed270bU,x,y) & 15) - 8; // grain
+	return uint8_t(max(0,min(255,v)));
+}
+
+static Pixel generate(const ATFGenSpec &spec, uint32_t seed, int32_t x, int32_t y)
+{
+	Pixel p;
+	int32_t size = spec.size;
+	switch ( spec.content ) {
+		case	ATF_GEN_GRADIENT: {
+				int32_t d = max(1,size - 1);
+				p.r = uint8_t(x * 255 / d);
+				p.g = uint8_t(y * 255 / d);
+				p.b = uint8_t(( x + y ) * 255 / ( 2 * d ));
+				p.a = uint8_t(255 - ( x * 255 / d ) / 2);
+				p.r = uint8_t(p.r ^ ( seed & 0x1F )); // faces differ
+			} break;
+		case	ATF_GEN_NOISE: {
+				uint32_t v = lattice(seed,x,y);
+				p.r = uint8_t(v);
+				p.g = uint8_t(v >> 8);
+				p.b = uint8_t(v >> 16);
+				p.a = uint8_t(v >> 24);
+			} break;
+		default:
+		case	ATF_GEN_PHOTO: {
+				p.r = photo_channel(seed,x,y,size);
+				p.g = uint8_t(( p.r * 3 + photo_channel(seed + 101,x,y,size) ) / 4);
+				p.b = photo_channel(seed + 202,x,y,size);
+				p.a = uint8_t(value_noise(seed + 303,x,y,5) >> 8);
+			} break;
+	}
+	return p;
+}
+
+// Box filters src (w x h) into dst, sizes stop at 1 like the mip chain does.
+static void downsample(const vector<Pixel> &src, int32_t w, int32_t h, vector<Pixel> &dst)
+{
+	int32_t dw = max(1,w/2);
+	int32_t dh = max(1,h/2);
+	dst.resize(dw*dh);
+	for ( int32_t y=0; y<dh; y++) {
+		for ( int32_t x=0; x<dw; x++) {
+			int32_t x0 = min(w-1,x*2), x1 = min(w-1,x*2+1);
+			int32_t y0 = min(h-1,y*2), y1 = min(h-1,y*2+1);
+			const Pixel &a = src[y0*w+x0], &b = src[y0*w+x1], &c = src[y1*w+x0], &d = src[y1*w+x1];
+			Pixel &p = dst[y*dw+x];
+			p.r = uint8_t(( a.r + b.r + c.r + d.r + 2 ) / 4);
+			p.g = uint8_t(( a.g + b.g + c.g + d.g + 2 ) / 4);
+			p.b = uint8_t(( a.b + b.b + c.b + d.b + 2 ) / 4);
+			p.a = uint8_t(( a.a + b.a + c.a + d.a + 2 ) / 4);
+		}
+	}
+}
+
+static uint16_t to565(const Pixel &p)
+{
+	return uint16_t(( ( p.r >> 3 ) << 11 ) | ( ( p.g >> 2 ) << 5 ) | ( p.b >> 3 ));
+}
+
+static Pixel from565(uint16_t c)
+{
+	Pixel p;
+	p.r = uint8_t(( ( c >> 11 ) & 31 ) * 255 / 31);
+	p.g = uint8_t(( ( c >> 5 ) & 63 ) * 255 / 63);
+	p.b = uint8_t(( c & 31 ) * 255 / 31);
+	p.a = 255;
+	return p;
+}
+
+static int32_t distance(const Pixel &a, const Pixel &b)
+{
+	int32_t r = a.r - b.r, g = a.g - b.g, bl = a.b - b.b;
+	return r*r + g*g + bl*bl;
+}
+
+// Color block with the brightest and darkest texel as endpoints, 4 color mode.
+static void encode_color_block(const Pixel block[16], uint8_t *dst)
+{
+	int32_t lo = 0, hi = 0;
+	for ( int32_t c=1; c<16; c++) {
+		int32_t l = block[c].r * 2 + block[c].g * 5 + block[c].b;
+		if ( l < block[lo].r * 2 + block[lo].g * 5 + block[lo].b ) lo = c;
+		if ( l > block[hi].r * 2 + block[hi].g * 5 + block[hi].b ) hi = c;
+	}
+	uint16_t c0 = to565(block[hi]);
+	uint16_t c1 = to565(block[lo]);
+	if ( c0 < c1 ) {
+		swap(c0,c1);
+	}
+	uint32_t indices = 0;
+	if ( c0 != c1 ) {
+		Pixel palette[4];
+		palette[0] = from565(c0);
+		palette[1] = from565(c1);
+		palette[2].r = uint8_t(( palette[0].r * 2 + palette[1].r ) / 3);
+		palette[2].g = uint8_t(( palette[0].g * 2 + palette[1].g ) / 3);
+		palette[2].b = uint8_t(( palette[0].b * 2 + palette[1].b ) / 3);
+		palette[3].r = uint8_t(( palette[0].r + palette[1].r * 2 ) / 3);
+		palette[3].g = uint8_t(( palette[0].g + palette[1].g * 2 ) / 3);
+		palette[3].b = uint8_t(( palette[0].b + palette[1].b * 2 ) / 3);
+		for ( int32_t c=0; c<16; c++) {
+			int32_t best = 0;
+			for ( int32_t i=1; i<4; i++) {
+				if ( distance(block[c],palette[i]) < distance(block[c],palette[best]) ) {
+					best = i;
+				}
+			}
+			indices |= uint32_t(best) << (c*2);
+		}
+	}
+	dst[0] = uint8_t(c0);
+	dst[1] = uint8_t(c0 >> 8);
+	dst[2] = uint8_t(c1);
+	dst[3] = uint8_t(c1 >> 8);
+	dst[4] = uint8_t(indices);
+	dst[5] = uint8_t(indices >> 8);
+	dst[6] = uint8_t(indices >> 16);
+	dst[7] = uint8_t(indices >> 24);
+}
+
+// DXT5 alpha block, 8 alpha mode between the smallest and largest alpha.
+static void encode_alpha_block(const Pixel block[16], uint8_t *dst)
+{
+	uint8_t a0 = 0, a1 = 255;
+	for ( int32_t c=0; c<16; c++) {
+		a0 = max(a0,block[c].a);
+		a1 = min(a1,block[c].a);
+	}
+	uint64_t indices = 0;
+	if ( a0 != a1 ) {
+		int32_t palette[8];
+		palette[0] = a0;
+		palette[1] = a1;
+		for ( int32_t i=1; i<7; i++) {
+			palette[i+1] = ( ( 7 - i ) * a0 + i * a1 ) / 7;
+		}
+		for ( int32_t c=0; c<16; c++) {
+			int32_t best = 0;
+			for ( int32_t i=1; i<8; i++) {
+				if ( abs(block[c].a - palette[i]) < abs(block[c].a - palette[best]) ) {
+					best = i;
+				}
+			}
+			indices |= uint64_t(best) << (c*3);
+		}
+	}
+	dst[0] = a0;
+	dst[1] = a1;
+	for ( int32_t c=0; c<6; c++) {
+		dst[2+c] = uint8_t(indices >> (c*8));
+	}
+}
+
+static void encode_level(int32_t format, const vector<Pixel> &pixels, const ATFMipLevel &level, vector<uint8_t> &dds)
+{
+	size_t pos = dds.size();
+	dds.resize(pos + level.length);
+	uint8_t *dst = &dds[pos];
+	int32_t w = level.width;
+	int32_t h = level.height;
+
+	if ( format == ATF_GEN_DXT1 || format == ATF_GEN_DXT5 ) {
+		for ( int32_t by=0; by<level.blocksh; by++) {
+			for ( int32_t bx=0; bx<level.blocksw; bx++) {
+				Pixel block[16];
+				for ( int32_t c=0; c<16; c++) {
+					int32_t x = min(w-1,bx*4+(c&3));
+					int32_t y = min(h-1,by*4+(c>>2));
+					block[c] = pixels[y*w+x];
+				}
+				if ( format == ATF_GEN_DXT5 ) {
+					encode_alpha_block(block,dst);
+					dst += 8;
+				}
+				encode_color_block(block,dst);
+				dst += 8;
+			}
+		}
+		return;
+	}
+
+	for ( int32_t c=0; c<w*h; c++) {
+		const Pixel &p = pixels[c];
+		switch ( format ) {
+			case	ATF_GEN_BGRA8:
+					*dst++ = p.b; *dst++ = p.g; *dst++ = p.r; *dst++ = p.a;
+					break;
+			case	ATF_GEN_BGRX8:
+					*dst++ = p.b; *dst++ = p.g; *dst++ = p.r; *dst++ = 0xFF;
+					break;
+			case	ATF_GEN_BGR8:
+					*dst++ = p.b; *dst++ = p.g; *dst++ = p.r;
+					break;
+			case	ATF_GEN_L8:
+					*dst++ = uint8_t(( p.r * 2 + p.g * 5 + p.b + 4 ) / 8);
+					break;
+		}
+	}
+}
+
+static void set_header(const ATFGenSpec &spec, int32_t count, uint32_t topLength, DDS_header &header)
+{
+	memset(&header,0,sizeof(header));
+	header.dwMagic = DDS_MAGIC;
+	header.dwSize = 124;
+	header.dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | ( spec.mips ? DDSD_MIPMAPCOUNT : 0 );
+	header.dwWidth = spec.size;
+	header.dwHeight = spec.size;
+	header.dwMipMapCount = spec.mips ? count : 0;
+	header.sPixelFormat.dwSize = 32;
+	header.sCaps.dwCaps1 = DDSCAPS_TEXTURE | ( spec.mips ? DDSCAPS_MIPMAP | DDSCAPS_COMPLEX : 0 );
+	if ( spec.cube ) {
+		header.sCaps.dwCaps1 |= DDSCAPS_COMPLEX;
+		header.sCaps.dwCaps2 = DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_POSITIVEX | DDSCAPS2_CUBEMAP_NEGATIVEX |
+							   DDSCAPS2_CUBEMAP_POSITIVEY | DDSCAPS2_CUBEMAP_NEGATIVEY |
+							   DDSCAPS2_CUBEMAP_POSITIVEZ | DDSCAPS2_CUBEMAP_NEGATIVEZ;
+	}
+
+	switch ( spec.format ) {
+		case	ATF_GEN_DXT1:
+		case	ATF_GEN_DXT5:
+				header.dwFlags |= DDSD_LINEARSIZE;
+				header.dwPitchOrLinearSize = topLength;
+				header.sPixelFormat.dwFlags = DDPF_FOURCC;
+				header.sPixelFormat.dwFourCC = spec.format == ATF_GEN_DXT1 ? D3DFMT_DXT1 : D3DFMT_DXT5;
+				break;
+		case	ATF_GEN_L8:
+				header.dwFlags |= DDSD_PITCH;
+				header.dwPitchOrLinearSize = spec.size;
+				header.sPixelFormat.dwFlags = 0x00020000; // DDPF_LUMINANCE
+				header.sPixelFormat.dwRGBBitCount = 8;
+				header.sPixelFormat.dwRBitMask = 0xFF;
+				break;
+		default:
+				header.dwFlags |= DDSD_PITCH;
+				header.sPixelFormat.dwFlags = DDPF_RGB | ( spec.format == ATF_GEN_BGRA8 ? DDPF_ALPHAPIXELS : 0 );
+				header.sPixelFormat.dwRGBBitCount = spec.format == ATF_GEN_BGR8 ? 24 : 32;
+				header.dwPitchOrLinearSize = spec.size * header.sPixelFormat.dwRGBBitCount / 8;
+				header.sPixelFormat.dwRBitMask = 0xFF0000;
+				header.sPixelFormat.dwGBitMask = 0xFF00;
+				header.sPixelFormat.dwBBitMask = 0xFF;
+				header.sPixelFormat.dwAlphaBitMask = spec.format == ATF_GEN_BGRA8 ? 0xFF000000U : 0;
+				break;
+	}
+}
+
+static int32_t mip_format(int32_t format)
+{
+	switch ( format ) {
+		case	ATF_GEN_DXT1:	return ATF_MIP_DXT1;
+		case	ATF_GEN_DXT5:	return ATF_MIP_DXT5;
+		case	ATF_GEN_BGR8:	return ATF_MIP_RGB8;
+		case	ATF_GEN_L8:		return ATF_MIP_L8;
+	}
+	return ATF_MIP_RGBA8;
+}
+
+string atf_gen_name(const ATFGenSpec &spec)
+{
+	ostringstream name;
+	name << format_names[spec.format] << "_" << spec.size;
+	name << ( spec.mips ? "_mips" : "" ) << ( spec.cube ? "_cube" : "" );
+	name << "_" << content_names[spec.content];
+	return name.str();
+}
+
+bool atf_gen_parse(const string &name, ATFGenSpec &spec)
+{
+	vector<string> parts;
+	istringstream s(name);
+	string part;
+	while ( getline(s,part,'_') ) {
+		parts.push_back(part);
+	}
+	if ( parts.size() < 3 ) {
+		return false;
+	}
+
+	spec.format = -1;
+	for ( int32_t c=0; c<ATF_GEN_FORMAT_COUNT; c++) {
+		if ( parts[0] == format_names[c] ) {
+			spec.format = c;
+		}
+	}
+	spec.content = -1;
+	for ( int32_t c=0; c<ATF_GEN_CONTENT_COUNT; c++) {
+		if ( parts.back() == content_names[c] ) {
+			spec.content = c;
+		}
+	}
+	istringstream size(parts[1]);
+	spec.size = 0;
+	size >> spec.size;
+	spec.mips = false;
+	spec.cube = false;
+	for ( size_t c=2; c+1<parts.size(); c++) {
+		if ( parts[c] == "mips" ) {
+			spec.mips = true;
+		} else if ( parts[c] == "cube" ) {
+			spec.cube = true;
+		} else {
+			return false;
+		}
+	}
+	return spec.format >= 0 && spec.content >= 0 && spec.size > 0 && spec.size <= 2048 && ( spec.size & (spec.size - 1) ) == 0;
+}
+
+void atf_gen_dds(const ATFGenSpec &spec, vector<uint8_t> &dds)
+{
+	ATFMipChain chain;
+	int32_t faces = spec.cube ? 6 : 1;
+	atf_mip_chain(mip_format(spec.format),spec.size,spec.size,spec.mips ? atf_mip_max_levels(spec.size,spec.size) : 1,faces,chain);
+
+	DDS_header header;
+	set_header(spec,chain.count,chain.level(0).length,header);
+	dds.clear();
+	dds.reserve(sizeof(header) + chain.length());
+	dds.insert(dds.end(),header.data,header.data + sizeof(header));
+
+	uint32_t seed = hash32(uint32_t(spec.format * 0x10000 + spec.content * 0x100) ^ uint32_t(spec.size));
+	for ( int32_t i=0; i<faces; i++) {
+		vector<Pixel> pixels(spec.size*spec.size);
+		uint32_t faceSeed = hash32(seed + uint32_t(i));
+		for ( int32_t y=0; y<spec.size; y++) {
+			for ( int32_t x=0; x<spec.size; x++) {
+				pixels[y*spec.size+x] = generate(spec,faceSeed,x,y);
+			}
+		}
+		int32_t w = spec.size;
+		int32_t h = spec.size;
+		for ( int32_t c=0; c<chain.count; c++) {
+			encode_level(spec.format,pixels,chain.level(c),dds);
+			vector<Pixel> next;
+			downsample(pixels,w,h,next);
+			pixels.swap(next);
+			w = max(1,w/2);
+			h = max(1,h/2);
+		}
+	}
+}
+
+void atf_gen_corpus(int32_t maxSize, int32_t maxCubeSize, int32_t step, vector<ATFGenSpec> &specs)
+{
+	vector<int32_t> sizes;
+	for ( int32_t s=0; (1<<s) < maxSize; s+=max(1,step)) {
+		sizes.push_back(1<<s);
+	}
+	sizes.push_back(maxSize);
+
+	for ( int32_t f=0; f<ATF_GEN_FORMAT_COUNT; f++) {
+		for ( size_t c=0; c<sizes.size(); c++) {
+			for ( int32_t cube=0; cube<2; cube++) {
+				if ( cube && sizes[c] > maxCubeSize ) {
+					continue;
+				}
+				for ( int32_t mips=0; mips<2; mips++) {
+					for ( int32_t content=0; content<ATF_GEN_CONTENT_COUNT; content++) {
+						ATFGenSpec spec = { f, sizes[c], mips ? true : false, cube ? true : false, content };
+						specs.push_back(spec);
+					}
+				}
+			}
+		}
+	}
+}
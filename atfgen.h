@@ -0,0 +1,73 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _ATFGEN_H_
+#define _ATFGEN_H_
+
+#include <string>
+#include <vector>
+
+//
+// Deterministic DDS test textures for benchmarks and regression runs. The
+// same spec gives the same file on every platform: all content is computed
+// with integer math from a seed derived from the spec. Mip levels are box
+// filtered from the level above, DXT data comes from a simple endpoint fit.
+//
+
+enum {
+	ATF_GEN_DXT1,
+	ATF_GEN_DXT5,
+	ATF_GEN_BGRA8,
+	ATF_GEN_BGRX8,
+	ATF_GEN_BGR8,
+	ATF_GEN_L8,
+	ATF_GEN_FORMAT_COUNT
+};
+
+enum {
+	ATF_GEN_GRADIENT,		// smooth ramps, compresses well
+	ATF_GEN_NOISE,			// white noise, the worst case for every encoder
+	ATF_GEN_PHOTO,			// value noise octaves with fine grain, like a photograph
+	ATF_GEN_CONTENT_COUNT
+};
+
+struct ATFGenSpec {
+	int32_t			format;		// ATF_GEN_*
+	int32_t			size;		// width and height, a power of 2
+	bool			mips;		// full mip chain or only the top level
+	bool			cube;
+	int32_t			content;	// ATF_GEN_GRADIENT, _NOISE or _PHOTO
+};
+
+// e.g. "dxt5_256_mips_cube_photo"
+std::string atf_gen_name(const ATFGenSpec &spec);
+
+// Parses a name written by atf_gen_name.
+bool atf_gen_parse(const std::string &name, ATFGenSpec &spec);
+
+void atf_gen_dds(const ATFGenSpec &spec, std::vector<uint8_t> &dds);
+
+// Every format and content with and without mips, sizes from 1x1 up to
+// maxSize in steps of 1<<step (1x1 and maxSize are always included), cube
+// maps up to maxCubeSize.
+void atf_gen_corpus(int32_t maxSize, int32_t maxCubeSize, int32_t step, std::vector<ATFGenSpec> &specs);
+
+#endif //#ifndef _ATFGEN_H_
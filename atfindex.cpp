@@ -0,0 +1,347 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif //#ifdef _MSC_VER
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif //#ifndef _MSC_VER
+
+#include "3rdparty/jpegxr/jpegxr.h"
+#include "atf.h"
+#include "atfcache.h"
+#include "atfindex.h"
+
+using namespace std;
+
+static uint32_t get_uint24(const uint8_t *p) {
+	return (uint32_t(p[0])<<16)|
+		   (uint32_t(p[1])<< 8)|
+		   (uint32_t(p[2])<< 0);
+}
+
+static uint32_t get_uint32(const uint8_t *p) {
+	return (uint32_t(p[0])<<24)|
+		   (uint32_t(p[1])<<16)|
+		   (uint32_t(p[2])<< 8)|
+		   (uint32_t(p[3])<< 0);
+}
+
+static uint64_t get_uint64(const uint8_t *p) {
+	return (uint64_t(get_uint32(p+0))<<32)|
+		   (uint64_t(get_uint32(p+4))<< 0);
+}
+
+static void put_uint24(uint32_t v, ostream &ofile) {
+	ofile.put(char((v>>16)&0xFF));
+	ofile.put(char((v>> 8)&0xFF));
+	ofile.put(char((v>> 0)&0xFF));
+}
+
+static void put_uint32(uint32_t v, ostream &ofile) {
+	ofile.put(char((v>>24)&0xFF));
+	ofile.put(char((v>>16)&0xFF));
+	ofile.put(char((v>> 8)&0xFF));
+	ofile.put(char((v>> 0)&0xFF));
+}
+
+static void put_uint64(uint64_t v, ostream &ofile) {
+	put_uint32(uint32_t(v>>32),ofile);
+	put_uint32(uint32_t(v>> 0),ofile);
+}
+
+int32_t atf_streams_per_level(uint8_t format)
+{
+	switch ( format & ~ATFDecoder::ATF_FORMAT_CUBEMAP ) {
+		case	ATFDecoder::ATF_FORMAT_888:
+		case	ATFDecoder::ATF_FORMAT_8888:
+				return 1;
+		case	ATFDecoder::ATF_FORMAT_COMPRESSED:
+				return 2 + 3 + 3;		// dxt1, pvrtc, etc1
+		case	ATFDecoder::ATF_FORMAT_COMPRESSEDRAW:
+				return 1 + 1 + 1;
+		case	ATFDecoder::ATF_FORMAT_COMPRESSEDALPHA:
+				return 4 + 3 + 3;		// dxt5, pvrtc, etc1
+		case	ATFDecoder::ATF_FORMAT_COMPRESSEDRAWALPHA:
+				return 1 + 1 + 1;
+	}
+	return 0;
+}
+
+bool atf_stream_group(uint8_t format, int32_t group, int32_t &first, int32_t &count)
+{
+	static const int32_t compressed[ATF_GROUP_COUNT+1]		= { 0, 2, 5, 8 };
+	static const int32_t compressedAlpha[ATF_GROUP_COUNT+1]	= { 0, 4, 7, 10 };
+	static const int32_t compressedRaw[ATF_GROUP_COUNT+1]	= { 0, 1, 2, 3 };
+
+	const int32_t *groups = 0;
+	switch ( format & ~ATFDecoder::ATF_FORMAT_CUBEMAP ) {
+		case	ATFDecoder::ATF_FORMAT_COMPRESSED:
+				groups = compressed;
+				break;
+		case	ATFDecoder::ATF_FORMAT_COMPRESSEDALPHA:
+				groups = compressedAlpha;
+				break;
+		case	ATFDecoder::ATF_FORMAT_COMPRESSEDRAW:
+		case	ATFDecoder::ATF_FORMAT_COMPRESSEDRAWALPHA:
+				groups = compressedRaw;
+				break;
+	}
+	if ( !groups || group < 0 || group >= ATF_GROUP_COUNT ) {
+		return false;
+	}
+	first = groups[group];
+	count = groups[group+1] - groups[group];
+	return true;
+}
+
+bool atf_parse_layout(const uint8_t *data, size_t dataLen, ATFLayout &layout)
+{
+	if ( dataLen < 10 || data[0] != 'A' || data[1] != 'T' || data[2] != 'F' ) {
+		return false;
+	}
+
+	layout.fileLen = uint32_t(dataLen);
+	layout.fileHash[0] = 0;
+	layout.fileHash[1] = 0;
+	layout.format  = data[6];
+	layout.wlog2   = data[7];
+	layout.hlog2   = data[8];
+	layout.count   = data[9];
+	layout.faces   = ( layout.format & ATFDecoder::ATF_FORMAT_CUBEMAP ) ? 6 : 1;
+	layout.streams = uint8_t(atf_streams_per_level(layout.format));
+	layout.blocks.clear();
+	layout.hashes.clear();
+
+	if ( layout.streams == 0 ) {
+		return false;
+	}
+
+	size_t pos = 10;
+	int32_t total = layout.faces * layout.count * layout.streams;
+	layout.blocks.reserve(total);
+	for ( int32_t c=0; c<total; c++) {
+		if ( pos + 3 > dataLen ) {
+			return false;
+		}
+		ATFBlock block;
+		block.length = get_uint24(data+pos);
+		block.offset = uint32_t(pos + 3);
+		pos += 3 + block.length;
+		if ( pos > dataLen ) {
+			return false;
+		}
+		layout.blocks.push_back(block);
+	}
+	return true;
+}
+
+bool atf_write_index(const ATFLayout &layout, ostream &ofile)
+{
+	ofile.put('A');
+	ofile.put('T');
+	ofile.put('F');
+	ofile.put('I');
+	ofile.put(char(layout.hashes.empty() ? 3 : 4));
+	put_uint32(layout.fileLen,ofile);
+	put_uint64(layout.fileHash[0],ofile);
+	put_uint64(layout.fileHash[1],ofile);
+	ofile.put(char(layout.format));
+	ofile.put(char(layout.wlog2));
+	ofile.put(char(layout.hlog2));
+	ofile.put(char(layout.count));
+	ofile.put(char(layout.streams));
+	for ( size_t c=0; c<layout.blocks.size(); c++) {
+		put_uint32(layout.blocks[c].offset,ofile);
+		put_uint24(layout.blocks[c].length,ofile);
+	}
+	for ( size_t c=0; c<layout.hashes.size(); c++) {
+		put_uint64(layout.hashes[c].hash[0],ofile);
+		put_uint64(layout.hashes[c].hash[1],ofile);
+	}
+	return !ofile.bad();
+}
+
+bool atf_read_index(istream &ifile, ATFLayout &layout)
+{
+	uint8_t header[30];
+	if ( !ifile.read((char *)header,9) ) {
+		return false;
+	}
+	if ( header[0] != 'A' || header[1] != 'T' || header[2] != 'F' || header[3] != 'I' || header[4] < 1 || header[4] > 4 ) {
+		return false;
+	}
+
+	// Versions 3 and 4 store the hash of the indexed file after its length.
+	uint8_t version = header[4];
+	const uint8_t *fields = header+9;
+	layout.fileHash[0] = 0;
+	layout.fileHash[1] = 0;
+	if ( version >= 3 ) {
+		if ( !ifile.read((char *)header+9,16) ) {
+			return false;
+		}
+		layout.fileHash[0] = get_uint64(header+9);
+		layout.fileHash[1] = get_uint64(header+17);
+		fields = header+25;
+	}
+	if ( !ifile.read((char *)fields,5) ) {
+		return false;
+	}
+
+	layout.fileLen = get_uint32(header+5);
+	layout.format  = fields[0];
+	layout.wlog2   = fields[1];
+	layout.hlog2   = fields[2];
+	layout.count   = fields[3];
+	layout.streams = fields[4];
+	layout.faces   = ( layout.format & ATFDecoder::ATF_FORMAT_CUBEMAP ) ? 6 : 1;
+
+	if ( layout.streams != atf_streams_per_level(layout.format) ) {
+		return false;
+	}
+
+	int32_t total = layout.faces * layout.count * layout.streams;
+	vector<uint8_t> entries(total * 7);
+	if ( total && !ifile.read((char *)&entries[0],entries.size()) ) {
+		return false;
+	}
+
+	layout.blocks.resize(total);
+	for ( int32_t c=0; c<total; c++) {
+		layout.blocks[c].offset = get_uint32(&entries[c*7+0]);
+		layout.blocks[c].length = get_uint24(&entries[c*7+4]);
+		if ( layout.blocks[c].offset + layout.blocks[c].length > layout.fileLen ) {
+			return false;
+		}
+	}
+
+	layout.hashes.clear();
+	if ( version == 2 || version == 4 ) {
+		int32_t levels = layout.faces * layout.count;
+		vector<uint8_t> hashes(levels * 16);
+		if ( levels && !ifile.read((char *)&hashes[0],hashes.size()) ) {
+			return false;
+		}
+		layout.hashes.resize(levels);
+		for ( int32_t c=0; c<levels; c++) {
+			layout.hashes[c].hash[0] = get_uint64(&hashes[c*16+0]);
+			layout.hashes[c].hash[1] = get_uint64(&hashes[c*16+8]);
+		}
+	}
+	return true;
+}
+
+string atf_index_name(const char *atfname)
+{
+	string name(atfname);
+	if ( name.size() >= 4 && name.compare(name.size()-4,4,".atf") == 0 ) {
+		return name + "idx";
+	}
+	return name + ".atfidx";
+}
+
+bool atf_write_index_file(const char *atfname)
+{
+	return atf_write_index_file(atfname,vector<ATFLevelHash>());
+}
+
+bool atf_write_index_file(const char *atfname, const vector<ATFLevelHash> &hashes)
+{
+	ifstream ifile(atfname,ios::in|ios::binary);
+	if ( !ifile.is_open() ) {
+		return false;
+	}
+
+	ifile.seekg(0,ios_base::end);
+	size_t filesize = ifile.tellg();
+	ifile.seekg(0,ios_base::beg);
+
+	vector<uint8_t> data(max(size_t(1),filesize));
+	ifile.read((char *)&data[0],filesize);
+	ifile.close();
+
+	ATFLayout layout;
+	if ( !atf_parse_layout(&data[0],filesize,layout) ) {
+		cerr << "Could not parse ATF file. '" << atfname << "'\n\n";
+		return false;
+	}
+	if ( hashes.size() == size_t(layout.faces * layout.count) ) {
+		layout.hashes = hashes;
+	}
+	atf_hash(&data[0],filesize,layout.fileHash);
+
+	string idxname = atf_index_name(atfname);
+	ofstream ofile(idxname.c_str(),ios::out|ios::binary);
+	if ( !ofile.is_open() ) {
+		cerr << "Could not open index file. '" << idxname << "'\n\n";
+		return false;
+	}
+	if ( !atf_write_index(layout,ofile) ) {
+		ofile.close();
+		remove(idxname.c_str());
+		return false;
+	}
+	ofile.close();
+	return true;
+}
+
+bool atf_load_layout(const char *atfname, istream &atf, ATFLayout &layout)
+{
+	atf.seekg(0,ios_base::end);
+	size_t filesize = atf.tellg();
+	atf.seekg(0,ios_base::beg);
+
+	vector<uint8_t> data(max(size_t(1),filesize));
+	atf.read((char *)&data[0],filesize);
+	atf.clear();
+	atf.seekg(0,ios_base::beg);
+
+	if ( !atf_parse_layout(&data[0],filesize,layout) ) {
+		return false;
+	}
+
+	// The level hashes only live in the sidecar. A file rewritten by another tool
+	// can keep its length, so the sidecar is only used if it hashes this exact file.
+	if ( atfname ) {
+		string idxname = atf_index_name(atfname);
+		ifstream ifile(idxname.c_str(),ios::in|ios::binary);
+		ATFLayout index;
+		if ( ifile.is_open() && atf_read_index(ifile,index) && ( index.fileHash[0] || index.fileHash[1] ) ) {
+			atf_hash(&data[0],filesize,layout.fileHash);
+			if ( index.fileLen == layout.fileLen &&
+				 index.fileHash[0] == layout.fileHash[0] && index.fileHash[1] == layout.fileHash[1] &&
+				 index.format == layout.format && index.count == layout.count &&
+				 index.blocks.size() == layout.blocks.size() ) {
+				layout.hashes = index.hashes;
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,106 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _ATFINDEX_H_
+#define _ATFINDEX_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+//
+// ATF index sidecar format (.atfidx):
+//
+// U8[4]   -  signature  - 'ATFI'
+// U8      -  version    - 3, or 4 if level hashes follow the entries
+// U32     -  len        - length in bytes of the indexed ATF file
+// U64[2]  -  hash       - hash of the whole indexed ATF file
+// U8      -  format     - ATF format byte (including the cubemap bit)
+// U8	   -  width      - texture size (2^n)
+// U8	   -  height     - texture size (2^n)
+// U8      -  count      - total texture count (main + mip maps)
+// U8      -  streams    - number of sub-streams per texture level
+//
+// faces * count * streams * [ // faces = 6 for cube maps, 1 otherwise
+// U32     -  offset     - offset in bytes of the sub-stream data (past its U24 len)
+// U24     -  len        - length in bytes of the sub-stream data
+// ]
+//
+// faces * count * [ // version 4 only
+// U64[2]  -  hash       - hash of the level's input data and encoder settings, 0 if not encoded
+// ]
+//
+// Entries are stored in ATF file order, so the entry for (face, level, stream)
+// lives at ((face * count) + level) * streams + stream.
+//
+// Version 1 and 2 sidecars lack the file hash. They can still be read, but
+// atf_load_layout ignores them.
+//
+
+struct ATFBlock {
+	uint32_t		offset;		// offset of the data, past the U24 length
+	uint32_t		length;		// length of the data
+};
+
+struct ATFLevelHash {
+	uint64_t		hash[2];
+};
+
+struct ATFLayout {
+	uint8_t			format;
+	uint8_t			wlog2;
+	uint8_t			hlog2;
+	uint8_t			count;
+	uint8_t			faces;
+	uint8_t			streams;
+	uint32_t		fileLen;
+	uint64_t		fileHash[2];	// 0 if unknown
+	std::vector<ATFBlock> blocks;
+	std::vector<ATFLevelHash> hashes;	// faces * count entries if known, empty otherwise
+
+	const ATFBlock &block(int32_t face, int32_t level, int32_t stream) const {
+		return blocks[((face * count) + level) * streams + stream];
+	}
+};
+
+// The compressed formats store DXT, PVRTC and ETC1 sub-streams per level, in that order.
+enum {
+	ATF_GROUP_DXT,
+	ATF_GROUP_PVRTC,
+	ATF_GROUP_ETC1,
+	ATF_GROUP_COUNT
+};
+
+int32_t atf_streams_per_level(uint8_t format);
+bool atf_stream_group(uint8_t format, int32_t group, int32_t &first, int32_t &count);
+
+bool atf_parse_layout(const uint8_t *data, size_t dataLen, ATFLayout &layout);
+
+bool atf_write_index(const ATFLayout &layout, std::ostream &ofile);
+bool atf_read_index(std::istream &ifile, ATFLayout &layout);
+
+std::string atf_index_name(const char *atfname);
+
+bool atf_write_index_file(const char *atfname);
+bool atf_write_index_file(const char *atfname, const std::vector<ATFLevelHash> &hashes);
+bool atf_load_layout(const char *atfname, std::istream &atf, ATFLayout &layout);
+
+#endif //#ifndef _ATFINDEX_H_
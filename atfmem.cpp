@@ -0,0 +1,180 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif //#ifdef _MSC_VER
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif //#ifndef _MSC_VER
+
+#include "atfmem.h"
+#include "atfthread.h"
+
+// Counters of one job, updated by every thread which works for it.
+struct ATFMemContext {
+	volatile size_t	current[ATF_MEM_COUNT];
+	volatile size_t	peak[ATF_MEM_COUNT];
+	volatile size_t	total;
+	volatile size_t	totalPeak;
+	volatile bool	exceeded;
+};
+
+// Placed in front of every block, 32 bytes keep the malloc alignment. A block
+// is freed from the context it was allocated from, whichever thread frees it.
+union ATFMemHeader {
+	struct {
+		size_t			size;
+		ATFMemContext  *context;
+		int				subsystem;
+	} block;
+	double		align[4];
+};
+
+static ATF_THREAD_LOCAL ATFMemContext threadContext;
+static ATF_THREAD_LOCAL ATFMemContext *currentContext;
+
+static volatile size_t processCurrent[ATF_MEM_COUNT];
+static volatile size_t processPeak[ATF_MEM_COUNT];
+static volatile size_t processTotal;
+static volatile size_t processTotalPeak;
+static size_t processLimit;
+
+static const char *names[ATF_MEM_COUNT] = { "jxr", "lzma", "image" };
+
+static ATFMemContext *current_context()
+{
+	return currentContext ? currentContext : &threadContext;
+}
+
+static void account(ATFMemContext *context, int subsystem, ptrdiff_t delta)
+{
+	size_t current = atf_atomic_add(&context->current[subsystem],delta);
+	size_t total = atf_atomic_add(&context->total,delta);
+	if ( delta > 0 ) {
+		atf_atomic_max(&context->peak[subsystem],current);
+		atf_atomic_max(&context->totalPeak,total);
+	}
+
+	current = atf_atomic_add(&processCurrent[subsystem],delta);
+	total = atf_atomic_add(&processTotal,delta);
+	if ( delta > 0 ) {
+		atf_atomic_max(&processPeak[subsystem],current);
+		atf_atomic_max(&processTotalPeak,total);
+		if ( processLimit && total > processLimit ) {
+			context->exceeded = true;
+		}
+	}
+}
+
+void *atf_mem_alloc(int subsystem, size_t size)
+{
+	ATFMemHeader *header = (ATFMemHeader *)malloc(sizeof(ATFMemHeader) + size);
+	if ( !header ) {
+		return 0;
+	}
+	header->block.size = size;
+	header->block.context = current_context();
+	header->block.subsystem = subsystem;
+	account(header->block.context,subsystem,ptrdiff_t(size));
+	return header + 1;
+}
+
+void *atf_mem_calloc(int subsystem, size_t count, size_t size)
+{
+	void *ptr = atf_mem_alloc(subsystem,count*size);
+	if ( ptr ) {
+		memset(ptr,0,count*size);
+	}
+	return ptr;
+}
+
+void atf_mem_free(void *ptr)
+{
+	if ( !ptr ) {
+		return;
+	}
+	ATFMemHeader *header = (ATFMemHeader *)ptr - 1;
+	account(header->block.context,header->block.subsystem,-ptrdiff_t(header->block.size));
+	free(header);
+}
+
+ATFMemContext *atf_mem_context(void)
+{
+	return current_context();
+}
+
+ATFMemContext *atf_mem_set_context(ATFMemContext *context)
+{
+	ATFMemContext *previous = current_context();
+	currentContext = context;
+	return previous;
+}
+
+void atf_mem_reset_context(void)
+{
+	ATFMemContext *context = current_context();
+	for ( int c=0; c<ATF_MEM_COUNT; c++) {
+		context->peak[c] = context->current[c];
+	}
+	context->totalPeak = context->total;
+	context->exceeded = false;
+}
+
+void atf_mem_get_context(ATFMemStats *stats)
+{
+	ATFMemContext *context = current_context();
+	for ( int c=0; c<ATF_MEM_COUNT; c++) {
+		stats->current[c] = context->current[c];
+		stats->peak[c] = context->peak[c];
+	}
+	stats->total = context->total;
+	stats->totalPeak = context->totalPeak;
+}
+
+void atf_mem_get_process(ATFMemStats *stats)
+{
+	for ( int c=0; c<ATF_MEM_COUNT; c++) {
+		stats->current[c] = processCurrent[c];
+		stats->peak[c] = processPeak[c];
+	}
+	stats->total = processTotal;
+	stats->totalPeak = processTotalPeak;
+}
+
+void atf_mem_set_limit(size_t limit)
+{
+	processLimit = limit;
+}
+
+int atf_mem_exceeded(void)
+{
+	return current_context()->exceeded ? 1 : 0;
+}
+
+const char *atf_mem_name(int subsystem)
+{
+	return names[subsystem];
+}
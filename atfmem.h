@@ -0,0 +1,88 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _ATFMEM_H_
+#define _ATFMEM_H_
+
+#include <stddef.h>
+
+//
+// Allocation accounting for the encoder's big consumers: the JPEG-XR codec
+// (jpegxr_malloc), LZMA (the ISzAlloc in LzmaLib.c) and the ImageData planes
+// the block data is split into. Every block carries a small header with its
+// size, so current and peak bytes are known per subsystem, both for one
+// conversion job and for the whole process.
+//
+// A job accounts to a context. Every thread has one of its own, which is the
+// context of the job it converts. Work a job hands to another thread (see
+// atfsched.h) switches that thread to the job's context while it runs, so
+// the allocations and the limit check belong to the job, not to the thread.
+//
+// Plain C, the LZMA sources are C.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif //#ifdef __cplusplus
+
+enum {
+	ATF_MEM_JXR,
+	ATF_MEM_LZMA,
+	ATF_MEM_IMAGE,
+	ATF_MEM_COUNT
+};
+
+struct ATFMemStats {
+	size_t		current[ATF_MEM_COUNT];
+	size_t		peak[ATF_MEM_COUNT];
+	size_t		total;			// current bytes of all subsystems
+	size_t		totalPeak;		// peak of total, not the sum of the peaks
+};
+
+struct ATFMemContext;
+
+void *atf_mem_alloc(int subsystem, size_t size);
+void *atf_mem_calloc(int subsystem, size_t count, size_t size);
+void  atf_mem_free(void *ptr);
+
+// Context the calling thread accounts to. atf_mem_set_context switches to
+// context, 0 switches back to the thread's own one, and returns the previous.
+struct ATFMemContext *atf_mem_context(void);
+struct ATFMemContext *atf_mem_set_context(struct ATFMemContext *context);
+
+// Statistics of the current context, reset at the start of every job.
+void atf_mem_reset_context(void);
+void atf_mem_get_context(struct ATFMemStats *stats);
+void atf_mem_get_process(struct ATFMemStats *stats);
+
+// Process wide limit of accounted bytes, 0 means no limit. Allocations are
+// never refused, a context which allocates past the limit is flagged and the
+// encoder gives up on its job at the next level boundary.
+void atf_mem_set_limit(size_t limit);
+int  atf_mem_exceeded(void);
+
+const char *atf_mem_name(int subsystem);
+
+#ifdef __cplusplus
+}
+#endif //#ifdef __cplusplus
+
+#endif //#ifndef _ATFMEM_H_
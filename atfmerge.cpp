@@ -0,0 +1,138 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif //#ifdef _MSC_VER
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif //#ifndef _MSC_VER
+
+#include "atfindex.h"
+#include "atfrepack.h"
+
+using namespace std;
+
+void print_usage()
+{
+	cout << "\natfmerge V0.4 Copyright 2010-2012 Adobe Systems Inc. All rights reserved.\n\n";
+	cout << "\nUsage: atfmerge [-d dxt.atf] [-p pvrtc.atf] [-e etc1.atf] [-x] -o output.atf\n\n";
+	cout << "   -d  ATF file providing the DXT1/DXT5 data.\n";
+	cout << "   -p  ATF file providing the PVRTC data.\n";
+	cout << "   -e  ATF file providing the ETC1 data.\n";
+	cout << "   -x  Write a .atfidx sidecar file for the output.\n\n";
+	cout << "All inputs need to have the same type, size and mip map count. Level data is copied as is, nothing is re-encoded.\n\n";
+}
+
+static ifstream ifiles[ATF_GROUP_COUNT];
+static ofstream ofile;
+
+int main(int argc, char *argv[]) {
+
+	const char *ifilenames[ATF_GROUP_COUNT] = { 0, 0, 0 };
+	const char *ofilename = 0;
+	bool writeIndex = false;
+
+	if ( argc > 1) {
+		for (int32_t c = 1; c < argc; c++) {
+			if (argv[c][0] == '-') {
+				if (argv[c][1] == 'd' && c+1 < argc) {
+					ifilenames[ATF_GROUP_DXT] = argv[c+1];
+				} else if (argv[c][1] == 'p' && c+1 < argc) {
+					ifilenames[ATF_GROUP_PVRTC] = argv[c+1];
+				} else if (argv[c][1] == 'e' && c+1 < argc) {
+					ifilenames[ATF_GROUP_ETC1] = argv[c+1];
+				} else if (argv[c][1] == 'x') {
+					writeIndex = true;
+				} else if (argv[c][1] == 'o' && c+1 < argc) {
+					ofilename = argv[c+1];
+				}
+			}
+		}
+
+		if ( !ifilenames[ATF_GROUP_DXT] && !ifilenames[ATF_GROUP_PVRTC] && !ifilenames[ATF_GROUP_ETC1] ) {
+			cerr << "No input file provided.\n";
+			goto printusage;
+		}
+
+		if ( !ofilename || strlen(ofilename) == 0 ) {
+			cerr << "No output file provided.\n";
+			goto printusage;
+		}
+
+		istream *atf[ATF_GROUP_COUNT] = { 0, 0, 0 };
+		ATFLayout layouts[ATF_GROUP_COUNT];
+		const ATFLayout *layout[ATF_GROUP_COUNT] = { 0, 0, 0 };
+
+		for ( int32_t g=0; g<ATF_GROUP_COUNT; g++) {
+			if ( !ifilenames[g] ) {
+				continue;
+			}
+			ifiles[g].open(ifilenames[g],ios::in|ios::binary);
+			if ( !ifiles[g].is_open() ) {
+				cerr << "Could not open input file. '";
+				cerr << ifilenames[g];
+				cerr << "'\n\n";
+				return -1;
+			}
+			if ( !atf_load_layout(ifilenames[g],ifiles[g],layouts[g]) ) {
+				cerr << "Input file not a valid ATF file. '";
+				cerr << ifilenames[g];
+				cerr << "'\n\n";
+				return -1;
+			}
+			atf[g] = &ifiles[g];
+			layout[g] = &layouts[g];
+		}
+
+		ofile.open(ofilename,ios::out|ios::binary);
+		if ( !ofile.is_open() ) {
+			cerr << "Could not open output file. '";
+			cerr << ofilename;
+			cerr << "'\n\n";
+			return -1;
+		}
+
+		if ( !atf_merge(atf,layout,ofile) ) {
+			ofile.close();
+			remove(ofilename);
+			return -1;
+		}
+
+		ofile.close();
+		if ( !writeIndex ) {
+			remove(atf_index_name(ofilename).c_str());
+		} else if ( !atf_write_index_file(ofilename) ) {
+			return -1;
+		}
+		return 0;
+	}
+printusage:
+	print_usage();
+	return -1;
+}
@@ -0,0 +1,396 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif //#ifdef _MSC_VER
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif //#ifndef _MSC_VER
+
+#include "3rdparty/jpegxr/jpegxr.h"
+#include "3rdparty/jpegxr/jxr_priv.h"
+#include "3rdparty/lzma/LzmaLib.h"
+#include "atfgen.h"
+#include "atfmicro.h"
+#include "atfthread.h"
+
+using namespace std;
+
+//
+// Microbenchmarks of the encoder's inner kernels: JPEG-XR bit emission, the
+// PCT and prefilter transforms the strip encoder (w_strip.cpp) runs on every
+// macroblock, the block gathers which feed DXT1, PVRTC and ETC1 colour planes
+// into JPEG-XR, PVRTC twiddling and LZMA on DXT index planes. All inputs are
+// fixed, every kernel is repeated until the minimum time has passed.
+//
+
+extern ATF_THREAD_LOCAL bool gSilent;
+
+void print_usage()
+{
+	cout << "\natfmicro V0.1 Copyright 2010-2012 Adobe Systems Inc. All rights reserved.\n\n";
+	cout << "\nUsage: atfmicro [-f <filter>] [-t <seconds>]\n\n";
+	cout << "Times the encoder's inner kernels on fixed inputs and reports ns per operation and MB/s.\n\n";
+	cout << "   -f  Only kernels whose name contains filter, e.g. -f gather.\n";
+	cout << "   -t  Minimum time spent per kernel. 0.2 by default.\n\n";
+}
+
+// Plane sizes: a 512x512 DXT texture has 128x128 blocks, split into a
+// 128x256 colour image (both block colours) and a 64KB index plane.
+static const int32_t BLOCKS = 128;
+static const int32_t PLANE_W = BLOCKS;
+static const int32_t PLANE_H = BLOCKS * 2;
+static const int32_t COEFF_MBS = 256;		// macroblocks of transform input, 256KB
+static const int32_t BITS_COUNT = 1<<16;	// values per bit emission pass
+
+struct MicroInput {
+	vector<uint16_t>	dxt1Col;
+	vector<uint8_t>		dxt1Bit;
+	vector<uint16_t>	pvrtcCol;
+	vector<uint32_t>	etc1Col;
+	vector<uint8_t>		etc1D0;
+	vector<int>			coeffSrc;
+	vector<int>			coeff;
+	vector<uint32_t>	bitValues;
+	vector<int>			bitWidths;
+	double				bitBytes;	// bytes the codes fill
+	vector<uint8_t>		lzmaBuffer;
+};
+
+static uint32_t micro_random(uint32_t &seed)
+{
+	seed = seed * 1664525 + 1013904223;
+	return seed >> 8;
+}
+
+static void micro_input(MicroInput &in)
+{
+	// DXT1 planes come from a generated photo like texture
+	ATFGenSpec spec = { ATF_GEN_DXT1, BLOCKS * 4, false, false, ATF_GEN_PHOTO };
+	vector<uint8_t> dds;
+	atf_gen_dds(spec,dds);
+	const uint8_t *src = &dds[128];
+	int32_t blocks = BLOCKS * BLOCKS;
+	in.dxt1Col.resize(blocks*2);
+	in.dxt1Bit.resize(blocks*4);
+	for ( int32_t b=0; b<blocks; b++, src += 8) {
+		in.dxt1Col[b] = uint16_t(src[0] | (src[1]<<8));
+		in.dxt1Col[b+blocks] = uint16_t(src[2] | (src[3]<<8));
+		memcpy(&in.dxt1Bit[b*4],src+4,4);
+	}
+	in.lzmaBuffer.resize(in.dxt1Bit.size()*2+LZMA_PROPS_SIZE+4096);
+
+	uint32_t seed = 1;
+	in.pvrtcCol.resize(PLANE_W*PLANE_H);
+	in.etc1Col.resize(PLANE_W*PLANE_H);
+	in.etc1D0.resize(PLANE_W*PLANE_H);
+	for ( int32_t c=0; c<PLANE_W*PLANE_H; c++) {
+		in.pvrtcCol[c] = uint16_t(micro_random(seed));
+		in.etc1Col[c] = micro_random(seed) & 0xFFFFFF;
+		in.etc1D0[c] = uint8_t(micro_random(seed) & 3);
+	}
+
+	in.coeffSrc.resize(COEFF_MBS*256);
+	for ( size_t c=0; c<in.coeffSrc.size(); c++) {
+		in.coeffSrc[c] = int(micro_random(seed) & 0x1FF) - 256;
+	}
+	in.coeff = in.coeffSrc;
+
+	// code lengths like the VLC tables emit them, mostly short codes
+	in.bitValues.resize(BITS_COUNT);
+	in.bitWidths.resize(BITS_COUNT);
+	in.bitBytes = 0;
+	for ( int32_t c=0; c<BITS_COUNT; c++) {
+		int32_t n = 1 + int32_t(micro_random(seed) % 4) + int32_t(micro_random(seed) % 13);
+		in.bitWidths[c] = n;
+		in.bitValues[c] = micro_random(seed) & ((1u<<n)-1);
+		in.bitBytes += n / 8.0;
+	}
+}
+
+typedef uint32_t (*micro_kernel)(MicroInput &in, int32_t iterations);
+
+struct MicroBench {
+	const char	   *name;
+	micro_kernel	kernel;
+	const char	   *op;			// what one operation is
+	double			ops;		// operations per iteration
+	double			bytes;		// bytes processed per iteration
+};
+
+static uint32_t bench_wbitstream_uint1(MicroInput &in, int32_t iterations)
+{
+	uint32_t sum = 0;
+	for ( int32_t c=0; c<iterations; c++) {
+		struct wbitstream str;
+		_jxr_wbitstream_initialize(&str);
+		for ( int32_t i=0; i<BITS_COUNT; i++) {
+			_jxr_wbitstream_uint1(&str,in.bitValues[i]&1);
+		}
+		_jxr_wbitstream_flush(&str);
+		sum += uint32_t(str.write_count);
+	}
+	return sum;
+}
+
+static uint32_t bench_wbitstream_uint8(MicroInput &in, int32_t iterations)
+{
+	uint32_t sum = 0;
+	for ( int32_t c=0; c<iterations; c++) {
+		struct wbitstream str;
+		_jxr_wbitstream_initialize(&str);
+		_jxr_wbitstream_uint1(&str,1);	// unaligned, like most of the bitstream
+		for ( int32_t i=0; i<BITS_COUNT; i++) {
+			_jxr_wbitstream_uint8(&str,uint8_t(in.bitValues[i]));
+		}
+		_jxr_wbitstream_flush(&str);
+		sum += uint32_t(str.write_count);
+	}
+	return sum;
+}
+
+static uint32_t bench_wbitstream_uintN(MicroInput &in, int32_t iterations)
+{
+	uint32_t sum = 0;
+	for ( int32_t c=0; c<iterations; c++) {
+		struct wbitstream str;
+		_jxr_wbitstream_initialize(&str);
+		for ( int32_t i=0; i<BITS_COUNT; i++) {
+			_jxr_wbitstream_uintN(&str,in.bitValues[i],in.bitWidths[i]);
+		}
+		_jxr_wbitstream_flush(&str);
+		sum += uint32_t(str.write_count);
+	}
+	return sum;
+}
+
+static uint32_t bench_wbitstream_uint32(MicroInput &in, int32_t iterations)
+{
+	uint32_t sum = 0;
+	for ( int32_t c=0; c<iterations; c++) {
+		struct wbitstream str;
+		_jxr_wbitstream_initialize(&str);
+		_jxr_wbitstream_uint1(&str,1);
+		for ( int32_t i=0; i<BITS_COUNT; i++) {
+			_jxr_wbitstream_uint32(&str,in.bitValues[i]);
+		}
+		_jxr_wbitstream_flush(&str);
+		sum += uint32_t(str.write_count);
+	}
+	return sum;
+}
+
+// The transforms work in place, every pass starts over from the same input.
+static void reset_coeff(MicroInput &in)
+{
+	memcpy(&in.coeff[0],&in.coeffSrc[0],in.coeff.size()*sizeof(int));
+}
+
+static uint32_t bench_pct_4x4(MicroInput &in, int32_t iterations)
+{
+	uint32_t sum = 0;
+	for ( int32_t c=0; c<iterations; c++) {
+		reset_coeff(in);
+		for ( size_t b=0; b<in.coeff.size(); b+=16) {
+			_jxr_4x4PCT(&in.coeff[b]);
+		}
+		sum += in.coeff[c&0xFF];
+	}
+	return sum;
+}
+
+// The coefficients as one 256 wide plane, the prefilters straddle the 4x4
+// block edges like first_prefilter444_up2 and second_prefilter444_up1 apply them.
+static const int32_t COEFF_W = 256;
+
+static int *at(MicroInput &in, int32_t x, int32_t y)
+{
+	return &in.coeff[y*COEFF_W+x];
+}
+
+static uint32_t bench_prefilter_4x4(MicroInput &in, int32_t iterations)
+{
+	int32_t h = int32_t(in.coeff.size()) / COEFF_W;
+	uint32_t sum = 0;
+	for ( int32_t c=0; c<iterations; c++) {
+		reset_coeff(in);
+		for ( int32_t y=2; y+4<=h; y+=4) {
+			for ( int32_t x=2; x+4<=COEFF_W; x+=4) {
+				_jxr_4x4PreFilter(at(in,x,y+0),at(in,x+1,y+0),at(in,x+2,y+0),at(in,x+3,y+0),
+								  at(in,x,y+1),at(in,x+1,y+1),at(in,x+2,y+1),at(in,x+3,y+1),
+								  at(in,x,y+2),at(in,x+1,y+2),at(in,x+2,y+2),at(in,x+3,y+2),
+								  at(in,x,y+3),at(in,x+1,y+3),at(in,x+2,y+3),at(in,x+3,y+3));
+			}
+		}
+		sum += in.coeff[c&0xFF];
+	}
+	return sum;
+}
+
+static uint32_t bench_prefilter_4(MicroInput &in, int32_t iterations)
+{
+	int32_t h = int32_t(in.coeff.size()) / COEFF_W;
+	uint32_t sum = 0;
+	for ( int32_t c=0; c<iterations; c++) {
+		reset_coeff(in);
+		for ( int32_t y=2; y+4<=h; y+=4) {
+			for ( int32_t x=0; x<COEFF_W; x++) {
+				_jxr_4PreFilter(at(in,x,y),at(in,x,y+1),at(in,x,y+2),at(in,x,y+3));
+			}
+		}
+		sum += in.coeff[c&0xFF];
+	}
+	return sum;
+}
+
+static uint32_t bench_prefilter_2x2(MicroInput &in, int32_t iterations)
+{
+	int32_t h = int32_t(in.coeff.size()) / COEFF_W;
+	uint32_t sum = 0;
+	for ( int32_t c=0; c<iterations; c++) {
+		reset_coeff(in);
+		for ( int32_t y=1; y+2<=h; y+=2) {
+			for ( int32_t x=1; x+2<=COEFF_W; x+=2) {
+				_jxr_2x2PreFilter(at(in,x,y),at(in,x+1,y),at(in,x,y+1),at(in,x+1,y+1));
+			}
+		}
+		sum += in.coeff[c&0xFF];
+	}
+	return sum;
+}
+
+static uint32_t bench_gather_dxt1(MicroInput &in, int32_t iterations)
+{
+	return micro_block_gather("DXT1",&in.dxt1Col[0],0,PLANE_W,PLANE_H,iterations);
+}
+
+static uint32_t bench_gather_pvrtc(MicroInput &in, int32_t iterations)
+{
+	return micro_block_gather("PVRTC",&in.pvrtcCol[0],0,PLANE_W,PLANE_H,iterations);
+}
+
+static uint32_t bench_gather_etc1(MicroInput &in, int32_t iterations)
+{
+	return micro_block_gather("ETC1",&in.etc1Col[0],&in.etc1D0[0],PLANE_W,PLANE_H,iterations);
+}
+
+static uint32_t bench_twiddle(MicroInput &, int32_t iterations)
+{
+	return micro_twiddle(PLANE_W,PLANE_H/2,iterations);
+}
+
+static uint32_t bench_lzma_dxt1_index(MicroInput &in, int32_t iterations)
+{
+	uint32_t sum = 0;
+	for ( int32_t c=0; c<iterations; c++) {
+		sum += uint32_t(LzmaSlowCompress(&in.dxt1Bit[0],&in.lzmaBuffer[0],in.dxt1Bit.size()));
+	}
+	return sum;
+}
+
+int main(int argc, char *argv[]) {
+
+	double minSeconds = 0.2;
+	const char *filter = 0;
+
+	for (int32_t c = 1; c < argc; c++) {
+		if (argv[c][0] != '-') {
+			continue;
+		}
+		if (argv[c][1] == 'f' && c+1 < argc) {
+			filter = argv[c+1];
+		} else if (argv[c][1] == 't' && c+1 < argc) {
+			std::istringstream s(argv[c+1]);
+			s >> minSeconds;
+		} else {
+			print_usage();
+			return -1;
+		}
+	}
+
+	gSilent = true;
+
+	MicroInput in;
+	micro_input(in);
+
+	double coeffs = double(COEFF_MBS*256);
+	double macroblocks = double((PLANE_W/16)*(PLANE_H/16));
+	MicroBench benches[] = {
+		{ "wbitstream_uint1",		bench_wbitstream_uint1,		"bit",		BITS_COUNT,			BITS_COUNT / 8.0 },
+		{ "wbitstream_uint8",		bench_wbitstream_uint8,		"byte",		BITS_COUNT,			BITS_COUNT },
+		{ "wbitstream_uintN",		bench_wbitstream_uintN,		"code",		BITS_COUNT,			in.bitBytes },
+		{ "wbitstream_uint32",		bench_wbitstream_uint32,	"word",		BITS_COUNT,			BITS_COUNT * 4.0 },
+		{ "pct_4x4",				bench_pct_4x4,				"block",	coeffs / 16,		coeffs * sizeof(int) },
+		{ "prefilter_4x4",			bench_prefilter_4x4,		"block",	coeffs / 16,		coeffs * sizeof(int) },
+		{ "prefilter_2x2",			bench_prefilter_2x2,		"block",	coeffs / 4,			coeffs * sizeof(int) },
+		{ "prefilter_4",			bench_prefilter_4,			"column",	coeffs / 4,			coeffs * sizeof(int) },
+		{ "gather_dxt1",			bench_gather_dxt1,			"mb",		macroblocks,		PLANE_W * PLANE_H * sizeof(uint16_t) },
+		{ "gather_pvrtc",			bench_gather_pvrtc,			"mb",		macroblocks,		PLANE_W * PLANE_H * sizeof(uint16_t) },
+		{ "gather_etc1",			bench_gather_etc1,			"mb",		macroblocks,		PLANE_W * PLANE_H * (sizeof(uint32_t) + 1) },
+		{ "twiddle",				bench_twiddle,				"index",	PLANE_W * PLANE_H / 2,	PLANE_W * PLANE_H / 2 * sizeof(uint16_t) },
+		{ "lzma_dxt1_index",		bench_lzma_dxt1_index,		"plane",	1,					double(in.dxt1Bit.size()) },
+	};
+
+	int32_t count = 0;
+	for ( size_t b=0; b<sizeof(benches)/sizeof(benches[0]); b++) {
+		const MicroBench &bench = benches[b];
+		if ( filter && !strstr(bench.name,filter) ) {
+			continue;
+		}
+		count++;
+
+		// doubles the iterations until minSeconds have passed
+		volatile uint32_t sink = bench.kernel(in,1);	// warm up
+		int32_t iterations = 1;
+		double seconds = 0;
+		for (;;) {
+			double start = atf_wall_time();
+			sink += bench.kernel(in,iterations);
+			seconds = atf_wall_time() - start;
+			if ( seconds >= minSeconds || iterations >= (1<<30) ) {
+				break;
+			}
+			iterations *= ( seconds < minSeconds / 16 ) ? 8 : 2;
+		}
+
+		double ops = bench.ops * iterations;
+		double bytes = bench.bytes * iterations;
+		cout << left << setw(20) << bench.name << right;
+		cout << fixed << setprecision(2) << setw(12) << seconds * 1e9 / ops << " ns/" << left << setw(8) << bench.op << right;
+		cout << setw(10) << bytes / (1024.0 * 1024.0) / max(seconds,1e-9) << " MB/s\n";
+		cout.unsetf(ios::floatfield);
+		cout.flush();
+	}
+
+	if ( count == 0 ) {
+		cerr << "No kernel matches the filter.\n";
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,44 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _ATFMICRO_H_
+#define _ATFMICRO_H_
+
+#include <stddef.h>
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif //#ifndef _MSC_VER
+
+//
+// Encoder kernels atfmicro times on their own, defined in pvr2atfcore.cpp.
+//
+
+// LZMA with the settings the encoder uses for block data planes, returns the compressed size.
+size_t LzmaSlowCompress(uint8_t *src, uint8_t *dst, size_t len);
+
+// Gathers every macroblock of a w x h "DXT1", "PVRTC" or "ETC1" colour plane iterations times.
+uint32_t micro_block_gather(const char *format, void *col, uint8_t *d0, int32_t w, int32_t h, int32_t iterations);
+
+// PVRTC twiddles every block of a w x h block image iterations times.
+uint32_t micro_twiddle(int32_t w, int32_t h, int32_t iterations);
+
+#endif //#ifndef _ATFMICRO_H_
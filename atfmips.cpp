@@ -0,0 +1,110 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif //#ifdef _MSC_VER
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif //#ifndef _MSC_VER
+
+#include "atfmips.h"
+
+using namespace std;
+
+static int32_t log2(int32_t x) {
+	return	((((x) & 0xAAAAAAAA)?1:0)     )|
+			((((x) & 0xCCCCCCCC)?1:0) << 1)|
+			((((x) & 0xF0F0F0F0)?1:0) << 2)|
+			((((x) & 0xFF00FF00)?1:0) << 3)|
+			((((x) & 0xFFFF0000)?1:0) << 4);
+}
+
+int32_t atf_mip_max_levels(int32_t width, int32_t height)
+{
+	return max(log2(width),log2(height)) + 1;
+}
+
+void atf_mip_level(int32_t format, int32_t width, int32_t height, ATFMipLevel &level)
+{
+	level.width  = max(1,width);
+	level.height = max(1,height);
+	level.offset = 0;
+
+	switch ( format ) {
+		case	ATF_MIP_L8:
+		case	ATF_MIP_RGB8:
+		case	ATF_MIP_RGBA8:
+				level.blocksw = level.width;
+				level.blocksh = level.height;
+				level.length  = level.blocks() * ( format == ATF_MIP_L8 ? 1 : ( format == ATF_MIP_RGB8 ? 3 : 4 ) );
+				return;
+		case	ATF_MIP_PVRTC4: {
+				const int32_t PVRTC4_MIN_TEXWIDTH = 8;
+				level.blocksw = max(PVRTC4_MIN_TEXWIDTH,level.width) / 4;
+				level.blocksh = max(PVRTC4_MIN_TEXWIDTH,level.height) / 4;
+				level.length  = level.blocks() * 8;
+				return;
+			}
+	}
+
+	level.blocksw = max(1,level.width/4);
+	level.blocksh = max(1,level.height/4);
+	level.length  = level.blocks() * ( ( format == ATF_MIP_DXT5 || format == ATF_MIP_ETC1_ALPHA ) ? 16 : 8 );
+}
+
+void atf_mip_chain(int32_t format, int32_t width, int32_t height, int32_t count, int32_t faces, ATFMipChain &chain)
+{
+	chain.format = format;
+	chain.faces  = faces;
+	chain.count  = max(0,min(count,atf_mip_max_levels(width,height)));
+	chain.base   = 0;
+	for ( int32_t i=0; i<6; i++) {
+		chain.order[i] = i;
+	}
+
+	chain.levels.resize(chain.count);
+	chain.faceLength = 0;
+	for ( int32_t c=0; c<chain.count; c++) {
+		ATFMipLevel &level = chain.levels[c];
+		atf_mip_level(format,width>>c,height>>c,level);
+		level.offset = chain.faceLength;
+		chain.faceLength += level.length;
+	}
+}
+
+bool atf_mip_truncate(ATFMipChain &chain, size_t available)
+{
+	int32_t count = 0;
+	size_t faceLength = 0;
+	while ( count < chain.count && ( faceLength + chain.levels[count].length ) * chain.faces <= available ) {
+		faceLength += chain.levels[count].length;
+		count++;
+	}
+	chain.count = count;
+	chain.faceLength = uint32_t(faceLength);
+	chain.levels.resize(count);
+	return count > 0;
+}
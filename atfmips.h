@@ -0,0 +1,100 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef _ATFMIPS_H_
+#define _ATFMIPS_H_
+
+#include <vector>
+
+//
+// Mip chain layout of an input texture. The chain is computed once from the
+// texture size and pixel format and lists for every level its size, its 4x4
+// block counts and where its data lives in the input, so the DDS front end
+// and the encoder do not have to walk the chain themselves.
+//
+// Faces are stored one after the other, each holding all of its levels:
+//
+// faces * [
+// count * [
+// U8[length] - level data
+// ]
+// ]
+//
+
+enum {
+	ATF_MIP_L8,				// 1 byte per texel
+	ATF_MIP_RGB8,			// 3 bytes per texel
+	ATF_MIP_RGBA8,			// 4 bytes per texel
+	ATF_MIP_DXT1,			// 8 bytes per 4x4 block
+	ATF_MIP_DXT5,			// 16 bytes per 4x4 block
+	ATF_MIP_PVRTC4,			// 8 bytes per 4x4 block, levels are padded to 8x8 texels
+	ATF_MIP_ETC1,			// 8 bytes per 4x4 block
+	ATF_MIP_ETC1_ALPHA,		// ETC1 color blocks followed by as many ETC1 alpha blocks
+};
+
+struct ATFMipLevel {
+	int32_t			width;		// size of the level in texels, at least 1
+	int32_t			height;
+	int32_t			blocksw;	// number of 4x4 blocks (texels for uncompressed formats)
+	int32_t			blocksh;
+	uint32_t		offset;		// offset of the level data from the start of its face
+	uint32_t		length;		// length of the level data, also the length of a raw block sub-stream
+
+	int32_t blocks() const { return blocksw * blocksh; }
+};
+
+struct ATFMipChain {
+	int32_t			format;		// ATF_MIP_*
+	int32_t			faces;
+	int32_t			count;		// number of levels per face
+	uint32_t		base;		// offset of the first face in the input
+	uint32_t		faceLength;	// length of all levels of one face
+	int32_t			order[6];	// input position of each face in ATF face order
+	std::vector<ATFMipLevel> levels;
+
+	const ATFMipLevel &level(int32_t level) const {
+		return levels[level];
+	}
+	uint32_t offset(int32_t face, int32_t level) const {
+		return base + faceLength * order[face] + levels[level].offset;
+	}
+	uint32_t length() const {
+		return faceLength * faces;
+	}
+};
+
+// Number of levels of a full chain for the given size (log2 of the larger side + 1).
+int32_t atf_mip_max_levels(int32_t width, int32_t height);
+
+// Fills level with the size, block counts and data length of a single level.
+void atf_mip_level(int32_t format, int32_t width, int32_t height, ATFMipLevel &level);
+
+// Computes the chain of count levels (capped to a full chain) for the given
+// top level size. base is 0 and faces are in input order, callers that read
+// from a file with a header or a different face order set these afterwards.
+void atf_mip_chain(int32_t format, int32_t width, int32_t height, int32_t count, int32_t faces, ATFMipChain &chain);
+
+// Drops the levels whose data does not fit into available bytes for all faces.
+// Returns false if not even the top level fits.
+bool atf_mip_truncate(ATFMipChain &chain, size_t available);
+
+#endif //#ifndef _ATFMIPS_H_
@@ -0,0 +1,270 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#include <process.h>
+#endif //#ifdef _MSC_VER
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif //#ifndef _MSC_VER
+
+#include "atfoutput.h"
+#include "atfthread.h"
+
+using namespace std;
+
+ATFBuffer::ATFBuffer()
+{
+	setp(0,0);
+	setg(0,0,0);
+}
+
+void ATFBuffer::grow(size_t len)
+{
+	size_t used = size();
+	size_t gpos = size_t(gptr() - eback());
+	if ( len <= m_data.size() ) {
+		return;
+	}
+	m_data.resize(len);
+	char *base = &m_data[0];
+	setp(base,base+m_data.size());
+	// pbump takes an int, ATF files are limited to 16MB
+	pbump(int(used));
+	setg(base,base+gpos,base+used);
+}
+
+void ATFBuffer::reserve(size_t len)
+{
+	grow(len);
+}
+
+ATFBuffer::int_type ATFBuffer::overflow(int_type c)
+{
+	if ( traits_type::eq_int_type(c,traits_type::eof()) ) {
+		return traits_type::not_eof(c);
+	}
+	grow(max(size_t(4096),m_data.size()*2));
+	*pptr() = traits_type::to_char_type(c);
+	pbump(1);
+	return c;
+}
+
+streamsize ATFBuffer::xsputn(const char *s, streamsize n)
+{
+	if ( n <= 0 ) {
+		return 0;
+	}
+	if ( size() + size_t(n) > m_data.size() ) {
+		grow(max(size() + size_t(n),m_data.size()*2));
+	}
+	memcpy(pptr(),s,size_t(n));
+	pbump(int(n));
+	return n;
+}
+
+ATFBuffer::int_type ATFBuffer::underflow()
+{
+	if ( !m_data.empty() ) {
+		setg(eback(),gptr(),pptr());
+	}
+	if ( gptr() < egptr() ) {
+		return traits_type::to_int_type(*gptr());
+	}
+	return traits_type::eof();
+}
+
+ATFBuffer::pos_type ATFBuffer::seekoff(off_type off, ios_base::seekdir dir, ios_base::openmode which)
+{
+	if ( which & ios_base::out ) {
+		// output is append only, only tellp is supported
+		if ( off != 0 || dir != ios_base::cur || ( which & ios_base::in ) ) {
+			return pos_type(off_type(-1));
+		}
+		return pos_type(off_type(size()));
+	}
+	off_type base = 0;
+	if ( dir == ios_base::cur ) {
+		base = gptr() - eback();
+	} else if ( dir == ios_base::end ) {
+		base = off_type(size());
+	}
+	return seekpos(pos_type(base + off),which);
+}
+
+ATFBuffer::pos_type ATFBuffer::seekpos(pos_type pos, ios_base::openmode which)
+{
+	off_type off = off_type(pos);
+	if ( ( which & ios_base::out ) || off < 0 || off > off_type(size()) ) {
+		return pos_type(off_type(-1));
+	}
+	if ( m_data.empty() ) {
+		return pos_type(0);
+	}
+	setg(&m_data[0],&m_data[0]+off,pptr());
+	return pos;
+}
+
+// Unique per process and call, so concurrent writers never share a temp file.
+static string output_name(const char *filename, int32_t flags)
+{
+	static atf_mutex tempMutex;
+	static uint32_t tempCount = 0;
+
+	if ( !( flags & ATF_OUTPUT_ATOMIC ) ) {
+		return filename;
+	}
+
+	tempMutex.lock();
+	uint32_t count = tempCount++;
+	tempMutex.unlock();
+
+#ifdef _MSC_VER
+	int32_t pid = _getpid();
+#else
+	int32_t pid = getpid();
+#endif //#ifdef _MSC_VER
+
+	std::ostringstream tmpname;
+	tmpname << filename << "." << pid << "." << count << ".tmp";
+	return tmpname.str();
+}
+
+#ifdef _MSC_VER
+
+bool atf_write_output(const char *filename, const uint8_t *data, size_t len, int32_t flags)
+{
+	string name = output_name(filename,flags);
+
+	ofstream ofile(name.c_str(),ios::out|ios::binary);
+	if ( !ofile.is_open() ) {
+		cerr << "Could not open output file. '" << name << "'\n\n";
+		return false;
+	}
+	ofile.write((const char *)data,len);
+	ofile.close();
+	if ( ofile.fail() ) {
+		cerr << "Could not write output file. '" << name << "'\n\n";
+		remove(name.c_str());
+		return false;
+	}
+	if ( ( flags & ATF_OUTPUT_ATOMIC ) && !MoveFileExA(name.c_str(),filename,MOVEFILE_REPLACE_EXISTING) ) {
+		cerr << "Could not replace output file. '" << filename << "'\n\n";
+		remove(name.c_str());
+		return false;
+	}
+	return true;
+}
+
+#else
+
+static bool write_all(int fd, const uint8_t *data, size_t len)
+{
+	while ( len ) {
+		ssize_t written = write(fd,data,len);
+		if ( written < 0 && errno == EINTR ) {
+			continue;
+		}
+		if ( written <= 0 ) {
+			return false;
+		}
+		data += written;
+		len -= written;
+	}
+	return true;
+}
+
+// O_DIRECT needs block aligned buffers and lengths, so the data is written
+// padded to the block size and the file truncated to its real length.
+static bool write_direct(int fd, const uint8_t *data, size_t len)
+{
+#ifdef O_DIRECT
+	const size_t align = 4096;
+	size_t padded = ( len + align - 1 ) & ~( align - 1 );
+	void *buffer = 0;
+	if ( posix_memalign(&buffer,align,max(padded,align)) != 0 ) {
+		return false;
+	}
+	memcpy(buffer,data,len);
+	memset((uint8_t *)buffer+len,0,padded-len);
+	bool ok = write_all(fd,(const uint8_t *)buffer,padded) && ftruncate(fd,len) == 0;
+	free(buffer);
+	return ok;
+#else
+	return write_all(fd,data,len);
+#endif //#ifdef O_DIRECT
+}
+
+bool atf_write_output(const char *filename, const uint8_t *data, size_t len, int32_t flags)
+{
+	string name = output_name(filename,flags);
+
+	int fd = -1;
+	bool direct = false;
+#ifdef O_DIRECT
+	if ( flags & ATF_OUTPUT_DIRECT ) {
+		fd = open(name.c_str(),O_WRONLY|O_CREAT|O_TRUNC|O_DIRECT,0666);
+		direct = fd >= 0;
+	}
+#endif //#ifdef O_DIRECT
+	if ( fd < 0 ) {
+		// no O_DIRECT on this platform or file system (e.g. tmpfs)
+		fd = open(name.c_str(),O_WRONLY|O_CREAT|O_TRUNC,0666);
+	}
+	if ( fd < 0 ) {
+		cerr << "Could not open output file. '" << name << "'\n\n";
+		return false;
+	}
+
+	bool ok = direct ? write_direct(fd,data,len) : write_all(fd,data,len);
+	if ( close(fd) != 0 ) {
+		ok = false;
+	}
+	if ( !ok ) {
+		cerr << "Could not write output file. '" << name << "'\n\n";
+		remove(name.c_str());
+		return false;
+	}
+	if ( ( flags & ATF_OUTPUT_ATOMIC ) && rename(name.c_str(),filename) != 0 ) {
+		cerr << "Could not replace output file. '" << filename << "'\n\n";
+		remove(name.c_str());
+		return false;
+	}
+	return true;
+}
+
+#endif //#ifdef _MSC_VER
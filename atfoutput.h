@@ -0,0 +1,64 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _ATFOUTPUT_H_
+#define _ATFOUTPUT_H_
+
+#include <iostream>
+#include <vector>
+
+//
+// ATF files are assembled in memory and written out with a single write.
+//
+
+// Contiguous memory stream. Writes append to one growable block, reads see
+// everything written so far, so a finished ATF file can be parsed and copied
+// out of it without another copy.
+class ATFBuffer : public std::streambuf {
+	public:
+		ATFBuffer();
+
+		void reserve(size_t len);
+
+		uint8_t *data() { return m_data.empty() ? 0 : (uint8_t *)&m_data[0]; }
+		size_t size() const { return size_t(pptr() - pbase()); }
+
+	protected:
+		virtual int_type overflow(int_type c);
+		virtual std::streamsize xsputn(const char *s, std::streamsize n);
+		virtual int_type underflow();
+		virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which);
+		virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+
+	private:
+		void grow(size_t len);
+
+		std::vector<char> m_data;
+};
+
+enum {
+	ATF_OUTPUT_ATOMIC	= 1,	// write to a temp file next to the output and rename it into place
+	ATF_OUTPUT_DIRECT	= 2		// bypass the page cache (O_DIRECT) where the file system supports it
+};
+
+bool atf_write_output(const char *filename, const uint8_t *data, size_t len, int32_t flags);
+
+#endif //#ifndef _ATFOUTPUT_H_
@@ -0,0 +1,435 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif //#ifdef _MSC_VER
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif //#ifndef _MSC_VER
+
+#include "atfcache.h"
+#include "atfgen.h"
+#include "atfsched.h"
+#include "atfstats.h"
+#include "atfthread.h"
+#include "libatf.h"
+
+using namespace std;
+
+//
+// Regression run over a golden corpus: every entry is converted serially,
+// timed and measured (output size, LZMA and JPEG-XR bytes, output hash), then
+// converted again with a pool of threads, which has to give the same bytes.
+// The numbers are compared against a baseline file, a run fails when an entry
+// got slower or bigger than the thresholds allow.
+//
+// The corpus file lists one entry per line: an atfgen name (see atfgen.h),
+// which is generated in memory, or a .dds path relative to the corpus file,
+// optionally followed by -q <0-100>. '#' starts a comment.
+//
+// Baseline file, one line per entry:
+//
+//   <entry> <quality> <insize> <ms> <outfilesize> <outlzmasize> <jxrbytes> <hash>
+//
+
+extern ATF_THREAD_LOCAL size_t	outfilesize;
+extern ATF_THREAD_LOCAL size_t	outlzmasize;
+
+void print_usage()
+{
+	cout << "\natfregress V0.1 Copyright 2010-2012 Adobe Systems Inc. All rights reserved.\n\n";
+	cout << "\nUsage: atfregress -c corpus.txt -b baseline.txt [-u] [-j <threads>] [-t <percent>] [-z <percent>] [-m <seconds>]\n\n";
+	cout << "Converts every entry of a golden corpus and compares time, output sizes and output hash against a baseline.\n\n";
+	cout << "   -c  Corpus file: one atfgen texture name or .dds path per line, optionally followed by -q <0-100>.\n";
+	cout << "   -b  Baseline file to compare against.\n";
+	cout << "   -u  Write the results to the baseline file instead of comparing.\n";
+	cout << "   -j  Threads of the parallel run whose output has to match the serial run, at least 2. Defaults to the number of CPUs.\n";
+	cout << "   -t  Allowed throughput drop in percent, 20 by default. 0 turns the check off, timings only compare on the same machine.\n";
+	cout << "   -z  Allowed size growth in percent for the output, LZMA and JPEG-XR bytes, 0 by default.\n";
+	cout << "   -m  Minimum time spent per entry, the fastest of the repeated conversions counts. 0.2 by default.\n\n";
+}
+
+struct RegressEntry {
+	string			name;
+	int32_t			quality;	// -1 for the dds2atf default
+	size_t			insize;
+	double			ms;
+	size_t			outfilesize;
+	size_t			outlzmasize;
+	size_t			jxrbytes;
+	string			hash;
+};
+
+static string hex_hash(const atf_buffer &atf)
+{
+	static const char hex[] = "0123456789abcdef";
+	uint64_t hash[2] = { 0, 0 };
+	atf_hash(atf.data,atf.size,hash);
+	string name;
+	for ( int32_t c=0; c<2; c++) {
+		for ( int32_t s=60; s>=0; s-=4) {
+			name += hex[(hash[c]>>s)&0xF];
+		}
+	}
+	return name;
+}
+
+static string entry_key(const string &name, int32_t quality)
+{
+	ostringstream key;
+	key << name << " " << quality;
+	return key.str();
+}
+
+static bool read_corpus(const char *filename, vector<RegressEntry> &entries)
+{
+	ifstream file(filename);
+	if ( !file.is_open() ) {
+		cerr << "Could not open corpus file. '" << filename << "'\n\n";
+		return false;
+	}
+	string line;
+	int32_t lineNumber = 0;
+	while ( getline(file,line) ) {
+		lineNumber++;
+		size_t comment = line.find('#');
+		if ( comment != string::npos ) {
+			line.erase(comment);
+		}
+		istringstream s(line);
+		RegressEntry entry;
+		if ( !( s >> entry.name ) ) {
+			continue;
+		}
+		entry.quality = -1;
+		string option;
+		while ( s >> option ) {
+			if ( option == "-q" && ( s >> entry.quality ) ) {
+				continue;
+			}
+			cerr << filename << ":" << lineNumber << ": unknown option '" << option << "'\n";
+			return false;
+		}
+		entries.push_back(entry);
+	}
+	if ( entries.empty() ) {
+		cerr << "Corpus file '" << filename << "' lists no entries.\n\n";
+		return false;
+	}
+	return true;
+}
+
+static bool load_entry(const RegressEntry &entry, const string &corpusDir, vector<uint8_t> &dds)
+{
+	ATFGenSpec spec;
+	if ( atf_gen_parse(entry.name,spec) ) {
+		atf_gen_dds(spec,dds);
+		return true;
+	}
+	string filename = entry.name;
+	if ( !corpusDir.empty() && filename[0] != '/' ) {
+		filename = corpusDir + "/" + filename;
+	}
+	ifstream file(filename.c_str(),ios::in|ios::binary);
+	if ( !file.is_open() ) {
+		cerr << "Could not open input file. '" << filename << "'\n";
+		return false;
+	}
+	dds.assign(istreambuf_iterator<char>(file),istreambuf_iterator<char>());
+	return !dds.empty();
+}
+
+static bool read_baseline(const char *filename, map<string,RegressEntry> &baseline)
+{
+	ifstream file(filename);
+	if ( !file.is_open() ) {
+		cerr << "Could not open baseline file. '" << filename << "' (Hint: create it with -u)\n\n";
+		return false;
+	}
+	string line;
+	while ( getline(file,line) ) {
+		if ( line.empty() || line[0] == '#' ) {
+			continue;
+		}
+		istringstream s(line);
+		RegressEntry entry;
+		if ( s >> entry.name >> entry.quality >> entry.insize >> entry.ms >> entry.outfilesize >> entry.outlzmasize >> entry.jxrbytes >> entry.hash ) {
+			baseline[entry_key(entry.name,entry.quality)] = entry;
+		}
+	}
+	return true;
+}
+
+static bool write_baseline(const char *filename, const vector<RegressEntry> &entries)
+{
+	ofstream file(filename,ios::out|ios::trunc);
+	if ( !file.is_open() ) {
+		cerr << "Could not write baseline file. '" << filename << "'\n\n";
+		return false;
+	}
+	file << "# <entry> <quality> <insize> <ms> <outfilesize> <outlzmasize> <jxrbytes> <hash>, written by atfregress -u\n";
+	for ( size_t c=0; c<entries.size(); c++) {
+		const RegressEntry &entry = entries[c];
+		file << entry.name << " " << entry.quality << " " << entry.insize << " ";
+		file << fixed << setprecision(3) << entry.ms;
+		file.unsetf(ios::floatfield);
+		file << " " << entry.outfilesize << " " << entry.outlzmasize << " " << entry.jxrbytes << " " << entry.hash << "\n";
+	}
+	return file.good();
+}
+
+// Serial conversion: the fastest of the repeated runs and the sizes of a run with statistics on.
+static bool measure_entry(RegressEntry &entry, const vector<uint8_t> &dds, double minSeconds)
+{
+	atf_options options;
+	atf_options_init(&options);
+	options.quality = entry.quality;
+
+	ATFStats stats;
+	atf_stats_reset(stats);
+	gStats = &stats;
+	atf_buffer atf = { 0, 0 };
+	int result = atf_convert_dds(&dds[0],dds.size(),&options,&atf);
+	gStats = 0;
+	if ( result != ATF_OK ) {
+		cerr << entry.name << ": " << atf_error_string(result) << "\n";
+		return false;
+	}
+
+	entry.insize = dds.size();
+	entry.outfilesize = outfilesize;
+	entry.outlzmasize = outlzmasize;
+	entry.jxrbytes = 0;
+	for ( size_t c=0; c<stats.streams.size(); c++) {
+		if ( stats.streams[c].stage == ATF_STAGE_JXR ) {
+			entry.jxrbytes += stats.streams[c].out;
+		}
+	}
+	entry.hash = hex_hash(atf);
+	atf_buffer_free(&atf);
+
+	double best = 0;
+	double start = atf_wall_time();
+	do {
+		double run = atf_wall_time();
+		result = atf_convert_dds(&dds[0],dds.size(),&options,&atf);
+		run = atf_wall_time() - run;
+		atf_buffer_free(&atf);
+		if ( result != ATF_OK ) {
+			cerr << entry.name << ": " << atf_error_string(result) << "\n";
+			return false;
+		}
+		if ( best == 0 || run < best ) {
+			best = run;
+		}
+	} while ( atf_wall_time() - start < minSeconds );
+	entry.ms = best * 1000.0;
+	return true;
+}
+
+// Percentage change from base to current, positive if current is bigger.
+static double percent(double base, double current)
+{
+	if ( base == 0 ) {
+		return current == 0 ? 0 : 100.0;
+	}
+	return ( current - base ) * 100.0 / base;
+}
+
+static bool check_size(const char *what, size_t base, size_t current, double sizeGrowth, ostringstream &notes)
+{
+	double growth = percent(double(base),double(current));
+	if ( growth > sizeGrowth ) {
+		notes << " " << what << " " << base << " -> " << current << " (+" << fixed << setprecision(2) << growth << "%)";
+		notes.unsetf(ios::floatfield);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+
+	const char *corpusName = 0;
+	const char *baselineName = 0;
+	bool update = false;
+	int32_t threads = atf_cpu_count();
+	double throughputDrop = 20;
+	double sizeGrowth = 0;
+	double minSeconds = 0.2;
+
+	for (int32_t c = 1; c < argc; c++) {
+		if (argv[c][0] != '-') {
+			continue;
+		}
+		if (argv[c][1] == 'c' && c+1 < argc) {
+			corpusName = argv[c+1];
+		} else if (argv[c][1] == 'b' && c+1 < argc) {
+			baselineName = argv[c+1];
+		} else if (argv[c][1] == 'u') {
+			update = true;
+		} else if (argv[c][1] == 'j' && c+1 < argc) {
+			std::istringstream s(argv[c+1]);
+			s >> threads;
+		} else if (argv[c][1] == 't' && c+1 < argc) {
+			std::istringstream s(argv[c+1]);
+			s >> throughputDrop;
+		} else if (argv[c][1] == 'z' && c+1 < argc) {
+			std::istringstream s(argv[c+1]);
+			s >> sizeGrowth;
+		} else if (argv[c][1] == 'm' && c+1 < argc) {
+			std::istringstream s(argv[c+1]);
+			s >> minSeconds;
+		} else {
+			print_usage();
+			return -1;
+		}
+	}
+
+	if ( !corpusName || !baselineName ) {
+		print_usage();
+		return -1;
+	}
+	// one thread would run every level inline, like the serial run
+	threads = max(2,threads);
+
+	vector<RegressEntry> entries;
+	if ( !read_corpus(corpusName,entries) ) {
+		return -1;
+	}
+	string corpusDir(corpusName);
+	size_t slash = corpusDir.find_last_of("/\\");
+	corpusDir = ( slash == string::npos ) ? string() : corpusDir.substr(0,slash);
+
+	map<string,RegressEntry> baseline;
+	if ( !update && !read_baseline(baselineName,baseline) ) {
+		return -1;
+	}
+
+	vector< vector<uint8_t> > inputs(entries.size());
+	int32_t failed = 0;
+	for ( size_t c=0; c<entries.size(); c++) {
+		if ( !load_entry(entries[c],corpusDir,inputs[c]) || !measure_entry(entries[c],inputs[c],minSeconds) ) {
+			entries[c].hash.clear();
+			failed++;
+		}
+	}
+
+	// the same conversions with a thread pool have to give the same bytes
+	vector<string> parallel(entries.size());
+	atf_sched_start(threads);
+	for ( size_t c=0; c<entries.size(); c++) {
+		if ( entries[c].hash.empty() ) {
+			continue;
+		}
+		atf_options options;
+		atf_options_init(&options);
+		options.quality = entries[c].quality;
+		atf_buffer atf = { 0, 0 };
+		if ( atf_convert_dds(&inputs[c][0],inputs[c].size(),&options,&atf) == ATF_OK ) {
+			parallel[c] = hex_hash(atf);
+		}
+		atf_buffer_free(&atf);
+	}
+	atf_sched_stop();
+
+	double baseTime = 0;
+	double currentTime = 0;
+	for ( size_t c=0; c<entries.size(); c++) {
+		const RegressEntry &entry = entries[c];
+		cout << left << setw(32) << entry_key(entry.name,entry.quality) << right;
+		if ( entry.hash.empty() ) {
+			cout << " FAILED: conversion error\n";
+			continue;
+		}
+		cout << setw(10) << entry.outfilesize << " bytes";
+		cout << fixed << setprecision(3) << setw(10) << entry.ms << " ms";
+		cout.unsetf(ios::floatfield);
+
+		ostringstream notes;
+		bool ok = true;
+		if ( parallel[c] != entry.hash ) {
+			notes << " output of " << threads << " threads differs from the serial output";
+			ok = false;
+		}
+		if ( !update ) {
+			map<string,RegressEntry>::const_iterator base = baseline.find(entry_key(entry.name,entry.quality));
+			if ( base == baseline.end() ) {
+				notes << " new";
+			} else {
+				const RegressEntry &b = base->second;
+				ok = check_size("size",b.outfilesize,entry.outfilesize,sizeGrowth,notes) && ok;
+				ok = check_size("lzma",b.outlzmasize,entry.outlzmasize,sizeGrowth,notes) && ok;
+				ok = check_size("jxr",b.jxrbytes,entry.jxrbytes,sizeGrowth,notes) && ok;
+				// throughput of the same input, so the time ratio will do. Entries
+				// below a millisecond are too short to time, they only count in the total.
+				double drop = -percent(entry.ms,b.ms);
+				if ( throughputDrop > 0 && b.ms >= 1.0 && drop > throughputDrop ) {
+					notes << " throughput " << fixed << setprecision(1) << -drop << "%";
+					notes.unsetf(ios::floatfield);
+					ok = false;
+				}
+				if ( b.hash != entry.hash && ok ) {
+					notes << " output changed";
+				}
+				if ( b.insize == entry.insize ) {
+					baseTime += b.ms;
+					currentTime += entry.ms;
+				}
+			}
+		}
+		if ( !ok ) {
+			failed++;
+		}
+		cout << ( ok ? "  ok" : "  FAILED:" ) << notes.str() << "\n";
+		cout.flush();
+	}
+
+	if ( update && failed ) {
+		cout << "\nBaseline not written.\n";
+	} else if ( update ) {
+		if ( !write_baseline(baselineName,entries) ) {
+			return -1;
+		}
+		cout << "\n" << entries.size() << " entries written to '" << baselineName << "'.\n";
+	} else if ( baseTime > 0 ) {
+		cout << "\nTotal time " << fixed << setprecision(3) << currentTime << " ms, baseline " << baseTime << " ms (";
+		cout << showpos << setprecision(1) << percent(baseTime,currentTime) << noshowpos << "%)\n";
+		cout.unsetf(ios::floatfield);
+		if ( throughputDrop > 0 && -percent(currentTime,baseTime) > throughputDrop ) {
+			cout << "FAILED: total throughput dropped by more than " << throughputDrop << "%.\n";
+			failed++;
+		}
+	}
+	if ( failed ) {
+		cout << failed << " of " << entries.size() << " entries failed.\n";
+	}
+	return failed ? -1 : 0;
+}
@@ -0,0 +1,282 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif //#ifdef _MSC_VER
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif //#ifndef _MSC_VER
+
+#include "atfrepack.h"
+
+using namespace std;
+
+static void write_uint24(uint32_t v, ostream &ofile) {
+	ofile.put(char((v>>16)&0xFF));
+	ofile.put(char((v>> 8)&0xFF));
+	ofile.put(char((v>> 0)&0xFF));
+}
+
+static bool write_header(const ATFLayout &layout, size_t filesize, ostream &ofile)
+{
+	filesize -= 6;
+	if ( filesize >> 24 ) {
+		cerr << "ATF file too large!\n\n";
+		return false;
+	}
+	ofile.put('A');
+	ofile.put('T');
+	ofile.put('F');
+	ofile.put(uint8_t((filesize>>16)&0xFF));
+	ofile.put(uint8_t((filesize>> 8)&0xFF));
+	ofile.put(uint8_t((filesize>> 0)&0xFF));
+	ofile.put(char(layout.format));
+	ofile.put(char(layout.wlog2));
+	ofile.put(char(layout.hlog2));
+	ofile.put(char(layout.count));
+	return true;
+}
+
+static bool copy_block(istream &atf, const ATFBlock &block, vector<uint8_t> &buffer, ostream &ofile)
+{
+	write_uint24(block.length,ofile);
+	if ( block.length == 0 ) {
+		return true;
+	}
+	buffer.resize(block.length);
+	atf.seekg(block.offset,ios_base::beg);
+	if ( !atf.read((char *)&buffer[0],block.length) ) {
+		cerr << "ATF file is short!\n\n";
+		return false;
+	}
+	ofile.write((const char *)&buffer[0],block.length);
+	return true;
+}
+
+size_t atf_slice_size(const ATFLayout &layout, int32_t start, int32_t end)
+{
+	size_t filesize = 10;
+	for ( int32_t i=0; i<layout.faces; i++) {
+		for ( int32_t c=0; c<layout.count; c++) {
+			for ( int32_t s=0; s<layout.streams; s++) {
+				filesize += 3;
+				if ( !( c < start || c > end ) ) {
+					filesize += layout.block(i,c,s).length;
+				}
+			}
+		}
+	}
+	return filesize;
+}
+
+bool atf_slice(istream &atf, const ATFLayout &layout, int32_t start, int32_t end, ostream &ofile)
+{
+	vector<uint8_t> buffer;
+
+	if ( !write_header(layout,atf_slice_size(layout,start,end),ofile) ) {
+		return false;
+	}
+
+	for ( int32_t i=0; i<layout.faces; i++) {
+		for ( int32_t c=0; c<layout.count; c++) {
+			bool empty = true;
+			for ( int32_t s=0; s<layout.streams; s++) {
+				if ( c < start || c > end ) {
+					write_uint24(0,ofile);
+				} else {
+					const ATFBlock &block = layout.block(i,c,s);
+					if ( !copy_block(atf,block,buffer,ofile) ) {
+						return false;
+					}
+					if ( block.length ) {
+						empty = false;
+					}
+				}
+			}
+			if ( empty && !( c < start || c > end ) && i == 0 ) {
+				cerr << "Warning: Level " << c << " has no data in the input file.\n";
+			}
+		}
+	}
+
+	return !ofile.bad();
+}
+
+bool atf_merge(istream *atf[ATF_GROUP_COUNT], const ATFLayout *layout[ATF_GROUP_COUNT], ostream &ofile)
+{
+	static const char *names[ATF_GROUP_COUNT] = { "DXT", "PVRTC", "ETC1" };
+
+	const ATFLayout *base = 0;
+	for ( int32_t g=0; g<ATF_GROUP_COUNT; g++) {
+		if ( !layout[g] ) {
+			continue;
+		}
+		int32_t first = 0;
+		int32_t count = 0;
+		if ( !atf_stream_group(layout[g]->format,g,first,count) ) {
+			cerr << "The " << names[g] << " input is not a block compressed ATF file!\n\n";
+			return false;
+		}
+		if ( !base ) {
+			base = layout[g];
+			continue;
+		}
+		if ( layout[g]->format != base->format ) {
+			cerr << "Texture types do not match!\n\n";
+			return false;
+		}
+		if ( layout[g]->wlog2 != base->wlog2 || layout[g]->hlog2 != base->hlog2 ) {
+			cerr << "Texture sizes do not match!\n\n";
+			return false;
+		}
+		if ( layout[g]->count != base->count ) {
+			cerr << "Mip map counts do not match!\n\n";
+			return false;
+		}
+	}
+
+	if ( !base ) {
+		return false;
+	}
+
+	for ( int32_t g=0; g<ATF_GROUP_COUNT; g++) {
+		if ( !layout[g] ) {
+			continue;
+		}
+		int32_t first = 0;
+		int32_t count = 0;
+		atf_stream_group(layout[g]->format,g,first,count);
+		bool empty = true;
+		for ( int32_t i=0; i<layout[g]->faces && empty; i++) {
+			for ( int32_t c=0; c<layout[g]->count && empty; c++) {
+				for ( int32_t s=first; s<first+count; s++) {
+					if ( layout[g]->block(i,c,s).length ) {
+						empty = false;
+					}
+				}
+			}
+		}
+		if ( empty ) {
+			cerr << "The " << names[g] << " input contains no " << names[g] << " data!\n\n";
+			return false;
+		}
+	}
+
+	size_t filesize = 10;
+	for ( int32_t i=0; i<base->faces; i++) {
+		for ( int32_t c=0; c<base->count; c++) {
+			for ( int32_t g=0; g<ATF_GROUP_COUNT; g++) {
+				int32_t first = 0;
+				int32_t count = 0;
+				atf_stream_group(base->format,g,first,count);
+				for ( int32_t s=first; s<first+count; s++) {
+					filesize += 3 + ( layout[g] ? layout[g]->block(i,c,s).length : 0 );
+				}
+			}
+		}
+	}
+
+	vector<uint8_t> buffer;
+
+	if ( !write_header(*base,filesize,ofile) ) {
+		return false;
+	}
+
+	for ( int32_t i=0; i<base->faces; i++) {
+		for ( int32_t c=0; c<base->count; c++) {
+			for ( int32_t g=0; g<ATF_GROUP_COUNT; g++) {
+				int32_t first = 0;
+				int32_t count = 0;
+				atf_stream_group(base->format,g,first,count);
+				for ( int32_t s=first; s<first+count; s++) {
+					if ( !layout[g] ) {
+						write_uint24(0,ofile);
+					} else if ( !copy_block(*atf[g],layout[g]->block(i,c,s),buffer,ofile) ) {
+						return false;
+					}
+				}
+			}
+		}
+	}
+
+	return !ofile.bad();
+}
+
+void atf_reuse_begin(ATFReuse *reuse, uint8_t format, int32_t faces, int32_t count)
+{
+	if ( !reuse ) {
+		return;
+	}
+	ATFLevelHash zero = { { 0, 0 } };
+	reuse->count = count;
+	reuse->hashes.assign(faces * count, zero);
+	reuse->active = reuse->atf &&
+					reuse->layout.format == format &&
+					reuse->layout.count == count &&
+					reuse->layout.hashes.size() == reuse->hashes.size();
+}
+
+bool atf_reuse_lookup(ATFReuse *reuse, int32_t face, int32_t level, const uint64_t hash[2], vector<uint8_t> &entry)
+{
+	if ( !reuse ) {
+		return false;
+	}
+
+	ATFLevelHash &current = reuse->hashes[face * reuse->count + level];
+	current.hash[0] = hash[0];
+	current.hash[1] = hash[1];
+
+	if ( !reuse->active ) {
+		return false;
+	}
+	const ATFLevelHash &previous = reuse->layout.hashes[face * reuse->count + level];
+	if ( previous.hash[0] != hash[0] || previous.hash[1] != hash[1] ) {
+		return false;
+	}
+
+	entry.clear();
+	for ( int32_t s=0; s<reuse->layout.streams; s++) {
+		const ATFBlock &block = reuse->layout.block(face,level,s);
+		if ( block.length == 0 ) {
+			return false; // level was not encoded in the previous output
+		}
+		size_t pos = entry.size();
+		entry.resize(pos + 3 + block.length);
+		entry[pos+0] = uint8_t((block.length>>16)&0xFF);
+		entry[pos+1] = uint8_t((block.length>> 8)&0xFF);
+		entry[pos+2] = uint8_t((block.length>> 0)&0xFF);
+		reuse->atf->clear();
+		reuse->atf->seekg(block.offset,ios_base::beg);
+		if ( !reuse->atf->read((char *)&entry[pos+3],block.length) ) {
+			return false;
+		}
+	}
+
+	reuse->reused++;
+	return true;
+}
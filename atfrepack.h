@@ -0,0 +1,57 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _ATFREPACK_H_
+#define _ATFREPACK_H_
+
+#include "atfindex.h"
+
+//
+// Block level repacking of existing ATF files. Nothing in here touches LZMA or
+// JPEG-XR, all functions copy the already encoded sub-streams verbatim. The
+// output length is computed up front, so ofile does not need to be seekable.
+//
+
+// Copies the levels start..end of every face from atf to ofile and writes zero
+// length sub-streams for all other levels, like dds2atf -n does at encode time.
+bool atf_slice(std::istream &atf, const ATFLayout &layout, int32_t start, int32_t end, std::ostream &ofile);
+size_t atf_slice_size(const ATFLayout &layout, int32_t start, int32_t end);
+
+// Interleaves the DXT, PVRTC and ETC1 sub-streams of up to three single format
+// files (indexed by ATF_GROUP_*, null entries stay empty) into one ATF file.
+bool atf_merge(std::istream *atf[ATF_GROUP_COUNT], const ATFLayout *layout[ATF_GROUP_COUNT], std::ostream &ofile);
+
+// Level reuse for incremental rebuilds (dds2atf -r). The encoder records the
+// input hash of every level it writes and asks for the level of the previous
+// output first, which is only used if it was encoded from the same hash.
+struct ATFReuse {
+	std::istream   *atf;		// previous output, 0 if there is none
+	ATFLayout		layout;		// layout of the previous output including its level hashes
+	bool			active;		// previous output has the same type and level count
+	int32_t			count;
+	std::vector<ATFLevelHash> hashes;	// level hashes of the current encode
+	size_t			reused;		// number of levels copied from the previous output
+};
+
+void atf_reuse_begin(ATFReuse *reuse, uint8_t format, int32_t faces, int32_t count);
+bool atf_reuse_lookup(ATFReuse *reuse, int32_t face, int32_t level, const uint64_t hash[2], std::vector<uint8_t> &entry);
+
+#endif //#ifndef _ATFREPACK_H_
@@ -0,0 +1,200 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <deque>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif //#ifdef _MSC_VER
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif //#ifndef _MSC_VER
+
+#include "atfsched.h"
+
+using namespace std;
+
+struct ATFTask {
+	atf_task_proc	proc;
+	void		   *arg;
+	ATFTaskGroup   *group;
+};
+
+// All queues share one lock, tasks are whole texture levels.
+static atf_mutex schedMutex;
+static atf_condition schedChanged;		// work was queued, a task finished or the pool stops
+static deque<ATFTask> schedJobs;
+static vector< deque<ATFTask> > schedTasks;	// one queue per thread of the pool
+static vector<atf_thread> schedThreads;
+static bool schedRunning = false;
+static bool schedStopping = false;
+
+// Queue of the calling thread, threads outside of the pool share the last one.
+static ATF_THREAD_LOCAL int32_t schedIndex = -1;
+
+static int32_t own_queue()
+{
+	return schedIndex >= 0 ? schedIndex : int32_t(schedTasks.size()) - 1;
+}
+
+// Takes the newest task of the own queue or the oldest one of another thread.
+static bool take_task(ATFTask &task)
+{
+	int32_t own = own_queue();
+	if ( !schedTasks[own].empty() ) {
+		task = schedTasks[own].back();
+		schedTasks[own].pop_back();
+		return true;
+	}
+	int32_t count = int32_t(schedTasks.size());
+	for ( int32_t c=1; c<count; c++) {
+		deque<ATFTask> &victim = schedTasks[(own + c) % count];
+		if ( !victim.empty() ) {
+			task = victim.front();
+			victim.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+// Runs task with the lock released.
+static void run_task(const ATFTask &task)
+{
+	schedMutex.unlock();
+	task.proc(task.arg);
+	schedMutex.lock();
+	task.group->pending--;
+	schedChanged.broadcast();
+}
+
+static void sched_worker(void *arg)
+{
+	schedIndex = int32_t(size_t(arg));
+
+	schedMutex.lock();
+	for (;;) {
+		ATFTask task;
+		if ( !schedJobs.empty() ) {
+			task = schedJobs.front();
+			schedJobs.pop_front();
+			run_task(task);
+		} else if ( take_task(task) ) {
+			run_task(task);
+		} else if ( schedStopping ) {
+			break;
+		} else {
+			schedChanged.wait(schedMutex);
+		}
+	}
+	schedMutex.unlock();
+}
+
+bool atf_sched_start(int32_t threads)
+{
+	if ( schedRunning || threads <= 1 ) {
+		return true;
+	}
+
+	// the calling thread owns queue 0, the last queue is shared by threads outside of the pool
+	schedTasks.resize(threads + 1);
+	schedThreads.resize(threads - 1);
+	schedIndex = 0;
+	schedRunning = true;
+	schedStopping = false;
+	for ( size_t c=0; c<schedThreads.size(); c++) {
+		if ( !atf_thread_start(schedThreads[c],sched_worker,(void *)(c + 1)) ) {
+			schedThreads.resize(c);
+			break;
+		}
+	}
+	return true;
+}
+
+void atf_sched_stop()
+{
+	if ( !schedRunning ) {
+		return;
+	}
+	schedMutex.lock();
+	schedStopping = true;
+	schedChanged.broadcast();
+	schedMutex.unlock();
+	for ( size_t c=0; c<schedThreads.size(); c++) {
+		atf_thread_join(schedThreads[c]);
+	}
+	schedThreads.clear();
+	schedTasks.clear();
+	schedIndex = -1;
+	schedRunning = false;
+}
+
+int32_t atf_sched_threads()
+{
+	return schedRunning ? int32_t(schedThreads.size()) + 1 : 1;
+}
+
+void atf_sched_job(ATFTaskGroup &group, atf_task_proc proc, void *arg)
+{
+	if ( !schedRunning ) {
+		proc(arg);
+		return;
+	}
+	ATFTask task = { proc, arg, &group };
+	schedMutex.lock();
+	group.pending++;
+	schedJobs.push_back(task);
+	schedChanged.broadcast();
+	schedMutex.unlock();
+}
+
+void atf_sched_task(ATFTaskGroup &group, atf_task_proc proc, void *arg)
+{
+	if ( !schedRunning ) {
+		proc(arg);
+		return;
+	}
+	ATFTask task = { proc, arg, &group };
+	schedMutex.lock();
+	group.pending++;
+	schedTasks[own_queue()].push_back(task);
+	schedChanged.broadcast();
+	schedMutex.unlock();
+}
+
+void atf_sched_wait(ATFTaskGroup &group)
+{
+	if ( !schedRunning ) {
+		return;
+	}
+	schedMutex.lock();
+	while ( group.pending ) {
+		ATFTask task;
+		if ( take_task(task) ) {
+			run_task(task);
+		} else {
+			schedChanged.wait(schedMutex);
+		}
+	}
+	schedMutex.unlock();
+}
@@ -0,0 +1,62 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _ATFSCHED_H_
+#define _ATFSCHED_H_
+
+#include "atfthread.h"
+
+//
+// One pool of -j threads for all parallel work in the converter. Jobs (whole
+// files in batch and watch mode) go to a shared queue, tasks (single texture
+// levels) go to a queue owned by the thread which submits them. A thread
+// without work takes the next job first and only then steals the oldest task
+// of another thread, so while files are queued every thread converts a file
+// of its own, and once the last files are running the idle threads help with
+// their levels. A thread waiting for its tasks runs them itself, newest first,
+// so the pool never runs more than -j threads at a time.
+//
+// Without a running scheduler tasks run right away on the submitting thread.
+// Tasks switch to the memory context (atfmem.h) of the job which submitted
+// them while they run, so their allocations and the limit belong to the job.
+//
+
+typedef void (*atf_task_proc)(void *arg);
+
+struct ATFTaskGroup {
+	ATFTaskGroup() : pending(0) { }
+	size_t			pending;	// submitted tasks which did not finish yet
+};
+
+// Starts threads-1 workers, the calling thread is the last one of the pool.
+bool atf_sched_start(int32_t threads);
+void atf_sched_stop();
+
+// Number of threads in the pool, 1 without a running scheduler.
+int32_t atf_sched_threads();
+
+void atf_sched_job(ATFTaskGroup &group, atf_task_proc proc, void *arg);
+void atf_sched_task(ATFTaskGroup &group, atf_task_proc proc, void *arg);
+
+// Runs tasks until all tasks of group are done. Jobs are not picked up here.
+void atf_sched_wait(ATFTaskGroup &group);
+
+#endif //#ifndef _ATFSCHED_H_
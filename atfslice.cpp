@@ -0,0 +1,137 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif //#ifdef _MSC_VER
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif //#ifndef _MSC_VER
+
+#include "atfindex.h"
+#include "atfrepack.h"
+
+using namespace std;
+
+void print_usage()
+{
+	cout << "\natfslice V0.4 Copyright 2010-2012 Adobe Systems Inc. All rights reserved.\n\n";
+	cout << "\nUsage: atfslice -n <start>,<end> [-x] -i input.atf -o output.atf\n\n";
+	cout << "   -n  Range of texture levels (main texture + mip map) to keep. The range is defined as <start>,<end>. 0 is the main texture, mip map starts with 1. All other levels are stored empty.\n";
+	cout << "   -x  Write a .atfidx sidecar file for the output.\n\n";
+	cout << "The input should contain all levels, e.g. be written by dds2atf without -n. Level data is copied as is, nothing is re-encoded.\n\n";
+}
+
+static ifstream ifile;
+static ofstream ofile;
+
+int main(int argc, char *argv[]) {
+
+	const char *ifilename = 0;
+	const char *ofilename = 0;
+	int32_t rangeStart = -1;
+	int32_t rangeEnd = -1;
+	bool writeIndex = false;
+
+	if ( argc > 1) {
+		for (int32_t c = 1; c < argc; c++) {
+			if (argv[c][0] == '-') {
+				if (argv[c][1] == 'n' && c+1 < argc) {
+					std::istringstream s(argv[c+1]);
+					char dummy;
+					s >> rangeStart >> dummy >> rangeEnd;
+				} else if (argv[c][1] == 'x') {
+					writeIndex = true;
+				} else if (argv[c][1] == 'i' && c+1 < argc) {
+					ifilename = argv[c+1];
+				} else if (argv[c][1] == 'o' && c+1 < argc) {
+					ofilename = argv[c+1];
+				}
+			}
+		}
+
+		if ( !ifilename ) {
+			cerr << "No input file provided.\n";
+			goto printusage;
+		}
+
+		if ( !ofilename || strlen(ofilename) == 0 ) {
+			cerr << "No output file provided.\n";
+			goto printusage;
+		}
+
+		if ( rangeStart < 0 || rangeEnd < rangeStart ) {
+			cerr << "No valid level range provided.\n";
+			goto printusage;
+		}
+
+		ifile.open(ifilename,ios::in|ios::binary);
+		if ( !ifile.is_open() ) {
+			cerr << "Could not open input file. '";
+			cerr << ifilename;
+			cerr << "'\n\n";
+			return -1;
+		}
+
+		ATFLayout layout;
+		if ( !atf_load_layout(ifilename,ifile,layout) ) {
+			cerr << "Input file not a valid ATF file.\n";
+			return -1;
+		}
+
+		if ( rangeStart >= layout.count ) {
+			cerr << "Level range starts past the last texture level.\n";
+			return -1;
+		}
+
+		ofile.open(ofilename,ios::out|ios::binary);
+		if ( !ofile.is_open() ) {
+			cerr << "Could not open output file. '";
+			cerr << ofilename;
+			cerr << "'\n\n";
+			return -1;
+		}
+
+		if ( !atf_slice(ifile,layout,rangeStart,rangeEnd,ofile) ) {
+			ofile.close();
+			remove(ofilename);
+			return -1;
+		}
+
+		ofile.close();
+		if ( !writeIndex ) {
+			remove(atf_index_name(ofilename).c_str());
+		} else if ( !atf_write_index_file(ofilename) ) {
+			return -1;
+		}
+		return 0;
+	}
+printusage:
+	print_usage();
+	return -1;
+}
@@ -0,0 +1,379 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif //#ifdef _MSC_VER
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif //#ifndef _MSC_VER
+
+#include "atfstats.h"
+
+using namespace std;
+
+ATF_THREAD_LOCAL ATFStats *gStats = 0;
+
+// the level currently being encoded on this thread
+static ATF_THREAD_LOCAL const char *gFormat = "";
+static ATF_THREAD_LOCAL int32_t gFace = 0;
+static ATF_THREAD_LOCAL int32_t gLevel = 0;
+
+static const char *stage_names[ATF_STAGE_COUNT+1] = { "read", "swizzle", "split", "lzma", "jxr", "write", "cached" };
+
+struct ATFTraceEvent {
+	std::string		name;
+	const char	   *category;
+	double			start;
+	double			duration;
+	int32_t			tid;
+	std::string		args;		// JSON object members, may be empty
+};
+
+// Trace events of all threads, tracing is switched on before any worker starts.
+static bool traceEnabled = false;
+static std::string traceFilename;
+static double traceStart = 0;
+static int32_t traceThreads = 0;
+static std::vector<ATFTraceEvent> traceEvents;
+static atf_mutex traceMutex;
+static ATF_THREAD_LOCAL int32_t traceTid = 0;
+
+static void write_string(ostream &out, const string &s);
+static void trace_event(const std::string &name, const char *category, const ATFStatsMark &start, const ATFStatsMark &end, const std::string &args);
+
+void atf_stats_reset(ATFStats &stats)
+{
+	stats.ok = false;
+	stats.wall = 0;
+	stats.cpu = 0;
+	for ( int32_t c=0; c<ATF_STAGE_COUNT; c++) {
+		stats.stageWall[c] = 0;
+		stats.stageCpu[c] = 0;
+	}
+	stats.streams.clear();
+	stats.infilesize = 0;
+	stats.outfilesize = 0;
+	stats.outlzmasize = 0;
+	stats.texturew = 0;
+	stats.textureh = 0;
+	stats.texturecomp = 0;
+	memset(&stats.memory,0,sizeof(stats.memory));
+}
+
+ATFStatsMark atf_stats_mark()
+{
+	ATFStatsMark mark = { 0, 0 };
+	if ( gStats || traceEnabled ) {
+		mark.wall = atf_wall_time();
+		mark.cpu = atf_cpu_time();
+	}
+	return mark;
+}
+
+void atf_stats_level(int32_t face, int32_t level)
+{
+	gFace = face;
+	gLevel = level;
+}
+
+void atf_stats_format(const char *format)
+{
+	gFormat = format;
+}
+
+ATFStatsContext atf_stats_context()
+{
+	ATFStatsContext context = { gStats, gFormat, gFace, gLevel };
+	return context;
+}
+
+void atf_stats_set_context(const ATFStatsContext &context)
+{
+	gStats = context.stats;
+	gFormat = context.format;
+	gFace = context.face;
+	gLevel = context.level;
+}
+
+void atf_stats_merge(const ATFStats &from)
+{
+	if ( !gStats ) {
+		return;
+	}
+	gStats->cpu += from.cpu;
+	for ( int32_t c=0; c<ATF_STAGE_COUNT; c++) {
+		gStats->stageWall[c] += from.stageWall[c];
+		gStats->stageCpu[c] += from.stageCpu[c];
+	}
+	gStats->streams.insert(gStats->streams.end(),from.streams.begin(),from.streams.end());
+}
+
+static string level_args()
+{
+	ostringstream args;
+	args << "\"format\": \"" << gFormat << "\", \"face\": " << gFace << ", \"level\": " << gLevel;
+	return args.str();
+}
+
+static void add_stage(int32_t stage, const ATFStatsMark &start, const ATFStatsMark &end)
+{
+	if ( gStats && stage >= 0 && stage < ATF_STAGE_COUNT ) {
+		gStats->stageWall[stage] += end.wall - start.wall;
+		gStats->stageCpu[stage] += end.cpu - start.cpu;
+	}
+}
+
+void atf_stats_stage(int32_t stage, const ATFStatsMark &start)
+{
+	if ( !gStats && !traceEnabled ) {
+		return;
+	}
+	ATFStatsMark end = atf_stats_mark();
+	add_stage(stage,start,end);
+	if ( traceEnabled ) {
+		trace_event(stage_names[stage],"stage",start,end,stage == ATF_STAGE_SPLIT ? level_args() : string());
+	}
+}
+
+void atf_stats_stream(int32_t stage, size_t in, size_t out, const ATFStatsMark &start)
+{
+	if ( !gStats && !traceEnabled ) {
+		return;
+	}
+	ATFStatsMark end = atf_stats_mark();
+	add_stage(stage,start,end);
+	if ( gStats ) {
+		ATFStatsStream stream;
+		stream.format = gFormat;
+		stream.face = gFace;
+		stream.level = gLevel;
+		stream.stage = stage;
+		stream.in = in;
+		stream.out = out;
+		stream.wall = end.wall - start.wall;
+		stream.cpu = end.cpu - start.cpu;
+		gStats->streams.push_back(stream);
+	}
+	if ( traceEnabled ) {
+		ostringstream args;
+		args << level_args() << ", \"bytes_in\": " << in << ", \"bytes_out\": " << out;
+		trace_event(stage_names[stage],"stream",start,end,args.str());
+	}
+}
+
+static void write_string(ostream &out, const string &s)
+{
+	out << '"';
+	for ( size_t c=0; c<s.size(); c++) {
+		unsigned char ch = (unsigned char)s[c];
+		if ( ch == '"' || ch == '\\' ) {
+			out << '\\' << ch;
+		} else if ( ch < 0x20 ) {
+			char buf[8];
+			sprintf(buf,"\\u%04x",ch);
+			out << buf;
+		} else {
+			out << ch;
+		}
+	}
+	out << '"';
+}
+
+// Times are written in milliseconds with microsecond resolution.
+static void write_ms(ostream &out, double seconds)
+{
+	char buf[32];
+	sprintf(buf,"%.3f",seconds * 1000.0);
+	out << buf;
+}
+
+// Output size relative to the input size.
+static void write_ratio(ostream &out, size_t from, size_t to)
+{
+	char buf[32];
+	sprintf(buf,"%.4f",from ? double(to) / double(from) : 0.0);
+	out << buf;
+}
+
+void atf_stats_write_memory(ostream &out, const ATFMemStats &memory)
+{
+	out << "{ ";
+	for ( int32_t c=0; c<ATF_MEM_COUNT; c++) {
+		out << "\"" << atf_mem_name(c) << "_peak\": " << memory.peak[c] << ", ";
+	}
+	out << "\"peak\": " << memory.totalPeak << " }";
+}
+
+void atf_stats_write_json(ostream &out, const ATFStats &stats, const char *indent)
+{
+	string in1 = string(indent) + "  ";
+	string in2 = in1 + "  ";
+
+	out << "{\n";
+	out << in1 << "\"input\": "; write_string(out,stats.input); out << ",\n";
+	out << in1 << "\"output\": "; write_string(out,stats.output); out << ",\n";
+	out << in1 << "\"ok\": " << ( stats.ok ? "true" : "false" ) << ",\n";
+	out << in1 << "\"texturew\": " << stats.texturew << ",\n";
+	out << in1 << "\"textureh\": " << stats.textureh << ",\n";
+	out << in1 << "\"texturecomp\": " << stats.texturecomp << ",\n";
+	out << in1 << "\"infilesize\": " << stats.infilesize << ",\n";
+	out << in1 << "\"outfilesize\": " << stats.outfilesize << ",\n";
+	out << in1 << "\"outlzmasize\": " << stats.outlzmasize << ",\n";
+	out << in1 << "\"ratio\": "; write_ratio(out,stats.infilesize,stats.outfilesize); out << ",\n";
+	out << in1 << "\"wall_ms\": "; write_ms(out,stats.wall); out << ",\n";
+	out << in1 << "\"cpu_ms\": "; write_ms(out,stats.cpu); out << ",\n";
+	out << in1 << "\"memory\": "; atf_stats_write_memory(out,stats.memory); out << ",\n";
+
+	out << in1 << "\"stages\": {\n";
+	for ( int32_t c=0; c<ATF_STAGE_COUNT; c++) {
+		out << in2 << "\"" << stage_names[c] << "\": { \"wall_ms\": "; write_ms(out,stats.stageWall[c]);
+		out << ", \"cpu_ms\": "; write_ms(out,stats.stageCpu[c]);
+		out << " }" << ( c+1 < ATF_STAGE_COUNT ? "," : "" ) << "\n";
+	}
+	out << in1 << "},\n";
+
+	out << in1 << "\"streams\": [";
+	for ( size_t c=0; c<stats.streams.size(); c++) {
+		const ATFStatsStream &s = stats.streams[c];
+		out << ( c ? ",\n" : "\n" ) << in2;
+		out << "{ \"face\": " << s.face << ", \"level\": " << s.level;
+		out << ", \"format\": "; write_string(out,s.format);
+		out << ", \"stage\": \"" << stage_names[s.stage] << "\"";
+		out << ", \"bytes_in\": " << s.in << ", \"bytes_out\": " << s.out;
+		out << ", \"ratio\": "; write_ratio(out,s.in,s.out);
+		out << ", \"wall_ms\": "; write_ms(out,s.wall);
+		out << ", \"cpu_ms\": "; write_ms(out,s.cpu);
+		out << " }";
+	}
+	out << ( stats.streams.empty() ? "]\n" : "\n" + in1 + "]\n" );
+	out << indent << "}";
+}
+
+bool atf_trace_open(const char *filename)
+{
+	// fail early rather than after the whole run
+	ofstream ofile(filename,ios::out|ios::binary);
+	if ( !ofile.is_open() ) {
+		cerr << "Could not open trace file. '" << filename << "'\n\n";
+		return false;
+	}
+	ofile.close();
+	traceFilename = filename;
+	traceStart = atf_wall_time();
+	traceEnabled = true;
+	return true;
+}
+
+bool atf_trace_enabled()
+{
+	return traceEnabled;
+}
+
+void atf_trace_task(const ATFStatsMark &start)
+{
+	if ( !traceEnabled ) {
+		return;
+	}
+	ostringstream name;
+	name << gFormat << " level " << gLevel;
+	if ( gFace ) {
+		name << " face " << gFace;
+	}
+	trace_event(name.str(),"level",start,atf_stats_mark(),level_args());
+}
+
+void atf_trace_span(const string &name, const char *category, const ATFStatsMark &start)
+{
+	if ( traceEnabled ) {
+		trace_event(name,category,start,atf_stats_mark(),string());
+	}
+}
+
+static void trace_event(const string &name, const char *category, const ATFStatsMark &start, const ATFStatsMark &end, const string &args)
+{
+	ATFTraceEvent event;
+	event.name = name;
+	event.category = category;
+	event.start = start.wall - traceStart;
+	event.duration = end.wall - start.wall;
+	event.args = args;
+
+	traceMutex.lock();
+	if ( traceTid == 0 ) {
+		traceTid = ++traceThreads;
+	}
+	event.tid = traceTid;
+	traceEvents.push_back(event);
+	traceMutex.unlock();
+}
+
+// Times in trace files are in microseconds.
+static void write_us(ostream &out, double seconds)
+{
+	char buf[32];
+	sprintf(buf,"%.3f",seconds * 1000000.0);
+	out << buf;
+}
+
+bool atf_trace_close()
+{
+	if ( !traceEnabled ) {
+		return true;
+	}
+	traceEnabled = false;
+
+	ofstream ofile(traceFilename.c_str(),ios::out|ios::binary);
+	if ( !ofile.is_open() ) {
+		cerr << "Could not open trace file. '" << traceFilename << "'\n\n";
+		return false;
+	}
+
+	ofile << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	ofile << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"dds2atf\"}}";
+	for ( int32_t c=1; c<=traceThreads; c++) {
+		ofile << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << c;
+		ofile << ", \"args\": {\"name\": \"thread " << c << "\"}}";
+	}
+	for ( size_t c=0; c<traceEvents.size(); c++) {
+		const ATFTraceEvent &event = traceEvents[c];
+		ofile << ",\n{\"name\": "; write_string(ofile,event.name);
+		ofile << ", \"cat\": \"" << event.category << "\", \"ph\": \"X\", \"ts\": "; write_us(ofile,event.start);
+		ofile << ", \"dur\": "; write_us(ofile,event.duration);
+		ofile << ", \"pid\": 1, \"tid\": " << event.tid;
+		if ( !event.args.empty() ) {
+			ofile << ", \"args\": {" << event.args << "}";
+		}
+		ofile << "}";
+	}
+	ofile << "\n]}\n";
+	ofile.close();
+
+	traceEvents.clear();
+	return !ofile.fail();
+}
@@ -0,0 +1,141 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _ATFSTATS_H_
+#define _ATFSTATS_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "atfmem.h"
+#include "atfthread.h"
+
+//
+// Per job timing and size statistics (dds2atf --stats=json). The encoder
+// reports into gStats, which is 0 unless statistics were requested, so the
+// clocks are only read when somebody looks at the numbers.
+//
+// Every sub-stream the encoder produces is recorded with the stage which
+// produced it, the face, level and block format it belongs to and its size
+// before and after. Stage totals also include work which does not map to a
+// single sub-stream, like reading the input or splitting blocks into planes.
+//
+// The same spans can be recorded as Chrome trace events (dds2atf --trace),
+// one complete event per stage, sub-stream, level task and job, tagged with
+// the thread which ran it. The file loads in chrome://tracing and Perfetto.
+//
+
+enum {
+	ATF_STAGE_READ,			// reading the DDS input
+	ATF_STAGE_SWIZZLE,		// DDS to PVR conversion, channel order and face layout
+	ATF_STAGE_SPLIT,		// block data copied or split into planes
+	ATF_STAGE_LZMA,
+	ATF_STAGE_JXR,
+	ATF_STAGE_WRITE,		// writing the ATF output
+	ATF_STAGE_COUNT,
+	ATF_STAGE_CACHED = ATF_STAGE_COUNT	// sub-streams copied from the cache or a previous output
+};
+
+struct ATFStatsMark {
+	double			wall;
+	double			cpu;
+};
+
+struct ATFStatsStream {
+	const char	   *format;		// "DXT1", "DXT5", "PVRTC", "ETC1", "RGB" or "RGBA"
+	int32_t			face;
+	int32_t			level;
+	int32_t			stage;		// ATF_STAGE_SPLIT for raw stored data, _LZMA, _JXR or _CACHED
+	size_t			in;
+	size_t			out;
+	double			wall;
+	double			cpu;
+};
+
+struct ATFStats {
+	std::string		input;
+	std::string		output;
+	bool			ok;
+	double			wall;
+	double			cpu;			// of the job's thread and its tasks which ran on other threads
+	double			stageWall[ATF_STAGE_COUNT];
+	double			stageCpu[ATF_STAGE_COUNT];
+	std::vector<ATFStatsStream> streams;
+
+	// encoder totals, copied from the converter's globals
+	size_t			infilesize;
+	size_t			outfilesize;
+	size_t			outlzmasize;
+	size_t			texturew;
+	size_t			textureh;
+	size_t			texturecomp;
+
+	ATFMemStats		memory;		// accounted allocations of the job's thread
+};
+
+extern ATF_THREAD_LOCAL ATFStats *gStats;
+
+void atf_stats_reset(ATFStats &stats);
+
+// Current time, zero if neither statistics nor tracing are on.
+ATFStatsMark atf_stats_mark();
+
+// Sets the level following sub-streams belong to.
+void atf_stats_level(int32_t face, int32_t level);
+void atf_stats_format(const char *format);
+
+// Adds the time since start to a stage, atf_stats_stream also records a sub-stream.
+void atf_stats_stage(int32_t stage, const ATFStatsMark &start);
+void atf_stats_stream(int32_t stage, size_t in, size_t out, const ATFStatsMark &start);
+
+// Stats context of the calling thread: gStats and the current format, face
+// and level. Work handed to another thread (see atfsched.h) takes it along.
+struct ATFStatsContext {
+	ATFStats	   *stats;
+	const char	   *format;
+	int32_t			face;
+	int32_t			level;
+};
+
+ATFStatsContext atf_stats_context();
+void atf_stats_set_context(const ATFStatsContext &context);
+
+// Adds the CPU time, stage times and sub-streams of from to gStats.
+void atf_stats_merge(const ATFStats &from);
+
+// Writes stats as one JSON object.
+void atf_stats_write_json(std::ostream &out, const ATFStats &stats, const char *indent);
+// Writes the peak bytes of memory as a JSON object.
+void atf_stats_write_memory(std::ostream &out, const ATFMemStats &memory);
+
+// Enables tracing for the whole process, events are kept in memory until
+// atf_trace_close writes them to filename.
+bool atf_trace_open(const char *filename);
+bool atf_trace_enabled();
+bool atf_trace_close();
+
+// Span for the encode of the current level in the current format.
+void atf_trace_task(const ATFStatsMark &start);
+// Span with an arbitrary name, e.g. a whole job.
+void atf_trace_span(const std::string &name, const char *category, const ATFStatsMark &start);
+
+#endif //#ifndef _ATFSTATS_H_
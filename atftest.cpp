@@ -0,0 +1,531 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif //#ifdef _MSC_VER
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif //#ifndef _MSC_VER
+
+#include "3rdparty/jpegxr/jpegxr.h"
+#include "3rdparty/jpegxr/jxr_priv.h"
+#include "atf.h"
+#include "atfgen.h"
+#include "atfindex.h"
+#include "atfverify.h"
+#include "libatf.h"
+
+using namespace std;
+
+//
+// Tests of libatf on damaged input: ATF files with a truncated JPEG-XR
+// sub-stream or flipped bits are decoded level by level and checked with
+// atf_verify. Decoding has to fail with an error code or give an image of the
+// right size, it must never crash. The inputs are atfgen textures (atfgen.h),
+// the damage comes from a fixed seed, so every run tests the same files.
+// A .atfidx sidecar must not be used once its ATF file was changed, and
+// JPEG-XR tiles with quantizers of their own have to decode with them.
+//
+
+void print_usage()
+{
+	cout << "\natftest V0.1 Copyright 2010-2012 Adobe Systems Inc. All rights reserved.\n\n";
+	cout << "\nUsage: atftest [-f <filter>]\n\n";
+	cout << "Runs the libatf tests and reports the failed ones.\n\n";
+	cout << "   -f  Only tests whose name contains filter, e.g. -f verify.\n\n";
+}
+
+struct TestCase {
+	const char	   *name;
+	bool			(*run)();
+};
+
+static const char *corpus[] = {
+	"bgra8_64_mips_photo",
+	"bgr8_64_mips_noise",
+	"l8_64_mips_gradient",
+	"bgra8_16_mips_cube_photo"
+};
+
+static const int32_t CORPUS_COUNT = int32_t(sizeof(corpus)/sizeof(corpus[0]));
+
+// same LCG on every platform
+static uint32_t next_random(uint32_t &seed)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static bool convert(const char *name, vector<uint8_t> &dds, vector<uint8_t> &atf)
+{
+	ATFGenSpec spec;
+	if ( !atf_gen_parse(name,spec) ) {
+		cerr << name << ": not an atfgen name\n";
+		return false;
+	}
+	atf_gen_dds(spec,dds);
+	atf_buffer out;
+	int result = atf_convert_dds(dds.data(),dds.size(),0,&out);
+	if ( result != ATF_OK ) {
+		cerr << name << ": " << atf_error_string(result) << "\n";
+		return false;
+	}
+	atf.assign(out.data,out.data+out.size);
+	atf_buffer_free(&out);
+	return true;
+}
+
+// Cuts the data of a block to length bytes and fixes its U24 length and the
+// one of the file, the layout of the result stays valid.
+static void truncate_block(const vector<uint8_t> &atf, const ATFBlock &block, uint32_t length, vector<uint8_t> &out)
+{
+	out.assign(atf.begin(),atf.begin()+block.offset+length);
+	out.insert(out.end(),atf.begin()+block.offset+block.length,atf.end());
+	out[block.offset-3] = uint8_t(length>>16);
+	out[block.offset-2] = uint8_t(length>>8);
+	out[block.offset-1] = uint8_t(length);
+	uint32_t fileLen = uint32_t(out.size()) - 6;
+	out[3] = uint8_t(fileLen>>16);
+	out[4] = uint8_t(fileLen>>8);
+	out[5] = uint8_t(fileLen);
+}
+
+// Decodes every level of every face, returns false if a level decoded into
+// an image of the wrong size.
+static bool decode_all(const vector<uint8_t> &atf, const ATFLayout &layout, int32_t &failed)
+{
+	failed = 0;
+	for ( int32_t f=0; f<layout.faces; f++) {
+		for ( int32_t l=0; l<layout.count; l++) {
+			atf_image image;
+			int result = atf_decode(atf.data(),atf.size(),f,l,&image);
+			if ( result != ATF_OK ) {
+				failed++;
+				continue;
+			}
+			size_t texels = size_t(max(1,(1 << layout.wlog2) >> l)) * max(1,(1 << layout.hlog2) >> l);
+			size_t expected = texels * ( image.pixels == ATF_PIXELS_RGBA8 ? 4 : 3 );
+			bool size = image.data.size == expected;
+			atf_buffer_free(&image.data);
+			if ( !size ) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool test_truncated_jxr()
+{
+	for ( int32_t c=0; c<CORPUS_COUNT; c++) {
+		vector<uint8_t> dds;
+		vector<uint8_t> atf;
+		ATFLayout layout;
+		if ( !convert(corpus[c],dds,atf) || !atf_parse_layout(atf.data(),atf.size(),layout) ) {
+			return false;
+		}
+		for ( int32_t f=0; f<layout.faces; f++) {
+			for ( int32_t l=0; l<layout.count; l++) {
+				const ATFBlock &block = layout.block(f,l,0);
+				uint32_t lengths[] = { 1, block.length / 4, block.length / 2, block.length * 3 / 4 };
+				for ( int32_t t=0; t<4; t++) {
+					if ( lengths[t] == 0 || lengths[t] >= block.length ) {
+						continue;
+					}
+					vector<uint8_t> cut;
+					truncate_block(atf,block,lengths[t],cut);
+					atf_image image;
+					int result = atf_decode(cut.data(),cut.size(),f,l,&image);
+					if ( result == ATF_OK ) {
+						atf_buffer_free(&image.data);
+						cerr << corpus[c] << ": face " << f << " level " << l << " cut to " << lengths[t] << " of " << block.length << " bytes decoded\n";
+						return false;
+					}
+					if ( result != ATF_ERROR_DECODE ) {
+						cerr << corpus[c] << ": face " << f << " level " << l << " cut to " << lengths[t] << " bytes: " << atf_error_string(result) << "\n";
+						return false;
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
+static bool test_truncated_file()
+{
+	vector<uint8_t> dds;
+	vector<uint8_t> atf;
+	if ( !convert(corpus[0],dds,atf) ) {
+		return false;
+	}
+	for ( size_t len=0; len<atf.size(); len+=max(size_t(1),atf.size()/97)) {
+		atf_info info;
+		atf_image image;
+		if ( atf_get_info(atf.data(),len,&info) == ATF_OK || atf_decode(atf.data(),len,0,0,&image) == ATF_OK ) {
+			cerr << corpus[0] << ": cut to " << len << " of " << atf.size() << " bytes was accepted\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool test_flipped_bits()
+{
+	uint32_t seed = 1;
+	for ( int32_t c=0; c<CORPUS_COUNT; c++) {
+		vector<uint8_t> dds;
+		vector<uint8_t> atf;
+		ATFLayout layout;
+		if ( !convert(corpus[c],dds,atf) || !atf_parse_layout(atf.data(),atf.size(),layout) ) {
+			return false;
+		}
+		for ( int32_t r=0; r<200; r++) {
+			// only the JPEG-XR data, a flip in the block lengths is a different layout
+			vector<uint8_t> flipped = atf;
+			int32_t flips = 1 + next_random(seed) % 8;
+			for ( int32_t i=0; i<flips; i++) {
+				const ATFBlock &block = layout.blocks[next_random(seed) % layout.blocks.size()];
+				if ( block.length != 0 ) {
+					flipped[block.offset + next_random(seed) % block.length] ^= uint8_t(1 << (next_random(seed) % 8));
+				}
+			}
+			int32_t failed = 0;
+			if ( !decode_all(flipped,layout,failed) ) {
+				cerr << corpus[c] << ": run " << r << " decoded into an image of the wrong size\n";
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool test_verify_corrupt()
+{
+	// atf_verify reports every failed level on cerr
+	ostringstream discard;
+	for ( int32_t c=0; c<CORPUS_COUNT; c++) {
+		vector<uint8_t> dds;
+		vector<uint8_t> atf;
+		ATFLayout layout;
+		if ( !convert(corpus[c],dds,atf) || !atf_parse_layout(atf.data(),atf.size(),layout) ) {
+			return false;
+		}
+		ATFVerifyResult result;
+		streambuf *err = cerr.rdbuf(discard.rdbuf());
+		bool ok = atf_verify(dds.data(),dds.size(),atf.data(),atf.size(),false,0,result);
+		cerr.rdbuf(err);
+		if ( !ok ) {
+			cerr << corpus[c] << ": intact output failed verification\n";
+			return false;
+		}
+
+		const ATFBlock &block = layout.block(0,0,0);
+		vector<uint8_t> cut;
+		truncate_block(atf,block,block.length/2,cut);
+		err = cerr.rdbuf(discard.rdbuf());
+		ok = atf_verify(dds.data(),dds.size(),cut.data(),cut.size(),false,0,result);
+		cerr.rdbuf(err);
+		if ( ok || result.failed == 0 ) {
+			cerr << corpus[c] << ": truncated output passed verification\n";
+			return false;
+		}
+
+		// flipped bits may still decode into something close enough, the
+		// check is that every level is decoded and compared without a crash
+		vector<uint8_t> flipped = atf;
+		uint32_t seed = uint32_t(c) + 1;
+		for ( int32_t r=0; r<50; r++) {
+			flipped[block.offset + next_random(seed) % block.length] ^= uint8_t(1 << (next_random(seed) % 8));
+			err = cerr.rdbuf(discard.rdbuf());
+			atf_verify(dds.data(),dds.size(),flipped.data(),flipped.size(),false,0,result);
+			cerr.rdbuf(err);
+			if ( result.levels == 0 ) {
+				cerr << corpus[c] << ": no level of the output with flipped bits was checked\n";
+				return false;
+			}
+		}
+		discard.str("");
+	}
+	return true;
+}
+
+static bool write_file(const char *name, const vector<uint8_t> &data)
+{
+	ofstream ofile(name,ios::out|ios::binary);
+	ofile.write((const char *)data.data(),data.size());
+	ofile.close();
+	return !ofile.fail();
+}
+
+static bool load_hashes(const char *name, ATFLayout &layout)
+{
+	ifstream ifile(name,ios::in|ios::binary);
+	return ifile.is_open() && atf_load_layout(name,ifile,layout);
+}
+
+static bool test_stale_index()
+{
+	const char *name = "atftest.tmp.atf";
+	string idxname = atf_index_name(name);
+	bool ok = true;
+	for ( int32_t c=0; c<CORPUS_COUNT && ok; c++) {
+		vector<uint8_t> dds;
+		vector<uint8_t> atf;
+		ATFLayout layout;
+		if ( !convert(corpus[c],dds,atf) || !atf_parse_layout(atf.data(),atf.size(),layout) ) {
+			ok = false;
+			break;
+		}
+		vector<ATFLevelHash> hashes(layout.faces * layout.count);
+		for ( size_t h=0; h<hashes.size(); h++) {
+			hashes[h].hash[0] = h + 1;
+			hashes[h].hash[1] = ~uint64_t(h);
+		}
+		if ( !write_file(name,atf) || !atf_write_index_file(name,hashes) ) {
+			ok = false;
+			break;
+		}
+		if ( !load_hashes(name,layout) || layout.hashes.size() != hashes.size() || layout.hashes[0].hash[1] != hashes[0].hash[1] ) {
+			cerr << corpus[c] << ": level hashes of an intact sidecar were not loaded\n";
+			ok = false;
+			break;
+		}
+
+		// same length, same layout, different data
+		const ATFBlock &block = layout.block(0,layout.count-1,0);
+		atf[block.offset + block.length/2] ^= 0x10;
+		if ( !write_file(name,atf) ) {
+			ok = false;
+			break;
+		}
+		if ( !load_hashes(name,layout) || !layout.hashes.empty() ) {
+			cerr << corpus[c] << ": level hashes of a stale sidecar were loaded\n";
+			ok = false;
+		}
+	}
+	remove(name);
+	remove(idxname.c_str());
+	return ok;
+}
+
+struct TileSource {
+	int32_t			w;
+	int32_t			h;
+	const uint8_t  *rgb;
+};
+
+static void ReadTileSource(jxr_image_t image, int mx, int my, int *data) {
+	const TileSource *src = (const TileSource *)jxr_get_user_data(image);
+	int32_t n = jxr_get_IMAGE_CHANNELS(image);
+	for ( int32_t y=0; y<16; y++) {
+		for ( int32_t x=0; x<16; x++) {
+			const uint8_t *p = src->rgb + (((my*16)+y)*src->w + (mx*16)+x)*3;
+			data[(16*y+x)*n+0] = p[0];
+			data[(16*y+x)*n+1] = p[1];
+			data[(16*y+x)*n+2] = p[2];
+		}
+	}
+}
+
+// Encodes rgb with 2 tile columns and 3 tile rows, every tile with a HP
+// quantizer of its own, and wraps the JPEG-XR stream into a single level RGB
+// ATF file. dds2atf only uses full width tiles, this covers the per tile
+// quantizer lookup (GET_TILE_QUANT) for tiles in several columns.
+static bool encode_tiles(const TileSource &src, const uint8_t hpqp[6], vector<uint8_t> &atf)
+{
+	static unsigned int tile_width[2 * 2] = { 0 };
+	static unsigned int tile_height[3 * 2] = { 0 };
+	static unsigned char window_params[5] = { 0, 0, 0, 0, 0 };
+
+	jxr_container_t container = jxr_create_container();
+	jxrc_start_file(container);
+	if ( jxrc_begin_ifd_entry(container) != 0 ) {
+		jxr_destroy_container(container);
+		return false;
+	}
+	jxrc_set_pixel_format(container, JXRC_FMT_24bppBGR);
+	jxrc_set_image_shape(container, src.w, src.h);
+	jxrc_set_separate_alpha_image_plane(container, 0);
+	jxrc_set_image_band_presence(container, JXR_BP_ALL);
+
+	jxr_image_t image = jxr_create_image(src.w, src.h, window_params);
+	jxr_set_INTERNAL_CLR_FMT(image, JXR_YUV444, 1);
+	jxr_set_OUTPUT_CLR_FMT(image, JXR_OCF_RGB);
+	jxr_set_OUTPUT_BITDEPTH(image, JXR_BD8);
+	jxr_set_BANDS_PRESENT(image, JXR_BP_ALL);
+	jxr_set_TRIM_FLEXBITS(image, 0);
+	jxr_set_OVERLAP_FILTER(image, 0);
+	jxr_set_DISABLE_TILE_OVERLAP(image, 1);
+	jxr_set_FREQUENCY_MODE_CODESTREAM_FLAG(image, 0);
+	jxr_set_PROFILE_IDC(image, 111);
+	jxr_set_LEVEL_IDC(image, 255);
+	jxr_set_LONG_WORD_FLAG(image, 1);
+	jxr_set_ALPHA_IMAGE_PLANE_FLAG(image, 0);
+	jxr_set_NUM_VER_TILES_MINUS1(image, 2);
+	jxr_set_NUM_HOR_TILES_MINUS1(image, 3);
+	tile_width[0] = 0;
+	tile_height[0] = 0;
+	jxr_set_TILE_WIDTH_IN_MB(image, tile_width);
+	jxr_set_TILE_HEIGHT_IN_MB(image, tile_height);
+
+	jxr_tile_qp tiles[6];
+	memset(tiles,0,sizeof(tiles));
+	for ( int32_t t=0; t<6; t++) {
+		tiles[t].component_mode = JXR_CM_UNIFORM;
+		tiles[t].channel[0].dc_qp = 4;
+		tiles[t].channel[0].num_lp = 1;
+		tiles[t].channel[0].lp_qp[0] = 4;
+		tiles[t].channel[0].num_hp = 1;
+		tiles[t].channel[0].hp_qp[0] = hpqp[t];
+	}
+	jxr_set_QP_UNIFORM(image, 4);
+	jxr_set_QP_DISTRIBUTED(image, tiles);
+
+	jxrc_begin_image_data(container);
+	jxr_set_block_input(image, ReadTileSource);
+	jxr_set_user_data(image, (void *)&src);
+	bool ok = jxr_write_image_bitstream(image,container) == 0;
+	jxr_destroy(image);
+
+	if ( ok ) {
+		jxrc_write_container_post(container);
+		uint32_t len = uint32_t(container->wb.len());
+		uint32_t fileLen = 4 + 3 + len;
+		uint8_t header[] = { 'A', 'T', 'F', uint8_t(fileLen>>16), uint8_t(fileLen>>8), uint8_t(fileLen),
+							 ATFDecoder::ATF_FORMAT_888, 0, 0, 1, uint8_t(len>>16), uint8_t(len>>8), uint8_t(len) };
+		for ( int32_t l=0; ( 1 << l ) < src.w; l++) {
+			header[7]++;
+		}
+		for ( int32_t l=0; ( 1 << l ) < src.h; l++) {
+			header[8]++;
+		}
+		atf.assign(header,header+sizeof(header));
+		atf.insert(atf.end(),container->wb.buffer(),container->wb.buffer()+len);
+	}
+	jxr_destroy_container(container);
+	return ok;
+}
+
+static bool test_tile_quant()
+{
+	// row major: tile (tx,ty) is hpqp[ty*2+tx], all different and out of order
+	static const uint8_t hpqp[6] = { 8, 80, 40, 120, 100, 20 };
+
+	TileSource src;
+	src.w = 128;
+	src.h = 128;
+	vector<uint8_t> rgb(src.w*src.h*3);
+	uint32_t seed = 1;
+	for ( size_t c=0; c<rgb.size(); c++) {
+		rgb[c] = uint8_t(64 + next_random(seed) % 128);
+	}
+	src.rgb = rgb.data();
+
+	vector<uint8_t> atf;
+	if ( !encode_tiles(src,hpqp,atf) ) {
+		cerr << "tile_quant: JPEG-XR encoding failed\n";
+		return false;
+	}
+	atf_image image;
+	int result = atf_decode(atf.data(),atf.size(),0,0,&image);
+	if ( result != ATF_OK ) {
+		cerr << "tile_quant: " << atf_error_string(result) << "\n";
+		return false;
+	}
+
+	// tiles are 64 wide and 32, 32 and 64 high (8 x 8 macroblocks split 4+4 and 2+2+4)
+	static const int32_t rows[4] = { 0, 32, 64, 128 };
+	double error[6] = { 0 };
+	for ( int32_t ty=0; ty<3; ty++) {
+		for ( int32_t tx=0; tx<2; tx++) {
+			double sum = 0;
+			for ( int32_t y=rows[ty]; y<rows[ty+1]; y++) {
+				for ( int32_t x=tx*64; x<(tx+1)*64; x++) {
+					for ( int32_t c=0; c<3; c++) {
+						size_t i = size_t((y*src.w)+x)*3+c;
+						sum += abs(int32_t(image.data.data[i]) - int32_t(rgb[i]));
+					}
+				}
+			}
+			error[ty*2+tx] = sum / ( (rows[ty+1]-rows[ty]) * 64 * 3 );
+		}
+	}
+	atf_buffer_free(&image.data);
+
+	// every tile has to be quantized with its own quantizer: the error of the
+	// tiles follows the order of their quantizers
+	for ( int32_t a=0; a<6; a++) {
+		for ( int32_t b=0; b<6; b++) {
+			if ( hpqp[a] < hpqp[b] && error[a] >= error[b] ) {
+				cerr << "tile_quant: tile " << a << " (qp " << int32_t(hpqp[a]) << ", error " << error[a] << ") not finer than tile " << b << " (qp " << int32_t(hpqp[b]) << ", error " << error[b] << ")\n";
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+
+	const char *filter = 0;
+
+	for (int32_t c = 1; c < argc; c++) {
+		if (argv[c][0] == '-' && argv[c][1] == 'f' && c+1 < argc) {
+			filter = argv[++c];
+		} else {
+			print_usage();
+			return -1;
+		}
+	}
+
+	TestCase tests[] = {
+		{ "truncated_jxr",		test_truncated_jxr },
+		{ "truncated_file",		test_truncated_file },
+		{ "flipped_bits",		test_flipped_bits },
+		{ "verify_corrupt",		test_verify_corrupt },
+		{ "stale_index",		test_stale_index },
+		{ "tile_quant",			test_tile_quant }
+	};
+
+	int32_t run = 0;
+	int32_t failed = 0;
+	for ( size_t c=0; c<sizeof(tests)/sizeof(tests[0]); c++) {
+		if ( filter && !strstr(tests[c].name,filter) ) {
+			continue;
+		}
+		bool ok = tests[c].run();
+		cout << ( ok ? "ok     " : "FAILED " ) << tests[c].name << "\n";
+		run++;
+		failed += ok ? 0 : 1;
+	}
+	cout << run << " tests, " << failed << " failed\n";
+	return failed ? 1 : 0;
+}
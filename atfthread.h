@@ -0,0 +1,219 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _ATFTHREAD_H_
+#define _ATFTHREAD_H_
+
+#include <stddef.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <time.h>
+#endif //#ifdef _MSC_VER
+
+//
+// Minimal threading support for the batch, watch and daemon modes. The converter keeps its settings
+// and stats in globals, these are declared ATF_THREAD_LOCAL so every worker
+// thread converts with its own copy.
+//
+
+#ifdef _MSC_VER
+#define ATF_THREAD_LOCAL __declspec(thread)
+#else
+#define ATF_THREAD_LOCAL __thread
+#endif //#ifdef _MSC_VER
+
+typedef void (*atf_thread_proc)(void *arg);
+
+struct atf_thread {
+	atf_thread_proc	proc;
+	void		   *arg;
+#ifdef _MSC_VER
+	HANDLE			handle;
+#else
+	pthread_t		handle;
+#endif //#ifdef _MSC_VER
+};
+
+#ifdef _MSC_VER
+static unsigned __stdcall atf_thread_entry(void *arg) {
+	atf_thread *thread = (atf_thread *)arg;
+	thread->proc(thread->arg);
+	return 0;
+}
+#else
+static void *atf_thread_entry(void *arg) {
+	atf_thread *thread = (atf_thread *)arg;
+	thread->proc(thread->arg);
+	return 0;
+}
+#endif //#ifdef _MSC_VER
+
+inline bool atf_thread_start(atf_thread &thread, atf_thread_proc proc, void *arg) {
+	thread.proc = proc;
+	thread.arg = arg;
+#ifdef _MSC_VER
+	thread.handle = (HANDLE)_beginthreadex(0, 0, atf_thread_entry, &thread, 0, 0);
+	return thread.handle != 0;
+#else
+	return pthread_create(&thread.handle, 0, atf_thread_entry, &thread) == 0;
+#endif //#ifdef _MSC_VER
+}
+
+inline void atf_thread_join(atf_thread &thread) {
+#ifdef _MSC_VER
+	WaitForSingleObject(thread.handle, INFINITE);
+	CloseHandle(thread.handle);
+#else
+	pthread_join(thread.handle, 0);
+#endif //#ifdef _MSC_VER
+}
+
+inline void atf_thread_detach(atf_thread &thread) {
+#ifdef _MSC_VER
+	CloseHandle(thread.handle);
+#else
+	pthread_detach(thread.handle);
+#endif //#ifdef _MSC_VER
+}
+
+struct atf_mutex {
+#ifdef _MSC_VER
+	CRITICAL_SECTION cs;
+	atf_mutex() { InitializeCriticalSection(&cs); }
+	~atf_mutex() { DeleteCriticalSection(&cs); }
+	void lock() { EnterCriticalSection(&cs); }
+	void unlock() { LeaveCriticalSection(&cs); }
+#else
+	pthread_mutex_t mutex;
+	atf_mutex() { pthread_mutex_init(&mutex, 0); }
+	~atf_mutex() { pthread_mutex_destroy(&mutex); }
+	void lock() { pthread_mutex_lock(&mutex); }
+	void unlock() { pthread_mutex_unlock(&mutex); }
+#endif //#ifdef _MSC_VER
+private:
+	atf_mutex(const atf_mutex &);
+	atf_mutex &operator=(const atf_mutex &);
+};
+
+struct atf_condition {
+#ifdef _MSC_VER
+	CONDITION_VARIABLE cv;
+	atf_condition() { InitializeConditionVariable(&cv); }
+	~atf_condition() { }
+	void wait(atf_mutex &mutex) { SleepConditionVariableCS(&cv, &mutex.cs, INFINITE); }
+	void signal() { WakeConditionVariable(&cv); }
+	void broadcast() { WakeAllConditionVariable(&cv); }
+#else
+	pthread_cond_t cond;
+	atf_condition() { pthread_cond_init(&cond, 0); }
+	~atf_condition() { pthread_cond_destroy(&cond); }
+	void wait(atf_mutex &mutex) { pthread_cond_wait(&cond, &mutex.mutex); }
+	void signal() { pthread_cond_signal(&cond); }
+	void broadcast() { pthread_cond_broadcast(&cond); }
+#endif //#ifdef _MSC_VER
+private:
+	atf_condition(const atf_condition &);
+	atf_condition &operator=(const atf_condition &);
+};
+
+// Adds delta to a counter shared between threads and returns the new value.
+inline size_t atf_atomic_add(volatile size_t *value, ptrdiff_t delta) {
+#ifdef _MSC_VER
+#ifdef _WIN64
+	return size_t(InterlockedExchangeAdd64((volatile LONG64 *)value, LONG64(delta)) + delta);
+#else
+	return size_t(InterlockedExchangeAdd((volatile LONG *)value, LONG(delta)) + delta);
+#endif //#ifdef _WIN64
+#else
+	return __sync_add_and_fetch(value, delta);
+#endif //#ifdef _MSC_VER
+}
+
+// Raises a counter shared between threads to at least v.
+inline void atf_atomic_max(volatile size_t *value, size_t v) {
+	size_t current = *value;
+	while ( current < v ) {
+#ifdef _MSC_VER
+#ifdef _WIN64
+		size_t previous = size_t(InterlockedCompareExchange64((volatile LONG64 *)value, LONG64(v), LONG64(current)));
+#else
+		size_t previous = size_t(InterlockedCompareExchange((volatile LONG *)value, LONG(v), LONG(current)));
+#endif //#ifdef _WIN64
+#else
+		size_t previous = __sync_val_compare_and_swap(value, current, v);
+#endif //#ifdef _MSC_VER
+		if ( previous == current ) {
+			break;
+		}
+		current = previous;
+	}
+}
+
+inline int32_t atf_cpu_count() {
+#ifdef _MSC_VER
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return int32_t(info.dwNumberOfProcessors);
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? int32_t(count) : 1;
+#endif //#ifdef _MSC_VER
+}
+
+// Wall clock time in seconds, only meaningful as a difference.
+inline double atf_wall_time() {
+#ifdef _MSC_VER
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return double(now.QuadPart) / double(freq.QuadPart);
+#else
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return double(tv.tv_sec) + double(tv.tv_usec) * 1e-6;
+#endif //#ifdef _MSC_VER
+}
+
+// CPU time of the calling thread in seconds, only meaningful as a difference.
+inline double atf_cpu_time() {
+#ifdef _MSC_VER
+	FILETIME creation, exit, kernel, user;
+	GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	return double(k.QuadPart + u.QuadPart) * 1e-7;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return double(ts.tv_sec) + double(ts.tv_nsec) * 1e-9;
+#endif //#ifdef _MSC_VER
+}
+
+#endif //#ifndef _ATFTHREAD_H_
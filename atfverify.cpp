@@ -0,0 +1,252 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <math.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif //#ifdef _MSC_VER
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif //#ifndef _MSC_VER
+
+#include "atfdds.h"
+#include "atfmem.h"
+#include "atfmips.h"
+#include "atfsched.h"
+#include "atfverify.h"
+#include "libatf.h"
+
+using namespace std;
+
+// How a DDS texel turns into the RGB(A) texel JPEG-XR encodes, the same
+// swizzle atf_dds_to_pvr applies.
+enum {
+	VERIFY_BLOCKS,		// DXT1/DXT5, compared as stored
+	VERIFY_BGRA8,
+	VERIFY_BGRX8,
+	VERIFY_BGR8,
+	VERIFY_L8
+};
+
+struct VerifyTask {
+	const uint8_t  *atf;
+	size_t			atfLen;
+	const uint8_t  *src;		// level data in the DDS file
+	size_t			srcLen;
+	int32_t			kind;		// VERIFY_*
+	int32_t			face;
+	int32_t			level;
+	bool			lossless;
+	ATFMemContext  *memory;		// of the job, the task may run on another thread
+
+	int				error;		// ATF_OK, ATF_ERROR_EMPTY for levels outside the embed range
+	bool			exact;
+	double			psnr;
+	double			blockPsnr;	// of the 4x4 block means, 0 for levels below VERIFY_BLOCK_MIN_SIZE
+};
+
+// Even the coarsest quantization keeps the block means of levels from this
+// size on above 20 dB, anything below VERIFY_BLOCK_PSNR is broken output.
+static const int32_t VERIFY_BLOCK_MIN_SIZE = 16;
+static const double VERIFY_BLOCK_PSNR = 18.0;
+
+static double psnr(double squaredError, size_t samples)
+{
+	return 10.0 * log10(255.0 * 255.0 * double(samples) / squaredError);
+}
+
+static void check_level(VerifyTask &task)
+{
+	task.exact = false;
+	task.psnr = 0;
+	task.blockPsnr = 0;
+
+	atf_image image;
+	task.error = atf_decode(task.atf,task.atfLen,task.face,task.level,&image);
+	if ( task.error != ATF_OK ) {
+		return;
+	}
+
+	if ( task.kind == VERIFY_BLOCKS ) {
+		task.exact = image.data.size == task.srcLen && memcmp(image.data.data,task.src,task.srcLen) == 0;
+		atf_buffer_free(&image.data);
+		return;
+	}
+
+	size_t texels = size_t(image.width) * image.height;
+	int32_t n = image.pixels == ATF_PIXELS_RGBA8 ? 4 : 3;
+	int32_t stride = ( task.kind == VERIFY_BGRA8 || task.kind == VERIFY_BGRX8 ) ? 4 : ( task.kind == VERIFY_BGR8 ? 3 : 1 );
+	if ( image.data.size != texels * n || task.srcLen != texels * stride || ( n == 4 ) != ( task.kind == VERIFY_BGRA8 ) ) {
+		task.error = ATF_ERROR_DECODE;
+		atf_buffer_free(&image.data);
+		return;
+	}
+
+	// squared error per texel and of the 4x4 block means: quantization noise
+	// mostly cancels out in the means, misplaced or garbled data does not
+	double sum = 0;
+	double blockSum = 0;
+	size_t blocks = 0;
+	for ( int32_t by=0; by<image.height; by+=4) {
+		for ( int32_t bx=0; bx<image.width; bx+=4) {
+			int32_t mean[4] = { 0, 0, 0, 0 };
+			int32_t count = 0;
+			for ( int32_t y=by; y<min(image.height,by+4); y++) {
+				for ( int32_t x=bx; x<min(image.width,bx+4); x++) {
+					size_t t = size_t(y) * image.width + x;
+					const uint8_t *dst = image.data.data + t * n;
+					const uint8_t *src = task.src + t * stride;
+					int32_t ref[4];
+					if ( task.kind == VERIFY_L8 ) {
+						ref[0] = ref[1] = ref[2] = src[0];
+					} else {
+						ref[0] = src[2];
+						ref[1] = src[1];
+						ref[2] = src[0];
+						ref[3] = stride == 4 ? src[3] : 255;
+					}
+					for ( int32_t d=0; d<n; d++) {
+						int32_t e = int32_t(dst[d]) - ref[d];
+						sum += double(e * e);
+						mean[d] += e;
+					}
+					count++;
+				}
+			}
+			for ( int32_t d=0; d<n; d++) {
+				double e = double(mean[d]) / count;
+				blockSum += e * e;
+			}
+			blocks++;
+		}
+	}
+	atf_buffer_free(&image.data);
+
+	task.exact = sum == 0;
+	if ( !task.exact ) {
+		task.psnr = psnr(sum,texels * n);
+		task.blockPsnr = image.width >= VERIFY_BLOCK_MIN_SIZE && image.height >= VERIFY_BLOCK_MIN_SIZE ? psnr(blockSum,blocks * n) : 0;
+	}
+}
+
+static void verify_level(void *arg)
+{
+	VerifyTask &task = *(VerifyTask *)arg;
+	ATFMemContext *memory = atf_mem_set_context(task.memory);
+	check_level(task);
+	atf_mem_set_context(memory);
+}
+
+bool atf_verify(const uint8_t *dds, size_t ddsLen, const uint8_t *atf, size_t atfLen, bool lossless, double minPsnr, ATFVerifyResult &result)
+{
+	result.levels = 0;
+	result.failed = 0;
+	result.minPsnr = 0;
+	result.minFace = 0;
+	result.minLevel = 0;
+
+	ATFMipChain chain;
+	atf_info info;
+	if ( !atf_dds_mip_chain(dds,ddsLen,chain) || atf_get_info(atf,atfLen,&info) != ATF_OK ) {
+		cerr << "Verification failed: output is not a valid ATF file.\n";
+		return false;
+	}
+	if ( info.count != chain.count || ( info.cubemap ? 6 : 1 ) != chain.faces ) {
+		cerr << "Verification failed: output has " << info.count << " levels and " << ( info.cubemap ? 6 : 1 ) << " faces, input " << chain.count << " and " << chain.faces << ".\n";
+		result.failed++;
+		return false;
+	}
+
+	// cube faces are stored in DDS order, ATF face i is DDS face dds2ogl[i] (see pvr_mip_chain)
+	static const int32_t dds2ogl[] = { 1, 0, 3, 2, 5, 4 };
+	chain.base = sizeof(DDS_header);
+	if ( chain.faces == 6 ) {
+		copy(dds2ogl,dds2ogl+6,chain.order);
+	}
+
+	const DDS_header *header = (const DDS_header *)dds;
+	int32_t kind = VERIFY_BLOCKS;
+	if ( PF_IS_BGRA8((*header)) ) {
+		kind = VERIFY_BGRA8;
+	} else if ( PF_IS_BGRX8((*header)) ) {
+		kind = VERIFY_BGRX8;
+	} else if ( PF_IS_BGR8((*header)) ) {
+		kind = VERIFY_BGR8;
+	} else if ( PF_IS_SINGLECHANNEL((*header)) ) {
+		kind = VERIFY_L8;
+	}
+
+	vector<VerifyTask> tasks(chain.faces*chain.count);
+	ATFTaskGroup group;
+	for ( int32_t i=0; i<chain.faces; i++) {
+		for ( int32_t c=0; c<chain.count; c++) {
+			VerifyTask &task = tasks[i*chain.count+c];
+			task.atf = atf;
+			task.atfLen = atfLen;
+			task.src = dds + chain.offset(i,c);
+			task.srcLen = chain.level(c).length;
+			task.kind = kind;
+			task.face = i;
+			task.level = c;
+			task.lossless = lossless;
+			task.memory = atf_mem_context();
+			atf_sched_task(group,verify_level,&task);
+		}
+	}
+	atf_sched_wait(group);
+
+	for ( size_t c=0; c<tasks.size(); c++) {
+		const VerifyTask &task = tasks[c];
+		if ( task.error == ATF_ERROR_EMPTY ) {
+			continue;
+		}
+		result.levels++;
+		if ( task.error != ATF_OK ) {
+			cerr << "Verification failed: face " << task.face << " level " << task.level << ": " << atf_error_string(task.error) << "\n";
+			result.failed++;
+		} else if ( task.exact ) {
+			continue;
+		} else if ( task.kind == VERIFY_BLOCKS || task.lossless ) {
+			cerr << "Verification failed: face " << task.face << " level " << task.level << " does not match the input.\n";
+			result.failed++;
+		} else {
+			if ( result.minPsnr == 0 || task.psnr < result.minPsnr ) {
+				result.minPsnr = task.psnr;
+				result.minFace = task.face;
+				result.minLevel = task.level;
+			}
+			if ( task.psnr < minPsnr ) {
+				cerr << "Verification failed: face " << task.face << " level " << task.level << " PSNR " << task.psnr << " dB, below " << minPsnr << " dB.\n";
+				result.failed++;
+			} else if ( task.blockPsnr != 0 && task.blockPsnr < VERIFY_BLOCK_PSNR ) {
+				cerr << "Verification failed: face " << task.face << " level " << task.level << " does not resemble the input, PSNR of the 4x4 block means " << task.blockPsnr << " dB.\n";
+				result.failed++;
+			}
+		}
+	}
+	return result.failed == 0;
+}
@@ -0,0 +1,53 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _ATFVERIFY_H_
+#define _ATFVERIFY_H_
+
+#include <stddef.h>
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif //#ifndef _MSC_VER
+
+//
+// Round trip check of an ATF file against the DDS file it was converted from
+// (dds2atf --verify). Every embedded level of every face is decoded again and
+// compared to the input level: block compressed data and lossless JPEG-XR
+// have to match byte for byte. Lossy JPEG-XR is measured by its PSNR, and
+// the PSNR of the 4x4 block means catches output which is broken rather than
+// quantized, whatever the quantization. The levels are checked as tasks on
+// the scheduler (atfsched.h).
+//
+
+struct ATFVerifyResult {
+	int32_t			levels;		// levels decoded and compared
+	int32_t			failed;		// levels which did not decode or did not match
+	double			minPsnr;	// lowest PSNR of a lossy level in dB, 0 if all were exact
+	int32_t			minFace;	// face and level of minPsnr
+	int32_t			minLevel;
+};
+
+// lossless asks for an exact match of JPEG-XR levels, otherwise every level
+// needs at least minPsnr dB (0 for no limit). Mismatches are reported on cerr.
+bool atf_verify(const uint8_t *dds, size_t ddsLen, const uint8_t *atf, size_t atfLen, bool lossless, double minPsnr, ATFVerifyResult &result);
+
+#endif //#ifndef _ATFVERIFY_H_
@@ -27,230 +27,100 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #ifdef _MSC_VER
 #include <windows.h>
+#include <fcntl.h>
+#include <io.h>
 #endif //#ifdef _MSC_VER
 
 #ifndef _MSC_VER
 #include <stdint.h>
 #endif //#ifndef _MSC_VER
 
+#ifndef _MSC_VER
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif //#ifndef _MSC_VER
+
+#ifdef __linux__
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#endif //#ifdef __linux__
+
+#include <deque>
+#include <map>
+
 #include "3rdparty/jpegxr/jpegxr.h"
 #include "3rdparty/jpegxr/jxr_priv.h"
 #include "3rdparty/lzma/LzmaLib.h"
 #include "atf.h"
+#include "atfcache.h"
+#include "atfdds.h"
+#include "atfindex.h"
+#include "atfmem.h"
+#include "atfmips.h"
+#include "atfoutput.h"
+#include "atfrepack.h"
+#include "atfsched.h"
+#include "atfstats.h"
+#include "atfthread.h"
+#include "atfverify.h"
 
 using namespace std;
 
-/* DDS loader written by Jon Watte 2002 */
-/* Permission granted to use freely, as long as Jon Watte */
-/* is held harmless for all possible damages resulting from */
-/* your use or failure to use this code. */
-/* No warranty is expressed or implied. Use at your own risk, */
-/* or not at all. */
-
-//  little-endian, of course
-#define DDS_MAGIC 0x20534444
-
-//  DDS_header.dwFlags
-#define DDSD_CAPS                   0x00000001 
-#define DDSD_HEIGHT                 0x00000002 
-#define DDSD_WIDTH                  0x00000004 
-#define DDSD_PITCH                  0x00000008 
-#define DDSD_PIXELFORMAT            0x00001000 
-#define DDSD_MIPMAPCOUNT            0x00020000 
-#define DDSD_LINEARSIZE             0x00080000 
-#define DDSD_DEPTH                  0x00800000 
-
-//  DDS_header.sPixelFormat.dwFlags
-#define DDPF_ALPHAPIXELS            0x00000001 
-#define DDPF_FOURCC                 0x00000004 
-#define DDPF_INDEXED                0x00000020 
-#define DDPF_RGB                    0x00000040 
-
-//  DDS_header.sCaps.dwCaps1
-#define DDSCAPS_COMPLEX             0x00000008 
-#define DDSCAPS_TEXTURE             0x00001000 
-#define DDSCAPS_MIPMAP              0x00400000 
-
-//  DDS_header.sCaps.dwCaps2
-#define DDSCAPS2_CUBEMAP            0x00000200 
-#define DDSCAPS2_CUBEMAP_POSITIVEX  0x00000400 
-#define DDSCAPS2_CUBEMAP_NEGATIVEX  0x00000800 
-#define DDSCAPS2_CUBEMAP_POSITIVEY  0x00001000 
-#define DDSCAPS2_CUBEMAP_NEGATIVEY  0x00002000 
-#define DDSCAPS2_CUBEMAP_POSITIVEZ  0x00004000 
-#define DDSCAPS2_CUBEMAP_NEGATIVEZ  0x00008000 
-#define DDSCAPS2_VOLUME             0x00200000 
-
-#define D3DFMT_DXT1     '1TXD'    //  DXT1 compression texture format 
-#define D3DFMT_DXT2     '2TXD'    //  DXT2 compression texture format 
-#define D3DFMT_DXT3     '3TXD'    //  DXT3 compression texture format 
-#define D3DFMT_DXT4     '4TXD'    //  DXT4 compression texture format 
-#define D3DFMT_DXT5     '5TXD'    //  DXT5 compression texture format 
-#define D3DFMT_ATI2     '2ITA'    //  ATI2 compression texture format 
-#define D3DFMT_ATI1     '1ITA'    //  ATI1 compression texture format 
-#define D3DFMT_BC4U     'U4CB'    //  BC4U compression texture format 
-#define D3DFMT_BC4S     'S4CB'    //  BC4S compression texture format 
-#define D3DFMT_BC5U     'U5CB'    //  BC4U compression texture format 
-#define D3DFMT_BC5S     'S5CB'    //  BC4S compression texture format 
-
-#define PF_IS_BC5S(pf) \
-  ((pf.sPixelFormat.dwFlags & DDPF_FOURCC) && \
-   (pf.sPixelFormat.dwFourCC == D3DFMT_BC5S))
-
-#define PF_IS_BC5U(pf) \
-  ((pf.sPixelFormat.dwFlags & DDPF_FOURCC) && \
-   (pf.sPixelFormat.dwFourCC == D3DFMT_BC5U))
-
-#define PF_IS_BC4S(pf) \
-  ((pf.sPixelFormat.dwFlags & DDPF_FOURCC) && \
-   (pf.sPixelFormat.dwFourCC == D3DFMT_BC4S))
-
-#define PF_IS_BC4U(pf) \
-  ((pf.sPixelFormat.dwFlags & DDPF_FOURCC) && \
-   (pf.sPixelFormat.dwFourCC == D3DFMT_BC4U))
-
-#define PF_IS_ATI1(pf) \
-  ((pf.sPixelFormat.dwFlags & DDPF_FOURCC) && \
-   (pf.sPixelFormat.dwFourCC == D3DFMT_ATI1))
-
-#define PF_IS_ATI2(pf) \
-  ((pf.sPixelFormat.dwFlags & DDPF_FOURCC) && \
-   (pf.sPixelFormat.dwFourCC == D3DFMT_ATI2))
-
-#define PF_IS_DXT1(pf) \
-  ((pf.sPixelFormat.dwFlags & DDPF_FOURCC) && \
-   (pf.sPixelFormat.dwFourCC == D3DFMT_DXT1))
-
-#define PF_IS_DXT3(pf) \
-  ((pf.sPixelFormat.dwFlags & DDPF_FOURCC) && \
-   (pf.sPixelFormat.dwFourCC == D3DFMT_DXT3))
-
-#define PF_IS_DXT5(pf) \
-  ((pf.sPixelFormat.dwFlags & DDPF_FOURCC) && \
-   (pf.sPixelFormat.dwFourCC == D3DFMT_DXT5))
-
-#define PF_IS_BGRA8(pf) \
-  ((pf.sPixelFormat.dwFlags & DDPF_RGB) && \
-   (pf.sPixelFormat.dwFlags & DDPF_ALPHAPIXELS) && \
-   (pf.sPixelFormat.dwRGBBitCount == 32) && \
-   (pf.sPixelFormat.dwRBitMask == 0xff0000) && \
-   (pf.sPixelFormat.dwGBitMask == 0xff00) && \
-   (pf.sPixelFormat.dwBBitMask == 0xff) && \
-   (pf.sPixelFormat.dwAlphaBitMask == 0xff000000U))
-
-#define PF_IS_BGR8(pf) \
-  ((pf.sPixelFormat.dwFlags & DDPF_RGB) && \
-  !(pf.sPixelFormat.dwFlags & DDPF_ALPHAPIXELS) && \
-   (pf.sPixelFormat.dwRGBBitCount == 24) && \
-   (pf.sPixelFormat.dwRBitMask == 0xff0000) && \
-   (pf.sPixelFormat.dwGBitMask == 0xff00) && \
-   (pf.sPixelFormat.dwBBitMask == 0xff))
-
-#define PF_IS_BGRX8(pf) \
-  ((pf.sPixelFormat.dwFlags & DDPF_RGB) && \
-  !(pf.sPixelFormat.dwFlags & DDPF_ALPHAPIXELS) && \
-   (pf.sPixelFormat.dwRGBBitCount == 32) && \
-   (pf.sPixelFormat.dwRBitMask == 0xff0000) && \
-   (pf.sPixelFormat.dwGBitMask == 0xff00) && \
-   (pf.sPixelFormat.dwBBitMask == 0xff))
-
-#define PF_IS_BGR5A1(pf) \
-  ((pf.sPixelFormat.dwFlags & DDPF_RGB) && \
-   (pf.sPixelFormat.dwFlags & DDPF_ALPHAPIXELS) && \
-   (pf.sPixelFormat.dwRGBBitCount == 16) && \
-   (pf.sPixelFormat.dwRBitMask == 0x00007c00) && \
-   (pf.sPixelFormat.dwGBitMask == 0x000003e0) && \
-   (pf.sPixelFormat.dwBBitMask == 0x0000001f) && \
-   (pf.sPixelFormat.dwAlphaBitMask == 0x00008000))
-
-#define PF_IS_BGR565(pf) \
-  ((pf.sPixelFormat.dwFlags & DDPF_RGB) && \
-  !(pf.sPixelFormat.dwFlags & DDPF_ALPHAPIXELS) && \
-   (pf.sPixelFormat.dwRGBBitCount == 16) && \
-   (pf.sPixelFormat.dwRBitMask == 0x0000f800) && \
-   (pf.sPixelFormat.dwGBitMask == 0x000007e0) && \
-   (pf.sPixelFormat.dwBBitMask == 0x0000001f))
-
-#define PF_IS_INDEX8(pf) \
-  ((pf.sPixelFormat.dwFlags & DDPF_INDEXED) && \
-   (pf.sPixelFormat.dwRGBBitCount == 8))
-
-#define PF_IS_SINGLECHANNEL(pf) \
-  (!(pf.sPixelFormat.dwFlags & DDPF_INDEXED) && \
-   (pf.sPixelFormat.dwRGBBitCount == 8) && \
-   ((pf.sPixelFormat.dwRBitMask == 0x000000FF) || \
-   (pf.sPixelFormat.dwGBitMask == 0x0000FF00) || \
-   (pf.sPixelFormat.dwBBitMask == 0x00FF0000) || \
-   (pf.sPixelFormat.dwAlphaBitMask == 0xFF000000)))
-
-
-union DDS_header {
-  struct {
-    unsigned int    dwMagic;
-    unsigned int    dwSize;
-    unsigned int    dwFlags;
-    unsigned int    dwHeight;
-    unsigned int    dwWidth;
-    unsigned int    dwPitchOrLinearSize;
-    unsigned int    dwDepth;
-    unsigned int    dwMipMapCount;
-    unsigned int    dwReserved1[ 11 ];
-
-    //  DDPIXELFORMAT
-    struct {
-      unsigned int    dwSize;
-      unsigned int    dwFlags;
-      unsigned int    dwFourCC;
-      unsigned int    dwRGBBitCount;
-      unsigned int    dwRBitMask;
-      unsigned int    dwGBitMask;
-      unsigned int    dwBBitMask;
-      unsigned int    dwAlphaBitMask;
-    }               sPixelFormat;
-
-    //  DDCAPS2
-    struct {
-      unsigned int    dwCaps1;
-      unsigned int    dwCaps2;
-      unsigned int    dwDDSX;
-      unsigned int    dwReserved;
-    }               sCaps;
-    unsigned int    dwReserved2;
-  };
-  char data[ 128 ];
-};
-
-
-using namespace std;
-
-extern int32_t	gCompressedFormats;
-extern bool		gEncodeRawJXR;
-extern bool		gCheckForAlphaValue;
-extern bool		gSilent;
-extern bool		gTrimFlexBitsDefault ;
-extern int32_t	gTrimFlexBits;
-extern bool		gJxrFormatDefault;
-extern jxr_color_fmt_t gJxrFormat;
-extern bool		gJxrQualityDefault;
-extern int32_t	gJxrQuality;
-extern int32_t  gEmbedRangeStart;
-extern int32_t  gEmbedRangeEnd;
-
-extern size_t	infilesize;
-extern size_t	outfilesize;
-extern size_t	outlzmasize;
-extern size_t	texturew;
-extern size_t	textureh;
-extern size_t	texturecomp;
+extern ATF_THREAD_LOCAL int32_t	gCompressedFormats;
+extern ATF_THREAD_LOCAL bool		gEncodeRawJXR;
+extern ATF_THREAD_LOCAL bool		gCheckForAlphaValue;
+extern ATF_THREAD_LOCAL bool		gSilent;
+extern ATF_THREAD_LOCAL bool		gTrimFlexBitsDefault ;
+extern ATF_THREAD_LOCAL int32_t	gTrimFlexBits;
+extern ATF_THREAD_LOCAL bool		gJxrFormatDefault;
+extern ATF_THREAD_LOCAL jxr_color_fmt_t gJxrFormat;
+extern ATF_THREAD_LOCAL bool		gJxrQualityDefault;
+extern ATF_THREAD_LOCAL int32_t	gJxrQuality;
+extern ATF_THREAD_LOCAL size_t	gTargetBytes;
+extern ATF_THREAD_LOCAL double	gJxrAdaptiveQP;
+extern ATF_THREAD_LOCAL int32_t  gEmbedRangeStart;
+extern ATF_THREAD_LOCAL int32_t  gEmbedRangeEnd;
+extern ATF_THREAD_LOCAL ATFReuse *gReuse;
+
+extern ATF_THREAD_LOCAL size_t	infilesize;
+extern ATF_THREAD_LOCAL size_t	outfilesize;
+extern ATF_THREAD_LOCAL size_t	outlzmasize;
+extern ATF_THREAD_LOCAL size_t	texturew;
+extern ATF_THREAD_LOCAL size_t	textureh;
+extern ATF_THREAD_LOCAL size_t	texturecomp;
 
 extern bool convert(istream &ifile_etc1, istream &ifile_pvrtc, istream &ifile_dxt1, istream &ifile_raw, ostream &ofile);	
 extern bool convert_with_alpha(istream &ifile_etc1, istream &ifile_pvrtc, istream &ifile_dxt5, ostream &ofile);
+extern size_t estimate_convert_memory(const ATFMipChain &chain, size_t filesize, int32_t quality);
 
 void print_usage()
 {
 	cout << "\ndds2atf V0.4 Copyright 2010-2012 Adobe Systems Inc. All rights reserved.\n\n";
 	cout << "\nUsage: dds2atf [-4|-2|-0] [-q <0-180>] [-f <0-15>] -i input.dds -o output.atf\n\n";
+	cout << "   -i/-o '-' reads the DDS file from stdin or writes the ATF file to stdout, e.g. to pipe the output into another tool.\n\n";
 	cout << "   -n  Embed a specific range of texture levels (main texture + mip map) for texture streaming. The range is defined as <start>,<end>. 0 is the main texture, mip map starts with 1.\n\n";
+	cout << "   -x  Write a .atfidx sidecar file listing the byte offset and length of every texture level.\n\n";
+	cout << "   -a  Write every output to a temp file first and rename it into place, so readers never see a partial file.\n\n";
+	cout << "   -d  Write outputs with O_DIRECT, bypassing the page cache, where the file system supports it.\n\n";
+	cout << "   -v  Write an additional output file from the same encode pass: -v <start>,<end>[,<q>[,<f>]] output.atf. The range works like -n, q and f override -q and -f for this output. Levels are encoded once and shared between all outputs with matching settings.\n\n";
+	cout << "   -b  Batch mode: convert all jobs listed in a manifest file instead of -i/-o. Each line reads <input.dds> <output.atf> [-n <start>,<end>] [-q <0-180>] [-f <0-15>] [-r <previous.atf>] [--target-bytes <size>] [--adaptive-qp[=<strength>]] [-4|-2|-0], options on the command line are the defaults for all jobs. '#' starts a comment.\n\n";
+	cout << "   -j  Number of threads, defaults to the number of CPUs. Files, texture levels and faces all share these threads: queued files are converted one per thread, threads without a file of their own help with the levels of the files still running. In daemon mode the number of workers.\n\n";
+	cout << "   -u  Daemon mode: -u <socket> keeps running and converts the jobs sent by atfclient over the UNIX domain socket on one shared worker pool. Options on the command line are the defaults for all jobs.\n\n";
+	cout << "   -w  Watch mode: -w <srcdir> -o <dstdir> keeps running and converts every .dds file in srcdir to dstdir whenever its content changes. Levels which did not change are copied from the previous output.\n\n";
+	cout << "   -r  Incremental rebuild: copy every level whose input data and settings did not change from the previous output file instead of encoding it again. The previous output needs a .atfidx sidecar with level hashes, which -r and -x write. The previous output can be the output file itself.\n\n";
+	cout << "   --stats=json  Print timing and size statistics as JSON once the conversion is done: wall and CPU time per stage (read, swizzle, split, lzma, jxr, write) and every sub-stream with its face, level, format and size in and out. Goes to stdout, or to stderr if the ATF file is written to stdout. Works for single files and batch mode.\n\n";
+	cout << "   --trace  Write a Chrome trace event file: --trace <out.json> records every job, level, LZMA and JPEG-XR call and I/O operation with the thread which ran it, for chrome://tracing or Perfetto. Works for single files and batch mode.\n\n";
+	cout << "   --verify  Decode every output again before it is written and compare each level with the input. Block compressed and lossless (-q 0 -f 0 -4) levels have to match exactly, lossy levels have to resemble the input and with --verify=<dB> need at least that PSNR. A mismatch fails the conversion. The levels are checked in parallel on the -j threads.\n\n";
+	cout << "   --target-bytes  Byte budget for the output file, e.g. --target-bytes 96K. Searches for the lowest -q whose output fits, encoding several qualities at once on the -j threads. An explicit -q is the lowest quality tried. Block compressed output only gets checked against the budget. Can be given per job in batch mode.\n\n";
+	cout << "   --adaptive-qp  Quantize every macroblock of JPEG-XR levels by its activity instead of one -q for the whole level: busy texture, which hides artifacts, gets coarser steps and flat areas and gradients finer ones. --adaptive-qp=<0-4> sets the strength, 0.5 by default. Can be given per job in batch mode.\n\n";
+	cout << "   --max-mem  Limit for the memory used by JPEG-XR, LZMA and the split block data of all running jobs, e.g. --max-mem 512M. A job which pushes the total past the limit fails. Peak usage per job is part of --stats=json.\n\n";
+	cout << "   --mem-budget  Memory budget for batch mode, e.g. --mem-budget 2G. The peak memory of every job is estimated from the size and format of its input and jobs only start while the estimates of all running jobs fit into the budget. Smaller jobs further down the manifest start ahead of a big job which has to wait. Defaults to --max-mem.\n\n";
+	cout << "   -c  Cache directory for encoded texture levels. Levels with identical input data and settings are copied from the cache instead of being encoded again. The directory can be shared between concurrent dds2atf processes.\n\n";
     cout << "Options for non-block compressed texture:\n";
 	cout << "   -4  Use 4:4:4 colorspace (default)\n";
 	cout << "   -2  Use 4:2:2 colorspace\n";
@@ -259,373 +129,1362 @@ void print_usage()
 	cout << "   -f  trim flex bits. 0 == lossless, higher values create compression artifacts.\n\n";
 }
 
-const char *ofilename = 0;
+bool writeIndex = false;
+bool writeStats = false;
+int32_t outputFlags = 0;
+size_t memBudget = 0;
+bool verifyOutput = false;
+double verifyPsnr = 0;
+
+struct OutputVariant {
+	string		filename;
+	int32_t		rangeStart;
+	int32_t		rangeEnd;
+	bool		jxrQualityDefault;
+	int32_t		jxrQuality;
+	bool		trimFlexBitsDefault;
+	int32_t		trimFlexBits;
+};
+
+// One input file and all outputs written from it, variants[0] is the -o output.
+struct ConvertJob {
+	string		ifilename;
+	bool		jxrFormatDefault;
+	jxr_color_fmt_t jxrFormat;
+	vector<OutputVariant> variants;
+	string		reuseFilename;	// previous output for -r, empty if none
+	size_t		targetBytes;	// --target-bytes, 0 if none
+	double		adaptiveQP;		// --adaptive-qp strength, 0 if off
+
+	bool		ok;
+	size_t		insize;
+	size_t		outsize;
+	double		seconds;
+	size_t		reused;
+	int32_t		quality;		// -q picked by --target-bytes, -1 if there was no search
+	ATFVerifyResult verified;	// only filled in with --verify
+	ATFStats	stats;			// only filled in with --stats
+};
+
+static bool same_encode_settings(const OutputVariant &a, const OutputVariant &b)
+{
+	if ( !gEncodeRawJXR ) {
+		return true; // block compressed data is stored raw, quality settings do not apply
+	}
+	return a.jxrQualityDefault == b.jxrQualityDefault &&
+		   a.jxrQuality == b.jxrQuality &&
+		   a.trimFlexBitsDefault == b.trimFlexBitsDefault &&
+		   a.trimFlexBits == b.trimFlexBits;
+}
+
+// --verify: decodes an output again and compares it with the input, adds the result to verified.
+static bool verify_output(const uint8_t *src, size_t len, ATFBuffer &output, bool lossless, ATFVerifyResult &verified)
+{
+	ATFStatsMark start = atf_stats_mark();
+	ATFVerifyResult result;
+	bool ok = atf_verify(src,len,output.data(),output.size(),lossless,verifyPsnr,result);
+	atf_trace_span("verify","verify",start);
+
+	verified.levels += result.levels;
+	verified.failed += result.failed;
+	if ( result.minPsnr != 0 && ( verified.minPsnr == 0 || result.minPsnr < verified.minPsnr ) ) {
+		verified.minPsnr = result.minPsnr;
+		verified.minFace = result.minFace;
+		verified.minLevel = result.minLevel;
+	}
+	return ok;
+}
+
+static bool write_variants(vector<OutputVariant> &variants, ATFReuse &reuse, bool levelHashes, iostream &tfile, stringstream &dfile, bool alpha, const uint8_t *src, size_t len, int32_t &quality, ATFVerifyResult &verified)
+{
+	vector<ATFBuffer *> outputs(variants.size());
+	vector< vector<ATFLevelHash> > hashes(variants.size());
+	bool ok = true;
+
+	vector<bool> written(variants.size(),false);
+	for ( size_t c=0; ok && c<variants.size(); c++) {
+		if ( written[c] ) {
+			continue;
+		}
+
+		// Encode the union of all ranges sharing these settings once...
+		int32_t rangeStart = variants[c].rangeStart;
+		int32_t rangeEnd = variants[c].rangeEnd;
+		for ( size_t d=c+1; d<variants.size(); d++) {
+			if ( !written[d] && same_encode_settings(variants[c],variants[d]) ) {
+				rangeStart = min(rangeStart,variants[d].rangeStart);
+				rangeEnd = max(rangeEnd,variants[d].rangeEnd);
+			}
+		}
+
+		gEmbedRangeStart = rangeStart;
+		gEmbedRangeEnd = rangeEnd;
+		gJxrQualityDefault = variants[c].jxrQualityDefault;
+		gJxrQuality = variants[c].jxrQuality;
+		gTrimFlexBitsDefault = variants[c].trimFlexBitsDefault;
+		gTrimFlexBits = variants[c].trimFlexBits;
+
+		tfile.clear();
+		tfile.seekg(0,ios_base::beg);
+		dfile.clear();
+		dfile.seekg(0,ios_base::beg);
+
+		ATFBuffer encoded;
+		ostream atf(&encoded);
+		reuse.hashes.clear();
+		gReuse = &reuse;
+		if ( alpha ) {
+			ok = convert_with_alpha(dfile, dfile, tfile, atf);
+		} else {
+			ok = convert(dfile, dfile, tfile, tfile, atf);
+		}
+		gReuse = 0;
+
+		if ( c == 0 && gTargetBytes && gEncodeRawJXR ) {
+			quality = gJxrQuality;
+		}
+
+		// the encoder resolved the defaults, lossless JPEG-XR has to round trip exactly
+		bool lossless = gJxrQuality == 0 && gTrimFlexBits == 0 && gJxrFormat == JXR_YUV444;
+
+		ATFLayout layout;
+		if ( ok ) {
+			ok = atf_parse_layout(encoded.data(),encoded.size(),layout);
+		}
+
+		// ...and cut every output out of the shared level blocks.
+		istream source(&encoded);
+		for ( size_t d=c; ok && d<variants.size(); d++) {
+			if ( written[d] || !same_encode_settings(variants[c],variants[d]) ) {
+				continue;
+			}
+			outputs[d] = new ATFBuffer;
+			outputs[d]->reserve(atf_slice_size(layout,variants[d].rangeStart,variants[d].rangeEnd));
+			ostream ofile(outputs[d]);
+			source.clear();
+			ok = atf_slice(source,layout,variants[d].rangeStart,variants[d].rangeEnd,ofile);
+			written[d] = true;
+
+			// the quality search only covers JPEG-XR, block compressed data is stored as is
+			if ( ok && gTargetBytes && outputs[d]->size() > gTargetBytes ) {
+				cerr << "Output is " << outputs[d]->size() << " bytes, above the target of " << gTargetBytes << " bytes.\n\n";
+				ok = false;
+			}
+
+			// checked before anything is written, a bad output never replaces a good file
+			if ( ok && verifyOutput ) {
+				ok = verify_output(src,len,*outputs[d],lossless,verified);
+			}
+
+			// levels sliced away were not encoded for this output
+			hashes[d] = reuse.hashes;
+			for ( size_t e=0; e<hashes[d].size(); e++) {
+				int32_t level = int32_t(e % layout.count);
+				if ( level < variants[d].rangeStart || level > variants[d].rangeEnd ) {
+					hashes[d][e].hash[0] = 0;
+					hashes[d][e].hash[1] = 0;
+				}
+			}
+		}
+	}
+
+	// Every output is written with a single write once all of them are complete.
+	for ( size_t c=0; c<variants.size(); c++) {
+		if ( ok ) {
+			ATFStatsMark write = atf_stats_mark();
+			if ( variants[c].filename == "-" ) {
+				cout.write((const char *)outputs[c]->data(),outputs[c]->size());
+				cout.flush();
+				ok = !cout.bad();
+			} else if ( !atf_write_output(variants[c].filename.c_str(),outputs[c]->data(),outputs[c]->size(),outputFlags) ) {
+				ok = false;
+			} else if ( writeIndex || levelHashes ) {
+				if ( !atf_write_index_file(variants[c].filename.c_str(),hashes[c]) ) {
+					ok = false;
+				}
+			} else {
+				// A sidecar left by an earlier -x run no longer describes this output.
+				remove(atf_index_name(variants[c].filename.c_str()).c_str());
+			}
+			outfilesize += outputs[c]->size();
+			atf_stats_stage(ATF_STAGE_WRITE,write);
+		}
+		delete outputs[c];
+	}
+
+	return ok;
+}
+
+// Parses a byte count with an optional K, M or G suffix.
+static bool parse_size(const char *arg, size_t &size)
+{
+	std::istringstream s(arg);
+	double value = 0;
+	char unit = 0;
+	if ( !( s >> value ) || value < 0 ) {
+		return false;
+	}
+	s >> unit;
+	switch ( unit ) {
+		case	'K': case 'k':
+				value *= 1024.0;
+				break;
+		case	'M': case 'm':
+				value *= 1024.0 * 1024.0;
+				break;
+		case	'G': case 'g':
+				value *= 1024.0 * 1024.0 * 1024.0;
+				break;
+		case	0:
+				break;
+		default:
+				return false;
+	}
+	size = size_t(value);
+	return true;
+}
+
+// Handles the options which can differ per job: -n, -q, -f, -r, -4, -2, -0, --target-bytes and --adaptive-qp.
+// Returns the number of arguments consumed, 0 if argv[c] is not a job option.
+static int32_t parse_job_option(int32_t argc, char *argv[], int32_t c, ConvertJob &job)
+{
+	OutputVariant &output = job.variants[0];
+	if (argv[c][0] != '-') {
+		return 0;
+	}
+	if (argv[c][1] == 'n' && c+1 < argc) {
+		std::istringstream s(argv[c+1]);
+		char dummy;
+		s >> output.rangeStart >> dummy >> output.rangeEnd;
+		return 2;
+	} else if (argv[c][1] == '4') {
+		job.jxrFormat = JXR_YUV444;
+		job.jxrFormatDefault = false;
+		return 1;
+	} else if (argv[c][1] == '2') {
+		job.jxrFormat = JXR_YUV422;
+		job.jxrFormatDefault = false;
+		return 1;
+	} else if (argv[c][1] == '0') {
+		job.jxrFormat = JXR_YUV420;
+		job.jxrFormatDefault = false;
+		return 1;
+	} else if (argv[c][1] == 'f' && c+1 < argc) {
+		std::istringstream s(argv[c+1]);
+		s >> output.trimFlexBits;
+		output.trimFlexBits = max(0,min(15,output.trimFlexBits));
+		output.trimFlexBitsDefault = false;
+		return 2;
+	} else if (argv[c][1] == 'q' && c+1 < argc) {
+		std::istringstream s(argv[c+1]);
+		s >> output.jxrQuality;
+		output.jxrQuality = max(0,min(100,output.jxrQuality));
+		output.jxrQualityDefault = false;
+		return 2;
+	} else if (argv[c][1] == 'r' && c+1 < argc) {
+		job.reuseFilename = argv[c+1];
+		return 2;
+	} else if (strcmp(argv[c],"--target-bytes") == 0 && c+1 < argc) {
+		return parse_size(argv[c+1],job.targetBytes) ? 2 : 0;
+	} else if (strcmp(argv[c],"--adaptive-qp") == 0) {
+		job.adaptiveQP = 0.5;
+		return 1;
+	} else if (strncmp(argv[c],"--adaptive-qp=",14) == 0) {
+		std::istringstream s(argv[c]+14);
+		if ( !( s >> job.adaptiveQP ) ) {
+			return 0;
+		}
+		job.adaptiveQP = max(0.0,min(4.0,job.adaptiveQP));
+		return 1;
+	}
+	return 0;
+}
+
+// Reads the whole input file, '-' reads from stdin.
+static bool read_input(const string &filename, vector<uint8_t> &data)
+{
+	if ( filename == "-" ) {
+#ifdef _MSC_VER
+		_setmode(_fileno(stdin),_O_BINARY);
+#endif //#ifdef _MSC_VER
+		char buffer[65536];
+		while ( cin.read(buffer,sizeof(buffer)) || cin.gcount() ) {
+			data.insert(data.end(),buffer,buffer+cin.gcount());
+		}
+		return true;
+	}
+
+	ifstream ifile(filename.c_str(),ios::in|ios::binary);
+	if ( !ifile.is_open() ) {
+		cerr << "Could not open input file. '";
+		cerr << filename;
+		cerr << "'\n\n";
+		return false;
+	}
+
+	ifile.seekg(0,ios_base::end);
+	size_t filesize = ifile.tellg();
+	ifile.seekg(0,ios_base::beg);
+
+	data.resize(filesize);
+	if ( filesize ) {
+		ifile.read((char *)&data[0],filesize);
+	}
+	ifile.close();
+	return true;
+}
+
+static bool encode_job(ConvertJob &job)
+{
+	double start = atf_wall_time();
+
+	job.ok = false;
+	job.insize = 0;
+	job.outsize = 0;
+	job.seconds = 0;
+	job.reused = 0;
+	job.quality = -1;
+	memset(&job.verified,0,sizeof(job.verified));
+
+	atf_mem_reset_context();
+
+	gJxrFormatDefault = job.jxrFormatDefault;
+	gJxrFormat = job.jxrFormat;
+	gTargetBytes = job.targetBytes;
+	gJxrAdaptiveQP = job.adaptiveQP;
+	gCompressedFormats = 1;
+	gCheckForAlphaValue = false;
+	infilesize = 0;
+	outfilesize = 0;
+	outlzmasize = 0;
+
+	ATFStatsMark read = atf_stats_mark();
+	vector<uint8_t> data;
+	if ( !read_input(job.ifilename,data) ) {
+		return false;
+	}
+	atf_stats_stage(ATF_STAGE_READ,read);
+	size_t filesize = data.size();
+	data.resize(max(size_t(1),filesize));
+	uint8_t *src = &data[0];
+	job.insize = filesize;
+
+	// The PVR data is kept in an ATFBuffer so the encoder can address levels in place.
+	ATFBuffer tbuffer;
+	tbuffer.reserve(filesize);
+	iostream tfile(&tbuffer);
+	stringstream dfile(ios_base::out|ios_base::in|ios_base::binary);
+	bool dxt5 = false;
+	ATFStatsMark swizzle = atf_stats_mark();
+	if ( !atf_dds_to_pvr(src,filesize,tfile,dxt5,gEncodeRawJXR) ) {
+		return false;
+	}
+	atf_stats_stage(ATF_STAGE_SWIZZLE,swizzle);
+	tfile.seekg(0,ios_base::beg);
+
+	// The previous output is read up front, it is usually overwritten by this job.
+	ATFReuse reuse;
+	reuse.atf = 0;
+	reuse.active = false;
+	reuse.count = 0;
+	reuse.reused = 0;
+	stringstream previous(ios_base::out|ios_base::in|ios_base::binary);
+	if ( !job.reuseFilename.empty() ) {
+		ifstream pfile(job.reuseFilename.c_str(),ios::in|ios::binary);
+		if ( pfile.is_open() ) {
+			previous << pfile.rdbuf();
+			pfile.close();
+			if ( !atf_load_layout(job.reuseFilename.c_str(),previous,reuse.layout) ) {
+				cerr << "Warning: Previous output is not a valid ATF file, encoding all levels. '" << job.reuseFilename << "'\n";
+			} else if ( reuse.layout.hashes.empty() ) {
+				cerr << "Warning: Previous output has no level hashes, encoding all levels. '" << job.reuseFilename << "'\n";
+			} else {
+				reuse.atf = &previous;
+			}
+		}
+	}
+
+	job.ok = write_variants(job.variants,reuse,!job.reuseFilename.empty(),tfile,dfile,dxt5,src,filesize,job.quality,job.verified);
+	job.reused = reuse.reused;
+	job.outsize = outfilesize;
+	job.seconds = atf_wall_time() - start;
+	return job.ok;
+}
+
+static bool convert_job(ConvertJob &job)
+{
+	if ( !writeStats && !atf_trace_enabled() ) {
+		return encode_job(job);
+	}
+
+	atf_stats_reset(job.stats);
+	job.stats.input = job.ifilename;
+	job.stats.output = job.variants[0].filename;
+	texturew = 0;
+	textureh = 0;
+	texturecomp = 3;
+
+	gStats = writeStats ? &job.stats : 0;
+	ATFStatsMark start = atf_stats_mark();
+	bool ok = encode_job(job);
+	ATFStatsMark end = atf_stats_mark();
+	gStats = 0;
+	atf_trace_span(job.ifilename,"job",start);
+
+	job.stats.ok = ok;
+	job.stats.wall = end.wall - start.wall;
+	job.stats.cpu += end.cpu - start.cpu;
+	job.stats.infilesize = infilesize;
+	job.stats.outfilesize = outfilesize;
+	job.stats.outlzmasize = outlzmasize;
+	job.stats.texturew = texturew;
+	job.stats.textureh = textureh;
+	job.stats.texturecomp = texturecomp;
+	atf_mem_get_context(&job.stats.memory);
+	return ok;
+}
+
+static void print_cache_stats()
+{
+	if ( gSilent || !atf_cache_enabled() ) {
+		return;
+	}
+	ATFCacheStats stats;
+	atf_cache_get_stats(stats);
+	cout << "Cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.stores << " stored";
+	cout << " (" << stats.hitBytes << " bytes reused).\n";
+}
+
+//
+// Batch mode: every manifest line is one job, the jobs are handed out to the
+// worker threads in manifest order.
+//
+// With a memory budget every job gets a peak memory estimate up front and is
+// only started while the estimates of all running jobs fit into the budget.
+// When the oldest waiting job does not fit, smaller jobs further down the
+// manifest backfill the free budget, at most one per thread, then the workers
+// wait until the oldest job fits. A job larger than the whole budget runs on
+// its own.
+//
+
+struct BatchQueue {
+	vector<ConvertJob> *jobs;
+	size_t		next;			// oldest job which has not been started
+	size_t		done;
+	size_t		failed;
+	bool		silent;
+	atf_mutex	mutex;
+
+	size_t		budget;			// 0 if jobs are not limited by memory
+	vector<size_t> estimates;
+	vector<bool> started;
+	size_t		admitted;		// sum of the estimates of the running jobs
+	size_t		admittedPeak;
+	int32_t		running;
+	int32_t		overtaken;		// jobs started ahead of the oldest one
+	int32_t		threads;
+	size_t		backfilled;
+	atf_condition changed;
+};
+
+// Peak memory estimate of a job from the size and the header of its input.
+static size_t estimate_job(const ConvertJob &job)
+{
+	ifstream ifile(job.ifilename.c_str(),ios::in|ios::binary);
+	if ( !ifile.is_open() ) {
+		return 0; // fails right away
+	}
+	ifile.seekg(0,ios_base::end);
+	size_t filesize = ifile.tellg();
+	ifile.seekg(0,ios_base::beg);
+
+	DDS_header header;
+	ATFMipChain chain;
+	if ( !ifile.read(header.data,sizeof(header)) || !atf_dds_mip_chain((const uint8_t *)header.data,filesize,chain) ) {
+		return filesize;
+	}
 
-static ifstream ifile;
-static ofstream ofile;
-static stringstream *tfile;
-static stringstream *dfile;
+	// lossless (the default quality) gives the largest JPEG-XR output
+	int32_t quality = 100;
+	for ( size_t c=0; c<job.variants.size(); c++) {
+		quality = min(quality,job.variants[c].jxrQualityDefault ? 0 : job.variants[c].jxrQuality);
+	}
+	return estimate_convert_memory(chain,filesize,quality) + ( job.variants.size() - 1 ) * chain.length();
+}
 
-static bool set_dxt1_header(uint8_t *dst, int width, int height, int count, bool cubemap, size_t textureLen)
+// Starts the next job which may run, false if there is none right now.
+// Called with the queue locked.
+static bool batch_admit(BatchQueue *queue, size_t &job)
 {
-	PVR_HEADER *header = (PVR_HEADER *)dst;
-	
-	header->dwHeaderSize = sizeof(PVR_HEADER);
-	header->dwWidth      = width;
-	header->dwHeight     = height;
-	header->dwMipMapCount= count;
-	header->dwTextureDataSize = textureLen;
-	header->dwpfFlags	 = header->dwMipMapCount ? PVRTEX_MIPMAP : 0;
-	header->dwPVR[0]	 = 'P';
-	header->dwPVR[1]	 = 'V';
-	header->dwPVR[2]	 = 'R';
-	header->dwPVR[3]	 = '!';
-	header->dwNumSurfs	 = 1;
-	
-	header->dwRBitMask = 0xFFFFFFFF;
-	header->dwGBitMask = 0xFFFFFFFF;
-	header->dwBBitMask = 0xFFFFFFFF;
-	header->dwpfFlags |= PVR_D3D_DXT1;
-	if ( cubemap ) {
-		header->dwpfFlags |= PVRTEX_CUBEMAP | PVRTEX_DDSCUBEMAPORDER;
+	size_t count = queue->jobs->size();
+	while ( queue->next < count && queue->started[queue->next] ) {
+		queue->next++;
+	}
+	for ( size_t c=queue->next; c<count; c++) {
+		if ( queue->started[c] ) {
+			continue;
+		}
+		size_t estimate = queue->estimates[c];
+		if ( queue->budget == 0 || queue->running == 0 || queue->admitted + estimate <= queue->budget ) {
+			if ( c == queue->next ) {
+				queue->overtaken = 0;
+			} else {
+				queue->overtaken++;
+				queue->backfilled++;
+			}
+			queue->started[c] = true;
+			queue->admitted += estimate;
+			queue->admittedPeak = max(queue->admittedPeak,queue->admitted);
+			queue->running++;
+			job = c;
+			return true;
+		}
+		if ( c == queue->next && queue->overtaken >= queue->threads ) {
+			return false; // no more backfilling, wait for the oldest job to fit
+		}
+	}
+	return false;
+}
+
+static void batch_worker(void *arg)
+{
+	BatchQueue *queue = (BatchQueue *)arg;
+
+	gSilent = queue->silent;
+
+	for (;;) {
+		size_t c = 0;
+		queue->mutex.lock();
+		while ( !batch_admit(queue,c) ) {
+			if ( queue->next >= queue->jobs->size() ) {
+				queue->mutex.unlock();
+				return;
+			}
+			queue->changed.wait(queue->mutex);
+		}
+		queue->mutex.unlock();
+
+		ConvertJob &job = (*queue->jobs)[c];
+		convert_job(job);
+
+		queue->mutex.lock();
+		queue->admitted -= queue->estimates[c];
+		queue->running--;
+		queue->changed.broadcast();
+		queue->done++;
+		if ( !job.ok ) {
+			queue->failed++;
+			cerr << "[" << queue->done << "/" << queue->jobs->size() << "] FAILED " << job.ifilename << "\n";
+		} else if ( !queue->silent ) {
+			cout << "[" << queue->done << "/" << queue->jobs->size() << "] " << job.ifilename << " -> " << job.variants[0].filename;
+			cout << " (" << job.insize << " -> " << job.outsize << " bytes, " << int32_t(job.seconds * 1000.0) << " ms";
+			if ( !job.reuseFilename.empty() ) {
+				cout << ", " << job.reused << " levels reused";
+			}
+			if ( job.quality >= 0 ) {
+				cout << ", -q " << job.quality;
+			}
+			if ( verifyOutput ) {
+				cout << ", " << job.verified.levels << " levels verified";
+				if ( job.verified.minPsnr != 0 ) {
+					cout << ", min PSNR " << int32_t(job.verified.minPsnr * 100.0) / 100.0 << " dB";
+				}
+			}
+			cout << ")\n";
+		}
+		queue->mutex.unlock();
+	}
+}
+
+// Parses one manifest line, '<input.dds> <output.atf> [options]'. Lines which
+// are empty or only hold a comment leave tokens empty and succeed.
+static bool parse_job_line(const string &line, const ConvertJob &defaults, ConvertJob &job, vector<string> &tokens, string &error)
+{
+	tokens.clear();
+	std::istringstream s(line);
+	string token;
+	while ( s >> token && token[0] != '#' ) {
+		tokens.push_back(token);
+	}
+	if ( tokens.size() == 0 ) {
+		return true;
+	}
+	if ( tokens.size() < 2 ) {
+		error = "Expected '<input.dds> <output.atf> [options]'.";
+		return false;
+	}
+
+	vector<char *> args(tokens.size());
+	for ( size_t c=0; c<tokens.size(); c++) {
+		args[c] = &tokens[c][0];
+	}
+
+	job = defaults;
+	job.ifilename = tokens[0];
+	job.variants[0].filename = tokens[1];
+	for ( int32_t c=2; c<int32_t(args.size()); ) {
+		int32_t used = parse_job_option(int32_t(args.size()),&args[0],c,job);
+		if ( used == 0 ) {
+			error = "Unknown option '" + tokens[c] + "'.";
+			return false;
+		}
+		c += used;
 	}
 	return true;
 }
 
-static bool set_dxt5_header(uint8_t *dst, int width, int height, int count, bool cubemap, size_t textureLen)
+static bool read_manifest(const char *manifest, const ConvertJob &defaults, vector<ConvertJob> &jobs)
 {
-	PVR_HEADER *header = (PVR_HEADER *)dst;
-	
-	header->dwHeaderSize = sizeof(PVR_HEADER);
-	header->dwWidth      = width;
-	header->dwHeight     = height;
-	header->dwMipMapCount= count;
-	header->dwTextureDataSize = textureLen;
-	header->dwpfFlags	 = header->dwMipMapCount ? PVRTEX_MIPMAP : 0;
-	header->dwPVR[0]	 = 'P';
-	header->dwPVR[1]	 = 'V';
-	header->dwPVR[2]	 = 'R';
-	header->dwPVR[3]	 = '!';
-	header->dwNumSurfs	 = 1;
-	
-	header->dwRBitMask = 0xFFFFFFFF;
-	header->dwGBitMask = 0xFFFFFFFF;
-	header->dwBBitMask = 0xFFFFFFFF;
-	header->dwpfFlags |= PVR_D3D_DXT5;
-	if ( cubemap ) {
-		header->dwpfFlags |= PVRTEX_CUBEMAP | PVRTEX_DDSCUBEMAPORDER;
+	ifstream mfile(manifest,ios::in);
+	if ( !mfile.is_open() ) {
+		cerr << "Could not open manifest file. '";
+		cerr << manifest;
+		cerr << "'\n\n";
+		return false;
+	}
+
+	string line;
+	for ( int32_t n=1; getline(mfile,line); n++) {
+		ConvertJob job;
+		vector<string> tokens;
+		string error;
+		if ( !parse_job_line(line,defaults,job,tokens,error) ) {
+			cerr << manifest << ":" << n << ": " << error << "\n";
+			return false;
+		}
+		if ( tokens.size() ) {
+			jobs.push_back(job);
+		}
 	}
 	return true;
 }
 
-static bool set_bgr_header(uint8_t *dst, int width, int height, int count, bool cubemap, size_t textureLen)
+static bool run_batch(vector<ConvertJob> &jobs, bool summary)
+{
+	BatchQueue queue;
+	queue.jobs = &jobs;
+	queue.next = 0;
+	queue.done = 0;
+	queue.failed = 0;
+	queue.silent = gSilent;
+
+	// One batch worker per thread of the scheduler, a thread whose worker ran
+	// out of jobs helps with the levels of the jobs which are still running.
+	int32_t threadCount = max(1,min(atf_sched_threads(),int32_t(jobs.size())));
+
+	queue.budget = threadCount > 1 ? memBudget : 0;
+	queue.estimates.resize(jobs.size(),0);
+	queue.started.resize(jobs.size(),false);
+	queue.admitted = 0;
+	queue.admittedPeak = 0;
+	queue.running = 0;
+	queue.overtaken = 0;
+	queue.threads = threadCount;
+	queue.backfilled = 0;
+	if ( queue.budget ) {
+		for ( size_t c=0; c<jobs.size(); c++) {
+			queue.estimates[c] = estimate_job(jobs[c]);
+		}
+	}
+
+	double start = atf_wall_time();
+
+	ATFTaskGroup group;
+	for ( int32_t c=1; c<threadCount; c++) {
+		atf_sched_job(group,batch_worker,&queue);
+	}
+	batch_worker(&queue);
+	atf_sched_wait(group);
+
+	double seconds = max(atf_wall_time() - start, 1e-6);
+
+	if ( summary && !gSilent ) {
+		size_t insize = 0;
+		size_t outsize = 0;
+		for ( size_t c=0; c<jobs.size(); c++) {
+			insize += jobs[c].insize;
+			outsize += jobs[c].outsize;
+		}
+		cout << "\n" << jobs.size() - queue.failed << " of " << jobs.size() << " files converted";
+		cout << " using " << atf_sched_threads() << " threads in " << seconds << "s";
+		if ( queue.failed ) {
+			cout << ", " << queue.failed << " failed";
+		}
+		cout << ".\n";
+		cout << "Read " << insize << " bytes, wrote " << outsize << " bytes";
+		cout << " (" << ( double(insize) / (1024.0 * 1024.0) ) / seconds << " MB/s, ";
+		cout << double(jobs.size()) / seconds << " files/s).\n";
+		if ( queue.budget ) {
+			cout << "Memory budget " << queue.budget << " bytes, at most " << queue.admittedPeak << " bytes admitted";
+			cout << ", " << queue.backfilled << " jobs started ahead of a bigger one.\n";
+		}
+		print_cache_stats();
+	}
+
+	return queue.failed == 0;
+}
+
+//
+// Watch mode: converts every .dds file in a directory whenever its content
+// changes. Files are converted once no further events arrived for them within
+// the debounce time, so files which are still being written are not picked
+// up half way. Outputs are rebuilt incrementally from the previous output.
+//
+
+#ifdef __linux__
+
+static const double WATCH_DEBOUNCE_SECONDS = 0.25;
+
+static bool is_dds_name(const string &name)
+{
+	if ( name.size() < 5 || name[0] == '.' ) {
+		return false;
+	}
+	string ext = name.substr(name.size()-4);
+	for ( size_t c=0; c<ext.size(); c++) {
+		ext[c] = char(tolower(ext[c]));
+	}
+	return ext == ".dds";
+}
+
+static bool content_hash(const string &filename, ATFLevelHash &hash)
 {
-	PVR_HEADER *header = (PVR_HEADER *)dst;
-	
-	header->dwHeaderSize = sizeof(PVR_HEADER);
-	header->dwWidth      = width;
-	header->dwHeight     = height;
-	header->dwMipMapCount= count;
-	header->dwTextureDataSize = textureLen;
-	header->dwpfFlags	 = header->dwMipMapCount ? PVRTEX_MIPMAP : 0;
-	header->dwPVR[0]	 = 'P';
-	header->dwPVR[1]	 = 'V';
-	header->dwPVR[2]	 = 'R';
-	header->dwPVR[3]	 = '!';
-	header->dwNumSurfs	 = 1;
-	
-    header->dwRBitMask = 0xFF;
-    header->dwGBitMask = 0xFF;
-    header->dwBBitMask = 0xFF;
-    header->dwBitCount = 24;
-    header->dwpfFlags |= PVR_OGL_RGB_888;
-	if ( cubemap ) {
-		header->dwpfFlags |= PVRTEX_CUBEMAP | PVRTEX_DDSCUBEMAPORDER;
+	ifstream ifile(filename.c_str(),ios::in|ios::binary);
+	if ( !ifile.is_open() ) {
+		return false;
 	}
+	stringstream data(ios_base::out|ios_base::in|ios_base::binary);
+	data << ifile.rdbuf();
+	string bytes = data.str();
+	hash.hash[0] = 0;
+	hash.hash[1] = 0;
+	atf_hash(bytes.data(),bytes.size(),hash.hash);
 	return true;
 }
 
-static bool set_bgra_header(uint8_t *dst, int width, int height, int count, bool cubemap, size_t textureLen)
+static bool run_watch(const char *srcdir, const char *dstdir, const ConvertJob &defaults)
 {
-	PVR_HEADER *header = (PVR_HEADER *)dst;
-	
-	header->dwHeaderSize = sizeof(PVR_HEADER);
-	header->dwWidth      = width;
-	header->dwHeight     = height;
-	header->dwMipMapCount= count;
-	header->dwTextureDataSize = textureLen;
-	header->dwpfFlags	 = header->dwMipMapCount ? PVRTEX_MIPMAP : 0;
-	header->dwPVR[0]	 = 'P';
-	header->dwPVR[1]	 = 'V';
-	header->dwPVR[2]	 = 'R';
-	header->dwPVR[3]	 = '!';
-	header->dwNumSurfs	 = 1;
-	
-	header->dwRBitMask = 0xFF;
-	header->dwGBitMask = 0xFF;
-	header->dwBBitMask = 0xFF;
-	header->dwAlphaBitMask = 0xFF;
-	header->dwBitCount = 32;
-	header->dwpfFlags |= PVR_OGL_RGBA_8888;
-	if ( cubemap ) {
-		header->dwpfFlags |= PVRTEX_CUBEMAP | PVRTEX_DDSCUBEMAPORDER;
+	string src(srcdir);
+	string dst(dstdir);
+
+	if ( mkdir(dst.c_str(),0777) != 0 && errno != EEXIST ) {
+		cerr << "Could not create output directory. '" << dst << "'\n\n";
+		return false;
+	}
+
+	int fd = inotify_init();
+	if ( fd < 0 || inotify_add_watch(fd,src.c_str(),IN_CLOSE_WRITE|IN_MOVED_TO|IN_MODIFY|IN_CREATE) < 0 ) {
+		cerr << "Could not watch input directory. '" << src << "'\n\n";
+		return false;
+	}
+
+	map<string,double> pending;			// file name -> time of the last event
+	map<string,ATFLevelHash> converted;	// file name -> content hash of the last conversion
+
+	// Pick up everything which changed while we were not watching.
+	DIR *dir = opendir(src.c_str());
+	if ( !dir ) {
+		cerr << "Could not open input directory. '" << src << "'\n\n";
+		return false;
+	}
+	while ( struct dirent *entry = readdir(dir) ) {
+		string name(entry->d_name);
+		if ( !is_dds_name(name) ) {
+			continue;
+		}
+		struct stat sstat, dstat;
+		string ofilename = dst + "/" + name.substr(0,name.size()-4) + ".atf";
+		if ( stat((src + "/" + name).c_str(),&sstat) == 0 &&
+			 ( stat(ofilename.c_str(),&dstat) != 0 || dstat.st_mtime < sstat.st_mtime ) ) {
+			pending[name] = 0;
+		}
+	}
+	closedir(dir);
+
+	if ( !gSilent ) {
+		cout << "Watching '" << src << "', writing to '" << dst << "'.\n";
+		cout.flush();
+	}
+
+	vector<char> events(64 * 1024);
+	for (;;) {
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if ( poll(&pfd,1,pending.empty() ? -1 : int(WATCH_DEBOUNCE_SECONDS * 1000.0 / 4)) < 0 && errno != EINTR ) {
+			cerr << "Watching input directory failed.\n";
+			close(fd);
+			return false;
+		}
+
+		if ( pfd.revents & POLLIN ) {
+			ssize_t len = read(fd,&events[0],events.size());
+			double now = atf_wall_time();
+			for ( ssize_t pos=0; pos<len; ) {
+				const struct inotify_event *event = (const struct inotify_event *)&events[pos];
+				if ( event->len && is_dds_name(event->name) ) {
+					pending[event->name] = now;
+				}
+				pos += sizeof(struct inotify_event) + event->len;
+			}
+		}
+
+		vector<ConvertJob> jobs;
+		vector<ATFLevelHash> hashes;
+		double now = atf_wall_time();
+		for ( map<string,double>::iterator it=pending.begin(); it!=pending.end(); ) {
+			if ( now - it->second < WATCH_DEBOUNCE_SECONDS ) {
+				++it;
+				continue;
+			}
+			ConvertJob job = defaults;
+			job.ifilename = src + "/" + it->first;
+			job.variants[0].filename = dst + "/" + it->first.substr(0,it->first.size()-4) + ".atf";
+			job.reuseFilename = job.variants[0].filename;
+
+			// touched or rewritten with identical content, nothing to do
+			ATFLevelHash hash;
+			map<string,ATFLevelHash>::iterator last = converted.find(it->first);
+			if ( content_hash(job.ifilename,hash) &&
+				 ( last == converted.end() || last->second.hash[0] != hash.hash[0] || last->second.hash[1] != hash.hash[1] ) ) {
+				jobs.push_back(job);
+				hashes.push_back(hash);
+			}
+			pending.erase(it++);
+		}
+
+		if ( jobs.size() ) {
+			run_batch(jobs,false);
+			for ( size_t c=0; c<jobs.size(); c++) {
+				if ( jobs[c].ok ) {
+					string name = jobs[c].ifilename.substr(src.size()+1);
+					converted[name] = hashes[c];
+				}
+			}
+			cout.flush();
+		}
 	}
 	return true;
 }
 
-inline int32_t log2(int32_t x) {
-    return	(((((x) & 0xAAAAAAAA)?1:0)     )|
-             ((((x) & 0xCCCCCCCC)?1:0) << 1)|
-             ((((x) & 0xF0F0F0F0)?1:0) << 2)|
-             ((((x) & 0xFF00FF00)?1:0) << 3)|
-             ((((x) & 0xFFFF0000)?1:0) << 4));
+#else
+
+static bool run_watch(const char *srcdir, const char *dstdir, const ConvertJob &defaults)
+{
+	cerr << "Watch mode is not supported on this platform.\n";
+	return false;
+}
+
+#endif //#ifdef __linux__
+
+//
+// Daemon mode: listens on a UNIX domain socket and runs the requested jobs on
+// one worker pool which lives as long as the daemon. A client connects,
+// writes one or more request lines and shuts down its sending side. Requests
+// use the manifest syntax with absolute paths, or are the word STATS. Every
+// request is answered with one line in request order, starting with OK,
+// FAILED, ERROR or STATS. bin/atfclient is the matching client.
+//
+
+#ifndef _MSC_VER
+
+struct DaemonRequest {
+	ConvertJob	job;
+	bool		stats;
+	bool		done;
+	string		response;
+};
+
+struct DaemonState {
+	ConvertJob	defaults;
+	std::deque<DaemonRequest *> queue;
+	atf_mutex	mutex;
+	atf_condition work;			// queue is not empty
+	atf_condition finished;		// a request was completed
+
+	size_t		jobs;
+	size_t		failed;
+	size_t		insize;
+	size_t		outsize;
+	double		busy;			// sum of all job times
+	double		start;
+};
+
+struct DaemonConnection {
+	DaemonState *state;
+	int			fd;
+	atf_thread	thread;
+};
+
+static string job_status(const ConvertJob &job)
+{
+	std::ostringstream s;
+	if ( !job.ok ) {
+		s << "FAILED " << job.ifilename;
+		return s.str();
+	}
+	s << "OK " << job.ifilename << " -> " << job.variants[0].filename;
+	s << " (" << job.insize << " -> " << job.outsize << " bytes, " << int32_t(job.seconds * 1000.0) << " ms";
+	if ( !job.reuseFilename.empty() ) {
+		s << ", " << job.reused << " levels reused";
+	}
+	s << ")";
+	return s.str();
+}
+
+static void daemon_worker(void *arg)
+{
+	DaemonState *state = (DaemonState *)arg;
+
+	gSilent = true;
+
+	for (;;) {
+		state->mutex.lock();
+		while ( state->queue.empty() ) {
+			state->work.wait(state->mutex);
+		}
+		DaemonRequest *request = state->queue.front();
+		state->queue.pop_front();
+		state->mutex.unlock();
+
+		convert_job(request->job);
+		string response = job_status(request->job);
+
+		state->mutex.lock();
+		state->jobs++;
+		state->failed += request->job.ok ? 0 : 1;
+		state->insize += request->job.insize;
+		state->outsize += request->job.outsize;
+		state->busy += request->job.seconds;
+		request->response = response;
+		request->done = true;
+		state->finished.broadcast();
+		state->mutex.unlock();
+	}
+}
+
+static string daemon_stats(DaemonState *state)
+{
+	ATFCacheStats cache;
+	atf_cache_get_stats(cache);
+
+	state->mutex.lock();
+	std::ostringstream s;
+	s << "STATS jobs=" << state->jobs << " failed=" << state->failed << " queued=" << state->queue.size();
+	s << " in=" << state->insize << " out=" << state->outsize;
+	s << " busy=" << state->busy << "s uptime=" << atf_wall_time() - state->start << "s";
+	s << " cache_hits=" << cache.hits << " cache_misses=" << cache.misses;
+	state->mutex.unlock();
+	return s.str();
+}
+
+static void daemon_connection(void *arg)
+{
+	DaemonConnection *connection = (DaemonConnection *)arg;
+	DaemonState *state = connection->state;
+
+	string data;
+	char buffer[4096];
+	for (;;) {
+		ssize_t len = read(connection->fd,buffer,sizeof(buffer));
+		if ( len < 0 && errno == EINTR ) {
+			continue;
+		}
+		if ( len <= 0 ) {
+			break;
+		}
+		data.append(buffer,len);
+	}
+
+	vector<DaemonRequest *> requests;
+	std::istringstream lines(data);
+	string line;
+	while ( getline(lines,line) ) {
+		DaemonRequest *request = new DaemonRequest;
+		request->stats = false;
+		request->done = false;
+		vector<string> tokens;
+		string error;
+		string word;
+		std::istringstream s(line);
+		if ( s >> word && word == "STATS" && !( s >> word ) ) {
+			request->stats = true;
+			request->done = true;
+		} else if ( !parse_job_line(line,state->defaults,request->job,tokens,error) ) {
+			request->response = "ERROR " + error;
+			request->done = true;
+		} else if ( tokens.size() == 0 ) {
+			delete request;
+			continue;
+		}
+		requests.push_back(request);
+	}
+
+	state->mutex.lock();
+	for ( size_t c=0; c<requests.size(); c++) {
+		if ( !requests[c]->done ) {
+			state->queue.push_back(requests[c]);
+		}
+	}
+	state->work.broadcast();
+	state->mutex.unlock();
+
+	string response;
+	for ( size_t c=0; c<requests.size(); c++) {
+		state->mutex.lock();
+		while ( !requests[c]->done ) {
+			state->finished.wait(state->mutex);
+		}
+		state->mutex.unlock();
+		if ( requests[c]->stats ) {
+			requests[c]->response = daemon_stats(state);
+		}
+		response += requests[c]->response + "\n";
+		delete requests[c];
+	}
+
+	for ( size_t pos=0; pos<response.size(); ) {
+		ssize_t len = write(connection->fd,response.data()+pos,response.size()-pos);
+		if ( len < 0 && errno == EINTR ) {
+			continue;
+		}
+		if ( len <= 0 ) {
+			break;
+		}
+		pos += len;
+	}
+
+	close(connection->fd);
+	delete connection;
+}
+
+static bool run_daemon(const char *socketPath, const ConvertJob &defaults, int32_t threadCount)
+{
+	signal(SIGPIPE,SIG_IGN);
+
+	struct sockaddr_un addr;
+	memset(&addr,0,sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if ( strlen(socketPath) >= sizeof(addr.sun_path) ) {
+		cerr << "Socket path too long. '" << socketPath << "'\n\n";
+		return false;
+	}
+	strcpy(addr.sun_path,socketPath);
+
+	// remove the socket of a previous daemon, but nothing else
+	struct stat sstat;
+	if ( stat(socketPath,&sstat) == 0 && S_ISSOCK(sstat.st_mode) ) {
+		unlink(socketPath);
+	}
+
+	int fd = socket(AF_UNIX,SOCK_STREAM,0);
+	if ( fd < 0 || bind(fd,(struct sockaddr *)&addr,sizeof(addr)) != 0 || listen(fd,64) != 0 ) {
+		cerr << "Could not listen on socket. '" << socketPath << "'\n\n";
+		return false;
+	}
+
+	DaemonState *state = new DaemonState;
+	state->defaults = defaults;
+	state->jobs = 0;
+	state->failed = 0;
+	state->insize = 0;
+	state->outsize = 0;
+	state->busy = 0;
+	state->start = atf_wall_time();
+
+	if ( threadCount <= 0 ) {
+		threadCount = atf_cpu_count();
+	}
+	vector<atf_thread> workers(threadCount);
+	for ( int32_t c=0; c<threadCount; c++) {
+		if ( !atf_thread_start(workers[c],daemon_worker,state) ) {
+			cerr << "Could not start worker threads.\n\n";
+			return false;
+		}
+	}
+
+	if ( !gSilent ) {
+		cout << "Listening on '" << socketPath << "' with " << threadCount << " worker threads.\n";
+		cout.flush();
+	}
+
+	for (;;) {
+		int client = accept(fd,0,0);
+		if ( client < 0 ) {
+			if ( errno == EINTR || errno == ECONNABORTED ) {
+				continue;
+			}
+			cerr << "Accepting connections failed.\n";
+			close(fd);
+			return false;
+		}
+		DaemonConnection *connection = new DaemonConnection;
+		connection->state = state;
+		connection->fd = client;
+		if ( !atf_thread_start(connection->thread,daemon_connection,connection) ) {
+			close(client);
+			delete connection;
+			continue;
+		}
+		atf_thread_detach(connection->thread);
+	}
+	return true;
 }
 
-static int32_t calcActualMipLevels(DDS_header *dds, int32_t size, int32_t &actualFileSize, int32_t &actualTextureSize)
+#else
+
+static bool run_daemon(const char *socketPath, const ConvertJob &defaults, int32_t threadCount)
 {
-    int32_t actual = 0;
-    int32_t w = dds->dwWidth;
-    int32_t h = dds->dwHeight;
-    int32_t texLen = 0;
-    int32_t wc = 0;
-    int32_t hc = 0;
-    int32_t fc = 0;
-
-	for (int32_t c=0; c<=dds->dwMipMapCount; c++) {
-        if ( PF_IS_DXT1((*dds)) ) {
-			int32_t w4 = max(1,(w/4));
-			int32_t h4 = max(1,(h/4));
-            texLen += w4*h4*sizeof(uint32_t)*2*((dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?6:1);
-        } else if ( PF_IS_DXT5((*dds)) ) {
-			int32_t w4 = max(1,(w/4));
-			int32_t h4 = max(1,(h/4));
-            texLen += w4*h4*sizeof(uint32_t)*4*((dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?6:1);
-        } else if ( PF_IS_BGRA8((*dds)) || PF_IS_BGRX8((*dds)) ) {
-			texLen += w*h*4*((dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?6:1);
-        } else if ( PF_IS_BGR8((*dds)) ) {
-            texLen += w*h*3*((dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?6:1);
-        } else if ( PF_IS_SINGLECHANNEL((*dds)) ) {
-            texLen += w*h*((dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?6:1);
-        }
-        if ( texLen > size ) {
-            actual = c-1;
-            goto done;
-        }
-        w /= 2;
-        h /= 2;
-	}
-    wc = log2((int32_t)dds->dwWidth);
-    hc = log2((int32_t)dds->dwHeight);
-    fc = dds->dwMipMapCount;
-    actual = min(max(wc,hc),fc);
-done:
-    w = dds->dwWidth;
-    h = dds->dwHeight;
-    texLen = 0;
-    int32_t fileLen = 0;
-	for (int32_t c=0; c<=actual; c++) {
-        if ( PF_IS_DXT1((*dds)) ) {
-			int32_t w4 = max(1,(w/4));
-			int32_t h4 = max(1,(h/4));
-            texLen += w4*h4*sizeof(uint32_t)*2;
-            fileLen += w4*h4*sizeof(uint32_t)*2*((dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?6:1);
-        } else if ( PF_IS_DXT5((*dds)) ) {
-			int32_t w4 = max(1,(w/4));
-			int32_t h4 = max(1,(h/4));
-            texLen += w4*h4*sizeof(uint32_t)*4;
-            fileLen += w4*h4*sizeof(uint32_t)*4*((dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?6:1);
-        } else if ( PF_IS_BGRA8((*dds)) || PF_IS_BGRX8((*dds)) ) {
-			texLen += w*h*4;
-			fileLen += w*h*4*((dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?6:1);
-        } else if ( PF_IS_BGR8((*dds)) ) {
-            texLen += w*h*3;
-            fileLen += w*h*3*((dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?6:1);
-        } else if ( PF_IS_SINGLECHANNEL((*dds)) ) {
-            texLen += w*h;
-            fileLen += w*h*((dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?6:1);
-        }
-        w /= 2;
-        h /= 2;
-	}
-    actualFileSize = fileLen;
-    actualTextureSize = texLen;
-    return actual;
+	cerr << "Daemon mode is not supported on this platform.\n";
+	return false;
 }
 
+#endif //#ifndef _MSC_VER
+
 int main(int argc, char *argv[]) {
 
-    gJxrFormatDefault = false;
-	gJxrFormat = JXR_YUV444;
-    
+	ConvertJob job;
+	OutputVariant output = { "", 0, 256, true, 0, true, 0 };
+	job.jxrFormatDefault = false;
+	job.jxrFormat = JXR_YUV444;
+	job.variants.push_back(output);
+	job.targetBytes = 0;
+	job.adaptiveQP = 0;
+
+	vector<OutputVariant> variants;
+	const char *ifilename = 0;
+	const char *ofilename = 0;
+	const char *manifest = 0;
+	const char *watchDir = 0;
+	const char *socketPath = 0;
+	int32_t threadCount = 0;
+
 	if ( argc > 1) {
 		for (int32_t c = 1; c < argc; c++) {
 			if (argv[c][0] == '-') {
-                if (argv[c][1] == 'n') {
-					std::istringstream s(argv[c+1]);
-                    char dummy;
-                    s >> gEmbedRangeStart >> dummy >> gEmbedRangeEnd;
+				if (argv[c][1] == '-') {
+					if ( strcmp(argv[c],"--stats=json") == 0 ) {
+						writeStats = true;
+						gSilent = true; // stdout carries the JSON
+					} else if ( strcmp(argv[c],"--max-mem") == 0 && c+1 < argc ) {
+						size_t limit = 0;
+						if ( !parse_size(argv[c+1],limit) ) {
+							cerr << "Invalid memory limit '" << argv[c+1] << "'.\n";
+							goto printusage;
+						}
+						atf_mem_set_limit(limit);
+						if ( memBudget == 0 ) {
+							memBudget = limit;
+						}
+					} else if ( strcmp(argv[c],"--mem-budget") == 0 && c+1 < argc ) {
+						if ( !parse_size(argv[c+1],memBudget) ) {
+							cerr << "Invalid memory budget '" << argv[c+1] << "'.\n";
+							goto printusage;
+						}
+					} else if ( strcmp(argv[c],"--verify") == 0 ) {
+						verifyOutput = true;
+					} else if ( strncmp(argv[c],"--verify=",9) == 0 ) {
+						std::istringstream s(argv[c]+9);
+						if ( !( s >> verifyPsnr ) ) {
+							cerr << "Invalid PSNR '" << argv[c]+9 << "'.\n";
+							goto printusage;
+						}
+						verifyOutput = true;
+					} else if ( strcmp(argv[c],"--trace") == 0 && c+1 < argc ) {
+						if ( !atf_trace_open(argv[c+1]) ) {
+							return -1;
+						}
+					} else if ( !parse_job_option(argc,argv,c,job) ) {
+						cerr << "Unknown option '" << argv[c] << "'.\n";
+						goto printusage;
+					}
+				} else if ( parse_job_option(argc,argv,c,job) ) {
+					continue;
 				} else if (argv[c][1] == 's') {
 					gSilent = true;
-				} else if (argv[c][1] == '4') {
-					gJxrFormat = JXR_YUV444;
-					gJxrFormatDefault = false;
-				} else if (argv[c][1] == '2') {
-					gJxrFormat = JXR_YUV422;
-					gJxrFormatDefault = false;
-				} else if (argv[c][1] == '0') {
-					gJxrFormat = JXR_YUV420;
-					gJxrFormatDefault = false;
-				} else if (argv[c][1] == 'f') {
-					std::istringstream s(argv[c+1]);
-					s >> gTrimFlexBits;
-					gTrimFlexBits = max(0,min(15,gTrimFlexBits));
-					gTrimFlexBitsDefault = false;
-				} else if (argv[c][1] == 'q') {
-					int32_t quality = 0;
-					std::istringstream s(argv[c+1]);
-					s >> gJxrQuality;
-					gJxrQuality = max(0,min(100,gJxrQuality));
-					gJxrQualityDefault = false;
-				} else if (argv[c][1] == 'i') {
-					ifile.open(argv[c+1],ios::in|ios::binary);
-	                if ( !ifile.is_open() ) {
-		                cerr << "Could not open input file. '";
-		                cerr << argv[c+1];
-		                cerr << "'\n\n";
-		                return -1;
-	                }
+				} else if (argv[c][1] == 'x') {
+					writeIndex = true;
+				} else if (argv[c][1] == 'a') {
+					outputFlags |= ATF_OUTPUT_ATOMIC;
+				} else if (argv[c][1] == 'd') {
+					outputFlags |= ATF_OUTPUT_DIRECT;
+				} else if (argv[c][1] == 'i' && c+1 < argc) {
+					ifilename = argv[c+1];
 				} else if (argv[c][1] == 'o') {
-					if ( argc < c+1 ) {
+					if ( argc <= c+1 ) {
+						cerr << "Missing output file name.\n\n";
+						return -1;
+					}
+					ofilename = argv[c+1];
+				} else if (argv[c][1] == 'u' && c+1 < argc) {
+					socketPath = argv[c+1];
+				} else if (argv[c][1] == 'w' && c+1 < argc) {
+					watchDir = argv[c+1];
+				} else if (argv[c][1] == 'b' && c+1 < argc) {
+					manifest = argv[c+1];
+				} else if (argv[c][1] == 'c' && c+1 < argc) {
+					if ( !atf_cache_open(argv[c+1]) ) {
+						return -1;
+					}
+				} else if (argv[c][1] == 'j' && c+1 < argc) {
+					std::istringstream s(argv[c+1]);
+					s >> threadCount;
+				} else if (argv[c][1] == 'v') {
+					if ( argc <= c+2 ) {
 						cerr << "Missing output file name.\n\n";
 						return -1;
 					}
-                    ofilename = argv[c+1];
+					OutputVariant variant = { argv[c+2], 0, 256, true, 0, true, 0 };
+					std::istringstream s(argv[c+1]);
+					char dummy;
+					s >> variant.rangeStart >> dummy >> variant.rangeEnd;
+					if ( s >> dummy >> variant.jxrQuality ) {
+						variant.jxrQuality = max(0,min(100,variant.jxrQuality));
+						variant.jxrQualityDefault = false;
+						if ( s >> dummy >> variant.trimFlexBits ) {
+							variant.trimFlexBits = max(0,min(15,variant.trimFlexBits));
+							variant.trimFlexBitsDefault = false;
+						}
+					}
+					variants.push_back(variant);
 				}
 			}
 		}
 
-        if ( !ifile.is_open() ) {
-            cerr << "No input file provided.\n";
-            goto printusage;
-        }
+		if ( socketPath ) {
+			if ( !run_daemon(socketPath,job,threadCount) ) {
+				return -1;
+			}
+			return 0;
+		}
 
-        if ( !ofilename || strlen(ofilename) == 0 ) {
-            cerr << "No output file provided.\n";
-            goto printusage;
-        }
+		// -j threads for files, levels and everything else which runs in parallel
+		if ( threadCount <= 0 ) {
+			threadCount = atf_cpu_count();
+		}
 
-	    ifile.seekg(0,ios_base::end);
-	    size_t filesize = ifile.tellg();
-	    ifile.seekg(0,ios_base::beg);
+		if ( watchDir ) {
+			if ( !ofilename || strlen(ofilename) == 0 ) {
+				cerr << "No output directory provided.\n";
+				goto printusage;
+			}
+			atf_sched_start(threadCount);
+			bool ok = run_watch(watchDir,ofilename,job);
+			atf_sched_stop();
+			if ( !ok ) {
+				return -1;
+			}
+			return 0;
+		}
 
-        uint8_t *src = new uint8_t [filesize];
-        ifile.read((char *)src,filesize);
+		if ( manifest ) {
+			vector<ConvertJob> jobs;
+			if ( !read_manifest(manifest,job,jobs) ) {
+				return -1;
+			}
+			if ( jobs.size() == 0 ) {
+				cerr << "Manifest file contains no jobs.\n";
+				return -1;
+			}
+			atf_sched_start(threadCount);
+			bool ok = run_batch(jobs,true);
+			atf_sched_stop();
+			if ( !atf_trace_close() ) {
+				ok = false;
+			}
+			if ( writeStats ) {
+				cout << "{\n  \"jobs\": [";
+				for ( size_t c=0; c<jobs.size(); c++) {
+					cout << ( c ? ",\n    " : "\n    " );
+					atf_stats_write_json(cout,jobs[c].stats,"    ");
+				}
+				ATFMemStats memory;
+				atf_mem_get_process(&memory);
+				cout << "\n  ],\n  \"memory\": ";
+				atf_stats_write_memory(cout,memory);
+				cout << "\n}\n";
+			}
+			if ( !ok ) {
+				return -1;
+			}
+			return 0;
+		}
 
-        DDS_header *dds = (DDS_header *)src;
-        if ( dds->dwMagic != DDS_MAGIC ) {
-			cerr << "Input file not a DDS file.\n";
-			return -1;
-        }
-
-        int32_t actualTextureSize = 0;
-        int32_t actualFileSize = 0;
-        int32_t actualMipLevels = calcActualMipLevels(dds,filesize-sizeof(DDS_header),actualFileSize,actualTextureSize);
-        int32_t strayBytes = (filesize-sizeof(DDS_header)) - actualFileSize;
-
-        PVR_HEADER pvr;
-        if ( PF_IS_DXT1((*dds)) ) {
-            set_dxt1_header((uint8_t*)&pvr,dds->dwWidth,dds->dwHeight,actualMipLevels,(dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?true:false,actualTextureSize);
-            gEncodeRawJXR = false;
-        } else if ( PF_IS_DXT5((*dds)) ) {
-            set_dxt5_header((uint8_t*)&pvr,dds->dwWidth,dds->dwHeight,actualMipLevels,(dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?true:false,actualTextureSize);
-            gEncodeRawJXR = false;
-        } else if ( PF_IS_BGRA8((*dds)) ) {
-            set_bgra_header((uint8_t*)&pvr,dds->dwWidth,dds->dwHeight,actualMipLevels,(dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?true:false,actualTextureSize);
-            gEncodeRawJXR = true;
-        } else if ( PF_IS_BGR8((*dds)) || PF_IS_SINGLECHANNEL((*dds)) || PF_IS_BGRX8((*dds))) {
-            set_bgr_header((uint8_t*)&pvr,dds->dwWidth,dds->dwHeight,actualMipLevels,(dds->sCaps.dwCaps2&DDSCAPS2_CUBEMAP)?true:false,actualTextureSize);
-            gEncodeRawJXR = true;
-        } else {
-            if ( PF_IS_ATI1((*dds)) || PF_IS_BC4U((*dds)) || PF_IS_BC4S((*dds)) ) {
-    			cerr << "Unsupported DDS file format: Detected ATI1/BC4 encoded data. (Has to be of type DXT1/BC1, DXT5/BC3, BGRA8 or BGR8).\n";
-            } else if ( PF_IS_ATI2((*dds)) || PF_IS_BC5U((*dds)) || PF_IS_BC5S((*dds)) ) {
-    			cerr << "Unsupported DDS file format: Detected ATI2/BC5 encoded data. (Has to be of type DXT1/BC1, DXT5/BC3, BGRA8 or BGR8).\n";
-            } else {
-    			cerr << "Unsupported DDS file format. (Has to be of type DXT1/BC1, DXT5/BC3, BGRA8 or BGR8).\n";
-            }
-			return -1;
-        }
-
-        if ( strayBytes > 0 ) {
-    		cerr << "Warning: Stray data in input file.\n";
-        }
-
-        tfile = new stringstream(ios_base::out|ios_base::in|ios_base::binary);
-        dfile = new stringstream(ios_base::out|ios_base::in|ios_base::binary);
-        tfile->write((char *)&pvr,sizeof(PVR_HEADER));
-
-        if ( PF_IS_BGRA8((*dds)) ) {
-            uint8_t *s = (src+sizeof(DDS_header));
-            for (int32_t c=0; c<actualFileSize; c+=4 ) {
-                tfile->put((char)s[c+2]);
-                tfile->put((char)s[c+1]);
-                tfile->put((char)s[c+0]);
-                tfile->put((char)s[c+3]);
-            }
-        } else if ( PF_IS_BGRX8((*dds)) ) {
-            uint8_t *s = (src+sizeof(DDS_header));
-            for (int32_t c=0; c<actualFileSize; c+=4 ) {
-                tfile->put((char)s[c+2]);
-                tfile->put((char)s[c+1]);
-                tfile->put((char)s[c+0]);
-            }
-        } else if ( PF_IS_BGR8((*dds)) ) {
-            uint8_t *s = (src+sizeof(DDS_header));
-            for (int32_t c=0; c<actualFileSize; c+=3 ) {
-                tfile->put((char)s[c+2]);
-                tfile->put((char)s[c+1]);
-                tfile->put((char)s[c+0]);
-            }
-        } else if ( PF_IS_SINGLECHANNEL((*dds)) ) {
-            uint8_t *s = (src+sizeof(DDS_header));
-            for (int32_t c=0; c<actualFileSize; c++) {
-                tfile->put((char)s[c+0]);
-                tfile->put((char)s[c+0]);
-                tfile->put((char)s[c+0]);
-            }
-        } else {
-            tfile->write((char *)(src+sizeof(DDS_header)),actualFileSize);
-        }
-        tfile->seekg(0,ios_base::beg);
-
-        gCompressedFormats = 1;
-		gCheckForAlphaValue = false;
-
-		ofile.open(ofilename,ios::out|ios::binary);
-		if ( !ofile.is_open() ) {
-			cerr << "Could not open output file. '";
-			cerr << ofilename;
-			cerr << "'\n\n";
-			return -1;
+		if ( !ifilename ) {
+			cerr << "No input file provided.\n";
+			goto printusage;
 		}
-		if ( ofile.bad() ) {
-			return false;
+
+		if ( !ofilename || strlen(ofilename) == 0 ) {
+			cerr << "No output file provided.\n";
+			goto printusage;
 		}
 
-        if (PF_IS_DXT5((*dds)) && convert_with_alpha(*dfile, *dfile, *tfile, ofile)) {
-			ofile.flush();
-			outfilesize += ofile.tellp();
-			ofile.close();
-			return 0;
-        } else if ( convert(*dfile, *dfile, *tfile, *tfile, ofile) ) {
-			ofile.flush();
-			outfilesize += ofile.tellp();
-			ofile.close();
-			return 0;
-		} 
-		ofile.close();
-		remove(ofilename);
-        return 0;
+		job.ifilename = ifilename;
+		job.variants[0].filename = ofilename;
+
+		if ( strcmp(ofilename,"-") == 0 ) {
+			// stdout carries the ATF data, so nothing else may be printed there
+			gSilent = true;
+			if ( writeIndex ) {
+				cerr << "Can not write a .atfidx sidecar for stdout.\n";
+				return -1;
+			}
+#ifdef _MSC_VER
+			_setmode(_fileno(stdout),_O_BINARY);
+#endif //#ifdef _MSC_VER
+		}
+		for ( size_t c=0; c<variants.size(); c++) {
+			if ( variants[c].filename == "-" ) {
+				cerr << "Only the -o output can be written to stdout.\n";
+				return -1;
+			}
+		}
+
+		// -q and -f apply to all -v outputs which do not override them
+		for ( size_t c=0; c<variants.size(); c++) {
+			if ( variants[c].jxrQualityDefault ) {
+				variants[c].jxrQualityDefault = job.variants[0].jxrQualityDefault;
+				variants[c].jxrQuality = job.variants[0].jxrQuality;
+			}
+			if ( variants[c].trimFlexBitsDefault ) {
+				variants[c].trimFlexBitsDefault = job.variants[0].trimFlexBitsDefault;
+				variants[c].trimFlexBits = job.variants[0].trimFlexBits;
+			}
+			job.variants.push_back(variants[c]);
+		}
+
+		atf_sched_start(threadCount);
+		bool ok = convert_job(job);
+		atf_sched_stop();
+		if ( !atf_trace_close() ) {
+			ok = false;
+		}
+		if ( writeStats ) {
+			ostream &out = strcmp(ofilename,"-") == 0 ? cerr : cout;
+			atf_stats_write_json(out,job.stats,"");
+			out << "\n";
+		}
+		if ( !ok ) {
+			return -1;
+		}
+		if ( !gSilent && !job.reuseFilename.empty() ) {
+			cout << job.reused << " levels reused from '" << job.reuseFilename << "'.\n";
+		}
+		if ( !gSilent && job.quality >= 0 ) {
+			cout << "-q " << job.quality << " is the best quality which fits into " << job.targetBytes << " bytes.\n";
+		}
+		if ( !gSilent && verifyOutput ) {
+			cout << job.verified.levels << " levels verified";
+			if ( job.verified.minPsnr != 0 ) {
+				cout << ", minimum PSNR " << job.verified.minPsnr << " dB in face " << job.verified.minFace << " level " << job.verified.minLevel << ".\n";
+			} else {
+				cout << ", all match the input exactly.\n";
+			}
+		}
+		print_cache_stats();
+		return 0;
 	}
 printusage:
 	print_usage();
@@ -0,0 +1,355 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif //#ifdef _MSC_VER
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif //#ifndef _MSC_VER
+
+#include "3rdparty/jpegxr/jpegxr.h"
+#include "atf.h"
+#include "atfdds.h"
+#include "atfindex.h"
+#include "atfmips.h"
+#include "atfoutput.h"
+#include "atfrepack.h"
+#include "atfthread.h"
+#include "libatf.h"
+
+using namespace std;
+
+extern ATF_THREAD_LOCAL int32_t	gCompressedFormats;
+extern ATF_THREAD_LOCAL bool		gEncodeRawJXR;
+extern ATF_THREAD_LOCAL bool		gCheckForAlphaValue;
+extern ATF_THREAD_LOCAL bool		gSilent;
+extern ATF_THREAD_LOCAL bool		gTrimFlexBitsDefault ;
+extern ATF_THREAD_LOCAL int32_t	gTrimFlexBits;
+extern ATF_THREAD_LOCAL bool		gJxrFormatDefault;
+extern ATF_THREAD_LOCAL jxr_color_fmt_t gJxrFormat;
+extern ATF_THREAD_LOCAL bool		gJxrQualityDefault;
+extern ATF_THREAD_LOCAL int32_t	gJxrQuality;
+extern ATF_THREAD_LOCAL int32_t  gEmbedRangeStart;
+extern ATF_THREAD_LOCAL int32_t  gEmbedRangeEnd;
+extern ATF_THREAD_LOCAL ATFReuse *gReuse;
+
+extern ATF_THREAD_LOCAL size_t	infilesize;
+extern ATF_THREAD_LOCAL size_t	outfilesize;
+extern ATF_THREAD_LOCAL size_t	outlzmasize;
+
+extern bool convert(istream &ifile_etc1, istream &ifile_pvrtc, istream &ifile_dxt1, istream &ifile_raw, ostream &ofile);	
+extern bool convert_with_alpha(istream &ifile_etc1, istream &ifile_pvrtc, istream &ifile_dxt5, ostream &ofile);
+
+static int set_buffer(atf_buffer *buffer, const void *data, size_t len)
+{
+	buffer->data = (unsigned char *)malloc(max(size_t(1),len));
+	if ( !buffer->data ) {
+		return ATF_ERROR_MEMORY;
+	}
+	memcpy(buffer->data,data,len);
+	buffer->size = len;
+	return ATF_OK;
+}
+
+int atf_version(void)
+{
+	return ATF_API_VERSION;
+}
+
+const char *atf_error_string(int error)
+{
+	switch ( error ) {
+		case	ATF_OK:					return "No error";
+		case	ATF_ERROR_ARGUMENT:		return "Invalid argument";
+		case	ATF_ERROR_INPUT:		return "Invalid or unsupported input file";
+		case	ATF_ERROR_ENCODE:		return "Encoding error";
+		case	ATF_ERROR_DECODE:		return "Decoding error";
+		case	ATF_ERROR_MEMORY:		return "Out of memory";
+		case	ATF_ERROR_UNSUPPORTED:	return "Unsupported ATF format";
+		case	ATF_ERROR_EMPTY:		return "Texture level not embedded";
+	}
+	return "Unknown error";
+}
+
+void atf_options_init(atf_options *options)
+{
+	if ( !options ) {
+		return;
+	}
+	options->quality = -1;
+	options->trim_flex_bits = -1;
+	options->colorspace = ATF_COLORSPACE_444;
+	options->embed_start = 0;
+	options->embed_end = 256;
+}
+
+static int convert_dds(const void *dds, size_t len, const atf_options *options, atf_buffer *out)
+{
+	static const jxr_color_fmt_t colorspaces[] = { JXR_YUV444, JXR_YUV422, JXR_YUV420 };
+
+	gSilent = true;
+	gCompressedFormats = 1;
+	gCheckForAlphaValue = false;
+	gReuse = 0;
+	gJxrQualityDefault = options->quality < 0;
+	gJxrQuality = max(0,min(100,options->quality));
+	gTrimFlexBitsDefault = options->trim_flex_bits < 0;
+	gTrimFlexBits = max(0,min(15,options->trim_flex_bits));
+	gJxrFormatDefault = false;
+	gJxrFormat = colorspaces[max(int(ATF_COLORSPACE_444),min(int(ATF_COLORSPACE_420),options->colorspace))];
+	gEmbedRangeStart = options->embed_start;
+	gEmbedRangeEnd = options->embed_end;
+	infilesize = 0;
+	outfilesize = 0;
+	outlzmasize = 0;
+
+	ATFBuffer tbuffer;
+	tbuffer.reserve(len);
+	iostream tfile(&tbuffer);
+	stringstream dfile(ios_base::out|ios_base::in|ios_base::binary);
+	bool dxt5 = false;
+	if ( !atf_dds_to_pvr((const uint8_t *)dds,len,tfile,dxt5,gEncodeRawJXR) ) {
+		return ATF_ERROR_INPUT;
+	}
+	tfile.seekg(0,ios_base::beg);
+
+	ATFBuffer buffer;
+	ostream atf(&buffer);
+	bool ok = false;
+	if ( dxt5 ) {
+		ok = convert_with_alpha(dfile,dfile,tfile,atf);
+	} else {
+		ok = convert(dfile,dfile,tfile,tfile,atf);
+	}
+	if ( !ok || atf.bad() ) {
+		return ATF_ERROR_ENCODE;
+	}
+	outfilesize = buffer.size();
+
+	return set_buffer(out,buffer.data(),buffer.size());
+}
+
+int atf_convert_dds(const void *dds, size_t len, const atf_options *options, atf_buffer *out)
+{
+	if ( !dds || !out ) {
+		return ATF_ERROR_ARGUMENT;
+	}
+	out->data = 0;
+	out->size = 0;
+
+	atf_options defaults;
+	if ( !options ) {
+		atf_options_init(&defaults);
+		options = &defaults;
+	}
+
+	try {
+		return convert_dds(dds,len,options,out);
+	} catch ( std::bad_alloc & ) {
+		return ATF_ERROR_MEMORY;
+	}
+}
+
+int atf_get_info(const void *atf, size_t len, atf_info *info)
+{
+	if ( !atf || !info ) {
+		return ATF_ERROR_ARGUMENT;
+	}
+	ATFLayout layout;
+	try {
+		if ( !atf_parse_layout((const uint8_t *)atf,len,layout) ) {
+			return ATF_ERROR_INPUT;
+		}
+	} catch ( std::bad_alloc & ) {
+		return ATF_ERROR_MEMORY;
+	}
+	info->format = layout.format & ~ATFDecoder::ATF_FORMAT_CUBEMAP;
+	info->cubemap = ( layout.format & ATFDecoder::ATF_FORMAT_CUBEMAP ) ? 1 : 0;
+	info->width = 1 << layout.wlog2;
+	info->height = 1 << layout.hlog2;
+	info->count = layout.count;
+	return ATF_OK;
+}
+
+struct DecodeTarget {
+	uint8_t	   *pixels;
+	int32_t		w;
+	int32_t		h;
+	int32_t		n;
+};
+
+static void WritePixelData(jxr_image_t image, int mx, int my, int *data) {
+	DecodeTarget *target = (DecodeTarget *)jxr_get_user_data(image);
+	int32_t n = jxr_get_IMAGE_CHANNELS(image) + jxr_get_ALPHACHANNEL_FLAG(image);
+	for ( int32_t y=0; y<16; y++) {
+		int32_t dy = (my*16)+y;
+		if ( dy >= target->h ) {
+			break;
+		}
+		for ( int32_t x=0; x<16; x++) {
+			int32_t dx = (mx*16)+x;
+			if ( dx >= target->w ) {
+				break;
+			}
+			uint8_t *dst = target->pixels + ((dy*target->w)+dx)*target->n;
+			for ( int32_t c=0; c<target->n; c++) {
+				dst[c] = uint8_t(max(0,min(255,data[(16*y+x)*n+c])));
+			}
+		}
+	}
+}
+
+static int decode_jxr(const uint8_t *data, size_t len, int32_t w, int32_t h, bool alpha, atf_image *out)
+{
+	jxr_container_t container = jxr_create_container();
+	if ( jxr_read_image_container(container,data,int(len)) != 0 ) {
+		jxr_destroy_container(container);
+		return ATF_ERROR_DECODE;
+	}
+	// the image and alpha data have to be in the buffer, and in a pixel
+	// format jxr_set_container_parameters knows
+	size_t offset = jxrc_image_offset(container,0);
+	size_t alphaOffset = jxrc_alpha_offset(container,0);
+	jxrc_t_pixelFormat format = jxrc_image_pixelformat(container,0);
+	if ( int32_t(jxrc_image_width(container,0)) != w || int32_t(jxrc_image_height(container,0)) != h ||
+		 offset >= len || jxrc_image_bytecount(container,0) > len - offset ||
+		 alphaOffset > len || jxrc_alpha_bytecount(container,0) > len - alphaOffset ||
+		 ( format != JXRC_FMT_24bppRGB && format != JXRC_FMT_24bppBGR && format != JXRC_FMT_32bppBGR && format != JXRC_FMT_32bppBGRA ) ) {
+		jxr_destroy_container(container);
+		return ATF_ERROR_DECODE;
+	}
+
+	jxr_image_t image = jxr_create_input();
+	jxr_set_container_parameters(image,
+								 jxrc_image_pixelformat(container,0),
+								 jxrc_image_width(container,0),
+								 jxrc_image_height(container,0),
+								 jxrc_alpha_offset(container,0),
+								 jxrc_image_band_presence(container,0),
+								 jxrc_alpha_band_presence(container,0),
+								 0);
+	jxr_destroy_container(container);
+
+	DecodeTarget target;
+	target.w = w;
+	target.h = h;
+	target.n = alpha ? 4 : 3;
+	target.pixels = (uint8_t *)calloc(size_t(w)*h*target.n,1);
+	if ( !target.pixels ) {
+		jxr_destroy(image);
+		return ATF_ERROR_MEMORY;
+	}
+
+	jxr_set_block_output(image, WritePixelData);
+	jxr_set_user_data(image, &target);
+	if ( jxr_read_image_bitstream(image,data+offset,int(len-offset)) != 0 ||
+		 jxr_get_IMAGE_CHANNELS(image) + jxr_get_ALPHACHANNEL_FLAG(image) < target.n ) {
+		jxr_destroy(image);
+		free(target.pixels);
+		return ATF_ERROR_DECODE;
+	}
+	jxr_destroy(image);
+
+	out->pixels = alpha ? ATF_PIXELS_RGBA8 : ATF_PIXELS_RGB8;
+	out->data.data = target.pixels;
+	out->data.size = size_t(w)*h*target.n;
+	return ATF_OK;
+}
+
+static int decode_level(const uint8_t *data, size_t len, int face, int level, atf_image *out)
+{
+	ATFLayout layout;
+	if ( !atf_parse_layout(data,len,layout) ) {
+		return ATF_ERROR_INPUT;
+	}
+	if ( face < 0 || face >= layout.faces || level < 0 || level >= layout.count ) {
+		return ATF_ERROR_ARGUMENT;
+	}
+
+	int32_t w = max(1,(1 << layout.wlog2) >> level);
+	int32_t h = max(1,(1 << layout.hlog2) >> level);
+	out->width = w;
+	out->height = h;
+
+	const ATFBlock &block = layout.block(face,level,0);
+	switch ( layout.format & ~ATFDecoder::ATF_FORMAT_CUBEMAP ) {
+		case	ATFDecoder::ATF_FORMAT_888:
+		case	ATFDecoder::ATF_FORMAT_8888: {
+					if ( block.length == 0 ) {
+						return ATF_ERROR_EMPTY;
+					}
+					bool alpha = ( layout.format & ~ATFDecoder::ATF_FORMAT_CUBEMAP ) == ATFDecoder::ATF_FORMAT_8888;
+					return decode_jxr(data+block.offset,block.length,w,h,alpha,out);
+				}
+		case	ATFDecoder::ATF_FORMAT_COMPRESSEDRAW:
+		case	ATFDecoder::ATF_FORMAT_COMPRESSEDRAWALPHA: {
+					bool alpha = ( layout.format & ~ATFDecoder::ATF_FORMAT_CUBEMAP ) == ATFDecoder::ATF_FORMAT_COMPRESSEDRAWALPHA;
+					if ( block.length == 0 ) {
+						bool other = false;
+						for ( int32_t s=1; s<layout.streams; s++) {
+							other = other || layout.block(face,level,s).length != 0;
+						}
+						return other ? ATF_ERROR_UNSUPPORTED : ATF_ERROR_EMPTY;
+					}
+					ATFMipLevel mip;
+					atf_mip_level(alpha?ATF_MIP_DXT5:ATF_MIP_DXT1,w,h,mip);
+					if ( block.length != mip.length ) {
+						return ATF_ERROR_DECODE;
+					}
+					out->pixels = alpha ? ATF_PIXELS_DXT5 : ATF_PIXELS_DXT1;
+					return set_buffer(&out->data,data+block.offset,block.length);
+				}
+	}
+	return ATF_ERROR_UNSUPPORTED;
+}
+
+int atf_decode(const void *atf, size_t len, int face, int level, atf_image *out)
+{
+	if ( !atf || !out ) {
+		return ATF_ERROR_ARGUMENT;
+	}
+	memset(out,0,sizeof(atf_image));
+
+	try {
+		return decode_level((const uint8_t *)atf,len,face,level,out);
+	} catch ( std::bad_alloc & ) {
+		return ATF_ERROR_MEMORY;
+	}
+}
+
+void atf_buffer_free(atf_buffer *buffer)
+{
+	if ( !buffer ) {
+		return;
+	}
+	free(buffer->data);
+	buffer->data = 0;
+	buffer->size = 0;
+}
@@ -0,0 +1,126 @@
+/*
+Copyright (c) 2012 Adobe Systems Incorporated
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _LIBATF_H_
+#define _LIBATF_H_
+
+//
+// libatf - in-process DDS to ATF conversion and ATF decoding.
+//
+// The API is plain C so it can be called from any language with a C FFI.
+// All calls are independent of each other and may run concurrently on
+// different threads. Output buffers are allocated by the library and have
+// to be released with atf_buffer_free. Diagnostics are printed to stderr.
+//
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif //#ifdef __cplusplus
+
+#if defined(_MSC_VER)
+#define ATF_API
+#else
+#define ATF_API __attribute__((visibility("default")))
+#endif //#if defined(_MSC_VER)
+
+#define ATF_API_VERSION 1
+
+// return values
+enum {
+	ATF_OK					= 0,
+	ATF_ERROR_ARGUMENT		= -1,	// null pointer, face or level out of range
+	ATF_ERROR_INPUT			= -2,	// not a valid or supported DDS/ATF file
+	ATF_ERROR_ENCODE		= -3,
+	ATF_ERROR_DECODE		= -4,
+	ATF_ERROR_MEMORY		= -5,
+	ATF_ERROR_UNSUPPORTED	= -6,	// ATF format which atf_decode can not decode
+	ATF_ERROR_EMPTY			= -7	// level is not embedded in the ATF file (dds2atf -n)
+};
+
+// atf_options.colorspace, same as the -4, -2 and -0 options of dds2atf
+enum {
+	ATF_COLORSPACE_444		= 0,
+	ATF_COLORSPACE_422		= 1,
+	ATF_COLORSPACE_420		= 2
+};
+
+// atf_image.pixels
+enum {
+	ATF_PIXELS_RGB8			= 0,	// 3 bytes per pixel, rows top to bottom
+	ATF_PIXELS_RGBA8		= 1,	// 4 bytes per pixel, straight alpha
+	ATF_PIXELS_DXT1			= 2,	// DXT1 blocks as stored in the DDS file
+	ATF_PIXELS_DXT5			= 3		// DXT5 blocks as stored in the DDS file
+};
+
+// Initialize with atf_options_init, fields added in later versions get their default there.
+typedef struct atf_options {
+	int		quality;		// -q, 0 == lossless, -1 picks the default for the texture type
+	int		trim_flex_bits;	// -f, 0 == lossless, -1 picks the default for the texture type
+	int		colorspace;		// ATF_COLORSPACE_*, 4:4:4 by default
+	int		embed_start;	// -n, first and last embedded texture level
+	int		embed_end;
+} atf_options;
+
+typedef struct atf_buffer {
+	unsigned char  *data;
+	size_t			size;
+} atf_buffer;
+
+typedef struct atf_info {
+	int		format;			// ATF format byte without the cube map bit
+	int		cubemap;		// 1 for cube maps (6 faces), 0 otherwise
+	int		width;
+	int		height;
+	int		count;			// texture levels (main texture + mip maps)
+} atf_info;
+
+typedef struct atf_image {
+	int		pixels;			// ATF_PIXELS_*
+	int		width;
+	int		height;
+	atf_buffer data;
+} atf_image;
+
+ATF_API int atf_version(void);
+ATF_API const char *atf_error_string(int error);
+
+ATF_API void atf_options_init(atf_options *options);
+
+// Converts a DXT1, DXT5, BGRA8, BGRX8, BGR8 or L8 DDS file in memory into an ATF
+// file, the same as dds2atf does. options may be null for the defaults.
+ATF_API int atf_convert_dds(const void *dds, size_t len, const atf_options *options, atf_buffer *out);
+
+ATF_API int atf_get_info(const void *atf, size_t len, atf_info *info);
+
+// Decodes one texture level of one face (0 unless cube map) of an ATF file.
+// RGB and RGBA files decode to pixels, block compressed files written by
+// dds2atf return their DXT blocks.
+ATF_API int atf_decode(const void *atf, size_t len, int face, int level, atf_image *out);
+
+ATF_API void atf_buffer_free(atf_buffer *buffer);
+
+#ifdef __cplusplus
+}
+#endif //#ifdef __cplusplus
+
+#endif //#ifndef _LIBATF_H_
@@ -24,6 +24,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <fstream>
 #include <sstream>
 #include <math.h>
+#include <string.h>
 
 #ifdef _MSC_VER
 #include <windows.h>
@@ -36,34 +37,46 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "3rdparty/jpegxr/jpegxr.h"
 #include "3rdparty/jpegxr/jxr_priv.h"
 #include "3rdparty/lzma/LzmaLib.h"
+#include "atfcache.h"
+#include "atfmem.h"
+#include "atfmicro.h"
+#include "atfmips.h"
+#include "atfoutput.h"
+#include "atfrepack.h"
+#include "atfsched.h"
+#include "atfstats.h"
+#include "atfthread.h"
 
 using namespace std;
 
-// compression settings
-bool	gSilent				 = false;		// silent operation
-bool	gEncodeRawJXR		 = false;		// Do not encode compressed data, use raw RGBA data and compressed as JXR
-int32_t gCompressedFormats	 = 0;			// 0 == all, 1 == dxt, 2 == pvrtc, 3 == etc1 
-bool	gStoreRawCompressed	 = true;		// Store raw compressed data, do not attempt to apply JXR compression
-bool	gEncodeEmptyMipmap	 = false;		// Store empty mip levels
-bool	gCheckForAlphaValue	 = false;		// Check for DXT1/PVRTC alpha channel values
-
-bool	gTrimFlexBitsDefault = true;		// JXR setting 
-int32_t gTrimFlexBits		 = 0;			// JXR setting 
-bool	gJxrQualityDefault	 = true;		// JXR setting 
-int32_t gJxrQuality			 = 0;			// JXR setting 
-bool	gJxrFormatDefault	 = true;		// JXR setting 
-int32_t gEmbedRangeStart     = 0;
-int32_t gEmbedRangeEnd       = 256;
-
-jxr_color_fmt_t gJxrFormat	 = JXR_YUV444;	// JXR setting 
-
-// stats for output
-size_t infilesize			 = 0;
-size_t outfilesize			 = 0;
-size_t outlzmasize			 = 0;
-size_t texturew				 = 0;
-size_t textureh				 = 0;
-size_t texturecomp			 = 3;
+// compression settings (per thread, see atfthread.h)
+ATF_THREAD_LOCAL bool	gSilent				 = false;		// silent operation
+ATF_THREAD_LOCAL bool	gEncodeRawJXR		 = false;		// Do not encode compressed data, use raw RGBA data and compressed as JXR
+ATF_THREAD_LOCAL int32_t gCompressedFormats	 = 0;			// 0 == all, 1 == dxt, 2 == pvrtc, 3 == etc1 
+ATF_THREAD_LOCAL bool	gStoreRawCompressed	 = true;		// Store raw compressed data, do not attempt to apply JXR compression
+ATF_THREAD_LOCAL bool	gEncodeEmptyMipmap	 = false;		// Store empty mip levels
+ATF_THREAD_LOCAL bool	gCheckForAlphaValue	 = false;		// Check for DXT1/PVRTC alpha channel values
+
+ATF_THREAD_LOCAL bool	gTrimFlexBitsDefault = true;		// JXR setting 
+ATF_THREAD_LOCAL int32_t gTrimFlexBits		 = 0;			// JXR setting 
+ATF_THREAD_LOCAL bool	gJxrQualityDefault	 = true;		// JXR setting 
+ATF_THREAD_LOCAL int32_t gJxrQuality			 = 0;			// JXR setting 
+ATF_THREAD_LOCAL bool	gJxrFormatDefault	 = true;		// JXR setting 
+ATF_THREAD_LOCAL double	gJxrAdaptiveQP		 = 0;			// JXR setting, adaptive quantization strength, 0 == uniform
+ATF_THREAD_LOCAL int32_t gEmbedRangeStart     = 0;
+ATF_THREAD_LOCAL int32_t gEmbedRangeEnd       = 256;
+ATF_THREAD_LOCAL ATFReuse *gReuse			 = 0;			// previous output for incremental rebuilds
+ATF_THREAD_LOCAL size_t gTargetBytes		 = 0;			// JXR quality search for a file size, 0 == use gJxrQuality
+
+ATF_THREAD_LOCAL jxr_color_fmt_t gJxrFormat	 = JXR_YUV444;	// JXR setting 
+
+// stats for output (per thread)
+ATF_THREAD_LOCAL size_t infilesize			 = 0;
+ATF_THREAD_LOCAL size_t outfilesize			 = 0;
+ATF_THREAD_LOCAL size_t outlzmasize			 = 0;
+ATF_THREAD_LOCAL size_t texturew				 = 0;
+ATF_THREAD_LOCAL size_t textureh				 = 0;
+ATF_THREAD_LOCAL size_t texturecomp			 = 3;
 
 enum {
 //
@@ -86,8 +99,6 @@ enum {
 	PVRTEX_FLIPPED			= (1<<16),
     PVRTEX_DDSCUBEMAPORDER  = (1<<17), // Flash specific
     PVRTEX_PVRCUBEMAPORDER  = (1<<18), // Flash specific
-// 
-	PVRTC4_MIN_TEXWIDTH		= 8
 };
 
 struct PVR_HEADER {
@@ -187,6 +198,26 @@ static void write_uint64(uint64_t v, ostream &ofile) {
 	write_uint32(v&((uint64_t(1)<<32)-1),ofile);
 }
 
+// Readers for level data addressed in memory, same byte order as the stream readers.
+static uint32_t read_uint8(const uint8_t *&src) {
+	return *src++;
+}
+
+static uint32_t read_uint16(const uint8_t *&src) {
+	uint32_t v = (uint32_t(src[0])<< 0)|
+				 (uint32_t(src[1])<< 8);
+	src += 2;
+	return v;
+}
+
+static uint32_t read_uint24(const uint8_t *&src) {
+	uint32_t v = (uint32_t(src[0])<<16)|
+				 (uint32_t(src[1])<< 8)|
+				 (uint32_t(src[2])<< 0);
+	src += 3;
+	return v;
+}
+
 struct ImageData {
 	uint32_t size;
 	
@@ -211,8 +242,18 @@ struct ImageData {
 	uint32_t *etc1_d1;		// etc1 data bottom
 };
 
-static unsigned int tile_width_in_MB[4096 * 2] = {0};
-static unsigned int tile_height_in_MB[4096 * 2] = {0};
+// ImageData planes are accounted as ATF_MEM_IMAGE, see atfmem.h
+template <typename T> static T *image_alloc(size_t count) {
+	return (T *)atf_mem_alloc(ATF_MEM_IMAGE,count*sizeof(T));
+}
+
+static void image_free(void *ptr) {
+	atf_mem_free(ptr);
+}
+
+// jxr_set_TILE_*_IN_MB keep a pointer to these, so they need to outlive the encode.
+static ATF_THREAD_LOCAL unsigned int tile_width_in_MB[4096 * 2] = {0};
+static ATF_THREAD_LOCAL unsigned int tile_height_in_MB[4096 * 2] = {0};
 
 static bool SetJPEGXRCommon(jxr_container_t container, jxr_image_t image, bool alpha, int32_t w, int32_t h) {
 
@@ -264,20 +305,174 @@ static bool SetJPEGXRCommon(jxr_container_t container, jxr_image_t image, bool a
     return true;
 }
 
+// JPEG-XR quantizer for a -q quality setting.
+static int32_t JPEGXRQuant(int32_t quality)
+{
+	if (quality < 16) {
+		return quality * 2;
+	} else if (quality <= 48) {
+		return quality + 18;
+	} else {
+		return quality + 18 + 2;
+	}
+}
+
 static void SetJPEGXRQuality(jxr_image_t image, int32_t quality)
 {
 	if (quality == 0 ) {
 	    jxr_set_QP_LOSSLESS(image);
 	} else {
-		if (quality < 16) {
-			quality = quality * 2;
-		} else if (quality <= 48) {
-			quality = quality + 18;
-		} else {
-			quality = quality + 18 + 2;
+	    jxr_set_QP_UNIFORM(image, JPEGXRQuant(quality));
+	}
+}
+
+// Tile rows SetJPEGXRCommon splits a w x h image into, tiles span the full width.
+static int32_t JPEGXRTileRows(int32_t w, int32_t h)
+{
+	if ( w < 32 || h < 64 || w*h < 64*64  ) {
+		return 1;
+	} else if ( h < 256 ) {
+		return 4;
+	}
+	return 8;
+}
+
+// Quantizer step size of qp, see _jxr_quant_map.
+static int32_t JPEGXRStep(int32_t qp)
+{
+	if ( qp < 16 ) {
+		return qp;
+	}
+	return (16 + (qp%16)) << ((qp>>4) - 1);
+}
+
+// Quantizer whose step size is closest to step.
+static int32_t JPEGXRQuantForStep(double step)
+{
+	int32_t best = 1;
+	for ( int32_t qp=2; qp<256; qp++) {
+		if ( fabs(log(JPEGXRStep(qp)/step)) < fabs(log(JPEGXRStep(best)/step)) ) {
+			best = qp;
+		}
+	}
+	return best;
+}
+
+// Quantizer tables of SetJPEGXRAdaptiveQuality, they need to outlive the encode.
+struct AdaptiveQP {
+	vector<jxr_tile_qp>		tiles;
+	vector<unsigned char>	map;		// HP quantizer index of every macroblock
+};
+
+static const int32_t ADAPTIVE_STEPS = 4;	// quantizer offsets in quarter octaves, up to one octave
+
+// --adaptive-qp: replaces the uniform quantizer of -q with one HP quantizer
+// per macroblock, picked from the activity of the macroblock: the variance of
+// its luma relative to the average of the level. Quantization noise is easy
+// to see in flat areas and gradients and masked by busy texture, so busy
+// macroblocks get coarser steps and flat ones finer steps. The step size
+// scales with the variance ratio to the power of strength/6. DC and LP keep
+// the -q quantizer. The alpha plane shares the map, macroblocks with an alpha
+// edge never get coarser than -q.
+//
+// Every tile carries the quantizers its macroblocks use, the most frequent
+// one first as index 0 costs a single bit per macroblock. Levels which are a
+// single tile (below 64x64) keep the uniform quantizer, they are a small part
+// of the file and the quantizer index would cost more than it saves. So do
+// levels where less than a third of the macroblocks leave the -q step: the
+// per tile quantizers cost more than those few macroblocks gain, homogeneous
+// textures grew by up to 1.2% without this.
+static void SetJPEGXRAdaptiveQuality(jxr_image_t image, int32_t quality, double strength, const ImageData &imageData, bool alpha, int32_t w, int32_t h, AdaptiveQP &aq)
+{
+	int32_t rows = JPEGXRTileRows(w,h);
+	if ( quality == 0 || rows == 1 ) {
+		return;
+	}
+
+	int32_t n = alpha ? 4 : 3;
+	int32_t mbw = w/16;
+	int32_t mbh = h/16;
+	vector<double> activity(mbw*mbh);
+	vector<bool> edge(mbw*mbh);
+	double average = 0;
+	for ( int32_t my=0; my<mbh; my++) {
+		for ( int32_t mx=0; mx<mbw; mx++) {
+			double sum = 0, sum2 = 0;
+			int32_t amin = 255, amax = 0;
+			for ( int32_t y=0; y<16; y++) {
+				int32_t dy = imageData.flipped ? h-((my*16)+y)-1 : (my*16)+y;
+				const uint8_t *p = imageData.raw + (dy*w+mx*16)*n;
+				for ( int32_t x=0; x<16; x++, p+=n) {
+					double l = (p[0] + 2*p[1] + p[2]) * 0.25;
+					sum += l;
+					sum2 += l*l;
+					if ( alpha ) {
+						amin = min(amin,int32_t(p[3]));
+						amax = max(amax,int32_t(p[3]));
+					}
+				}
+			}
+			double variance = max(0.0,sum2/256.0 - (sum/256.0)*(sum/256.0));
+			activity[my*mbw+mx] = log(variance + 1.0) / log(2.0);
+			edge[my*mbw+mx] = amax > amin;
+			average += activity[my*mbw+mx];
 		}
-	    jxr_set_QP_UNIFORM(image, quality);
 	}
+	average /= activity.size();
+
+	int32_t qp = JPEGXRQuant(quality);
+	int32_t qps[ADAPTIVE_STEPS*2+1];
+	for ( int32_t o=-ADAPTIVE_STEPS; o<=ADAPTIVE_STEPS; o++) {
+		qps[o+ADAPTIVE_STEPS] = JPEGXRQuantForStep(JPEGXRStep(qp) * pow(2.0,double(o)/ADAPTIVE_STEPS));
+	}
+	vector<int32_t> offset(activity.size());
+	size_t changed = 0;
+	for ( size_t c=0; c<activity.size(); c++) {
+		int32_t o = int32_t(floor(strength / 6.0 * (activity[c] - average) * ADAPTIVE_STEPS + 0.5));
+		o = max(-ADAPTIVE_STEPS,min(edge[c] ? 0 : ADAPTIVE_STEPS,o));
+		offset[c] = o + ADAPTIVE_STEPS;
+		changed += o != 0 ? 1 : 0;
+	}
+	if ( changed * 3 < activity.size() ) {
+		return;
+	}
+
+	aq.tiles.assign(rows,jxr_tile_qp());
+	aq.map.resize(mbw*mbh);
+	int32_t tileh = mbh/rows;
+	for ( int32_t t=0; t<rows; t++) {
+		int32_t first = t*tileh*mbw;
+		int32_t last = (t+1)*tileh*mbw;
+		int32_t count[ADAPTIVE_STEPS*2+1] = { 0 };
+		for ( int32_t c=first; c<last; c++) {
+			count[offset[c]]++;
+		}
+
+		jxr_tile_qp &tile = aq.tiles[t];
+		memset(&tile,0,sizeof(tile));
+		tile.component_mode = JXR_CM_UNIFORM;
+		tile.channel[0].dc_qp = uint8_t(qp);
+		tile.channel[0].num_lp = 1;
+		tile.channel[0].lp_qp[0] = uint8_t(qp);
+
+		int32_t index[ADAPTIVE_STEPS*2+1];
+		int32_t used = 0;
+		for ( int32_t m = int32_t(max_element(count,count+ADAPTIVE_STEPS*2+1) - count); count[m] > 0; m = int32_t(max_element(count,count+ADAPTIVE_STEPS*2+1) - count) ) {
+			index[m] = used;
+			tile.channel[0].hp_qp[used++] = uint8_t(qps[m]);
+			count[m] = 0;
+		}
+		tile.channel[0].num_hp = uint8_t(used);
+
+		for ( int32_t c=first; c<last; c++) {
+			aq.map[c] = uint8_t(index[offset[c]]);
+		}
+		tile.hp_map = &aq.map[first];
+	}
+
+	// QP_UNIFORM sets up the scaling, QP_DISTRIBUTED moves the quantizers to the tiles
+	jxr_set_QP_UNIFORM(image, uint8_t(qp));
+	jxr_set_QP_DISTRIBUTED(image, &aq.tiles[0]);
 }
 
 static bool SetJPEGXRaw(jxr_container_t container, jxr_image_t image, int32_t quality, bool alpha, int32_t w, int32_t h) {
@@ -612,6 +807,65 @@ static void Read555Data_ETC1(jxr_image_t image, int mx, int my, int *data) {
 	}
 }
 
+// Entry points for atfmicro (atfmicro.h), which times the block gathers and twiddle above
+// in isolation. format is "DXT1", "PVRTC" or "ETC1", col the colour plane of a
+// w x h JPEG-XR image laid out like the encoder splits it and d0 the ETC1 mode
+// plane. Every macroblock is gathered iterations times, the checksum keeps the
+// compiler from dropping the work.
+uint32_t micro_block_gather(const char *format, void *col, uint8_t *d0, int32_t w, int32_t h, int32_t iterations)
+{
+	ImageData imageData;
+	memset(&imageData,0,sizeof(imageData));
+	block_fun_t gather = Read565Data_DXT1;
+	if ( strcmp(format,"PVRTC") == 0 ) {
+		imageData.pvrtc_col = (uint16_t *)col;
+		gather = Read555Data_PVRTC;
+	} else if ( strcmp(format,"ETC1") == 0 ) {
+		imageData.etc1_col = (uint32_t *)col;
+		imageData.etc1_d0 = d0;
+		gather = Read555Data_ETC1;
+	} else {
+		imageData.dxt1_col = (uint16_t *)col;
+	}
+
+	static unsigned char window_params[5] = {0,0,0,0,0};
+	jxr_image_t image = jxr_create_image(w, h, window_params);
+	if ( !image ) {
+		return 0;
+	}
+	jxr_set_INTERNAL_CLR_FMT(image, JXR_YUV444, 1);
+	jxr_set_user_data(image, &imageData);
+
+	uint32_t sum = 0;
+	int data[16*16*3];
+	for ( int32_t c=0; c<iterations; c++) {
+		for ( int32_t my=0; my<(h+15)/16; my++) {
+			for ( int32_t mx=0; mx<(w+15)/16; mx++) {
+				gather(image,mx,my,data);
+				sum += data[(mx+my)&0xFF];
+			}
+		}
+	}
+
+	jxr_destroy(image);
+	return sum;
+}
+
+uint32_t micro_twiddle(int32_t w, int32_t h, int32_t iterations)
+{
+	uint32_t sum = 0;
+	for ( int32_t c=0; c<iterations; c++) {
+		for ( int32_t v=0; v<h; v++) {
+			for ( int32_t u=0; u<w; u++) {
+				int32_t r = 0;
+				twiddle(r,u,v,w,h);
+				sum += r;
+			}
+		}
+	}
+	return sum;
+}
+
 bool validate_texture(PVR_HEADER &pvr_header)
 {
 	if ( (pvr_header.dwpfFlags & PVRTEX_FLIPPED) ) {
@@ -645,6 +899,8 @@ bool validate_texture(PVR_HEADER &pvr_header)
 	return true;
 }
 
+static const uint32_t LZMA_DICT_SIZE = 1<<20;
+
 size_t LzmaSlowCompress(uint8_t *src, uint8_t *dst, size_t len)
 {
 	size_t  sln = 0x7FFFFFFF;
@@ -656,9 +912,11 @@ size_t LzmaSlowCompress(uint8_t *src, uint8_t *dst, size_t len)
 		cout.flush();
 	}
 
+	ATFStatsMark start = atf_stats_mark();
 	size_t bufferLen = len*2+4096;
 	size_t propsLen = LZMA_PROPS_SIZE;
-	int res = LzmaCompress(dst+LZMA_PROPS_SIZE,&bufferLen,(const unsigned char *)src,len,(unsigned char *)dst,&propsLen,9,1<<20,slc,0,spb,273,1);
+	int res = LzmaCompress(dst+LZMA_PROPS_SIZE,&bufferLen,(const unsigned char *)src,len,(unsigned char *)dst,&propsLen,9,LZMA_DICT_SIZE,slc,0,spb,273,1);
+	atf_stats_stream(ATF_STAGE_LZMA,len,bufferLen+LZMA_PROPS_SIZE,start);
 	return bufferLen+LZMA_PROPS_SIZE;
 }
 
@@ -765,28 +1023,102 @@ static void write_header(int32_t w, int32_t h, uint8_t format, int32_t textureCo
 	ofile.put(uint8_t(textureCount));
 }
 
-static bool write_dxt1(int32_t w, int32_t h, int32_t level, bool flipped, istream &ifile, ostream &ofile)
+// Mip chain of one PVR input, with the size and level count of checkHeader so
+// inputs that are not encoded still get the right block counts. The face
+// stride is the one in the PVR header and cube faces are mapped to ATF face
+// order: from DDS order if flagged, DXT input is in PVR order otherwise.
+static void pvr_mip_chain(const PVR_HEADER &pvr_header, const PVR_HEADER &checkHeader, int32_t format, size_t base, ATFMipChain &chain)
 {
+	static const int32_t dds2ogl[] = { 1, 0, 3, 2, 5, 4 };
+	static const int32_t pvr2ogl[] = { 2, 3, 5, 4, 0, 1 };
+
+	bool cubeMap = ( checkHeader.dwpfFlags & PVRTEX_CUBEMAP ) ? true : false;
+	atf_mip_chain(format,checkHeader.dwWidth,checkHeader.dwHeight,checkHeader.dwMipMapCount+1,cubeMap?6:1,chain);
+
+	chain.base = uint32_t(base);
+	if ( pvr_header.dwTextureDataSize ) {
+		chain.faceLength = pvr_header.dwTextureDataSize;
+	}
+	if ( cubeMap ) {
+		if ( pvr_header.dwpfFlags & ( PVRTEX_DDSCUBEMAPORDER | PVRTEX_PVRCUBEMAPORDER ) ) {
+			copy(dds2ogl,dds2ogl+6,chain.order);
+		} else if ( format == ATF_MIP_DXT1 || format == ATF_MIP_DXT5 ) {
+			copy(pvr2ogl,pvr2ogl+6,chain.order);
+		}
+	}
+}
+
+// PVR input addressed in memory. Levels and cube faces are located through
+// the mip chain, so they can be read in any order without seeking. Input in an
+// ATFBuffer is used in place, any other stream is read once.
+struct PVRInput {
+	const uint8_t		   *data;
+	size_t					len;
+	std::vector<uint8_t>	copy;
+};
+
+static void map_input(istream &ifile, PVRInput &input)
+{
+	ATFBuffer *buffer = dynamic_cast<ATFBuffer *>(ifile.rdbuf());
+	if ( buffer ) {
+		input.data = buffer->data();
+		input.len = buffer->size();
+		return;
+	}
+
+	streampos pos = ifile.tellg();
+	ifile.seekg(0,ios_base::end);
+	input.copy.resize(max(streamoff(0),streamoff(ifile.tellg())));
+	ifile.seekg(0,ios_base::beg);
+	if ( !input.copy.empty() ) {
+		ifile.read((char *)&input.copy[0],input.copy.size());
+	}
+	ifile.clear();
+	ifile.seekg(pos);
+	input.data = input.copy.empty() ? 0 : &input.copy[0];
+	input.len = input.copy.size();
+}
+
+// Level data of face/level, 0 if the input is short.
+static const uint8_t *level_data(const PVRInput &input, const ATFMipChain &chain, int32_t face, int32_t level)
+{
+	size_t offset = chain.offset(face,level);
+	if ( !input.data || offset + chain.level(level).length > input.len ) {
+		return 0;
+	}
+	return input.data + offset;
+}
+
+static bool write_dxt1(const ATFMipLevel &mip, int32_t level, bool flipped, const uint8_t *src, ostream &ofile)
+{
+	int32_t w = mip.width;
+	int32_t h = mip.height;
+	int32_t blocks = mip.blocks();
+
+	atf_stats_format("DXT1");
+
 	if ( ( gCompressedFormats == 0 || gCompressedFormats == 1 ) && !(level < gEmbedRangeStart || level > gEmbedRangeEnd ) ) {
 
+		ATFStatsMark task = atf_stats_mark();
+
 		if ( gStoreRawCompressed ) {
 
-			uint32_t tsize = max(1,w/4)*max(1,h/4)*sizeof(uint32_t)*2;
+			ATFStatsMark split = atf_stats_mark();
+			uint32_t tsize = mip.length;
 			write_uint24(tsize,ofile);
-
-			for ( int32_t d=0; d<tsize; d++) {
-				write_uint8(read_uint8(ifile),ofile);
-			}
+			ofile.write((const char *)src,tsize);
+			atf_stats_stream(ATF_STAGE_SPLIT,tsize,tsize,split);
 
 		} else {
+			ATFStatsMark split = atf_stats_mark();
 			ImageData imageData;
 			imageData.flipped = flipped;
-			imageData.dxt1_col = new uint16_t[max(2,(w/4))*max(2,(h/4)*2)];
+			imageData.dxt1_col = image_alloc<uint16_t>(max(2,(w/4))*max(2,(h/4)*2));
 			uint16_t *cl0 = imageData.dxt1_col;
-			uint16_t *cl1 = imageData.dxt1_col + max(1,w/4)*max(1,h/4);
-			imageData.dxt1_bit = new uint8_t[max(1,w/4)*max(1,h/4)*4];
+			uint16_t *cl1 = imageData.dxt1_col + blocks;
+			imageData.dxt1_bit = image_alloc<uint8_t>(blocks*4);
 			uint8_t *bit = imageData.dxt1_bit;
-			for ( int32_t d=0; d<max(1,w/4)*max(1,h/4); d++) {
+			for ( int32_t d=0; d<blocks; d++) {
 				if ( gEncodeEmptyMipmap && level > 0 ) {
 					*cl0++ = 0;
 					*cl1++ = 0;
@@ -795,34 +1127,51 @@ static bool write_dxt1(int32_t w, int32_t h, int32_t level, bool flipped, istrea
 					*bit++ = 0;
 					*bit++ = 0;
 				} else {
-					uint16_t c0 = read_uint16(ifile);
+					uint16_t c0 = read_uint16(src);
 					*cl0++ = c0;
-					uint16_t c1 = read_uint16(ifile);
+					uint16_t c1 = read_uint16(src);
 					*cl1++ = c1;
 					if ( gCheckForAlphaValue && c0 < c1 ) {
 						cerr << "DXT1 textures with alpha not supported!\n\n";
 						return false;
 					}
-					*bit++ = read_uint8(ifile);
-					*bit++ = read_uint8(ifile);
-					*bit++ = read_uint8(ifile);
-					*bit++ = read_uint8(ifile);
+					*bit++ = read_uint8(src);
+					*bit++ = read_uint8(src);
+					*bit++ = read_uint8(src);
+					*bit++ = read_uint8(src);
 				}
 			}
+			atf_stats_stage(ATF_STAGE_SPLIT,split);
+
+			ATFCacheKey key;
+			vector<uint8_t> cached;
+			atf_cache_key(key,ATF_CACHE_DXT1,w,h,flipped,false,gJxrQuality,gTrimFlexBits,gJxrFormat);
+			atf_cache_hash(key,imageData.dxt1_col,blocks*sizeof(uint16_t)*2);
+			atf_cache_hash(key,imageData.dxt1_bit,blocks*4);
+			ATFStatsMark lookup = atf_stats_mark();
+			if ( atf_cache_lookup(key,cached) ) {
+				ofile.write((const char *)&cached[0],cached.size());
+				atf_stats_stream(ATF_STAGE_CACHED,cached.size(),cached.size(),lookup);
+				image_free(imageData.dxt1_col);
+				image_free(imageData.dxt1_bit);
+				return true;
+			}
 
 			{
-				uint8_t *buffer = new uint8_t[max(1,w/4)*max(1,h/4)*sizeof(uint32_t)*2+LZMA_PROPS_SIZE+4096];
+				uint8_t *buffer = new uint8_t[blocks*sizeof(uint32_t)*2+LZMA_PROPS_SIZE+4096];
 
-				size_t bufferLen = LzmaSlowCompress((uint8_t*)imageData.dxt1_bit, buffer, max(1,w/4)*max(1,h/4)*sizeof(uint32_t));
+				size_t bufferLen = LzmaSlowCompress((uint8_t*)imageData.dxt1_bit, buffer, blocks*sizeof(uint32_t));
 				
 				write_uint24(bufferLen,ofile);
 
 				ofile.write((const char *)buffer,bufferLen);
 				outlzmasize += bufferLen;
+				atf_cache_append(cached,buffer,bufferLen);
 
 				delete [] buffer;
 			}
 
+			ATFStatsMark encode = atf_stats_mark();
 			jxr_container_t container = jxr_create_container();
 			jxrc_start_file(container);
 
@@ -831,17 +1180,17 @@ static bool write_dxt1(int32_t w, int32_t h, int32_t level, bool flipped, istrea
 				return false;
 			}
 			jxrc_set_pixel_format(container, JXRC_FMT_16bppBGR565);
-			jxrc_set_image_shape(container, max(1,w/4), max(2,h/2));
+			jxrc_set_image_shape(container, mip.blocksw, max(2,h/2));
 			jxrc_set_separate_alpha_image_plane(container, 0);
 			jxrc_set_image_band_presence(container, JXR_BP_ALL);
 			static unsigned char window_params[5] = {0,0,0,0,0};
-			jxr_image_t image = jxr_create_image(max(1,w/4), max(2,h/2), window_params);
+			jxr_image_t image = jxr_create_image(mip.blocksw, max(2,h/2), window_params);
 
 			if ( !image ) {
 				return false;
 			}
 
-			SetJPEGX565(container,image,gJxrQuality, max(1,w/4), max(2,h/2));
+			SetJPEGX565(container,image,gJxrQuality, mip.blocksw, max(2,h/2));
 
 			jxrc_begin_image_data(container);
 			jxr_set_block_input(image, Read565Data_DXT1);  
@@ -855,17 +1204,21 @@ static bool write_dxt1(int32_t w, int32_t h, int32_t level, bool flipped, istrea
 			jxr_destroy(image); 
 
 			jxrc_write_container_post(container);
+			atf_stats_stream(ATF_STAGE_JXR,blocks*sizeof(uint16_t)*2,container->wb.len(),encode);
 
 			//write_debug_image(container);
 
 			write_uint24(container->wb.len(),ofile);
 			ofile.write((const char *)container->wb.buffer(),container->wb.len());
+			atf_cache_append(cached,container->wb.buffer(),container->wb.len());
+			atf_cache_store(key,cached);
 			
 			jxr_destroy_container(container);
 			
-			delete [] imageData.dxt1_col;
-			delete [] imageData.dxt1_bit;
+			image_free(imageData.dxt1_col);
+			image_free(imageData.dxt1_bit);
 		}
+		atf_trace_task(task);
 	} else {
 		if ( gStoreRawCompressed ) {
 			write_uint24(0,ofile);
@@ -873,41 +1226,46 @@ static bool write_dxt1(int32_t w, int32_t h, int32_t level, bool flipped, istrea
 			write_uint24(0,ofile);
 			write_uint24(0,ofile);
 		}
-		for ( int32_t d=0; d<max(1,w/4)*max(1,h/4); d++) {
-            read_uint32(ifile);
-            read_uint32(ifile);
-        }
 	}
 	return true;
 }
 
-static bool write_dxt5(int32_t w, int32_t h, int32_t level, bool flipped, istream &ifile, ostream &ofile)
+static bool write_dxt5(const ATFMipLevel &mip, int32_t level, bool flipped, const uint8_t *src, ostream &ofile)
 {
+	int32_t w = mip.width;
+	int32_t h = mip.height;
+	int32_t blocks = mip.blocks();
+
+	atf_stats_format("DXT5");
+
 	if ( ( gCompressedFormats == 0 || gCompressedFormats == 1 ) && !(level < gEmbedRangeStart || level > gEmbedRangeEnd ) ) {
 
+		ATFStatsMark task = atf_stats_mark();
+
 		if ( gStoreRawCompressed ) {
 
-			uint32_t tsize = max(1,w/4)*max(1,h/4)*sizeof(uint32_t)*4;
+			ATFStatsMark split = atf_stats_mark();
+			uint32_t tsize = mip.length;
 			write_uint24(tsize,ofile);
-			for ( int32_t d=0; d<tsize; d++) {
-				write_uint8(read_uint8(ifile),ofile);
-			}
+			ofile.write((const char *)src,tsize);
+			atf_stats_stream(ATF_STAGE_SPLIT,tsize,tsize,split);
 
 		} else {
 
+			ATFStatsMark split = atf_stats_mark();
 			ImageData imageData;
 			imageData.flipped = flipped;
-			imageData.dxt5_alp = new uint8_t[max(2,(w/4))*max(2,(h/4)*2)];
-			imageData.dxt5_col = new uint16_t[max(2,(w/4))*max(2,(h/4)*2)];
+			imageData.dxt5_alp = image_alloc<uint8_t>(max(2,(w/4))*max(2,(h/4)*2));
+			imageData.dxt5_col = image_alloc<uint16_t>(max(2,(w/4))*max(2,(h/4)*2));
 			uint8_t *al0 = imageData.dxt5_alp;
-			uint8_t *al1= imageData.dxt5_alp + max(1,w/4)*max(1,h/4);
+			uint8_t *al1= imageData.dxt5_alp + blocks;
 			uint16_t *cl0 = imageData.dxt5_col;
-			uint16_t *cl1 = imageData.dxt5_col + max(1,w/4)*max(1,h/4);
-			imageData.dxt5_abt = new uint8_t[max(1,w/4)*max(1,h/4)*6];
-			imageData.dxt5_bit = new uint8_t[max(1,w/4)*max(1,h/4)*4];
+			uint16_t *cl1 = imageData.dxt5_col + blocks;
+			imageData.dxt5_abt = image_alloc<uint8_t>(blocks*6);
+			imageData.dxt5_bit = image_alloc<uint8_t>(blocks*4);
 			uint8_t *abt = (uint8_t *)imageData.dxt5_abt;
 			uint8_t *bit = (uint8_t *)imageData.dxt5_bit;
-			for ( int32_t d=0; d<max(1,w/4)*max(1,h/4); d++) {
+			for ( int32_t d=0; d<blocks; d++) {
 				if ( gEncodeEmptyMipmap && level > 0 ) {
 					*al0++ = 0;
 					*al1++ = 0;
@@ -925,33 +1283,34 @@ static bool write_dxt5(int32_t w, int32_t h, int32_t level, bool flipped, istrea
 					*bit++ = 0;
 					*bit++ = 0;
 				} else {
-					uint8_t a0 = read_uint8(ifile);
+					uint8_t a0 = read_uint8(src);
 					*al0++ = a0;
-					uint8_t a1 = read_uint8(ifile);
+					uint8_t a1 = read_uint8(src);
 					*al1++ = a1;
 
-					*abt++ = read_uint8(ifile);
-					*abt++ = read_uint8(ifile);
-					*abt++ = read_uint8(ifile);
-					*abt++ = read_uint8(ifile);
-					*abt++ = read_uint8(ifile);
-					*abt++ = read_uint8(ifile);
+					*abt++ = read_uint8(src);
+					*abt++ = read_uint8(src);
+					*abt++ = read_uint8(src);
+					*abt++ = read_uint8(src);
+					*abt++ = read_uint8(src);
+					*abt++ = read_uint8(src);
 
-					uint16_t c0 = read_uint16(ifile);
+					uint16_t c0 = read_uint16(src);
 					*cl0++ = c0;
-					uint16_t c1 = read_uint16(ifile);
+					uint16_t c1 = read_uint16(src);
 					*cl1++ = c1;
-					*bit++ = read_uint8(ifile);
-					*bit++ = read_uint8(ifile);
-					*bit++ = read_uint8(ifile);
-					*bit++ = read_uint8(ifile);
+					*bit++ = read_uint8(src);
+					*bit++ = read_uint8(src);
+					*bit++ = read_uint8(src);
+					*bit++ = read_uint8(src);
 				}
 			}
+			atf_stats_stage(ATF_STAGE_SPLIT,split);
 
 			{
-				uint8_t *buffer = new uint8_t[max(1,w/4)*max(1,h/4)*sizeof(uint32_t)*8+LZMA_PROPS_SIZE+4096];
+				uint8_t *buffer = new uint8_t[blocks*sizeof(uint32_t)*8+LZMA_PROPS_SIZE+4096];
 
-				size_t bufferLen = LzmaSlowCompress((uint8_t*)imageData.dxt5_abt, buffer, max(1,w/4)*max(1,h/4)*6);
+				size_t bufferLen = LzmaSlowCompress((uint8_t*)imageData.dxt5_abt, buffer, blocks*6);
 				
 				write_uint24(bufferLen,ofile);
 
@@ -962,6 +1321,7 @@ static bool write_dxt5(int32_t w, int32_t h, int32_t level, bool flipped, istrea
 			}
 
 			{
+				ATFStatsMark encode = atf_stats_mark();
 				jxr_container_t container = jxr_create_container();
 				jxrc_start_file(container);
 
@@ -970,17 +1330,17 @@ static bool write_dxt5(int32_t w, int32_t h, int32_t level, bool flipped, istrea
 					return false;
 				}
 				jxrc_set_pixel_format(container, JXRC_FMT_8bppGray);
-				jxrc_set_image_shape(container, max(1,w/4), max(2,h/2));
+				jxrc_set_image_shape(container, mip.blocksw, max(2,h/2));
 				jxrc_set_separate_alpha_image_plane(container, 0);
 				jxrc_set_image_band_presence(container, JXR_BP_ALL);
 				static unsigned char window_params[5] = {0,0,0,0,0};
-				jxr_image_t image = jxr_create_image(max(1,w/4), max(2,h/2), window_params);
+				jxr_image_t image = jxr_create_image(mip.blocksw, max(2,h/2), window_params);
 
 				if ( !image ) {
 					return false;
 				}
 
-				SetJPEG8(container,image,gJxrQuality, max(1,w/4), max(2,h/2));
+				SetJPEG8(container,image,gJxrQuality, mip.blocksw, max(2,h/2));
 
 				jxrc_begin_image_data(container);
 				jxr_set_block_input(image, Read8Data_DXT5);  
@@ -994,6 +1354,7 @@ static bool write_dxt5(int32_t w, int32_t h, int32_t level, bool flipped, istrea
 				jxr_destroy(image); 
 
 				jxrc_write_container_post(container);
+				atf_stats_stream(ATF_STAGE_JXR,blocks*2,container->wb.len(),encode);
 
 				//write_debug_image(container);
 
@@ -1004,9 +1365,9 @@ static bool write_dxt5(int32_t w, int32_t h, int32_t level, bool flipped, istrea
 			}
 
 			{
-				uint8_t *buffer = new uint8_t[max(1,w/4)*max(1,h/4)*sizeof(uint32_t)*8+LZMA_PROPS_SIZE+4096];
+				uint8_t *buffer = new uint8_t[blocks*sizeof(uint32_t)*8+LZMA_PROPS_SIZE+4096];
 
-				size_t bufferLen = LzmaSlowCompress((uint8_t*)imageData.dxt5_bit, buffer, max(1,w/4)*max(1,h/4)*4);
+				size_t bufferLen = LzmaSlowCompress((uint8_t*)imageData.dxt5_bit, buffer, blocks*4);
 				
 				write_uint24(bufferLen,ofile);
 
@@ -1017,6 +1378,7 @@ static bool write_dxt5(int32_t w, int32_t h, int32_t level, bool flipped, istrea
 			}
 
 			{
+				ATFStatsMark encode = atf_stats_mark();
 				jxr_container_t container = jxr_create_container();
 				jxrc_start_file(container);
 
@@ -1025,17 +1387,17 @@ static bool write_dxt5(int32_t w, int32_t h, int32_t level, bool flipped, istrea
 					return false;
 				}
 				jxrc_set_pixel_format(container, JXRC_FMT_16bppBGR565);
-				jxrc_set_image_shape(container, max(1,w/4), max(2,h/2));
+				jxrc_set_image_shape(container, mip.blocksw, max(2,h/2));
 				jxrc_set_separate_alpha_image_plane(container, 0);
 				jxrc_set_image_band_presence(container, JXR_BP_ALL);
 				static unsigned char window_params[5] = {0,0,0,0,0};
-				jxr_image_t image = jxr_create_image(max(1,w/4), max(2,h/2), window_params);
+				jxr_image_t image = jxr_create_image(mip.blocksw, max(2,h/2), window_params);
 
 				if ( !image ) {
 					return false;
 				}
 
-				SetJPEGX565(container,image,gJxrQuality, max(1,w/4), max(2,h/2));
+				SetJPEGX565(container,image,gJxrQuality, mip.blocksw, max(2,h/2));
 
 				jxrc_begin_image_data(container);
 				jxr_set_block_input(image, Read565Data_DXT5);  
@@ -1049,6 +1411,7 @@ static bool write_dxt5(int32_t w, int32_t h, int32_t level, bool flipped, istrea
 				jxr_destroy(image); 
 
 				jxrc_write_container_post(container);
+				atf_stats_stream(ATF_STAGE_JXR,blocks*sizeof(uint16_t)*2,container->wb.len(),encode);
 
 				//write_debug_image(container);
 
@@ -1058,11 +1421,12 @@ static bool write_dxt5(int32_t w, int32_t h, int32_t level, bool flipped, istrea
 				jxr_destroy_container(container);
 			}
 			
-			delete [] imageData.dxt5_alp;
-			delete [] imageData.dxt5_abt;
-			delete [] imageData.dxt5_col;
-			delete [] imageData.dxt5_bit;
+			image_free(imageData.dxt5_alp);
+			image_free(imageData.dxt5_abt);
+			image_free(imageData.dxt5_col);
+			image_free(imageData.dxt5_bit);
 		}
+		atf_trace_task(task);
 	} else {
 		if ( gStoreRawCompressed ) {
 			write_uint24(0,ofile);
@@ -1072,43 +1436,45 @@ static bool write_dxt5(int32_t w, int32_t h, int32_t level, bool flipped, istrea
 			write_uint24(0,ofile);
 			write_uint24(0,ofile);
 		}
-		for ( int32_t d=0; d<max(1,w/4)*max(1,h/4); d++) {
-            read_uint32(ifile);
-            read_uint32(ifile);
-            read_uint32(ifile);
-            read_uint32(ifile);
-        }
 	}
 	return true;
 }
 
-static bool write_pvrtc_alpha(int32_t w, int32_t h, int32_t level, bool flipped, istream &ifile, ostream &ofile)
+static bool write_pvrtc_alpha(const ATFMipLevel &mip, int32_t level, bool flipped, const uint8_t *src, ostream &ofile)
 {
-	int32_t pw = max(int32_t(PVRTC4_MIN_TEXWIDTH),w);
-	int32_t ph = max(int32_t(PVRTC4_MIN_TEXWIDTH),h);
+	int32_t w = mip.width;
+	int32_t h = mip.height;
+	int32_t pw = mip.blocksw*4;
+	int32_t ph = mip.blocksh*4;
+	int32_t blocks = mip.blocks();
+
+	atf_stats_format("PVRTC");
 
 	if ( ( gCompressedFormats == 0 || gCompressedFormats == 3 ) && !(level < gEmbedRangeStart || level > gEmbedRangeEnd ) ) {
 
+		ATFStatsMark task = atf_stats_mark();
+
         if ( gStoreRawCompressed ) {
 
-			uint32_t tsize = max(1,pw/4)*max(1,ph/4)*sizeof(uint32_t)*2;
+			ATFStatsMark split = atf_stats_mark();
+			uint32_t tsize = mip.length;
 			write_uint24(tsize,ofile);
-			for ( int32_t d=0; d<tsize; d++) {
-				write_uint8(read_uint8(ifile),ofile);
-			}
+			ofile.write((const char *)src,tsize);
+			atf_stats_stream(ATF_STAGE_SPLIT,tsize,tsize,split);
 
 		} else {
+			ATFStatsMark split = atf_stats_mark();
 			ImageData imageData;
 			imageData.flipped = flipped;
-			imageData.pvrtc_col = new uint16_t[max(2,pw/4)*max(2,ph/4)*2];
+			imageData.pvrtc_col = image_alloc<uint16_t>(max(2,pw/4)*max(2,ph/4)*2);
 			uint16_t *cl0 = imageData.pvrtc_col;
-			uint16_t *cl1 = imageData.pvrtc_col + max(1,pw/4)*max(1,ph/4);
-			imageData.pvrtc_d0 = new uint8_t[max(1,pw/4)*max(1,ph/4)];
+			uint16_t *cl1 = imageData.pvrtc_col + blocks;
+			imageData.pvrtc_d0 = image_alloc<uint8_t>(blocks);
 			uint8_t *d0 = (uint8_t *)imageData.pvrtc_d0;
-			imageData.pvrtc_d1 = new uint32_t[max(1,pw/4)*max(1,ph/4)];
+			imageData.pvrtc_d1 = image_alloc<uint32_t>(blocks);
 			uint8_t *d1 = (uint8_t *)imageData.pvrtc_d1;
 			
-			for ( int32_t d=0; d<max(1,pw/4)*max(1,ph/4); d++) {
+			for ( int32_t d=0; d<blocks; d++) {
 				if ( gEncodeEmptyMipmap && level > 0 ) {
 					*d1++ = 0;
 					*d1++ = 0;
@@ -1118,22 +1484,23 @@ static bool write_pvrtc_alpha(int32_t w, int32_t h, int32_t level, bool flipped,
 					*d0++ = 0;
 					*cl1++ = 0;
 				} else {
-					*d1++ = read_uint8(ifile);
-					*d1++ = read_uint8(ifile);
-					*d1++ = read_uint8(ifile);
-					*d1++ = read_uint8(ifile);
-					uint16_t c0 = read_uint16(ifile);
+					*d1++ = read_uint8(src);
+					*d1++ = read_uint8(src);
+					*d1++ = read_uint8(src);
+					*d1++ = read_uint8(src);
+					uint16_t c0 = read_uint16(src);
 					*cl0++ = c0;
-					uint16_t c1 = read_uint16(ifile);
+					uint16_t c1 = read_uint16(src);
 					*d0++ = ( ( c0 & 1 ) ? 1 : 0 ) | ( ( c0 & 0x8000 ) ? 2 : 0 ) | ( ( c1 & 0x8000 ) ? 4 : 0 );
 					*cl1++ = c1;
 				}
 			}
+			atf_stats_stage(ATF_STAGE_SPLIT,split);
 
 			{ // pvrtc d1
-				uint8_t *buffer = new uint8_t[max(1,pw/4)*max(1,ph/4)*sizeof(uint8_t)*2+LZMA_PROPS_SIZE+4096];
+				uint8_t *buffer = new uint8_t[blocks*sizeof(uint8_t)*2+LZMA_PROPS_SIZE+4096];
 
-				size_t bufferLen = LzmaSlowCompress((uint8_t*)imageData.pvrtc_d0, buffer, max(1,pw/4)*max(1,ph/4)*sizeof(uint8_t));
+				size_t bufferLen = LzmaSlowCompress((uint8_t*)imageData.pvrtc_d0, buffer, blocks*sizeof(uint8_t));
 
 				write_uint24(bufferLen,ofile);
 
@@ -1143,9 +1510,9 @@ static bool write_pvrtc_alpha(int32_t w, int32_t h, int32_t level, bool flipped,
 			}
 			
 			{ // pvrtc d1
-				uint8_t *buffer = new uint8_t[max(1,pw/4)*max(1,ph/4)*sizeof(uint32_t)*2+LZMA_PROPS_SIZE+4096];
+				uint8_t *buffer = new uint8_t[blocks*sizeof(uint32_t)*2+LZMA_PROPS_SIZE+4096];
 
-				size_t bufferLen = LzmaSlowCompress((uint8_t*)imageData.pvrtc_d1, buffer, max(1,pw/4)*max(1,ph/4)*sizeof(uint32_t));
+				size_t bufferLen = LzmaSlowCompress((uint8_t*)imageData.pvrtc_d1, buffer, blocks*sizeof(uint32_t));
 
 				write_uint24(bufferLen,ofile);
 
@@ -1154,6 +1521,7 @@ static bool write_pvrtc_alpha(int32_t w, int32_t h, int32_t level, bool flipped,
 				delete [] buffer;
 			}
 
+			ATFStatsMark encode = atf_stats_mark();
 			jxr_container_t container = jxr_create_container();
 			jxrc_start_file(container);
 
@@ -1162,17 +1530,17 @@ static bool write_pvrtc_alpha(int32_t w, int32_t h, int32_t level, bool flipped,
 				return false;
 			}
 			jxrc_set_pixel_format(container, JXRC_FMT_16bppBGR555);
-			jxrc_set_image_shape(container, max(1,pw/4), max(2,ph/2));
+			jxrc_set_image_shape(container, mip.blocksw, max(2,ph/2));
 			jxrc_set_separate_alpha_image_plane(container, 0);
 			jxrc_set_image_band_presence(container, JXR_BP_ALL);
 			static unsigned char window_params[5] = {0,0,0,0,0};
-			jxr_image_t image = jxr_create_image(max(1,pw/4), max(2,ph/2), window_params);
+			jxr_image_t image = jxr_create_image(mip.blocksw, max(2,ph/2), window_params);
 
 			if ( !image ) {
 				return false;
 			}
 
-			SetJPEGX555(container,image,gJxrQuality, max(1,pw/4), max(2,ph/2));
+			SetJPEGX555(container,image,gJxrQuality, mip.blocksw, max(2,ph/2));
 
 			jxrc_begin_image_data(container);
 			jxr_set_block_input(image, Read555Data_PVRTC);  
@@ -1186,6 +1554,7 @@ static bool write_pvrtc_alpha(int32_t w, int32_t h, int32_t level, bool flipped,
 			jxr_destroy(image); 
 
 			jxrc_write_container_post(container);
+			atf_stats_stream(ATF_STAGE_JXR,blocks*sizeof(uint16_t)*2,container->wb.len(),encode);
 
 			//write_debug_image(container);
 			
@@ -1194,10 +1563,11 @@ static bool write_pvrtc_alpha(int32_t w, int32_t h, int32_t level, bool flipped,
 			
 			jxr_destroy_container(container);
 			
-			delete [] imageData.pvrtc_col;
-			delete [] imageData.pvrtc_d0;
-			delete [] imageData.pvrtc_d1;
+			image_free(imageData.pvrtc_col);
+			image_free(imageData.pvrtc_d0);
+			image_free(imageData.pvrtc_d1);
 		}
+		atf_trace_task(task);
 	} else {
 		if ( gStoreRawCompressed ) {
 			write_uint24(0,ofile);
@@ -1206,42 +1576,46 @@ static bool write_pvrtc_alpha(int32_t w, int32_t h, int32_t level, bool flipped,
 			write_uint24(0,ofile);
 			write_uint24(0,ofile);
 		}
-		for ( int32_t d=0; d<max(1,pw/4)*max(1,ph/4); d++) {
-            read_uint32(ifile);
-            read_uint32(ifile);
-        }
 	}
 	return true;
 }
 
 
-static bool write_pvrtc(int32_t w, int32_t h, int32_t level, bool flipped, istream &ifile, ostream &ofile)
+static bool write_pvrtc(const ATFMipLevel &mip, int32_t level, bool flipped, const uint8_t *src, ostream &ofile)
 {
-	int32_t pw = max(int32_t(PVRTC4_MIN_TEXWIDTH),w);
-	int32_t ph = max(int32_t(PVRTC4_MIN_TEXWIDTH),h);
+	int32_t w = mip.width;
+	int32_t h = mip.height;
+	int32_t pw = mip.blocksw*4;
+	int32_t ph = mip.blocksh*4;
+	int32_t blocks = mip.blocks();
+
+	atf_stats_format("PVRTC");
 
 	if ( ( gCompressedFormats == 0 || gCompressedFormats == 3 ) && !(level < gEmbedRangeStart || level > gEmbedRangeEnd ) ) {
 
+		ATFStatsMark task = atf_stats_mark();
+
         if ( gStoreRawCompressed ) {
 
-			uint32_t tsize = max(1,pw/4)*max(1,ph/4)*sizeof(uint32_t)*2;
+			ATFStatsMark split = atf_stats_mark();
+			uint32_t tsize = mip.length;
 			write_uint24(tsize,ofile);
-			for ( int32_t d=0; d<tsize; d++) {
-				write_uint8(read_uint8(ifile),ofile);
-			}
+			ofile.write((const char *)src,tsize);
+			atf_stats_stream(ATF_STAGE_SPLIT,tsize,tsize,split);
 
 		} else {
+			ATFStatsMark split = atf_stats_mark();
 			ImageData imageData;
 			imageData.flipped = flipped;
-			imageData.pvrtc_col = new uint16_t[max(2,pw/4)*max(2,ph/4)*2];
+			imageData.pvrtc_col = image_alloc<uint16_t>(max(2,pw/4)*max(2,ph/4)*2);
 			uint16_t *cl0 = imageData.pvrtc_col;
-			uint16_t *cl1 = imageData.pvrtc_col + max(1,pw/4)*max(1,ph/4);
-			imageData.pvrtc_d0 = new uint8_t[max(1,pw/4)*max(1,ph/4)];
+			uint16_t *cl1 = imageData.pvrtc_col + blocks;
+			imageData.pvrtc_d0 = image_alloc<uint8_t>(blocks);
 			uint8_t *d0 = (uint8_t *)imageData.pvrtc_d0;
-			imageData.pvrtc_d1 = new uint32_t[max(1,pw/4)*max(1,ph/4)];
+			imageData.pvrtc_d1 = image_alloc<uint32_t>(blocks);
 			uint8_t *d1 = (uint8_t *)imageData.pvrtc_d1;
 			
-			for ( int32_t d=0; d<max(1,pw/4)*max(1,ph/4); d++) {
+			for ( int32_t d=0; d<blocks; d++) {
 				if ( gEncodeEmptyMipmap && level > 0 ) {
 					*d1++ = 0;
 					*d1++ = 0;
@@ -1251,17 +1625,17 @@ static bool write_pvrtc(int32_t w, int32_t h, int32_t level, bool flipped, istre
 					*d0++ = 0;
 					*cl1++ = 0;
 				} else {
-					*d1++ = read_uint8(ifile);
-					*d1++ = read_uint8(ifile);
-					*d1++ = read_uint8(ifile);
-					*d1++ = read_uint8(ifile);
-					uint16_t c0 = read_uint16(ifile);
+					*d1++ = read_uint8(src);
+					*d1++ = read_uint8(src);
+					*d1++ = read_uint8(src);
+					*d1++ = read_uint8(src);
+					uint16_t c0 = read_uint16(src);
 					if ( gCheckForAlphaValue && ( c0 & 0x8000 ) == 0 ) {
 						cerr << "PVRTC textures with alpha not supported!\n\n";
 						return false;
 					}
 					*cl0++ = c0;
-					uint16_t c1 = read_uint16(ifile);
+					uint16_t c1 = read_uint16(src);
 					if ( gCheckForAlphaValue && ( c1 & 0x8000 ) == 0 ) {
 						cerr << "PVRTC textures with alpha not supported!\n\n";
 						return false;
@@ -1270,11 +1644,12 @@ static bool write_pvrtc(int32_t w, int32_t h, int32_t level, bool flipped, istre
 					*cl1++ = c1;
 				}
 			}
+			atf_stats_stage(ATF_STAGE_SPLIT,split);
 
 			{ // pvrtc d1
-				uint8_t *buffer = new uint8_t[max(1,pw/4)*max(1,ph/4)*sizeof(uint8_t)*2+LZMA_PROPS_SIZE+4096];
+				uint8_t *buffer = new uint8_t[blocks*sizeof(uint8_t)*2+LZMA_PROPS_SIZE+4096];
 
-				size_t bufferLen = LzmaSlowCompress((uint8_t*)imageData.pvrtc_d0, buffer, max(1,pw/4)*max(1,ph/4)*sizeof(uint8_t));
+				size_t bufferLen = LzmaSlowCompress((uint8_t*)imageData.pvrtc_d0, buffer, blocks*sizeof(uint8_t));
 
 				write_uint24(bufferLen,ofile);
 
@@ -1284,9 +1659,9 @@ static bool write_pvrtc(int32_t w, int32_t h, int32_t level, bool flipped, istre
 			}
 			
 			{ // pvrtc d1
-				uint8_t *buffer = new uint8_t[max(1,pw/4)*max(1,ph/4)*sizeof(uint32_t)*2+LZMA_PROPS_SIZE+4096];
+				uint8_t *buffer = new uint8_t[blocks*sizeof(uint32_t)*2+LZMA_PROPS_SIZE+4096];
 
-				size_t bufferLen = LzmaSlowCompress((uint8_t*)imageData.pvrtc_d1, buffer, max(1,pw/4)*max(1,ph/4)*sizeof(uint32_t));
+				size_t bufferLen = LzmaSlowCompress((uint8_t*)imageData.pvrtc_d1, buffer, blocks*sizeof(uint32_t));
 
 				write_uint24(bufferLen,ofile);
 
@@ -1295,6 +1670,7 @@ static bool write_pvrtc(int32_t w, int32_t h, int32_t level, bool flipped, istre
 				delete [] buffer;
 			}
 
+			ATFStatsMark encode = atf_stats_mark();
 			jxr_container_t container = jxr_create_container();
 			jxrc_start_file(container);
 
@@ -1303,17 +1679,17 @@ static bool write_pvrtc(int32_t w, int32_t h, int32_t level, bool flipped, istre
 				return false;
 			}
 			jxrc_set_pixel_format(container, JXRC_FMT_16bppBGR555);
-			jxrc_set_image_shape(container, max(1,pw/4), max(2,ph/2));
+			jxrc_set_image_shape(container, mip.blocksw, max(2,ph/2));
 			jxrc_set_separate_alpha_image_plane(container, 0);
 			jxrc_set_image_band_presence(container, JXR_BP_ALL);
 			static unsigned char window_params[5] = {0,0,0,0,0};
-			jxr_image_t image = jxr_create_image(max(1,pw/4), max(2,ph/2), window_params);
+			jxr_image_t image = jxr_create_image(mip.blocksw, max(2,ph/2), window_params);
 
 			if ( !image ) {
 				return false;
 			}
 
-			SetJPEGX555(container,image,gJxrQuality, max(1,pw/4), max(2,ph/2));
+			SetJPEGX555(container,image,gJxrQuality, mip.blocksw, max(2,ph/2));
 
 			jxrc_begin_image_data(container);
 			jxr_set_block_input(image, Read555Data_PVRTC);  
@@ -1327,6 +1703,7 @@ static bool write_pvrtc(int32_t w, int32_t h, int32_t level, bool flipped, istre
 			jxr_destroy(image); 
 
 			jxrc_write_container_post(container);
+			atf_stats_stream(ATF_STAGE_JXR,blocks*sizeof(uint16_t)*2,container->wb.len(),encode);
 
 			//write_debug_image(container);
 			
@@ -1335,10 +1712,11 @@ static bool write_pvrtc(int32_t w, int32_t h, int32_t level, bool flipped, istre
 			
 			jxr_destroy_container(container);
 			
-			delete [] imageData.pvrtc_col;
-			delete [] imageData.pvrtc_d0;
-			delete [] imageData.pvrtc_d1;
+			image_free(imageData.pvrtc_col);
+			image_free(imageData.pvrtc_d0);
+			image_free(imageData.pvrtc_d1);
 		}
+		atf_trace_task(task);
 	} else {
 		if ( gStoreRawCompressed ) {
 			write_uint24(0,ofile);
@@ -1347,41 +1725,43 @@ static bool write_pvrtc(int32_t w, int32_t h, int32_t level, bool flipped, istre
 			write_uint24(0,ofile);
 			write_uint24(0,ofile);
 		}
-		for ( int32_t d=0; d<max(1,pw/4)*max(1,ph/4); d++) {
-            read_uint32(ifile);
-            read_uint32(ifile);
-        }
 	}
 	return true;
 }
 				
-static bool write_etc1(int32_t w, int32_t h, int32_t level, bool flipped, istream &ifile, ostream &ofile, bool alpha)
+static bool write_etc1(const ATFMipLevel &mip, int32_t level, bool flipped, const uint8_t *src, ostream &ofile, bool alpha)
 {
+	int32_t w = mip.width;
+	int32_t h = mip.height;
+	int32_t blocks = mip.blocks();
+
+	atf_stats_format("ETC1");
+
 	if ( ( gCompressedFormats == 0 || gCompressedFormats == 2 ) && !(level < gEmbedRangeStart || level > gEmbedRangeEnd ) ) {
 
+		ATFStatsMark task = atf_stats_mark();
+
 		if ( gStoreRawCompressed ) {
 
-			uint32_t tsize = max(1,w/4)*max(1,h/4)*sizeof(uint32_t)*2;
-            if ( alpha ) {
-                tsize = max(1,w/4)*max(1,h/4)*sizeof(uint32_t)*4;
-            }
+			ATFStatsMark split = atf_stats_mark();
+			uint32_t tsize = mip.length;
 			write_uint24(tsize,ofile);
-			for ( int32_t d=0; d<tsize; d++) {
-				write_uint8(read_uint8(ifile),ofile);
-			}
+			ofile.write((const char *)src,tsize);
+			atf_stats_stream(ATF_STAGE_SPLIT,tsize,tsize,split);
 
 		} else {
 
+			ATFStatsMark split = atf_stats_mark();
 			ImageData imageData;
 			imageData.flipped = flipped;
-			imageData.etc1_col = new uint32_t[max(2,w/4)*max(2,h/2)*(alpha?2:1)];
+			imageData.etc1_col = image_alloc<uint32_t>(max(2,w/4)*max(2,h/2)*(alpha?2:1));
 			uint32_t *col = imageData.etc1_col;
-			imageData.etc1_d0 = new uint8_t[max(1,w/4)*max(1,h/4)*(alpha?2:1)];
+			imageData.etc1_d0 = image_alloc<uint8_t>(blocks*(alpha?2:1));
 			uint8_t *d0 = (uint8_t *)imageData.etc1_d0;
-			imageData.etc1_d1 = new uint32_t[max(1,w/4)*max(1,h/4)*(alpha?2:1)];
+			imageData.etc1_d1 = image_alloc<uint32_t>(blocks*(alpha?2:1));
 			uint8_t *d1 = (uint8_t *)imageData.etc1_d1;
 
-			for ( int32_t d=0; d<max(1,w/4)*max(1,h/4)*(alpha?2:1); d++) {
+			for ( int32_t d=0; d<blocks*(alpha?2:1); d++) {
 				if ( gEncodeEmptyMipmap && level > 0 ) {
 					*col++ = 0;
 					*d0++ = 0;
@@ -1390,41 +1770,61 @@ static bool write_etc1(int32_t w, int32_t h, int32_t level, bool flipped, istrea
 					*d1++ = 0;
 					*d1++ = 0;
 				} else {
-					*col++ = read_uint24(ifile);
-					*d0++ = read_uint8(ifile);
-					*d1++ = read_uint8(ifile);
-					*d1++ = read_uint8(ifile);
-					*d1++ = read_uint8(ifile);
-					*d1++ = read_uint8(ifile);
+					*col++ = read_uint24(src);
+					*d0++ = read_uint8(src);
+					*d1++ = read_uint8(src);
+					*d1++ = read_uint8(src);
+					*d1++ = read_uint8(src);
+					*d1++ = read_uint8(src);
 				}
 			}
+			atf_stats_stage(ATF_STAGE_SPLIT,split);
+
+			ATFCacheKey key;
+			vector<uint8_t> cached;
+			atf_cache_key(key,ATF_CACHE_ETC1,w,h,flipped,alpha,gJxrQuality,gTrimFlexBits,gJxrFormat);
+			atf_cache_hash(key,imageData.etc1_col,blocks*(alpha?2:1)*sizeof(uint32_t));
+			atf_cache_hash(key,imageData.etc1_d0,blocks*(alpha?2:1));
+			atf_cache_hash(key,imageData.etc1_d1,blocks*(alpha?2:1)*sizeof(uint32_t));
+			ATFStatsMark lookup = atf_stats_mark();
+			if ( atf_cache_lookup(key,cached) ) {
+				ofile.write((const char *)&cached[0],cached.size());
+				atf_stats_stream(ATF_STAGE_CACHED,cached.size(),cached.size(),lookup);
+				image_free(imageData.etc1_col);
+				image_free(imageData.etc1_d0);
+				image_free(imageData.etc1_d1);
+				return true;
+			}
 
 			{ // etc1 d0 data				
-				uint8_t *buffer = new uint8_t[max(1,w/4)*max(1,h/4)*sizeof(uint8_t)*2*(alpha?2:1)+LZMA_PROPS_SIZE+4096];
+				uint8_t *buffer = new uint8_t[blocks*sizeof(uint8_t)*2*(alpha?2:1)+LZMA_PROPS_SIZE+4096];
 
-				size_t bufferLen = LzmaSlowCompress((uint8_t*)imageData.etc1_d0, buffer, max(1,w/4)*max(1,h/4)*sizeof(uint8_t)*(alpha?2:1));
+				size_t bufferLen = LzmaSlowCompress((uint8_t*)imageData.etc1_d0, buffer, blocks*sizeof(uint8_t)*(alpha?2:1));
 
 				write_uint24(bufferLen,ofile);
 
 				ofile.write((const char *)buffer,bufferLen);
 				outlzmasize += bufferLen;
+				atf_cache_append(cached,buffer,bufferLen);
 
 				delete [] buffer;
 			}
 
 			{ // etc1 d1 data				
-				uint8_t *buffer = new uint8_t[max(1,w/4)*max(1,h/4)*sizeof(uint32_t)*2*(alpha?2:1)+LZMA_PROPS_SIZE+4096];
+				uint8_t *buffer = new uint8_t[blocks*sizeof(uint32_t)*2*(alpha?2:1)+LZMA_PROPS_SIZE+4096];
 				
-				size_t bufferLen = LzmaSlowCompress((uint8_t*)imageData.etc1_d1, buffer, max(1,w/4)*max(1,h/4)*sizeof(uint32_t)*(alpha?2:1));
+				size_t bufferLen = LzmaSlowCompress((uint8_t*)imageData.etc1_d1, buffer, blocks*sizeof(uint32_t)*(alpha?2:1));
 
 				write_uint24(bufferLen,ofile);
 
 				ofile.write((const char *)buffer,bufferLen);
 				outlzmasize += bufferLen;
+				atf_cache_append(cached,buffer,bufferLen);
 
 				delete [] buffer;
 			}
 
+			ATFStatsMark encode = atf_stats_mark();
 			jxr_container_t container = jxr_create_container();
 			jxrc_start_file(container);
 			
@@ -1433,17 +1833,17 @@ static bool write_etc1(int32_t w, int32_t h, int32_t level, bool flipped, istrea
 				return false;
 			}
 			jxrc_set_pixel_format(container, JXRC_FMT_16bppBGR555);
-			jxrc_set_image_shape(container, max(1,w/4), max(2,h/2)*(alpha?2:1));
+			jxrc_set_image_shape(container, mip.blocksw, max(2,h/2)*(alpha?2:1));
 			jxrc_set_separate_alpha_image_plane(container, 0);
 			jxrc_set_image_band_presence(container, JXR_BP_ALL);
 			static unsigned char window_params[5] = {0,0,0,0,0};
-			jxr_image_t image = jxr_create_image(max(1,w/4), max(2,h/2)*(alpha?2:1), window_params);
+			jxr_image_t image = jxr_create_image(mip.blocksw, max(2,h/2)*(alpha?2:1), window_params);
 
 			if ( !image ) {
 				return false;
 			}
 
-			SetJPEGX555(container,image,gJxrQuality, max(1,w/4), max(2,h/2)*(alpha?2:1));
+			SetJPEGX555(container,image,gJxrQuality, mip.blocksw, max(2,h/2)*(alpha?2:1));
 
 			jxrc_begin_image_data(container);
 			jxr_set_block_input(image, Read555Data_ETC1);  
@@ -1457,18 +1857,22 @@ static bool write_etc1(int32_t w, int32_t h, int32_t level, bool flipped, istrea
 			jxr_destroy(image); 
 
 			jxrc_write_container_post(container);
+			atf_stats_stream(ATF_STAGE_JXR,blocks*3*(alpha?2:1),container->wb.len(),encode);
 
 			//write_debug_image(container);
 
 			write_uint24(container->wb.len(),ofile);
 			ofile.write((const char *)container->wb.buffer(),container->wb.len());
+			atf_cache_append(cached,container->wb.buffer(),container->wb.len());
+			atf_cache_store(key,cached);
 			
 			jxr_destroy_container(container);
 
-			delete [] imageData.etc1_col;
-			delete [] imageData.etc1_d0;
-			delete [] imageData.etc1_d1;
+			image_free(imageData.etc1_col);
+			image_free(imageData.etc1_d0);
+			image_free(imageData.etc1_d1);
 		}
+		atf_trace_task(task);
 	} else {
 		if ( gStoreRawCompressed ) {
 			write_uint24(0,ofile);
@@ -1477,14 +1881,285 @@ static bool write_etc1(int32_t w, int32_t h, int32_t level, bool flipped, istrea
 			write_uint24(0,ofile);
 			write_uint24(0,ofile);
 		}
-		for ( int32_t d=0; d<max(1,w/4)*max(1,h/4)*(alpha?2:1); d++) {
-            read_uint32(ifile);
-            read_uint32(ifile);
-        }
 	}
 	return true;
 }
 
+// One level of write_raw_jxr. Levels are encoded as scheduler tasks (see
+// atfsched.h) which may run on any thread, so a task carries the settings and
+// the stats and memory contexts of its job instead of relying on the thread
+// locals.
+struct RawLevelTask {
+	const ATFMipLevel  *mip;
+	const uint8_t	   *src;
+	bool				empty;		// encode a black level, gEncodeEmptyMipmap
+	bool				rgba;
+	bool				flipped;
+	int32_t				quality;
+	int32_t				trimFlexBits;
+	jxr_color_fmt_t		format;
+	double				adaptive;	// gJxrAdaptiveQP
+	ATFStatsContext		context;
+	ATFStats			stats;		// merged into the job's stats in level order
+	ATFMemContext	   *memory;
+	ATFCacheKey			key;
+	vector<uint8_t>		block;		// U24 length and data of the level block
+	bool				encode;
+	bool				ok;
+};
+
+// Switches the calling thread to the stats of task, returns the previous context.
+static ATFStatsContext enter_raw_level(RawLevelTask &task)
+{
+	ATFStatsContext previous = atf_stats_context();
+	ATFStatsContext context = task.context;
+	if ( context.stats ) {
+		context.stats = &task.stats;
+	}
+	atf_stats_set_context(context);
+	return previous;
+}
+
+// Writes the JPEG-XR image of a level into container, image is set as soon
+// as it is created. The caller releases both on every return.
+static bool write_raw_level(RawLevelTask &task, ImageData &imageData, jxr_container_t container, jxr_image_t &image)
+{
+	const ATFMipLevel &mip = *task.mip;
+	int32_t w = mip.width;
+	int32_t h = mip.height;
+
+	jxrc_start_file(container);
+
+	if ( jxrc_begin_ifd_entry(container) != 0 ) {
+		cerr << "Could not create ATF file!\n\n";
+		return false;
+	}
+
+	if ( task.rgba ) {
+		jxrc_set_pixel_format(container, JXRC_FMT_32bppBGRA);
+	} else {
+		jxrc_set_pixel_format(container, JXRC_FMT_24bppBGR);
+	}
+
+	jxrc_set_image_shape(container, w, h);
+	jxrc_set_separate_alpha_image_plane(container, 0);
+	jxrc_set_image_band_presence(container, JXR_BP_ALL);
+
+	static unsigned char window_params[5] = {0,0,0,0,0};
+	image = jxr_create_image(w, h, window_params);
+
+	if ( !image ) {
+		cerr << "Could not create image!\n\n";
+		return false;
+	}
+
+	SetJPEGXRaw(container,image,task.quality,task.rgba, w, h);
+	AdaptiveQP aq;
+	if ( task.adaptive > 0 ) {
+		SetJPEGXRAdaptiveQuality(image,task.quality,task.adaptive,imageData,task.rgba,w,h,aq);
+	}
+
+	jxrc_begin_image_data(container);
+	if ( task.rgba ) {
+		jxr_set_block_input(image, Read8888Data);
+	} else {
+		jxr_set_block_input(image, Read888Data);
+	}
+	jxr_set_user_data(image, &imageData);
+
+	if ( jxr_write_image_bitstream(image,container) != 0 ) {
+		cerr << "JPEGXR encoding error!\n";
+		return false;
+	}
+	return true;
+}
+
+static bool encode_raw_level(RawLevelTask &task)
+{
+	const ATFMipLevel &mip = *task.mip;
+
+	ATFStatsMark start = atf_stats_mark();
+	ImageData imageData;
+	imageData.flipped = task.flipped;
+
+	ATFStatsMark split = atf_stats_mark();
+	imageData.raw = image_alloc<uint8_t>(mip.blocks()*4);
+	if ( task.empty ) {
+		memset(imageData.raw,0,mip.length);
+	} else {
+		memcpy(imageData.raw,task.src,mip.length);
+	}
+	atf_stats_stage(ATF_STAGE_SPLIT,split);
+
+	ATFStatsMark encode = atf_stats_mark();
+	jxr_container_t container = jxr_create_container();
+	jxr_image_t image = 0;
+	bool ok = write_raw_level(task,imageData,container,image);
+
+	jxr_destroy(image);
+
+	if ( ok ) {
+		jxrc_write_container_post(container);
+		atf_stats_stream(ATF_STAGE_JXR,mip.length,container->wb.len(),encode);
+
+		size_t len = container->wb.len();
+		task.block.resize(3 + len);
+		task.block[0] = uint8_t((len>>16)&0xFF);
+		task.block[1] = uint8_t((len>> 8)&0xFF);
+		task.block[2] = uint8_t((len>> 0)&0xFF);
+		memcpy(&task.block[3],container->wb.buffer(),len);
+
+		//write_debug_image(container);
+	}
+
+	jxr_destroy_container(container);
+
+	image_free(imageData.raw);
+	imageData.raw = 0;
+
+	if ( ok ) {
+		atf_trace_task(start);
+	}
+	return ok;
+}
+
+static void raw_level_task(void *arg)
+{
+	RawLevelTask &task = *(RawLevelTask *)arg;
+
+	// the CPU time of the job's own thread already covers tasks it runs itself
+	ATFMemContext *memory = atf_mem_set_context(task.memory);
+	bool foreign = memory != task.memory;
+	double cpu = ( foreign && task.context.stats ) ? atf_cpu_time() : 0;
+
+	ATFStatsContext previous = enter_raw_level(task);
+	jxr_color_fmt_t format = gJxrFormat;
+	int32_t trimFlexBits = gTrimFlexBits;
+	gJxrFormat = task.format;
+	gTrimFlexBits = task.trimFlexBits;
+
+	// the job reports an exceeded limit once all of its tasks are done
+	task.ok = !atf_mem_exceeded() && encode_raw_level(task) && !atf_mem_exceeded();
+
+	gJxrFormat = format;
+	gTrimFlexBits = trimFlexBits;
+	atf_stats_set_context(previous);
+	if ( foreign && task.context.stats ) {
+		task.stats.cpu += atf_cpu_time() - cpu;
+	}
+	atf_mem_set_context(memory);
+}
+
+// Trim flex bits write_raw_jxr uses for quality.
+static int32_t raw_trim_flex_bits(int32_t quality, bool rgba)
+{
+	if ( rgba ) {
+		return 0; // trimming flex bits cause crashers during decode.
+	}
+	if ( gTrimFlexBitsDefault ) {
+		return quality > 5 ? 3 : 0;
+	}
+	return gTrimFlexBits;
+}
+
+// --target-bytes: finds the lowest quality setting whose file fits into
+// gTargetBytes. Every round encodes the levels in the embed range at up to
+// three qualities at once, spread over the range still in question, and
+// narrows it down to the qualities between the highest one which did not fit
+// and the lowest one which did, so with one thread this is a binary search.
+// Trials share the input levels, but the quantization is applied inside the
+// JPEG-XR strip pipeline, so each trial runs all of it. The levels of the
+// chosen quality are returned in best, gJxrQuality and gTrimFlexBits are set
+// to it.
+static bool search_raw_quality(const ATFMipChain &chain, const PVRInput &input, bool rgba, bool flipped, vector<RawLevelTask> &best)
+{
+	size_t fixed = 10; // header, see write_header
+	vector<RawLevelTask> setup(chain.faces*chain.count);
+	for ( int32_t i=0; i<chain.faces; i++) {
+		for ( int32_t c=0; c<chain.count; c++ ) {
+			RawLevelTask &task = setup[i*chain.count+c];
+			task.encode = c >= gEmbedRangeStart && c <= gEmbedRangeEnd;
+			task.ok = true;
+			if ( !task.encode ) {
+				fixed += 3;
+				continue;
+			}
+			atf_stats_level(i,c);
+			task.context = atf_stats_context();
+			task.memory = atf_mem_context();
+			task.mip = &chain.level(c);
+			task.src = level_data(input,chain,i,c);
+			if ( !task.src ) {
+				cerr << "pvr file is short!\n\n";
+				return false;
+			}
+			task.empty = gEncodeEmptyMipmap && c > 0;
+			task.rgba = rgba;
+			task.flipped = flipped;
+			task.format = gJxrFormat;
+			task.adaptive = gJxrAdaptiveQP;
+		}
+	}
+
+	int32_t trials = min(3,atf_sched_threads());
+	int32_t lo = gJxrQualityDefault ? 0 : gJxrQuality;	// lowest quality which may still fit
+	int32_t hi = 101;									// lowest quality known to fit
+	size_t smallest = 0;
+	while ( lo < hi ) {
+		vector<int32_t> qualities;
+		int32_t n = hi - lo;
+		for ( int32_t t=0; t<min(n,trials); t++) {
+			qualities.push_back(n <= trials ? lo + t : lo + ((t+1)*n)/(trials+1));
+		}
+
+		vector< vector<RawLevelTask> > round(qualities.size(),setup);
+		ATFTaskGroup group;
+		for ( size_t t=0; t<round.size(); t++) {
+			for ( size_t c=0; c<round[t].size(); c++) {
+				RawLevelTask &task = round[t][c];
+				if ( task.encode ) {
+					task.quality = qualities[t];
+					task.trimFlexBits = raw_trim_flex_bits(qualities[t],rgba);
+					atf_stats_reset(task.stats);
+					atf_sched_task(group,raw_level_task,&task);
+				}
+			}
+		}
+		atf_sched_wait(group);
+		if ( atf_mem_exceeded() ) {
+			cerr << "Memory limit exceeded!\n\n";
+			return false;
+		}
+
+		int32_t failed = lo - 1;
+		for ( size_t t=0; t<round.size(); t++) {
+			size_t size = fixed;
+			for ( size_t c=0; c<round[t].size(); c++) {
+				if ( !round[t][c].ok ) {
+					return false;
+				}
+				size += round[t][c].block.size();
+			}
+			if ( size <= gTargetBytes ) {
+				hi = qualities[t];
+				best.swap(round[t]);
+				break;
+			}
+			failed = qualities[t];
+			smallest = size;
+		}
+		lo = failed + 1;
+	}
+
+	if ( hi > 100 ) {
+		cerr << "Could not fit the texture into " << gTargetBytes << " bytes, -q 100 needs " << smallest << " bytes.\n\n";
+		return false;
+	}
+	gJxrQuality = hi;
+	gTrimFlexBits = raw_trim_flex_bits(hi,rgba);
+	return true;
+}
+
 static bool write_raw_jxr(istream &ifile_raw, ostream &ofile) {
 	if ( gJxrQualityDefault ) {
 		gJxrQuality = 15;
@@ -1547,132 +2222,126 @@ static bool write_raw_jxr(istream &ifile_raw, ostream &ofile) {
 	}
 
 	int32_t w = texturew = pvr_header.dwWidth;
-	int32_t h = texturew = pvr_header.dwHeight;
+	int32_t h = textureh = pvr_header.dwHeight;
+
+	bool rgba = ( pvr_header.dwpfFlags & 0xFF ) == PVR_OGL_RGBA_8888;
+	atf_stats_format(rgba?"RGBA":"RGB");
+	ATFMipChain chain;
+	pvr_mip_chain(pvr_header,pvr_header,rgba?ATF_MIP_RGBA8:ATF_MIP_RGB8,ifile_raw.tellg(),chain);
 	
-	if ( ( pvr_header.dwpfFlags & 0xFF ) == PVR_OGL_RGBA_8888 ) {
+	if ( rgba ) {
 		texturecomp = 4;
-		write_header(w,h,ATF_FORMAT_8888|(cubeMap?ATF_FORMAT_CUBEMAP:0),pvr_header.dwMipMapCount+1,ofile);
+		write_header(w,h,ATF_FORMAT_8888|(cubeMap?ATF_FORMAT_CUBEMAP:0),chain.count,ofile);
+		atf_reuse_begin(gReuse,ATF_FORMAT_8888|(cubeMap?ATF_FORMAT_CUBEMAP:0),chain.faces,chain.count);
 	} else {
-		write_header(w,h,ATF_FORMAT_888 |(cubeMap?ATF_FORMAT_CUBEMAP:0),pvr_header.dwMipMapCount+1,ofile);
+		write_header(w,h,ATF_FORMAT_888 |(cubeMap?ATF_FORMAT_CUBEMAP:0),chain.count,ofile);
+		atf_reuse_begin(gReuse,ATF_FORMAT_888 |(cubeMap?ATF_FORMAT_CUBEMAP:0),chain.faces,chain.count);
 	}
 
-    int32_t raw_pos = ifile_raw.tellg();
-	
-	for ( int32_t i=0; i<(cubeMap?6:1); i++) {
+	PVRInput input;
+	map_input(ifile_raw,input);
 
-		w = texturew = pvr_header.dwWidth;
-		h = texturew = pvr_header.dwHeight;
+	bool flipped = ( pvr_header.dwpfFlags & PVRTEX_FLIPPED ) ? true : false;
+	vector<RawLevelTask> searched;
+	if ( gTargetBytes && !search_raw_quality(chain,input,rgba,flipped,searched) ) {
+		return false;
+	}
 
-		if ( cubeMap ) {
-            if ( pvr_header.dwpfFlags & ( PVRTEX_DDSCUBEMAPORDER | PVRTEX_PVRCUBEMAPORDER ) ) {
-    			const int32_t dds2ogl[] = { 1, 0, 3, 2, 5, 4 };
-                int32_t pos = raw_pos + pvr_header.dwTextureDataSize * dds2ogl[i];
-	    		ifile_raw.seekg( ( pos ), ios_base::beg);
-            }
-		}
+	// Levels which are neither outside of the embed range nor copied from a
+	// previous output or the cache are encoded as tasks, the blocks are
+	// written in level order once all tasks are done.
+	vector<RawLevelTask> tasks(chain.faces*chain.count);
+	ATFTaskGroup group;
+	bool ok = true;
+	for ( int32_t i=0; i<chain.faces && ok; i++) {
 	
-		for ( int32_t c=0; (c<pvr_header.dwMipMapCount+1) && (w>0||h>0); c++ ) {
+		for ( int32_t c=0; c<chain.count; c++ ) {
+
+			atf_stats_level(i,c);
+			if ( atf_mem_exceeded() ) {
+				cerr << "Memory limit exceeded!\n\n";
+				ok = false;
+				break;
+			}
+
+			const ATFMipLevel &mip = chain.level(c);
+			RawLevelTask &task = tasks[i*chain.count+c];
+			task.context = atf_stats_context();
+			task.memory = atf_mem_context();
+			task.encode = false;
+			task.ok = true;
+			atf_stats_reset(task.stats);
 		
             if ( c < gEmbedRangeStart || c > gEmbedRangeEnd ) {
 
-			    write_uint24(0,ofile);
-				int32_t l = max(1,w)*max(1,h)*3;
-				for ( int32_t d=0; d<l; d++) {
-                    read_uint8(ifile_raw);
-                }
+			    task.block.resize(3,0);
 
             } else {
-			    ImageData imageData;
-			    imageData.flipped = ( pvr_header.dwpfFlags & PVRTEX_FLIPPED ) ? true : false;
-
-			    if ( ifile_raw.eof() ) {
+			    task.mip = &mip;
+			    task.src = level_data(input,chain,i,c);
+			    if ( !task.src ) {
 				    cerr << "pvr file is short!\n\n";
-				    return false;
+				    ok = false;
+				    break;
 			    }
-
-			    imageData.raw = new uint8_t [max(1,w)*max(1,h)*4];
-			    uint8_t *raw = imageData.raw;
-			    if ( ( pvr_header.dwpfFlags & 0xFF ) == PVR_OGL_RGBA_8888 ) {
-				    int32_t l = max(1,w)*max(1,h)*4;
-				    for ( int32_t d=0; d<l; d++) {
-					    if ( gEncodeEmptyMipmap && c > 0 ) {
-						    *raw++ = 0;
-					    } else {
-						    *raw++ = read_uint8(ifile_raw);
-					    }
-				    }
-			    } else {
-				    int32_t l = max(1,w)*max(1,h)*3;
-				    for ( int32_t d=0; d<l; d++) {
-					    if ( gEncodeEmptyMipmap && c > 0 ) {
-						    *raw++ = 0;
-					    } else {
-						    *raw++ = read_uint8(ifile_raw);
-					    }
-				    }
+			    task.empty = gEncodeEmptyMipmap && c > 0;
+			    task.rgba = rgba;
+			    task.flipped = flipped;
+			    task.quality = gJxrQuality;
+			    task.trimFlexBits = gTrimFlexBits;
+			    task.format = gJxrFormat;
+			    task.adaptive = gJxrAdaptiveQP;
+
+			    atf_cache_key(task.key,rgba?ATF_CACHE_RAW_8888:ATF_CACHE_RAW_888,mip.width,mip.height,task.flipped,rgba,gJxrQuality,gTrimFlexBits,gJxrFormat);
+			    if ( task.adaptive > 0 ) {
+				    atf_cache_hash(task.key,&task.adaptive,sizeof(task.adaptive));
 			    }
-
-			    jxr_container_t container = jxr_create_container();
-			    jxrc_start_file(container);
-
-			    if ( jxrc_begin_ifd_entry(container) != 0 ) {
-				    cerr << "Could not create ATF file!\n\n";
-				    return false;
-			    }
-
-			    if ( ( pvr_header.dwpfFlags & 0xFF ) == PVR_OGL_RGBA_8888 ) {
-				    jxrc_set_pixel_format(container, JXRC_FMT_32bppBGRA);
+			    if ( task.empty ) {
+				    vector<uint8_t> black(mip.length,0);
+				    atf_cache_hash(task.key,&black[0],mip.length);
 			    } else {
-				    jxrc_set_pixel_format(container, JXRC_FMT_24bppBGR);
-			    }
-			
-			    jxrc_set_image_shape(container, max(1,w), max(1,h));
-			    jxrc_set_separate_alpha_image_plane(container, 0);
-			    jxrc_set_image_band_presence(container, JXR_BP_ALL);
-
-			    static unsigned char window_params[5] = {0,0,0,0,0};
-			    jxr_image_t image = jxr_create_image(max(1,w), max(1,h), window_params);
-		    
-			    if ( !image ) {
-				    cerr << "Could not create image!\n\n";
-				    return false;
+				    atf_cache_hash(task.key,task.src,mip.length);
 			    }
-		    
-			    SetJPEGXRaw(container,image,gJxrQuality,( pvr_header.dwpfFlags & 0xFF ) == PVR_OGL_RGBA_8888, max(1,w), max(1,h));
 
-			    jxrc_begin_image_data(container);
-			    if ( ( pvr_header.dwpfFlags & 0xFF ) == PVR_OGL_RGBA_8888 ) {
-				    jxr_set_block_input(image, Read8888Data);  
-			    } else {
-				    jxr_set_block_input(image, Read888Data);  
+			    ATFStatsContext previous = enter_raw_level(task);
+			    ATFStatsMark lookup = atf_stats_mark();
+			    bool cached = atf_reuse_lookup(gReuse,i,c,task.key.hash,task.block) || atf_cache_lookup(task.key,task.block);
+			    if ( cached ) {
+				    atf_stats_stream(ATF_STAGE_CACHED,task.block.size(),task.block.size(),lookup);
 			    }
-			    jxr_set_user_data(image, &imageData);
-			
-			    if ( jxr_write_image_bitstream(image,container) != 0 ) {
-				    cerr << "JPEGXR encoding error!\n";
-				    return false;
+			    atf_stats_set_context(previous);
+
+			    if ( !cached && !searched.empty() ) {
+				    // encoded by the last round of the quality search
+				    task.block.swap(searched[i*chain.count+c].block);
+				    task.stats = searched[i*chain.count+c].stats;
+				    task.encode = true;
+			    } else if ( !cached ) {
+				    task.block.clear();
+				    task.encode = true;
+				    atf_sched_task(group,raw_level_task,&task);
 			    }
-
-			    jxr_destroy(image); 
-
-			    jxrc_write_container_post(container);
-
-			    write_uint24(container->wb.len(),ofile);
-			    ofile.write((const char *)container->wb.buffer(),container->wb.len());
-			
-			    //write_debug_image(container);
-
-			    jxr_destroy_container(container);
-			
-			    delete [] imageData.raw;
-			    imageData.raw = 0;
             }
-            			
-			w /= 2;
-			h /= 2;
 		}
 	}
-	return true;
+	atf_sched_wait(group);
+	if ( ok && atf_mem_exceeded() ) {
+		cerr << "Memory limit exceeded!\n\n";
+		return false;
+	}
+
+	for ( size_t c=0; c<tasks.size() && ok; c++) {
+		RawLevelTask &task = tasks[c];
+		if ( !task.ok ) {
+			return false;
+		}
+		atf_stats_merge(task.stats);
+		ofile.write((const char *)&task.block[0],task.block.size());
+		if ( task.encode ) {
+			atf_cache_store(task.key,task.block);
+		}
+	}
+	return ok;
 }
 
 static bool write_compressed_alpha_textures(istream &ifile_etc1, istream &ifile_pvrtc, istream &ifile_dxt5, ostream &ofile) {
@@ -1813,52 +2482,37 @@ static bool write_compressed_alpha_textures(istream &ifile_etc1, istream &ifile_
 	int32_t w = texturew = checkHeader->dwWidth;
 	int32_t h = textureh = checkHeader->dwHeight;
 	
-	write_header(w,h,(gStoreRawCompressed?ATF_FORMAT_COMPRESSEDRAWALPHA:ATF_FORMAT_COMPRESSEDALPHA)|(cubeMap?ATF_FORMAT_CUBEMAP:0),checkHeader->dwMipMapCount+1,ofile);
-	
-	size_t dxt5_pos = ifile_dxt5.tellg();
-	size_t etc1_pos = ifile_etc1.tellg();
-	size_t pvrtc_pos = ifile_pvrtc.tellg();
-
-	for ( int32_t i=0; i<(cubeMap?6:1); i++) {
-
-		if ( gCompressedFormats == 0 || gCompressedFormats == 1 ) {
-			if ( cubeMap ) {
-                if ( pvr_header_dxt5.dwpfFlags & ( PVRTEX_DDSCUBEMAPORDER | PVRTEX_PVRCUBEMAPORDER ) ) {
-    				const int32_t dds2ogl[] = { 1, 0, 3, 2, 5, 4 };
-                    int32_t pos = dxt5_pos + pvr_header_dxt5.dwTextureDataSize * dds2ogl[i];
-	    			ifile_dxt5.seekg( ( pos ), ios_base::beg);
-                } else {
-    				const int32_t pvr2ogl[] = { 2, 3, 5, 4, 0, 1 };
-                    int32_t pos = dxt5_pos + pvr_header_dxt5.dwTextureDataSize * pvr2ogl[i];
-	    			ifile_dxt5.seekg( ( pos ), ios_base::beg);
-                }
-			}
-		}
+	ATFMipChain dxt5_chain;
+	ATFMipChain etc1_chain;
+	ATFMipChain pvrtc_chain;
+	pvr_mip_chain(pvr_header_dxt5,*checkHeader,ATF_MIP_DXT5,ifile_dxt5.tellg(),dxt5_chain);
+	pvr_mip_chain(pvr_header_etc1,*checkHeader,ATF_MIP_ETC1_ALPHA,ifile_etc1.tellg(),etc1_chain);
+	pvr_mip_chain(pvr_header_pvrtc,*checkHeader,ATF_MIP_PVRTC4,ifile_pvrtc.tellg(),pvrtc_chain);
+
+	write_header(w,h,(gStoreRawCompressed?ATF_FORMAT_COMPRESSEDRAWALPHA:ATF_FORMAT_COMPRESSEDALPHA)|(cubeMap?ATF_FORMAT_CUBEMAP:0),dxt5_chain.count,ofile);
+
+	PVRInput input_dxt5 = { 0 };
+	PVRInput input_etc1 = { 0 };
+	PVRInput input_pvrtc = { 0 };
+	if ( gCompressedFormats == 0 || gCompressedFormats == 1 ) {
+		map_input(ifile_dxt5,input_dxt5);
+	}
+	if ( gCompressedFormats == 0 || gCompressedFormats == 2 ) {
+		map_input(ifile_etc1,input_etc1);
+	}
+	if ( gCompressedFormats == 0 || gCompressedFormats == 3 ) {
+		map_input(ifile_pvrtc,input_pvrtc);
+	}
 
-		if ( gCompressedFormats == 0 || gCompressedFormats == 2 ) {
-			if ( cubeMap ) {
-                if ( pvr_header_etc1.dwpfFlags & ( PVRTEX_DDSCUBEMAPORDER | PVRTEX_PVRCUBEMAPORDER ) ) {
-    				const int32_t dds2ogl[] = { 1, 0, 3, 2, 5, 4 };
-                    int32_t pos = etc1_pos + pvr_header_etc1.dwTextureDataSize * dds2ogl[i];
-	    			ifile_etc1.seekg( ( pos ), ios_base::beg);
-                }
-			}
-		}
+	for ( int32_t i=0; i<dxt5_chain.faces; i++) {
 
-		if ( gCompressedFormats == 0 || gCompressedFormats == 3 ) {
-			if ( cubeMap ) {
-                if ( pvr_header_pvrtc.dwpfFlags & ( PVRTEX_DDSCUBEMAPORDER | PVRTEX_PVRCUBEMAPORDER ) ) {
-    				const int32_t dds2ogl[] = { 1, 0, 3, 2, 5, 4 };
-                    int32_t pos = pvrtc_pos + pvr_header_pvrtc.dwTextureDataSize * dds2ogl[i];
-	    			ifile_pvrtc.seekg( ( pos ), ios_base::beg);
-                }
-			}
-		}
+		for ( int32_t c=0; c<dxt5_chain.count; c++ ) {
 
-		w = texturew = checkHeader->dwWidth;
-		h = texturew = checkHeader->dwHeight;
-	
-		for ( int32_t c=0; (c<checkHeader->dwMipMapCount+1) && (w>0||h>0); c++ ) {
+			atf_stats_level(i,c);
+			if ( atf_mem_exceeded() ) {
+				cerr << "Memory limit exceeded!\n\n";
+				return false;
+			}
 
 			bool dxt_flipped = false;
 			if ( gCompressedFormats == 0 || gCompressedFormats == 1 ) {
@@ -1873,12 +2527,19 @@ static bool write_compressed_alpha_textures(istream &ifile_etc1, istream &ifile_
 				etc1_flipped = ( pvr_header_pvrtc.dwpfFlags & PVRTEX_FLIPPED ) ? true : false;
 			}
 
-			if ( !write_dxt5(w,h,c,dxt_flipped,ifile_dxt5,ofile) ) return false;
-			if ( !write_pvrtc_alpha(w,h,c,pvrtc_flipped,ifile_pvrtc,ofile) ) return false;
-			if ( !write_etc1(w,h,c,etc1_flipped,ifile_etc1,ofile,true) ) return false;
+			const uint8_t *dxt_src = level_data(input_dxt5,dxt5_chain,i,c);
+			const uint8_t *etc1_src = level_data(input_etc1,etc1_chain,i,c);
+			const uint8_t *pvrtc_src = level_data(input_pvrtc,pvrtc_chain,i,c);
+			if ( ( ( gCompressedFormats == 0 || gCompressedFormats == 1 ) && !dxt_src ) ||
+				 ( ( gCompressedFormats == 0 || gCompressedFormats == 2 ) && !etc1_src ) ||
+				 ( ( gCompressedFormats == 0 || gCompressedFormats == 3 ) && !pvrtc_src ) ) {
+				cerr << "pvr file is short!\n\n";
+				return false;
+			}
 
-			w /= 2;
-			h /= 2;
+			if ( !write_dxt5(dxt5_chain.level(c),c,dxt_flipped,dxt_src,ofile) ) return false;
+			if ( !write_pvrtc_alpha(pvrtc_chain.level(c),c,pvrtc_flipped,pvrtc_src,ofile) ) return false;
+			if ( !write_etc1(etc1_chain.level(c),c,etc1_flipped,etc1_src,ofile,true) ) return false;
 		}		
 	}
 	return true;
@@ -2020,52 +2681,37 @@ static bool write_compressed_textures(istream &ifile_etc1, istream &ifile_pvrtc,
 	int32_t w = texturew = checkHeader->dwWidth;
 	int32_t h = textureh = checkHeader->dwHeight;
 	
-	write_header(w,h,(gStoreRawCompressed ? ATF_FORMAT_COMPRESSEDRAW : ATF_FORMAT_COMPRESSED )|(cubeMap?ATF_FORMAT_CUBEMAP:0),checkHeader->dwMipMapCount+1,ofile);
-	
-	size_t dxt1_pos = ifile_dxt1.tellg();
-	size_t etc1_pos = ifile_dxt1.tellg();
-	size_t pvrtc_pos = ifile_dxt1.tellg();
-
-	for ( int32_t i=0; i<(cubeMap?6:1); i++) {
-
-		if ( gCompressedFormats == 0 || gCompressedFormats == 1 ) {
-			if ( cubeMap ) {
-                if ( pvr_header_dxt1.dwpfFlags & ( PVRTEX_DDSCUBEMAPORDER | PVRTEX_PVRCUBEMAPORDER ) ) {
-    				const int32_t dds2ogl[] = { 1, 0, 3, 2, 5, 4 };
-                    int32_t pos = dxt1_pos + pvr_header_dxt1.dwTextureDataSize * dds2ogl[i];
-	    			ifile_dxt1.seekg( ( pos ), ios_base::beg);
-                } else {
-    				const int32_t pvr2ogl[] = { 2, 3, 5, 4, 0, 1 };
-                    int32_t pos = dxt1_pos + pvr_header_dxt1.dwTextureDataSize * pvr2ogl[i];
-	    			ifile_dxt1.seekg( ( pos ), ios_base::beg);
-                }
-			}
-		}
+	ATFMipChain dxt1_chain;
+	ATFMipChain etc1_chain;
+	ATFMipChain pvrtc_chain;
+	pvr_mip_chain(pvr_header_dxt1,*checkHeader,ATF_MIP_DXT1,ifile_dxt1.tellg(),dxt1_chain);
+	pvr_mip_chain(pvr_header_etc1,*checkHeader,ATF_MIP_ETC1,ifile_etc1.tellg(),etc1_chain);
+	pvr_mip_chain(pvr_header_pvrtc,*checkHeader,ATF_MIP_PVRTC4,ifile_pvrtc.tellg(),pvrtc_chain);
+
+	write_header(w,h,(gStoreRawCompressed ? ATF_FORMAT_COMPRESSEDRAW : ATF_FORMAT_COMPRESSED )|(cubeMap?ATF_FORMAT_CUBEMAP:0),dxt1_chain.count,ofile);
+
+	PVRInput input_dxt1 = { 0 };
+	PVRInput input_etc1 = { 0 };
+	PVRInput input_pvrtc = { 0 };
+	if ( gCompressedFormats == 0 || gCompressedFormats == 1 ) {
+		map_input(ifile_dxt1,input_dxt1);
+	}
+	if ( gCompressedFormats == 0 || gCompressedFormats == 2 ) {
+		map_input(ifile_etc1,input_etc1);
+	}
+	if ( gCompressedFormats == 0 || gCompressedFormats == 3 ) {
+		map_input(ifile_pvrtc,input_pvrtc);
+	}
 
-		if ( gCompressedFormats == 0 || gCompressedFormats == 2 ) {
-			if ( cubeMap ) {
-                if ( pvr_header_etc1.dwpfFlags & ( PVRTEX_DDSCUBEMAPORDER | PVRTEX_PVRCUBEMAPORDER ) ) {
-    				const int32_t dds2ogl[] = { 1, 0, 3, 2, 5, 4 };
-                    int32_t pos = etc1_pos + pvr_header_etc1.dwTextureDataSize * dds2ogl[i];
-	    			ifile_etc1.seekg( ( pos ), ios_base::beg);
-                }
-			}
-		}
+	for ( int32_t i=0; i<dxt1_chain.faces; i++) {
 
-		if ( gCompressedFormats == 0 || gCompressedFormats == 3 ) {
-			if ( cubeMap ) {
-                if ( pvr_header_pvrtc.dwpfFlags & ( PVRTEX_DDSCUBEMAPORDER | PVRTEX_PVRCUBEMAPORDER ) ) {
-    				const int32_t dds2ogl[] = { 1, 0, 3, 2, 5, 4 };
-                    int32_t pos = pvrtc_pos + pvr_header_pvrtc.dwTextureDataSize * dds2ogl[i];
-	    			ifile_pvrtc.seekg( ( pos ), ios_base::beg);
-                }
-			}
-		}
+		for ( int32_t c=0; c<dxt1_chain.count; c++ ) {
 
-		w = texturew = checkHeader->dwWidth;
-		h = texturew = checkHeader->dwHeight;
-	
-		for ( int32_t c=0; (c<checkHeader->dwMipMapCount+1) && (w>0||h>0); c++ ) {
+			atf_stats_level(i,c);
+			if ( atf_mem_exceeded() ) {
+				cerr << "Memory limit exceeded!\n\n";
+				return false;
+			}
 
 			bool dxt_flipped = false;
 			if ( gCompressedFormats == 0 || gCompressedFormats == 1 ) {
@@ -2080,56 +2726,116 @@ static bool write_compressed_textures(istream &ifile_etc1, istream &ifile_pvrtc,
 				etc1_flipped = ( pvr_header_pvrtc.dwpfFlags & PVRTEX_FLIPPED ) ? true : false;
 			}
 
-			if ( !write_dxt1(w,h,c,dxt_flipped,ifile_dxt1,ofile) ) return false;
-			if ( !write_pvrtc(w,h,c,pvrtc_flipped,ifile_pvrtc,ofile) ) return false;
-			if ( !write_etc1(w,h,c,etc1_flipped,ifile_etc1,ofile,false) ) return false;
+			const uint8_t *dxt_src = level_data(input_dxt1,dxt1_chain,i,c);
+			const uint8_t *etc1_src = level_data(input_etc1,etc1_chain,i,c);
+			const uint8_t *pvrtc_src = level_data(input_pvrtc,pvrtc_chain,i,c);
+			if ( ( ( gCompressedFormats == 0 || gCompressedFormats == 1 ) && !dxt_src ) ||
+				 ( ( gCompressedFormats == 0 || gCompressedFormats == 2 ) && !etc1_src ) ||
+				 ( ( gCompressedFormats == 0 || gCompressedFormats == 3 ) && !pvrtc_src ) ) {
+				cerr << "pvr file is short!\n\n";
+				return false;
+			}
 
-			w /= 2;
-			h /= 2;
+			if ( !write_dxt1(dxt1_chain.level(c),c,dxt_flipped,dxt_src,ofile) ) return false;
+			if ( !write_pvrtc(pvrtc_chain.level(c),c,pvrtc_flipped,pvrtc_src,ofile) ) return false;
+			if ( !write_etc1(etc1_chain.level(c),c,etc1_flipped,etc1_src,ofile,false) ) return false;
 		}		
 	}
 	return true;
 }
 
-bool convert_with_alpha(istream &ifile_etc1, istream &ifile_pvrtc, istream &ifile_dxt5, ostream &ofile) {
-	if ( !write_compressed_alpha_textures(ifile_etc1,ifile_pvrtc,ifile_dxt5,ofile) ) {
+// Upper bound of the ATF size for raw stored block data (which is stored 1:1)
+// and in practice for JPEG-XR, from the level layout in the PVR header.
+static size_t estimate_atf_size(istream &ifile)
+{
+	PVR_HEADER pvr_header = { 0 };
+	streampos pos = ifile.tellg();
+	read_pvr(ifile,pvr_header);
+	ifile.clear();
+	ifile.seekg(pos);
+
+	size_t faces = ( pvr_header.dwpfFlags & PVRTEX_CUBEMAP ) ? 6 : 1;
+	size_t levels = min(uint32_t(16),pvr_header.dwMipMapCount+1);
+	return 10 + faces * ( min(uint32_t(1<<24),pvr_header.dwTextureDataSize) + levels * 10 * 3 ); // at most 10 sub-streams per level
+}
+
+// The whole file is assembled in one buffer, the length is patched in once
+// all level blocks are known and the file is handed to ofile with a single
+// write, so ofile does not need to be seekable.
+static bool write_atf(ATFBuffer &atf, ostream &ofile)
+{
+	size_t filesize = atf.size() - 6;
+	if ( filesize >> 24 ) {
+		cerr << "ATF file too large!\n\n";
 		return false;
 	}
 
-	size_t filesize = ofile.tellp();
-	filesize -= 6;
-	ofile.seekp(3);
+	uint8_t *data = atf.data();
+	data[3] = uint8_t((filesize>>16)&0xFF);
+	data[4] = uint8_t((filesize>> 8)&0xFF);
+	data[5] = uint8_t((filesize>> 0)&0xFF);
 
-	ofile.put(uint8_t((filesize>>16)&0xFF));
-	ofile.put(uint8_t((filesize>> 8)&0xFF));
-	ofile.put(uint8_t((filesize>> 0)&0xFF));
-	
-	ofile.seekp(0,ios_base::end);
+	ofile.write((const char *)data,atf.size());
+	return !ofile.bad();
+}
 
-    return true;
+bool convert_with_alpha(istream &ifile_etc1, istream &ifile_pvrtc, istream &ifile_dxt5, ostream &ofile) {
+	ATFBuffer buffer;
+	buffer.reserve(estimate_atf_size(ifile_dxt5));
+	ostream atf(&buffer);
+	if ( !write_compressed_alpha_textures(ifile_etc1,ifile_pvrtc,ifile_dxt5,atf) ) {
+		return false;
+	}
+
+	return write_atf(buffer,ofile);
 }
 
 bool convert(istream &ifile_etc1, istream &ifile_pvrtc, istream &ifile_dxt1, istream &ifile_raw, ostream &ofile ) {
 	
+	ATFBuffer buffer;
+	buffer.reserve(estimate_atf_size(gEncodeRawJXR ? ifile_raw : ifile_dxt1));
+	ostream atf(&buffer);
 	if ( gEncodeRawJXR ) {
-		if ( !write_raw_jxr(ifile_raw,ofile) ) {
+		if ( !write_raw_jxr(ifile_raw,atf) ) {
 			return false;
 		}
 	} else {
-		if ( !write_compressed_textures(ifile_etc1,ifile_pvrtc,ifile_dxt1,ofile) ) {
+		if ( !write_compressed_textures(ifile_etc1,ifile_pvrtc,ifile_dxt1,atf) ) {
 			return false;
 		}
 	}
 	
-	size_t filesize = ofile.tellp();
-	filesize -= 6;
-	ofile.seekp(3);
+	return write_atf(buffer,ofile);
+}
 
-	ofile.put(uint8_t((filesize>>16)&0xFF));
-	ofile.put(uint8_t((filesize>> 8)&0xFF));
-	ofile.put(uint8_t((filesize>> 0)&0xFF));
-	
-	ofile.seekp(0,ios_base::end);
+// Working set of JPEG-XR encoding a w x h image with comp channels: the
+// macroblock row buffers grow with the width, the output buffer grows by
+// doubling and ends up about the raw size for lossless encoding.
+static size_t estimate_jxr_memory(size_t w, size_t h, size_t comp, int32_t quality)
+{
+	size_t raw = w * h * comp;
+	return 65536 + w * comp * 1536 + ( quality ? raw * 3 / 4 : raw * 3 );
+}
 
-	return true;
+// Rough peak memory of converting the DDS input chain: the input, PVR and ATF
+// buffers plus the allocations accounted in atfmem.h for the largest level,
+// which is the one encoded at a time. quality is the lowest -q of the job,
+// 0 (lossless) gives the largest JPEG-XR output.
+size_t estimate_convert_memory(const ATFMipChain &chain, size_t filesize, int32_t quality)
+{
+	if ( chain.count == 0 ) {
+		return filesize;
+	}
+	const ATFMipLevel &top = chain.level(0);
+	size_t pvr = size_t(chain.length()) * ( chain.format == ATF_MIP_L8 ? 3 : 1 );
+	size_t memory = filesize + pvr * 2;
+	if ( chain.format == ATF_MIP_L8 || chain.format == ATF_MIP_RGB8 || chain.format == ATF_MIP_RGBA8 ) {
+		memory += size_t(top.width) * top.height * 4; // ImageData planes
+		memory += estimate_jxr_memory(top.width,top.height,chain.format == ATF_MIP_RGBA8 ? 4 : 3,quality);
+	} else if ( !gStoreRawCompressed ) {
+		memory += size_t(top.length) * 3; // ImageData planes and the LZMA output
+		memory += size_t(LZMA_DICT_SIZE) * 23 / 2 + 65536;
+		memory += estimate_jxr_memory(top.blocksw,top.blocksh*2,3,quality);
+	}
+	return memory;
 }